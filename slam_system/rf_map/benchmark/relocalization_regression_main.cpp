@@ -0,0 +1,141 @@
+//
+//  relocalization_regression_main.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-31.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+// regression check of the camera model on a sequence with ground truth pan, tilt and focal length
+// run it before and after a change of projection, RANSAC or the relocalizer, then compare the summaries
+// usage: relocalization_regression model_file feature_label_file [test_parameter_file]
+// feature_label_file: .mat files with keypoint, descriptor and ptz, e.g., from synthetic_data_generator
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include "bt_dt_regressor.h"
+#include "btdtr_ptz_util.h"
+#include "ptz_relocalizer.h"
+#include "pgl_ptz_camera.h"
+
+using std::string;
+using std::vector;
+
+namespace {
+    double median(vector<double> values)
+    {
+        if (values.empty()) {
+            return 0.0;
+        }
+        std::sort(values.begin(), values.end());
+        return values[values.size()/2];
+    }
+    
+    double mean(const vector<double> & values)
+    {
+        double sum = 0.0;
+        for (int i = 0; i<values.size(); i++) {
+            sum += values[i];
+        }
+        return values.empty() ? 0.0 : sum / values.size();
+    }
+    
+    void printError(const char * name, const vector<double> & values)
+    {
+        printf("%-28s mean %10.5f, median %10.5f\n", name, mean(values), median(values));
+    }
+}
+
+int main(int argc, const char * argv[])
+{
+    if (argc < 3) {
+        printf("usage: %s model_file feature_label_file [test_parameter_file]\n", argv[0]);
+        return -1;
+    }
+    const char * model_file = argv[1];
+    const char * feature_label_file = argv[2];
+    
+    PTZRelocalizerParameter param;
+    if (argc >= 4 && !param.readFromFile(argv[3])) {
+        return -1;
+    }
+    BTDTRegressor model;
+    if (!model.load(model_file)) {
+        return -1;
+    }
+    
+    vector<string> files;
+    std::ifstream file(feature_label_file);
+    string str;
+    while (std::getline(file, str)) {
+        if (!str.empty()) {
+            files.push_back(str);
+        }
+    }
+    printf("read %lu feature label files\n", files.size());
+    
+    const Eigen::Vector2f pp(param.pp_x_, param.pp_y_);
+    const Eigen::Vector2d ppd(param.pp_x_, param.pp_y_);
+    PTZRelocalizer relocalizer(param);
+    
+    // round trip: keypoint -> ray -> keypoint with the ground truth camera
+    // refine: optimizePTZ from a perturbed ground truth with ground truth rays
+    // relocalize: forest prediction, RANSAC and refinement
+    vector<double> round_trip_errors;
+    vector<double> refine_pan_errors, refine_tilt_errors, refine_focal_errors;
+    vector<double> pan_errors, tilt_errors, focal_errors;
+    int success_num = 0;
+    for (int i = 0; i<files.size(); i++) {
+        Eigen::Vector3f ptz;
+        vector<btdtr_ptz_util::PTZTrainingSample> samples;
+        btdtr_ptz_util::generatePTZSampleWithFeature(files[i].c_str(), pp, ptz, samples);
+        if (samples.empty()) {
+            continue;
+        }
+        const Eigen::Vector3d gt_ptz = ptz.cast<double>();
+        
+        vector<Eigen::Vector2d> rays(samples.size());
+        vector<Eigen::Vector2d> points(samples.size());
+        double round_trip = 0.0;
+        for (int j = 0; j<samples.size(); j++) {
+            rays[j] = Eigen::Vector2d(samples[j].pan_tilt_[0], samples[j].pan_tilt_[1]);
+            points[j] = samples[j].loc_.cast<double>();
+            round_trip += (cvx_pgl::panTilt2Point(ppd, gt_ptz, rays[j]) - points[j]).norm();
+        }
+        round_trip_errors.push_back(round_trip / samples.size());
+        
+        Eigen::Vector3d init_ptz(gt_ptz[0] + 0.5, gt_ptz[1] - 0.3, gt_ptz[2] * 1.05);
+        Eigen::Vector3d opt_ptz;
+        cvx_pgl::optimizePTZ(ppd, rays, points, init_ptz, opt_ptz);
+        refine_pan_errors.push_back(fabs(opt_ptz[0] - gt_ptz[0]));
+        refine_tilt_errors.push_back(fabs(opt_ptz[1] - gt_ptz[1]));
+        refine_focal_errors.push_back(fabs(opt_ptz[2] / gt_ptz[2] - 1.0));
+        
+        vector<btdtr_ptz_util::PTZSample> test_samples(samples.begin(), samples.end());
+        double estimated_ptz[3] = {gt_ptz[0], gt_ptz[1], gt_ptz[2]};
+        int inlier_num = relocalizer.relocalize(model, test_samples, estimated_ptz);
+        const double pan_error = fabs(estimated_ptz[0] - gt_ptz[0]);
+        const double tilt_error = fabs(estimated_ptz[1] - gt_ptz[1]);
+        const double focal_error = fabs(estimated_ptz[2] / gt_ptz[2] - 1.0);
+        pan_errors.push_back(pan_error);
+        tilt_errors.push_back(tilt_error);
+        focal_errors.push_back(focal_error);
+        if (inlier_num > 0 && pan_error < 0.5 && tilt_error < 0.5 && focal_error < 0.02) {
+            success_num++;
+        }
+    }
+    
+    printf("frames %lu, relocalization success %d (pan, tilt < 0.5 degree, focal length < 2%%)\n",
+           pan_errors.size(), success_num);
+    printError("round trip (pixel)", round_trip_errors);
+    printError("refine pan (degree)", refine_pan_errors);
+    printError("refine tilt (degree)", refine_tilt_errors);
+    printError("refine focal length (ratio)", refine_focal_errors);
+    printError("relocalize pan (degree)", pan_errors);
+    printError("relocalize tilt (degree)", tilt_errors);
+    printError("relocalize focal length (ratio)", focal_errors);
+    return 0;
+}
@@ -0,0 +1,78 @@
+//
+//  tree_training_benchmark_main.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-31.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+// training time of one BTDTRTree, full split scan vs. split estimated from max_sample_num samples
+// usage: tree_training_benchmark sample_num [max_tree_depth] [max_sample_num] [seed]
+// features are uniform random 128 dimension, labels are linear in the first three dimensions
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include "bt_dtr_tree.h"
+#include "dt_rng.hpp"
+
+int main(int argc, const char * argv[])
+{
+    if (argc < 2) {
+        printf("usage: %s sample_num [max_tree_depth] [max_sample_num] [seed]\n", argv[0]);
+        return -1;
+    }
+    const int sample_num = atoi(argv[1]);
+    const int max_tree_depth = argc >= 3 ? atoi(argv[2]) : 15;
+    const int max_sample_num = argc >= 4 ? atoi(argv[3]) : 1000;
+    const uint64_t seed = argc >= 5 ? (uint64_t)atoll(argv[4]) : 7;
+    const int feature_dim = 128;
+    if (sample_num <= 0) {
+        printf("Error: sample_num must be positive, %d\n", sample_num);
+        return -1;
+    }
+    
+    DTRng rng(seed);
+    vector<VectorXf> features(sample_num);
+    vector<VectorXf> labels(sample_num);
+    for (int i = 0; i<sample_num; i++) {
+        features[i] = VectorXf(feature_dim);
+        for (int d = 0; d<feature_dim; d++) {
+            features[i][d] = (float)rng.uniform();
+        }
+        labels[i] = VectorXf(2);
+        labels[i][0] = features[i][0] * 50.0f + features[i][1] * 10.0f;
+        labels[i][1] = features[i][2] * 20.0f;
+    }
+    vector<unsigned int> indices(sample_num);
+    for (int i = 0; i<sample_num; i++) {
+        indices[i] = i;
+    }
+    
+    // 0: every candidate threshold is evaluated on all samples of a node
+    const int sample_nums[2] = {0, max_sample_num};
+    for (int k = 0; k<2; k++) {
+        BTDTRTreeParameter param;
+        param.max_tree_depth_ = max_tree_depth;
+        param.max_sample_num_ = sample_nums[k];
+        
+        BTDTRTree tree;
+        tree.setRandomGenerator(DTRng(seed, 1));
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        tree.buildTree(features, labels, indices, param);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        
+        // training error on every 10th example
+        double error = 0.0;
+        int num = 0;
+        for (int i = 0; i<sample_num; i += 10) {
+            VectorXf pred;
+            float dist = 0.0f;
+            tree.predict(features[i], 1, pred, dist);
+            error += (pred - labels[i]).norm();
+            num++;
+        }
+        printf("max_sample_num %d: build %f seconds, mean training error %f\n",
+               sample_nums[k], seconds, error/num);
+    }
+    return 0;
+}
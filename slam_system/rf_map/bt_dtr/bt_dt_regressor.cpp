@@ -11,6 +11,7 @@
 #include "bt_dtr_node.h"
 #include "yael_io.h"
 #include "dt_util.hpp"
+#include "dt_profiler.hpp"
 
 using std::string;
 
@@ -139,9 +140,260 @@ bool BTDTRegressor::predict(const Eigen::VectorXf & feature,
     return predictions.size() == maxTreeNum;
 }
 
+bool BTDTRegressor::predict(const Eigen::VectorXf & feature,
+                            const int maxCheck,
+                            BTDTRTree::SearchBuffer & buffer,
+                            vector<Eigen::VectorXf> & predictions,
+                            vector<float> & dists) const
+{
+    assert(trees_.size() > 0);
+    assert(feature_dim_ == feature.size());
+    
+    const int tree_num = (int)trees_.size();
+    predictions.resize(tree_num);
+    dists.resize(tree_num);
+    
+    // Step 1: predict from each tree, insertion sort by feature distance
+    // in place, as the number of trees is small
+    for (int i = 0; i<tree_num; i++) {
+        float dist = 0.0f;
+        trees_[i]->predict(feature, maxCheck, buffer, predictions[i], dist);
+        dists[i] = dist;
+        for (int j = i; j > 0 && dists[j] < dists[j-1]; j--) {
+            std::swap(dists[j], dists[j-1]);
+            predictions[j].swap(predictions[j-1]);
+        }
+    }
+    return true;
+}
+
+int BTDTRegressor::predictAdaptive(const Eigen::VectorXf & feature,
+                                   const int maxCheck,
+                                   const BTDTREarlyExitParameter & early_exit,
+                                   BTDTRTree::SearchBuffer & buffer,
+                                   vector<Eigen::VectorXf> & predictions,
+                                   vector<float> & dists) const
+{
+    assert(trees_.size() > 0);
+    assert(feature_dim_ == feature.size());
+    
+    int tree_num = (int)trees_.size();
+    if (early_exit.max_tree_num_ > 0) {
+        tree_num = std::min(tree_num, early_exit.max_tree_num_);
+    }
+    const double agree_tolerance_sq = early_exit.agree_tolerance_ * early_exit.agree_tolerance_;
+    predictions.resize(tree_num);
+    dists.resize(tree_num);
+    
+    int pred_num = 0;
+    for (int i = 0; i<tree_num; i++) {
+        Eigen::VectorXf & cur_pred = predictions[pred_num];
+        float cur_dist = 0.0f;
+        trees_[i]->predict(feature, maxCheck, buffer, cur_pred, cur_dist);
+        
+        // agreement with previous trees, before sorting
+        int agree_num = 1;
+        if (early_exit.agree_tree_num_ > 0) {
+            for (int j = 0; j<pred_num; j++) {
+                if ((predictions[j] - cur_pred).squaredNorm() <= agree_tolerance_sq) {
+                    agree_num++;
+                }
+            }
+        }
+        
+        // insertion sort by feature distance
+        dists[pred_num] = cur_dist;
+        for (int j = pred_num; j > 0 && dists[j] < dists[j-1]; j--) {
+            std::swap(dists[j], dists[j-1]);
+            predictions[j].swap(predictions[j-1]);
+        }
+        pred_num++;
+        
+        // unmatchable descriptor
+        if (i == 0 && early_exit.reject_distance_ > 0 && cur_dist > early_exit.reject_distance_) {
+            predictions.clear();
+            dists.clear();
+            return 1;
+        }
+        if (early_exit.confident_distance_ > 0 && cur_dist < early_exit.confident_distance_) {
+            break;
+        }
+        if (early_exit.agree_tree_num_ > 0 && agree_num >= early_exit.agree_tree_num_) {
+            break;
+        }
+    }
+    predictions.resize(pred_num);
+    dists.resize(pred_num);
+    return pred_num;
+}
+
+BTDTRegressor::JointSearchBuffer::JointSearchBuffer()
+{
+    heap_ = NULL;
+    heap_size_ = 0;
+}
+
+BTDTRegressor::JointSearchBuffer::~JointSearchBuffer()
+{
+    if (heap_) {
+        delete heap_;
+        heap_ = NULL;
+    }
+}
+
+void BTDTRegressor::JointSearchBuffer::reserve(const vector<BTDTRTree* > & trees)
+{
+    // a branch is an internal node, fewer than leaf nodes
+    int leaf_node_num = 0;
+    checked_.resize(trees.size());
+    for (int i = 0; i<trees.size(); i++) {
+        leaf_node_num += trees[i]->leaf_node_num_;
+        if (checked_[i].size() < trees[i]->leaf_node_num_) {
+            checked_[i].resize(trees[i]->leaf_node_num_);
+        }
+    }
+    if (heap_ == NULL || heap_size_ < leaf_node_num) {
+        if (heap_) {
+            delete heap_;
+        }
+        heap_ = new flann::Heap<BTDTRTree::ForestBranch>(leaf_node_num);
+        heap_size_ = leaf_node_num;
+    }
+    best_leaf_.resize(trees.size());
+    best_dist_.resize(trees.size());
+}
+
+bool BTDTRegressor::predictJoint(const Eigen::VectorXf & feature,
+                                 const int maxCheck,
+                                 JointSearchBuffer & buffer,
+                                 vector<Eigen::VectorXf> & predictions,
+                                 vector<float> & dists) const
+{
+    // no early exit, all trees are queried
+    this->predictJoint(feature, maxCheck, BTDTREarlyExitParameter(), buffer, predictions, dists);
+    return true;
+}
+
+int BTDTRegressor::predictJoint(const Eigen::VectorXf & feature,
+                                const int maxCheck,
+                                const BTDTREarlyExitParameter & early_exit,
+                                JointSearchBuffer & buffer,
+                                vector<Eigen::VectorXf> & predictions,
+                                vector<float> & dists) const
+{
+    assert(trees_.size() > 0);
+    assert(feature_dim_ == feature.size());
+    
+    buffer.reserve(trees_);
+    flann::Heap<BTDTRTree::ForestBranch> * heap = buffer.heap_;
+    heap->clear();
+    
+    // Step 1: search trees down to a leaf in order, until agreement or a confident leaf
+    int max_tree_num = (int)trees_.size();
+    if (early_exit.max_tree_num_ > 0) {
+        max_tree_num = std::min(max_tree_num, early_exit.max_tree_num_);
+    }
+    const double agree_tolerance_sq = early_exit.agree_tolerance_ * early_exit.agree_tolerance_;
+    const float *vec = feature.data();
+    int checkCount = 0;
+    int tree_num = 0;
+    for (int i = 0; i<max_tree_num; i++) {
+        buffer.checked_[i].reset();
+        buffer.best_leaf_[i] = -1;
+        buffer.best_dist_[i] = 0.0f;
+        trees_[i]->searchLevel(vec, trees_[i]->root_, 0.0f, i, buffer.best_leaf_[i], buffer.best_dist_[i],
+                               checkCount, heap, buffer.checked_[i]);
+        tree_num++;
+        
+        const float cur_dist = buffer.best_dist_[i];
+        if (early_exit.confident_distance_ > 0 && cur_dist < early_exit.confident_distance_) {
+            break;
+        }
+        if (early_exit.agree_tree_num_ > 0) {
+            const Eigen::VectorXf & cur_label = trees_[i]->leaf_nodes_[buffer.best_leaf_[i]]->label_mean_;
+            int agree_num = 1;
+            for (int j = 0; j<i; j++) {
+                const Eigen::VectorXf & label = trees_[j]->leaf_nodes_[buffer.best_leaf_[j]]->label_mean_;
+                if ((label - cur_label).squaredNorm() <= agree_tolerance_sq) {
+                    agree_num++;
+                }
+            }
+            if (agree_num >= early_exit.agree_tree_num_) {
+                break;
+            }
+        }
+    }
+    
+    // Step 2: back tracking the closest branch of the queried trees
+    BTDTRTree::ForestBranch branch;
+    while (checkCount < maxCheck && heap->popMin(branch)) {
+        const int index = branch.tree_index_;
+        trees_[index]->searchLevel(vec, branch.node_, branch.mindist_, index,
+                                   buffer.best_leaf_[index], buffer.best_dist_[index],
+                                   checkCount, heap, buffer.checked_[index]);
+    }
+    
+    // Step 3: insertion sort by feature distance
+    predictions.resize(tree_num);
+    dists.resize(tree_num);
+    for (int i = 0; i<tree_num; i++) {
+        assert(buffer.best_leaf_[i] >= 0);
+        predictions[i] = trees_[i]->leaf_nodes_[buffer.best_leaf_[i]]->label_mean_;
+        dists[i] = buffer.best_dist_[i];
+        for (int j = i; j > 0 && dists[j] < dists[j-1]; j--) {
+            std::swap(dists[j], dists[j-1]);
+            predictions[j].swap(predictions[j-1]);
+        }
+    }
+    
+    // unmatchable descriptor, the first tree alone is not back tracked so the closest leaf of all decides
+    if (early_exit.reject_distance_ > 0 && dists[0] > early_exit.reject_distance_) {
+        predictions.clear();
+        dists.clear();
+    }
+    return tree_num;
+}
+
+size_t BTDTRegressor::memorySize(void) const
+{
+    // a binary tree has leaf_node_num - 1 internal nodes
+    // a leaf node has a feature mean, a label mean and a label standard deviation
+    const size_t leaf_vector_bytes = sizeof(float) * (feature_dim_ + 2 * label_dim_);
+    size_t bytes = 0;
+    for (const auto& tree: trees_) {
+        const size_t leaf_num = tree->leaf_nodes_.size();
+        bytes += sizeof(BTDTRTree);
+        bytes += (2 * leaf_num) * sizeof(BTDTRNode) + leaf_num * (leaf_vector_bytes + sizeof(BTDTRNode*));
+    }
+    return bytes;
+}
+
+void BTDTRegressor::copyTo(BTDTRegressor & other) const
+{
+    assert(&other != this);
+    for (int i = 0; i<other.trees_.size(); i++) {
+        delete other.trees_[i];
+    }
+    other.trees_.clear();
+    
+    other.reg_tree_param_ = reg_tree_param_;
+    other.feature_dim_ = feature_dim_;
+    other.label_dim_ = label_dim_;
+    for (const auto& tree: trees_) {
+        BTDTRTree *copy = new BTDTRTree();
+        copy->root_ = BTDTRNode::copyTree(tree->root_);
+        copy->tree_param_ = tree->tree_param_;
+        copy->leaf_node_num_ = tree->leaf_node_num_;
+        copy->rng_ = tree->rng_;
+        copy->hashLeafNode();
+        other.trees_.push_back(copy);
+    }
+}
+
 bool BTDTRegressor::saveModel(const char *file_name) const
 {
     assert(trees_.size() > 0);
+    DTScopedTimer timer(DTProfiler::SAVE);
     // write tree number and tree files to file Name
     FILE *pf = fopen(file_name, "w");
     if(!pf) {
@@ -191,6 +443,7 @@ bool BTDTRegressor::saveModel(const char *file_name) const
 
 bool BTDTRegressor::load(const char *fileName)
 {
+    DTScopedTimer timer(DTProfiler::LOAD);
     FILE *pf = fopen(fileName, "r");
     if (!pf) {
         printf("Error: can not open file %s\n", fileName);
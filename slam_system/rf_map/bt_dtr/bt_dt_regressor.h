@@ -11,6 +11,26 @@
 
 using std::vector;
 
+// early exit of BTDTRegressor::predictAdaptive and predictJoint, 0 disables a rule
+// distances are in the unit of tree predictions (squared L2)
+struct BTDTREarlyExitParameter
+{
+    int agree_tree_num_;          // stop once this number of trees agree on the label
+    double agree_tolerance_;      // label distance of agreement, e.g., pan-tilt in degrees
+    double confident_distance_;   // stop once a leaf node is closer than this
+    double reject_distance_;      // no prediction if the first tree (the closest leaf in joint search) is farther than this
+    int max_tree_num_;            // query at most the first max_tree_num_ trees
+    
+    BTDTREarlyExitParameter()
+    {
+        max_tree_num_ = 0;
+        agree_tree_num_ = 0;
+        agree_tolerance_ = 0.0;
+        confident_distance_ = 0.0;
+        reject_distance_ = 0.0;
+    }
+};
+
 class BTDTRegressor
 {
     friend class BTDTRegressorBuilder;
@@ -24,6 +44,29 @@ private:
     int feature_dim_;       // feature dimension
     int label_dim_;
     
+public:
+    // reusable memory of the joint search, one per thread
+    class JointSearchBuffer
+    {
+        friend class BTDTRegressor;
+        
+        flann::Heap<BTDTRTree::ForestBranch> * heap_;   // shared by all trees
+        vector<flann::DynamicBitset> checked_;          // checked leaf nodes of each tree
+        vector<int> best_leaf_;
+        vector<float> best_dist_;
+        int heap_size_;
+        
+    public:
+        JointSearchBuffer();
+        ~JointSearchBuffer();
+        
+    private:
+        void reserve(const vector<BTDTRTree* > & trees);
+        
+        JointSearchBuffer(const JointSearchBuffer & other);
+        JointSearchBuffer & operator = (const JointSearchBuffer & other);
+    };
+    
 public:
     BTDTRegressor(){feature_dim_ = 0; label_dim_ = 0;}
     ~BTDTRegressor();
@@ -56,11 +99,59 @@ public:
                  vector<Eigen::VectorXf> & predictions,
                  vector<float> & dists) const;
     
+    // buffer: search memory, reused between predictions, one per thread
+    // predictions and dists are resized to the number of trees
+    bool predict(const Eigen::VectorXf & feature,
+                 const int maxCheck,
+                 BTDTRTree::SearchBuffer & buffer,
+                 vector<Eigen::VectorXf> & predictions,
+                 vector<float> & dists) const;
+    
+    // query trees in order, stop early by early_exit
+    // predictions and dists are resized to the number of queried trees, dists in non-decrease order
+    // a rejected feature has no prediction
+    // return: number of queried trees
+    int predictAdaptive(const Eigen::VectorXf & feature,
+                        const int maxCheck,
+                        const BTDTREarlyExitParameter & early_exit,
+                        BTDTRTree::SearchBuffer & buffer,
+                        vector<Eigen::VectorXf> & predictions,
+                        vector<float> & dists) const;
+    
+    // joint best-bin-first search, as the randomized kd-tree forest in flann
+    // one priority queue holds branches of all trees, the closest branch in any tree is checked next
+    // maxCheck: number of checked leaf nodes in all trees, each tree checks at least one leaf node
+    // predictions: nearest leaf node of each tree
+    // dists: in non-decrease order
+    bool predictJoint(const Eigen::VectorXf & feature,
+                      const int maxCheck,
+                      JointSearchBuffer & buffer,
+                      vector<Eigen::VectorXf> & predictions,
+                      vector<float> & dists) const;
+    
+    // joint search of the trees that are queried in order until agreement or a confident leaf
+    // maxCheck: limits back tracking in the queried trees, early_exit limits the number of queried trees
+    // predictions and dists are resized to the number of queried trees
+    // a feature whose closest leaf is farther than reject_distance has no prediction
+    // return: number of queried trees
+    int predictJoint(const Eigen::VectorXf & feature,
+                     const int maxCheck,
+                     const BTDTREarlyExitParameter & early_exit,
+                     JointSearchBuffer & buffer,
+                     vector<Eigen::VectorXf> & predictions,
+                     vector<float> & dists) const;
+    
+    // deep copy of all trees to other, e.g., a snapshot of an online model for another thread
+    void copyTo(BTDTRegressor & other) const;
     
     bool saveModel(const char *file_name) const;
     bool load(const char *file_name);
     
-    int treeNum(void){return (int)trees_.size();}    
+    int treeNum(void) const {return (int)trees_.size();}    
+    int featureDim(void) const {return feature_dim_;}
+    
+    // approximate heap memory of the trees in bytes, nodes and leaf node vectors
+    size_t memorySize(void) const;
 };
 
 
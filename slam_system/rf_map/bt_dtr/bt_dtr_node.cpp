@@ -15,6 +15,19 @@ BTDTRNode::~BTDTRNode()
         right_child_ = NULL;
     }    
 }
+
+BTDTRNode::NodePtr BTDTRNode::copyTree(const NodePtr root)
+{
+    if (!root) {
+        return NULL;
+    }
+    // copy node data, then replace the children
+    NodePtr node = new BTDTRNode(*root);
+    node->left_child_ = BTDTRNode::copyTree(root->left_child_);
+    node->right_child_ = BTDTRNode::copyTree(root->right_child_);
+    return node;
+}
+
 void BTDTRNode::writeNode(FILE *pf, const NodePtr node)
 {
     if (!node) {
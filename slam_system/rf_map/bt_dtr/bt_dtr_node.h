@@ -63,6 +63,9 @@ public:
     static bool writeTree(const char *fileName, const NodePtr root, const int leafNodeNum);
     static bool readTree(const char *fileName, NodePtr & root, int &leafNodeNum);
     
+    // deep copy of a subtree, leaf node indices are kept
+    static NodePtr copyTree(const NodePtr root);
+    
 private:
     static void writeNode(FILE *pf, const NodePtr node);
     static void readNode(FILE *pf, NodePtr & node);
@@ -34,6 +34,7 @@ BTDTRTree::BTDTRTree(const BTDTRTree & other)
     root_ = other.root_;
     tree_param_ = other.tree_param_;
     leaf_node_num_ = other.leaf_node_num_;
+    rng_ = other.rng_;
     
     std::copy(other.leaf_nodes_.begin(), other.leaf_nodes_.end(), leaf_nodes_.begin());
 }
@@ -50,7 +51,7 @@ bool BTDTRTree::buildTree(const vector<VectorXf> & features,
     root_ = new BTDTRNode(0);
     leaf_node_num_ = 0;
     
-    
+    dims_.clear();
     for (unsigned int i = 0; i<features.front().size(); i++) {
         dims_.push_back(i);
     }
@@ -67,11 +68,18 @@ bool BTDTRTree::buildTree(const vector<VectorXf> & features,
 bool BTDTRTree::updateTree(const vector<VectorXf> & features,
                            const vector<VectorXf> & labels,
                            const vector<unsigned int> & indices,
-                           const BTDTRTreeParameter & param)
+                           const BTDTRTreeParameter & param,
+                           const bool prune_empty_branch)
 {
     assert(features.size() == labels.size());
     assert(indices.size() <= features.size());
     
+    // no example, keep the tree (and its root) as it is
+    if (indices.size() == 0) {
+        printf("Warning: update a tree without example, skipped.\n");
+        return false;
+    }
+    
     tree_param_ = param;
     leaf_node_num_ = 0;
     
@@ -81,7 +89,7 @@ bool BTDTRTree::updateTree(const vector<VectorXf> & features,
     }
     
     // update tree
-    this->updateNode(features, labels, indices, root_, 0);
+    this->updateNode(features, labels, indices, root_, 0, prune_empty_branch);
     
     // record leaf node
     this->hashLeafNode();
@@ -90,14 +98,56 @@ bool BTDTRTree::updateTree(const vector<VectorXf> & features,
 }
 
 
+// keep at most sample_num randomly selected indices, reservoir sampling
+static void reservoirSampling(const vector<unsigned int> & indices,
+                              const int sample_num,
+                              DTRng & rng,
+                              vector<unsigned int> & sampled_indices)
+{
+    assert(sample_num > 0);
+    const size_t k = std::min((size_t)sample_num, indices.size());
+    sampled_indices.assign(indices.begin(), indices.begin() + k);
+    for (size_t i = k; i<indices.size(); i++) {
+        size_t j = rng.uniformInt((uint32_t)(i + 1));
+        if (j < k) {
+            sampled_indices[j] = indices[i];
+        }
+    }
+}
+
+// split data by comparing with the threshold
+static void splitIndices(const vector<VectorXf> & features,
+                         const vector<unsigned int> & indices,
+                         const BTDTRSplitParameter & split_param,
+                         vector<unsigned int> & left_indices,
+                         vector<unsigned int> & right_indices)
+{
+    const int dim = split_param.split_dim_;
+    const double threshold = split_param.split_threshold_;
+    left_indices.clear();
+    right_indices.clear();
+    for (int j = 0; j<indices.size(); j++) {
+        int index = indices[j];
+        double v = features[index][dim];
+        if (v < threshold) {
+            left_indices.push_back(index);
+        }
+        else {
+            right_indices.push_back(index);
+        }
+    }
+}
+
+// split threshold and loss in dimension split_param.split_dim_
+// min_split_num: minimum number of indices in left and right
 static bool bestSplitDimension(const vector<VectorXf> & features,
                                const vector<VectorXf> & labels,
                                const vector<unsigned int> & indices,
                                const BTDTRTreeParameter & tree_param,
                                const int depth,
-                               BTDTRSplitParameter & split_param,
-                               vector<unsigned int> & left_indices,
-                               vector<unsigned int> & right_indices)
+                               const int min_split_num,
+                               DTRng & rng,
+                               BTDTRSplitParameter & split_param)
 {
     // randomly select number in a range
     const int dim = split_param.split_dim_;
@@ -118,7 +168,7 @@ static bool bestSplitDimension(const vector<VectorXf> & features,
         return false;
     }
     
-    vector<double> rnd_split_values = DTRandom::generateRandomNumber(min_v, max_v, threshold_num);
+    vector<double> rnd_split_values = DTRandom::generateRandomNumber(min_v, max_v, threshold_num, rng);
     
     bool is_use_balance = false;
     if (depth <= tree_param.max_balanced_depth_) {
@@ -127,22 +177,12 @@ static bool bestSplitDimension(const vector<VectorXf> & features,
     
     bool is_split = false;
     double loss = std::numeric_limits<double>::max();
-    const int min_split_num = tree_param.min_split_node_;
+    vector<unsigned int> cur_left_indices;
+    vector<unsigned int> cur_right_indices;
+    BTDTRSplitParameter cur_split_param = split_param;
     for (int i = 0; i<rnd_split_values.size(); i++) {
-        double threshold = rnd_split_values[i];
-        vector<unsigned int> cur_left_indices;
-        vector<unsigned int> cur_right_indices;
-        // split data by comparing with the threshold
-        for (int j = 0; j<indices.size(); j++) {
-            int index = indices[j];
-            double v = features[index][dim];
-            if (v < threshold) {
-                cur_left_indices.push_back(index);
-            }
-            else {
-                cur_right_indices.push_back(index);
-            }
-        }
+        cur_split_param.split_threshold_ = rnd_split_values[i];
+        splitIndices(features, indices, cur_split_param, cur_left_indices, cur_right_indices);
         
         if (cur_left_indices.size() < min_split_num ||
             cur_right_indices.size() < min_split_num) {
@@ -161,9 +201,7 @@ static bool bestSplitDimension(const vector<VectorXf> & features,
         if (cur_loss < loss) {
             loss = cur_loss;
             is_split = true;
-            left_indices = cur_left_indices;
-            right_indices = cur_right_indices;
-            split_param.split_threshold_ = threshold;
+            split_param.split_threshold_ = cur_split_param.split_threshold_;
             split_param.split_loss_ = cur_loss;
         }
     }
@@ -171,6 +209,38 @@ static bool bestSplitDimension(const vector<VectorXf> & features,
     return is_split;
 }
 
+// best split in the random dimensions
+static bool bestSplit(const vector<VectorXf> & features,
+                      const vector<VectorXf> & labels,
+                      const vector<unsigned int> & indices,
+                      const vector<unsigned int> & random_dim,
+                      const BTDTRTreeParameter & tree_param,
+                      const int depth,
+                      const int min_split_num,
+                      DTRng & rng,
+                      BTDTRSplitParameter & split_param)
+{
+    bool is_split = false;
+    double loss = std::numeric_limits<double>::max();
+    
+    // optimize random feature
+    for (int i = 0; i<random_dim.size(); i++) {
+        BTDTRSplitParameter cur_split_param;
+        cur_split_param.split_dim_ = random_dim[i];
+        
+        bool cur_is_split = bestSplitDimension(features, labels, indices, tree_param, depth,
+                                               min_split_num,
+                                               rng,
+                                               cur_split_param);
+        if (cur_is_split && cur_split_param.split_loss_ < loss) {
+            is_split = true;
+            loss = cur_split_param.split_loss_;
+            split_param = cur_split_param;
+        }
+    }
+    return is_split;
+}
+
 
 bool BTDTRTree::configureNode(const vector<VectorXf> & features,
                    const vector<VectorXf> & labels,
@@ -209,7 +279,7 @@ bool BTDTRTree::configureNode(const vector<VectorXf> & features,
     
     // randomly select a subset of dimensions
     assert(dims_.size() == dim);
-    std::random_shuffle(dims_.begin(), dims_.end());
+    rng_.partialShuffle(dims_.begin(), dims_.begin() + candidate_dim_num, dims_.end());
     vector<unsigned int> random_dim(dims_.begin(), dims_.begin() + candidate_dim_num);
     assert(random_dim.size() > 0 && random_dim.size() <= dims_.size());
     
@@ -217,28 +287,31 @@ bool BTDTRTree::configureNode(const vector<VectorXf> & features,
     vector<unsigned int> left_indices;
     vector<unsigned int> right_indices;
     BTDTRSplitParameter split_param;
-    bool is_split = false;
-    double loss = std::numeric_limits<double>::max();
     
-    
-    // optimize random feature
-    for (int i = 0; i<random_dim.size(); i++) {
-        BTDTRSplitParameter cur_split_param;
-        cur_split_param.split_dim_ = random_dim[i];
-        
-        vector<unsigned int> cur_left_indices;
-        vector<unsigned int> cur_right_indices;
-        
-        bool cur_is_split = bestSplitDimension(features, labels, indices, tree_param_, depth,
-                                               cur_split_param,
-                                               cur_left_indices,
-                                               cur_right_indices);
-        if (cur_is_split && cur_split_param.split_loss_ < loss) {
-            is_split = true;
-            loss = cur_split_param.split_loss_;
-            split_param = cur_split_param;
-            left_indices = cur_left_indices;
-            right_indices = cur_right_indices;
+    // estimate the split from at most max_sample_num_ randomly sampled points in large nodes,
+    // the split is applied to all points
+    const int max_sample_num = tree_param_.max_sample_num_;
+    const int min_split_num = tree_param_.min_split_node_;
+    const bool is_sampled = max_sample_num > 0 && indices.size() > max_sample_num;
+    bool is_split = false;
+    if (is_sampled) {
+        vector<unsigned int> sampled_indices;
+        reservoirSampling(indices, max_sample_num, rng_, sampled_indices);
+        // minimum split number in proportion to sampled points
+        const int sampled_min_split_num = std::max(1, (int)(1.0 * min_split_num * sampled_indices.size() / indices.size()));
+        is_split = bestSplit(features, labels, sampled_indices, random_dim, tree_param_, depth,
+                             sampled_min_split_num, rng_, split_param);
+        if (is_split) {
+            splitIndices(features, indices, split_param, left_indices, right_indices);
+            // sampled points are not representative, fall back to all points
+            is_split = left_indices.size() >= min_split_num && right_indices.size() >= min_split_num;
+        }
+    }
+    if (!is_split) {
+        is_split = bestSplit(features, labels, indices, random_dim, tree_param_, depth,
+                             min_split_num, rng_, split_param);
+        if (is_split) {
+            splitIndices(features, indices, split_param, left_indices, right_indices);
         }
     }
     
@@ -277,7 +350,8 @@ bool BTDTRTree::updateNode(const vector<VectorXf> & features,
                            const vector<VectorXf> & labels,
                            const vector<unsigned int> & indices,
                            BTDTRNode* & node,
-                           const int depth)
+                           const int depth,
+                           const bool prune_empty_branch)
 {
     const int min_leaf_node = tree_param_.min_leaf_node_;
     const int max_depth     = tree_param_.max_tree_depth_;    
@@ -286,6 +360,14 @@ bool BTDTRTree::updateNode(const vector<VectorXf> & features,
     const double min_split_stddev = tree_param_.min_split_node_std_dev_;
     assert(candidate_dim_num <= dim);
     
+    // dead branch, no example reaches it (e.g., its keyframes are removed)
+    // the root is never pruned
+    if (prune_empty_branch && depth > 0 && indices.size() == 0) {
+        delete node;
+        node = NULL;
+        return true;
+    }
+    
     // leaf node
     bool reach_leaf = false;
     if (indices.size() < min_leaf_node || depth > max_depth) {
@@ -318,8 +400,18 @@ bool BTDTRTree::updateNode(const vector<VectorXf> & features,
                 right_indices.push_back(index);
             }
         }
-        this->updateNode(features, labels, left_indices, node->left_child_, depth+1);
-        this->updateNode(features, labels, right_indices, node->right_child_, depth+1);
+        
+        // all examples go to one side, the split is useless, learn the node again
+        if (prune_empty_branch && (left_indices.empty() || right_indices.empty())) {
+            delete node->left_child_;
+            delete node->right_child_;
+            node->left_child_ = NULL;
+            node->right_child_ = NULL;
+            this->configureNode(features, labels, indices, node);
+            return true;
+        }
+        this->updateNode(features, labels, left_indices, node->left_child_, depth+1, prune_empty_branch);
+        this->updateNode(features, labels, right_indices, node->right_child_, depth+1, prune_empty_branch);
         return true;
     }
     else if(node != NULL && node->is_leaf_) {
@@ -366,6 +458,33 @@ void BTDTRTree::setLeafNode(const vector<VectorXf> & features,
 
 
 
+BTDTRTree::SearchBuffer::SearchBuffer()
+{
+    heap_ = NULL;
+    leaf_node_num_ = 0;
+}
+
+BTDTRTree::SearchBuffer::~SearchBuffer()
+{
+    if (heap_) {
+        delete heap_;
+        heap_ = NULL;
+    }
+}
+
+void BTDTRTree::SearchBuffer::reserve(int leaf_node_num)
+{
+    if (heap_ != NULL && leaf_node_num <= leaf_node_num_) {
+        return;
+    }
+    if (heap_) {
+        delete heap_;
+    }
+    heap_ = new flann::Heap<BranchSt>(leaf_node_num);
+    checked_.resize(leaf_node_num);
+    leaf_node_num_ = leaf_node_num;
+}
+
 bool BTDTRTree::predict(const Eigen::VectorXf & feature,
                         const int maxCheck,
                         Eigen::VectorXf & pred) const
@@ -407,6 +526,16 @@ bool BTDTRTree::predict(const Eigen::VectorXf & feature,
                         const int maxCheck,
                         VectorXf & pred,
                         float & dist)
+{
+    SearchBuffer buffer;
+    return this->predict(feature, maxCheck, buffer, pred, dist);
+}
+
+bool BTDTRTree::predict(const Eigen::VectorXf & feature,
+                        const int maxCheck,
+                        SearchBuffer & buffer,
+                        VectorXf & pred,
+                        float & dist) const
 {
     assert(root_);
     
@@ -414,10 +543,13 @@ bool BTDTRTree::predict(const Eigen::VectorXf & feature,
     float epsError = 1.0;
     const int knn = 1;
     
-    BranchSt branch;
-    flann::Heap<BranchSt> * heap = new flann::Heap<BranchSt>(leaf_node_num_);  // why use so large heap
-    flann::DynamicBitset checked(leaf_node_num_);
+    buffer.reserve(leaf_node_num_);
+    flann::Heap<BranchSt> * heap = buffer.heap_;
+    flann::DynamicBitset & checked = buffer.checked_;
+    heap->clear();
+    checked.reset();
     
+    BranchSt branch;
     flann::KNNResultSet2<DistanceType> result(knn); // only keep the nearest one
     const ElementType *vec = feature.data();
     
@@ -429,8 +561,6 @@ bool BTDTRTree::predict(const Eigen::VectorXf & feature,
         assert(branch.node);
         this->searchLevel(result, vec, branch.node, branch.mindist, checkCount, maxCheck, epsError, heap, checked);
     }
-    
-    delete heap;
     assert(result.size() == knn);
     
     size_t index = 0;
@@ -483,6 +613,47 @@ void BTDTRTree::searchLevel(flann::ResultSet<DistanceType>  & result_set, const
     this->searchLevel(result_set, vec, bestChild, min_dist, checkCount, maxCheck, epsError, heap, checked);
 }
 
+void BTDTRTree::searchLevel(const ElementType* vec, const NodePtr node, const DistanceType min_dist,
+                            const int tree_index, int & best_leaf, DistanceType & best_dist, int & checkCount,
+                            flann::Heap<ForestBranch>* heap, flann::DynamicBitset& checked) const
+{
+    if (best_leaf >= 0 && best_dist < min_dist) {
+        return;
+    }
+    
+    // check leaf node
+    if (node->is_leaf_) {
+        int index = node->index_;
+        if (checked.test(index)) {
+            return;
+        }
+        checked.set(index);
+        checkCount++;
+        
+        // squared distance
+        DistanceType dist = distance_(node->feat_mean_.data(), vec, node->feat_mean_.size());
+        if (best_leaf < 0 || dist < best_dist) {
+            best_leaf = index;
+            best_dist = dist;
+        }
+        return;
+    }
+    
+    // create a branch record for the branch not taken
+    ElementType val = vec[node->split_param_.split_dim_];
+    DistanceType diff = val - node->split_param_.split_threshold_;
+    NodePtr bestChild  = (diff < 0 ) ? node->left_child_: node->right_child_;
+    NodePtr otherChild = (diff < 0 ) ? node->right_child_: node->left_child_;
+    
+    DistanceType new_dist_sq = min_dist + distance_.accum_dist(val, node->split_param_.split_threshold_, node->split_param_.split_dim_);
+    if (best_leaf < 0 || new_dist_sq < best_dist) {
+        heap->insert(ForestBranch(otherChild, tree_index, new_dist_sq));
+    }
+    
+    // call recursively to search next level
+    this->searchLevel(vec, bestChild, min_dist, tree_index, best_leaf, best_dist, checkCount, heap, checked);
+}
+
 void BTDTRTree::recordLeafNodes(NodePtr node, vector<NodePtr> & leafNodes, int & index)
 {
     assert(node);    
@@ -550,6 +721,11 @@ void BTDTRTree::setTreeParameter(const BTDTRTreeParameter & param)
     tree_param_ = param;    
 }
 
+void BTDTRTree::setRandomGenerator(const DTRng & rng)
+{
+    rng_ = rng;
+}
+
 
 
 
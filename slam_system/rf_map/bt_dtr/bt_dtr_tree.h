@@ -14,6 +14,7 @@
 #include <Eigen/Dense>
 #include <algorithm>
 #include "bt_dtr_util.h"
+#include "dt_rng.hpp"
 
 #include "flann/util/heap.h"
 #include "flann/util/result_set.h"
@@ -48,6 +49,48 @@ class BTDTRTree
     vector<NodePtr> leaf_nodes_;   // leaf node for back tracking    
     
     vector<int> dims_;             // candidate split dimension, only used in training
+    DTRng rng_;                    // random number generator, only used in training
+    
+public:
+    // branch of the joint search of a forest, see BTDTRegressor::JointSearchBuffer
+    struct ForestBranch
+    {
+        NodePtr node_;
+        int tree_index_;
+        DistanceType mindist_;
+        
+        ForestBranch() {node_ = NULL; tree_index_ = 0; mindist_ = 0;}
+        ForestBranch(NodePtr node, int tree_index, DistanceType mindist)
+        {
+            node_ = node;
+            tree_index_ = tree_index;
+            mindist_ = mindist;
+        }
+        bool operator < (const ForestBranch & rhs) const { return mindist_ < rhs.mindist_; }
+        bool operator > (const ForestBranch & rhs) const { return mindist_ > rhs.mindist_; }
+    };
+    
+    // reusable search memory, avoids allocation in each prediction
+    // one buffer per thread, can be shared by trees
+    class SearchBuffer
+    {
+        friend class BTDTRTree;
+        
+        flann::Heap<BranchSt> * heap_;
+        flann::DynamicBitset checked_;
+        int leaf_node_num_;
+        
+    public:
+        SearchBuffer();
+        ~SearchBuffer();
+        
+        // grow the buffer for trees with at most leaf_node_num leaf nodes
+        void reserve(int leaf_node_num);
+        
+    private:
+        SearchBuffer(const SearchBuffer & other);
+        SearchBuffer & operator = (const SearchBuffer & other);
+    };
     
 public:
     BTDTRTree();
@@ -66,10 +109,16 @@ public:
     // updte tree using new examples
     // it is used for online learning in which
     // examples come by time
+    // prune_empty_branch: true when examples can be removed, branches that no example reaches are removed
+    //                     and one-sided splits are learned again, so the tree shrinks
+    //                     false, examples are only added and the tree is updated as before
+    //                     the root is never removed
+    // return: false if indices is empty, the tree is not changed
     bool updateTree(const vector<VectorXf> & features,
                     const vector<VectorXf> & labels,
                     const vector<unsigned int> & indices,
-                    const BTDTRTreeParameter & param);
+                    const BTDTRTreeParameter & param,
+                    const bool prune_empty_branch = false);
     
     bool predict(const Eigen::VectorXf & feature,
                  const int maxCheck,
@@ -80,12 +129,22 @@ public:
                  VectorXf & pred,
                  float & dist);
     
+    // buffer: reused between predictions
+    bool predict(const Eigen::VectorXf & feature,
+                 const int maxCheck,
+                 SearchBuffer & buffer,
+                 VectorXf & pred,
+                 float & dist) const;
+    
     // each row is a descriptor
     void getLeafNodeDescriptor(Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> & data);
     void setLeafNodeDescriptor(const Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> & data);
     
     const BTDTRTreeParameter & getTreeParameter(void) const;
-    void setTreeParameter(const BTDTRTreeParameter & param);   
+    void setTreeParameter(const BTDTRTreeParameter & param);
+    
+    // the same generator (seed) and training data produce the same tree
+    void setRandomGenerator(const DTRng & rng);
     
 private:
     // split node into left and right subtree
@@ -99,7 +158,8 @@ private:
                     const vector<VectorXf> & labels,
                     const vector<unsigned int> & indices,
                     BTDTRNode* & node,
-                    const int depth);
+                    const int depth,
+                    const bool prune_empty_branch);
     
     // record leaf node in an array for O(1) access
     void hashLeafNode();
@@ -118,6 +178,12 @@ private:
                      const DistanceType min_dist, int & checkCount, const int maxCheck, const float epsError,
                      flann::Heap<BranchSt>* heap, flann::DynamicBitset& checked) const;
     
+    // searchLevel of the joint search, branches not taken go to the heap shared by all trees
+    // best_leaf, best_dist: nearest leaf node of this tree so far, -1 if not found
+    void searchLevel(const ElementType* vec, const NodePtr node, const DistanceType min_dist,
+                     const int tree_index, int & best_leaf, DistanceType & best_dist, int & checkCount,
+                     flann::Heap<ForestBranch>* heap, flann::DynamicBitset& checked) const;
+    
 };
 
 
@@ -0,0 +1,97 @@
+//
+//  bt_hamming_regressor.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-22.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#include "bt_hamming_regressor.h"
+#include "dt_profiler.hpp"
+
+template <int WordNum>
+bool BTHammingRegressor<WordNum>::predict(const Descriptor & feature,
+                                          const int maxCheck,
+                                          BTHammingSearchBuffer & buffer,
+                                          vector<Eigen::VectorXf> & predictions,
+                                          vector<float> & dists) const
+{
+    assert(trees_.size() > 0);
+    
+    const int tree_num = (int)trees_.size();
+    predictions.resize(tree_num);
+    dists.resize(tree_num);
+    
+    // insertion sort by feature distance, as in BTDTRegressor
+    for (int i = 0; i<tree_num; i++) {
+        float dist = 0.0f;
+        trees_[i].predict(feature, maxCheck, buffer, predictions[i], dist);
+        dists[i] = dist;
+        for (int j = i; j > 0 && dists[j] < dists[j-1]; j--) {
+            std::swap(dists[j], dists[j-1]);
+            predictions[j].swap(predictions[j-1]);
+        }
+    }
+    return true;
+}
+
+template <int WordNum>
+bool BTHammingRegressor<WordNum>::saveModel(const char *file_name) const
+{
+    assert(trees_.size() > 0);
+    DTScopedTimer timer(DTProfiler::SAVE);
+    FILE *pf = fopen(file_name, "w");
+    if(!pf) {
+        printf("Error: can not open file %s\n", file_name);
+        return false;
+    }
+    fprintf(pf, "%d %d\n", (int)TreeType::BIT_NUM, label_dim_);
+    reg_tree_param_.writeToFile(pf);
+    for (int i = 0; i<trees_.size(); i++) {
+        trees_[i].writeTree(pf);
+    }
+    fclose(pf);
+    return true;
+}
+
+template <int WordNum>
+bool BTHammingRegressor<WordNum>::load(const char *file_name)
+{
+    DTScopedTimer timer(DTProfiler::LOAD);
+    FILE *pf = fopen(file_name, "r");
+    if (!pf) {
+        printf("Error: can not open file %s\n", file_name);
+        return false;
+    }
+    
+    int bit_num = 0;
+    int ret_num = fscanf(pf, "%d %d", &bit_num, &label_dim_);
+    if (ret_num != 2 || bit_num != TreeType::BIT_NUM) {
+        printf("Error: %s is not a %d bit Hamming forest\n", file_name, (int)TreeType::BIT_NUM);
+        fclose(pf);
+        return false;
+    }
+    
+    bool is_read = reg_tree_param_.readFromFile(pf);
+    assert(is_read);
+    reg_tree_param_.printSelf();
+    
+    trees_.clear();
+    trees_.resize(reg_tree_param_.tree_num_);
+    for (int i = 0; i<trees_.size(); i++) {
+        is_read = trees_[i].readTree(pf);
+        if (!is_read) {
+            printf("Error: read tree %d from %s failed\n", i, file_name);
+            trees_.clear();
+            fclose(pf);
+            return false;
+        }
+        trees_[i].tree_param_ = reg_tree_param_;
+    }
+    fclose(pf);
+    printf("read from %s\n", file_name);
+    return true;
+}
+
+template class BTHammingRegressor<4>;
+template class BTHammingRegressor<8>;
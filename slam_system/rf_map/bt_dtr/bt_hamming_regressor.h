@@ -0,0 +1,55 @@
+//
+//  bt_hamming_regressor.h
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-22.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef __BT_Hamming_Regressor__
+#define __BT_Hamming_Regressor__
+
+// random forest of BTHammingTree, binary descriptor version of BTDTRegressor
+#include <stdio.h>
+#include <vector>
+#include "bt_hamming_tree.h"
+
+using std::vector;
+
+template <int WordNum>
+class BTHammingRegressor
+{
+    friend class RFMapBuilder;
+public:
+    typedef BTHammingTree<WordNum> TreeType;
+    typedef typename TreeType::Descriptor Descriptor;
+    
+private:
+    vector<TreeType> trees_;
+    BTDTRTreeParameter reg_tree_param_;
+    int label_dim_;
+    
+public:
+    BTHammingRegressor(){label_dim_ = 0;}
+    
+    // return every prediction and distance from every tree
+    // buffer: search memory, reused between predictions, one per thread
+    // dists: Hamming distance in each tree, in non-decrease order
+    bool predict(const Descriptor & feature,
+                 const int maxCheck,
+                 BTHammingSearchBuffer & buffer,
+                 vector<Eigen::VectorXf> & predictions,
+                 vector<float> & dists) const;
+    
+    // all trees in one text file
+    bool saveModel(const char *file_name) const;
+    bool load(const char *file_name);
+    
+    int treeNum(void) const {return (int)trees_.size();}
+    int bitNum(void) const {return TreeType::BIT_NUM;}
+};
+
+typedef BTHammingRegressor<4> BTHammingRegressor256;   // ORB
+typedef BTHammingRegressor<8> BTHammingRegressor512;   // LATCH 64 bytes
+
+#endif /* defined(__BT_Hamming_Regressor__) */
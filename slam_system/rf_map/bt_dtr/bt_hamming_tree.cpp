@@ -0,0 +1,398 @@
+//
+//  bt_hamming_tree.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-22.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#include "bt_hamming_tree.h"
+#include "dt_util.hpp"
+#include <algorithm>
+#include <limits>
+#include <climits>
+#include <string.h>
+
+// split indices by one bit, 0 to left, 1 to right
+template <int WordNum>
+static void splitIndices(const vector<typename BTHammingTree<WordNum>::Descriptor> & features,
+                         const vector<unsigned int> & indices,
+                         const int split_bit,
+                         vector<unsigned int> & left_indices,
+                         vector<unsigned int> & right_indices)
+{
+    left_indices.clear();
+    right_indices.clear();
+    for (int i = 0; i<indices.size(); i++) {
+        const int index = indices[i];
+        if (BTHammingTree<WordNum>::bit(features[index], split_bit)) {
+            right_indices.push_back(index);
+        }
+        else {
+            left_indices.push_back(index);
+        }
+    }
+}
+
+template <int WordNum>
+BTHammingTree<WordNum>::BTHammingTree()
+{
+    
+}
+
+template <int WordNum>
+void BTHammingTree<WordNum>::pack(const unsigned char* bytes, Descriptor & descriptor)
+{
+    assert(bytes);
+    // little endian, bit i is bit (i%8) of byte i/8
+    for (int i = 0; i<WordNum; i++) {
+        uint64_t word = 0;
+        for (int j = 0; j<8; j++) {
+            word |= (uint64_t)bytes[8 * i + j] << (8 * j);
+        }
+        descriptor[i] = word;
+    }
+}
+
+template <int WordNum>
+void BTHammingTree<WordNum>::setRandomGenerator(const DTRng & rng)
+{
+    rng_ = rng;
+}
+
+template <int WordNum>
+bool BTHammingTree<WordNum>::buildTree(const vector<Descriptor> & features,
+                                       const vector<VectorXf> & labels,
+                                       const vector<unsigned int> & indices,
+                                       const BTDTRTreeParameter & param)
+{
+    assert(features.size() == labels.size());
+    assert(indices.size() <= features.size());
+    assert(indices.size() > 0);
+    
+    tree_param_ = param;
+    nodes_.clear();
+    prototypes_.clear();
+    label_means_.clear();
+    label_stddevs_.clear();
+    
+    bits_.resize(BIT_NUM);
+    for (int i = 0; i<BIT_NUM; i++) {
+        bits_[i] = i;
+    }
+    
+    int root = this->configureNode(features, labels, indices, 0);
+    assert(root == 0);
+    bits_.clear();
+    return true;
+}
+
+template <int WordNum>
+int BTHammingTree<WordNum>::configureNode(const vector<Descriptor> & features,
+                                          const vector<VectorXf> & labels,
+                                          const vector<unsigned int> & indices,
+                                          const int depth)
+{
+    const int min_leaf_node = tree_param_.min_leaf_node_;
+    const int max_depth     = tree_param_.max_tree_depth_;
+    const int candidate_bit_num = std::min(tree_param_.candidate_dim_num_, (int)BIT_NUM);
+    const double min_split_stddev = tree_param_.min_split_node_std_dev_;
+    
+    // leaf node
+    bool reach_leaf = false;
+    if (indices.size() < min_leaf_node || depth > max_depth) {
+        reach_leaf = true;
+    }
+    
+    // check standard deviation
+    if (reach_leaf == false && depth > max_depth/2) {
+        Eigen::VectorXf mean;
+        Eigen::VectorXf std_dev;
+        DTUtil::meanStddev<Eigen::VectorXf>(labels, indices, mean, std_dev);
+        reach_leaf = (std_dev.array() < min_split_stddev).all();
+    }
+    if (reach_leaf) {
+        return this->setLeafNode(features, labels, indices, depth);
+    }
+    
+    // randomly select a subset of bits
+    rng_.partialShuffle(bits_.begin(), bits_.begin() + candidate_bit_num, bits_.end());
+    vector<int> candidate_bits(bits_.begin(), bits_.begin() + candidate_bit_num);
+    
+    // estimate the split from at most max_sample_num_ randomly sampled points in large nodes
+    const int max_sample_num = tree_param_.max_sample_num_;
+    const int min_split_num = tree_param_.min_split_node_;
+    vector<unsigned int> left_indices;
+    vector<unsigned int> right_indices;
+    int split_bit = -1;
+    double split_loss = 0.0;
+    bool is_split = false;
+    if (max_sample_num > 0 && indices.size() > max_sample_num) {
+        // reservoir sampling
+        vector<unsigned int> sampled_indices(indices.begin(), indices.begin() + max_sample_num);
+        for (size_t i = max_sample_num; i<indices.size(); i++) {
+            size_t j = rng_.uniformInt((uint32_t)(i + 1));
+            if (j < max_sample_num) {
+                sampled_indices[j] = indices[i];
+            }
+        }
+        const int sampled_min_split_num = std::max(1, (int)(1.0 * min_split_num * max_sample_num / indices.size()));
+        is_split = this->bestSplitBit(features, labels, sampled_indices, candidate_bits, depth,
+                                      sampled_min_split_num, split_bit, split_loss);
+        if (is_split) {
+            splitIndices<WordNum>(features, indices, split_bit, left_indices, right_indices);
+            is_split = left_indices.size() >= min_split_num && right_indices.size() >= min_split_num;
+        }
+    }
+    if (!is_split) {
+        is_split = this->bestSplitBit(features, labels, indices, candidate_bits, depth,
+                                      min_split_num, split_bit, split_loss);
+        if (is_split) {
+            splitIndices<WordNum>(features, indices, split_bit, left_indices, right_indices);
+        }
+    }
+    if (!is_split) {
+        return this->setLeafNode(features, labels, indices, depth);
+    }
+    
+    // children are added after the node, node memory may move
+    const int node_index = (int)nodes_.size();
+    BTHammingNode node;
+    node.split_bit_ = split_bit;
+    node.depth_ = depth;
+    node.sample_num_ = (int)indices.size();
+    nodes_.push_back(node);
+    
+    int left_child = this->configureNode(features, labels, left_indices, depth + 1);
+    int right_child = this->configureNode(features, labels, right_indices, depth + 1);
+    nodes_[node_index].left_child_ = left_child;
+    nodes_[node_index].right_child_ = right_child;
+    return node_index;
+}
+
+template <int WordNum>
+bool BTHammingTree<WordNum>::bestSplitBit(const vector<Descriptor> & features,
+                                          const vector<VectorXf> & labels,
+                                          const vector<unsigned int> & indices,
+                                          const vector<int> & candidate_bits,
+                                          const int depth,
+                                          const int min_split_num,
+                                          int & split_bit,
+                                          double & split_loss) const
+{
+    const bool is_use_balance = depth <= tree_param_.max_balanced_depth_;
+    bool is_split = false;
+    double loss = std::numeric_limits<double>::max();
+    vector<unsigned int> left_indices;
+    vector<unsigned int> right_indices;
+    for (int i = 0; i<candidate_bits.size(); i++) {
+        const int cur_bit = candidate_bits[i];
+        splitIndices<WordNum>(features, indices, cur_bit, left_indices, right_indices);
+        if (left_indices.size() < min_split_num ||
+            right_indices.size() < min_split_num) {
+            continue;
+        }
+        
+        double cur_loss = 0.0;
+        if (is_use_balance) {
+            cur_loss = DTUtil::balanceLoss((int)left_indices.size(), (int)right_indices.size());
+        }
+        else {
+            cur_loss += DTUtil::spatialVariance<VectorXf>(labels, left_indices);
+            cur_loss += DTUtil::spatialVariance<VectorXf>(labels, right_indices);
+        }
+        if (cur_loss < loss) {
+            loss = cur_loss;
+            is_split = true;
+            split_bit = cur_bit;
+            split_loss = cur_loss;
+        }
+    }
+    return is_split;
+}
+
+template <int WordNum>
+int BTHammingTree<WordNum>::setLeafNode(const vector<Descriptor> & features,
+                                        const vector<VectorXf> & labels,
+                                        const vector<unsigned int> & indices,
+                                        const int depth)
+{
+    assert(indices.size() > 0);
+    
+    // majority vote of each bit
+    vector<int> counts(BIT_NUM, 0);
+    for (int i = 0; i<indices.size(); i++) {
+        const Descriptor & d = features[indices[i]];
+        for (int w = 0; w<WordNum; w++) {
+            uint64_t word = d[w];
+            while (word) {
+                counts[w * 64 + __builtin_ctzll(word)]++;
+                word &= word - 1;
+            }
+        }
+    }
+    Descriptor prototype;
+    prototype.fill(0);
+    for (int b = 0; b<BIT_NUM; b++) {
+        if (2 * counts[b] > indices.size()) {
+            prototype[b >> 6] |= (uint64_t)1 << (b & 63);
+        }
+    }
+    
+    Eigen::VectorXf mean;
+    Eigen::VectorXf stddev;
+    DTUtil::meanStddev<Eigen::VectorXf>(labels, indices, mean, stddev);
+    
+    BTHammingNode node;
+    node.leaf_index_ = (int)prototypes_.size();
+    node.depth_ = depth;
+    node.sample_num_ = (int)indices.size();
+    prototypes_.push_back(prototype);
+    label_means_.push_back(mean);
+    label_stddevs_.push_back(stddev);
+    
+    nodes_.push_back(node);
+    return (int)nodes_.size() - 1;
+}
+
+template <int WordNum>
+bool BTHammingTree<WordNum>::predict(const Descriptor & feature,
+                                     const int maxCheck,
+                                     BTHammingSearchBuffer & buffer,
+                                     VectorXf & pred,
+                                     float & dist) const
+{
+    assert(nodes_.size() > 0);
+    
+    typedef std::pair<int, int> Branch;   // (minimum distance, node index)
+    vector<Branch> & heap = buffer.branches_;
+    heap.clear();
+    // std::*_heap is a max heap
+    auto greater = [](const Branch & a, const Branch & b) { return a.first > b.first; };
+    
+    int best_dist = INT_MAX;
+    int best_leaf = -1;
+    int check_count = 0;
+    
+    // search down to a leaf, record the branches not taken
+    // the other branch differs at least one bit from the feature
+    int node_index = 0;
+    int min_dist = 0;
+    while (true) {
+        while (nodes_[node_index].leaf_index_ < 0) {
+            const BTHammingNode & node = nodes_[node_index];
+            const bool is_one = bit(feature, node.split_bit_);
+            const int best_child  = is_one ? node.right_child_ : node.left_child_;
+            const int other_child = is_one ? node.left_child_ : node.right_child_;
+            if (min_dist + 1 < best_dist) {
+                heap.push_back(Branch(min_dist + 1, other_child));
+                std::push_heap(heap.begin(), heap.end(), greater);
+            }
+            node_index = best_child;
+        }
+        
+        const int leaf_index = nodes_[node_index].leaf_index_;
+        const int cur_dist = hammingDistance(feature, prototypes_[leaf_index]);
+        check_count++;
+        if (cur_dist < best_dist) {
+            best_dist = cur_dist;
+            best_leaf = leaf_index;
+        }
+        
+        // next branch
+        bool has_branch = false;
+        while (check_count < maxCheck && !heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), greater);
+            Branch branch = heap.back();
+            heap.pop_back();
+            if (branch.first < best_dist) {
+                min_dist = branch.first;
+                node_index = branch.second;
+                has_branch = true;
+                break;
+            }
+        }
+        if (!has_branch) {
+            break;
+        }
+    }
+    assert(best_leaf >= 0);
+    
+    pred = label_means_[best_leaf];
+    dist = (float)best_dist;
+    return true;
+}
+
+template <int WordNum>
+bool BTHammingTree<WordNum>::writeTree(FILE *pf) const
+{
+    assert(pf);
+    fprintf(pf, "%d %d %d\n", (int)nodes_.size(), (int)prototypes_.size(), BIT_NUM);
+    for (int i = 0; i<nodes_.size(); i++) {
+        const BTHammingNode & node = nodes_[i];
+        fprintf(pf, "%d %d %d %d %d %d\n", node.left_child_, node.right_child_, node.split_bit_,
+                node.leaf_index_, node.depth_, node.sample_num_);
+    }
+    for (int i = 0; i<prototypes_.size(); i++) {
+        const int label_dim = (int)label_means_[i].size();
+        fprintf(pf, "%d", label_dim);
+        for (int j = 0; j<label_dim; j++) {
+            fprintf(pf, " %f", label_means_[i][j]);
+        }
+        for (int j = 0; j<label_dim; j++) {
+            fprintf(pf, " %f", label_stddevs_[i][j]);
+        }
+        for (int w = 0; w<WordNum; w++) {
+            fprintf(pf, " %016llx", (unsigned long long)prototypes_[i][w]);
+        }
+        fprintf(pf, "\n");
+    }
+    return true;
+}
+
+template <int WordNum>
+bool BTHammingTree<WordNum>::readTree(FILE *pf)
+{
+    assert(pf);
+    int node_num = 0;
+    int leaf_num = 0;
+    int bit_num = 0;
+    int ret = fscanf(pf, "%d %d %d", &node_num, &leaf_num, &bit_num);
+    if (ret != 3 || bit_num != BIT_NUM) {
+        printf("Error: read Hamming tree failed, descriptor bit number %d vs %d\n", bit_num, (int)BIT_NUM);
+        return false;
+    }
+    nodes_.resize(node_num);
+    for (int i = 0; i<node_num; i++) {
+        BTHammingNode & node = nodes_[i];
+        ret = fscanf(pf, "%d %d %d %d %d %d", &node.left_child_, &node.right_child_, &node.split_bit_,
+                     &node.leaf_index_, &node.depth_, &node.sample_num_);
+        assert(ret == 6);
+    }
+    prototypes_.resize(leaf_num);
+    label_means_.resize(leaf_num);
+    label_stddevs_.resize(leaf_num);
+    for (int i = 0; i<leaf_num; i++) {
+        int label_dim = 0;
+        ret = fscanf(pf, "%d", &label_dim);
+        assert(ret == 1);
+        label_means_[i] = VectorXf::Zero(label_dim);
+        label_stddevs_[i] = VectorXf::Zero(label_dim);
+        for (int j = 0; j<label_dim; j++) {
+            ret = fscanf(pf, "%f", &label_means_[i][j]);
+        }
+        for (int j = 0; j<label_dim; j++) {
+            ret = fscanf(pf, "%f", &label_stddevs_[i][j]);
+        }
+        for (int w = 0; w<WordNum; w++) {
+            unsigned long long word = 0;
+            ret = fscanf(pf, "%llx", &word);
+            assert(ret == 1);
+            prototypes_[i][w] = word;
+        }
+    }
+    return true;
+}
+
+template class BTHammingTree<4>;
+template class BTHammingTree<8>;
@@ -0,0 +1,143 @@
+//
+//  bt_hamming_tree.h
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-22.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef __BT_Hamming_Tree__
+#define __BT_Hamming_Tree__
+
+// back tracking decision tree over packed binary descriptors, e.g., ORB (256 bits), LATCH (512 bits)
+// split node: test one bit
+// leaf node: majority vote of bits as the prototype descriptor
+// back tracking: popcount Hamming distance to leaf prototypes
+#include <stdio.h>
+#include <stdint.h>
+#include <array>
+#include <vector>
+#include <utility>
+#include <Eigen/Dense>
+#include "bt_dtr_util.h"
+#include "dt_rng.hpp"
+
+using std::vector;
+using Eigen::VectorXf;
+
+// tree node, stored in an array
+struct BTHammingNode
+{
+    int left_child_;     // node index, bit is 0
+    int right_child_;    // node index, bit is 1
+    int split_bit_;
+    int leaf_index_;     // index of leaf data, -1 for internal node
+    int depth_;
+    int sample_num_;
+    
+    BTHammingNode()
+    {
+        left_child_ = -1;
+        right_child_ = -1;
+        split_bit_ = -1;
+        leaf_index_ = -1;
+        depth_ = 0;
+        sample_num_ = 0;
+    }
+};
+
+// reusable search memory, one per thread, shared by trees
+class BTHammingSearchBuffer
+{
+public:
+    vector<std::pair<int, int> > branches_;   // (minimum distance, node index) heap
+};
+
+template <int WordNum>
+class BTHammingTree
+{
+    template <int N> friend class BTHammingRegressor;
+public:
+    enum { BIT_NUM = WordNum * 64, BYTE_NUM = WordNum * 8 };
+    typedef std::array<uint64_t, WordNum> Descriptor;
+    
+private:
+    vector<BTHammingNode> nodes_;      // nodes_[0] is the root
+    vector<Descriptor> prototypes_;    // leaf node descriptor
+    vector<VectorXf> label_means_;     // leaf node label
+    vector<VectorXf> label_stddevs_;
+    BTDTRTreeParameter tree_param_;
+    
+    vector<int> bits_;                 // candidate split bits, only used in training
+    DTRng rng_;                        // random number generator, only used in training
+    
+public:
+    BTHammingTree();
+    
+    // descriptor from BYTE_NUM bytes, e.g., a row of OpenCV descriptors
+    static void pack(const unsigned char* bytes, Descriptor & descriptor);
+    
+    static inline bool bit(const Descriptor & descriptor, const int index)
+    {
+        return (descriptor[index >> 6] >> (index & 63)) & 1;
+    }
+    
+    static inline int hammingDistance(const Descriptor & a, const Descriptor & b)
+    {
+        int dist = 0;
+        for (int i = 0; i<WordNum; i++) {
+            dist += __builtin_popcountll(a[i] ^ b[i]);
+        }
+        return dist;
+    }
+    
+    // indices: training examples of the tree
+    // param: candidate_dim_num_ is the number of candidate bits, max_sample_num_ is used as in BTDTRTree
+    bool buildTree(const vector<Descriptor> & features,
+                   const vector<VectorXf> & labels,
+                   const vector<unsigned int> & indices,
+                   const BTDTRTreeParameter & param);
+    
+    // maxCheck: number of checked leaf nodes in back tracking
+    // dist: Hamming distance to the prototype of the nearest leaf node
+    bool predict(const Descriptor & feature,
+                 const int maxCheck,
+                 BTHammingSearchBuffer & buffer,
+                 VectorXf & pred,
+                 float & dist) const;
+    
+    int leafNodeNum() const { return (int)prototypes_.size(); }
+    
+    // the same generator (seed) and training data produce the same tree
+    void setRandomGenerator(const DTRng & rng);
+    
+    bool writeTree(FILE *pf) const;
+    bool readTree(FILE *pf);
+    
+private:
+    // return node index
+    int configureNode(const vector<Descriptor> & features,
+                      const vector<VectorXf> & labels,
+                      const vector<unsigned int> & indices,
+                      const int depth);
+    
+    int setLeafNode(const vector<Descriptor> & features,
+                    const vector<VectorXf> & labels,
+                    const vector<unsigned int> & indices,
+                    const int depth);
+    
+    // best split bit in candidate bits
+    bool bestSplitBit(const vector<Descriptor> & features,
+                      const vector<VectorXf> & labels,
+                      const vector<unsigned int> & indices,
+                      const vector<int> & candidate_bits,
+                      const int depth,
+                      const int min_split_num,
+                      int & split_bit,
+                      double & split_loss) const;
+};
+
+typedef BTHammingTree<4> BTHammingTree256;   // ORB
+typedef BTHammingTree<8> BTHammingTree512;   // LATCH 64 bytes
+
+#endif /* defined(__BT_Hamming_Tree__) */
@@ -0,0 +1,222 @@
+//
+//  pgl_pan_tilt_grid.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-29.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#include "pgl_pan_tilt_grid.h"
+#include "pgl_ptz_camera.h"
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+
+namespace cvx_pgl {
+    namespace {
+        // angle to [-180, 180)
+        double wrapAngle(double angle)
+        {
+            return angle - 360.0 * floor((angle + 180.0) / 360.0);
+        }
+    }
+    
+    pan_tilt_grid::pan_tilt_grid(double cell_size)
+    {
+        assert(cell_size > 0 && cell_size <= 90);
+        cell_size_ = cell_size;
+        pan_cell_num_ = (int)ceil(360.0 / cell_size_);
+        tilt_cell_num_ = (int)ceil(180.0 / cell_size_);
+        cells_.resize(pan_cell_num_ * tilt_cell_num_);
+        size_ = 0;
+    }
+    
+    int pan_tilt_grid::cell_index(const Vector2d& pan_tilt) const
+    {
+        int col = (int)floor((wrapAngle(pan_tilt[0]) + 180.0) / cell_size_);
+        int row = (int)floor((pan_tilt[1] + 90.0) / cell_size_);
+        col = std::min(std::max(col, 0), pan_cell_num_ - 1);
+        row = std::min(std::max(row, 0), tilt_cell_num_ - 1);
+        return row * pan_cell_num_ + col;
+    }
+    
+    void pan_tilt_grid::insert(int id, const Vector2d& pan_tilt)
+    {
+        assert(id >= 0);
+        if (id >= cell_.size()) {
+            cell_.resize(id + 1, -1);
+            position_.resize(id + 1, -1);
+            pan_tilt_.resize(id + 1, Vector2d::Zero());
+        }
+        assert(cell_[id] == -1);
+        
+        const int c = cell_index(pan_tilt);
+        cell_[id] = c;
+        position_[id] = (int)cells_[c].size();
+        pan_tilt_[id] = pan_tilt;
+        cells_[c].push_back(id);
+        size_++;
+    }
+    
+    bool pan_tilt_grid::remove(int id)
+    {
+        if (!contains(id)) {
+            return false;
+        }
+        // swap the last id of the cell into the position
+        vector<int> & cell = cells_[cell_[id]];
+        const int last = cell.back();
+        cell[position_[id]] = last;
+        position_[last] = position_[id];
+        cell.pop_back();
+        
+        cell_[id] = -1;
+        position_[id] = -1;
+        size_--;
+        return true;
+    }
+    
+    void pan_tilt_grid::update(int id, const Vector2d& pan_tilt)
+    {
+        assert(contains(id));
+        if (cell_index(pan_tilt) == cell_[id]) {
+            pan_tilt_[id] = pan_tilt;
+        }
+        else {
+            remove(id);
+            insert(id, pan_tilt);
+        }
+    }
+    
+    void pan_tilt_grid::clear()
+    {
+        for (int i = 0; i < cells_.size(); i++) {
+            cells_[i].clear();
+        }
+        cell_.clear();
+        position_.clear();
+        pan_tilt_.clear();
+        size_ = 0;
+    }
+    
+    void pan_tilt_grid::query(const Vector2d& pp,
+                              const Vector3d& ptz,
+                              int width,
+                              int height,
+                              vector<int>& candidates) const
+    {
+        candidates.clear();
+        if (size_ == 0) {
+            return;
+        }
+        
+        // camera to world rotation, x = K * R * p
+        const Matrix3d rt = (matrixFromTiltX(ptz[1]) * matrixFromPanY(ptz[0])).transpose();
+        const double fl = ptz[2];
+        
+        // pan, tilt range of the image border, pan is relative to the camera pan
+        // there is no extreme of pan or tilt inside the image except a pole
+        const int sample_num = 32;
+        double min_pan = 180.0, max_pan = -180.0, min_tilt = 90.0, max_tilt = -90.0;
+        for (int i = 0; i < 4 * sample_num; i++) {
+            const int side = i / sample_num;
+            const double t = (double)(i % sample_num) / sample_num;
+            double x = 0, y = 0;
+            switch (side) {
+                case 0: x = t * width;       y = 0;                  break;
+                case 1: x = width;           y = t * height;         break;
+                case 2: x = (1 - t) * width; y = height;             break;
+                default: x = 0;              y = (1 - t) * height;   break;
+            }
+            Vector3d d = rt * Vector3d((x - pp[0]) / fl, (y - pp[1]) / fl, 1.0);
+            double pan = atan2(d[0], d[2]) * 180.0 / M_PI;
+            double tilt = atan2(-d[1], sqrt(d[0] * d[0] + d[2] * d[2])) * 180.0 / M_PI;
+            double delta_pan = wrapAngle(pan - ptz[0]);
+            min_pan = std::min(min_pan, delta_pan);
+            max_pan = std::max(max_pan, delta_pan);
+            min_tilt = std::min(min_tilt, tilt);
+            max_tilt = std::max(max_tilt, tilt);
+        }
+        
+        // a pole in the image covers all pans
+        bool is_full_pan = false;
+        for (int k = 0; k < 2; k++) {
+            Vector3d pole(0, k == 0 ? -1.0 : 1.0, 0);   // tilt 90, tilt -90
+            Vector3d q = rt.transpose() * pole;
+            if (q[2] <= 0) {
+                continue;
+            }
+            double x = fl * q[0] / q[2] + pp[0];
+            double y = fl * q[1] / q[2] + pp[1];
+            if (x >= 0 && x <= width && y >= 0 && y <= height) {
+                is_full_pan = true;
+                if (k == 0) {
+                    max_tilt = 90.0;
+                }
+                else {
+                    min_tilt = -90.0;
+                }
+            }
+        }
+        
+        // one cell margin for the sampling of the border
+        int min_row = (int)floor((min_tilt - cell_size_ + 90.0) / cell_size_);
+        int max_row = (int)floor((max_tilt + cell_size_ + 90.0) / cell_size_);
+        min_row = std::max(min_row, 0);
+        max_row = std::min(max_row, tilt_cell_num_ - 1);
+        
+        int start_col = 0;
+        int col_num = pan_cell_num_;
+        if (!is_full_pan) {
+            start_col = (int)floor((ptz[0] + min_pan - cell_size_ + 180.0) / cell_size_);
+            int end_col = (int)floor((ptz[0] + max_pan + cell_size_ + 180.0) / cell_size_);
+            col_num = std::min(end_col - start_col + 1, pan_cell_num_);
+        }
+        
+        for (int r = min_row; r <= max_row; r++) {
+            for (int j = 0; j < col_num; j++) {
+                int c = ((start_col + j) % pan_cell_num_ + pan_cell_num_) % pan_cell_num_;
+                const vector<int> & cell = cells_[r * pan_cell_num_ + c];
+                candidates.insert(candidates.end(), cell.begin(), cell.end());
+            }
+        }
+    }
+    
+    void pan_tilt_grid::visible(const Vector2d& pp,
+                                const Vector3d& ptz,
+                                int width,
+                                int height,
+                                vector<int>& ids,
+                                vector<Vector2d>& points) const
+    {
+        vector<int> candidates;
+        query(pp, ptz, width, height, candidates);
+        
+        vector<Vector2d> candidate_pan_tilt(candidates.size());
+        for (int i = 0; i < candidates.size(); i++) {
+            candidate_pan_tilt[i] = pan_tilt_[candidates[i]];
+        }
+        vector<Vector2d> projections;
+        panTilt2Point(pp, ptz, candidate_pan_tilt, projections, NULL, NULL);
+        
+        // a ray behind the camera also projects to the image, z of the camera coordinate must be positive
+        const Matrix3d r = matrixFromTiltX(ptz[1]) * matrixFromPanY(ptz[0]);
+        const double deg2rad = M_PI / 180.0;
+        
+        ids.clear();
+        points.clear();
+        for (int i = 0; i < candidates.size(); i++) {
+            const double a = candidate_pan_tilt[i][0] * deg2rad;
+            const double b = candidate_pan_tilt[i][1] * deg2rad;
+            const Vector3d d(cos(b) * sin(a), -sin(b), cos(b) * cos(a));
+            if (r.row(2).dot(d) <= 0) {
+                continue;
+            }
+            const Vector2d & p = projections[i];
+            if (p.x() >= 0 && p.x() < width && p.y() >= 0 && p.y() < height) {
+                ids.push_back(candidates[i]);
+                points.push_back(p);
+            }
+        }
+    }
+}
@@ -0,0 +1,75 @@
+//
+//  pgl_pan_tilt_grid.h
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-29.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef __ptz_slam_dev__pgl_pan_tilt_grid__
+#define __ptz_slam_dev__pgl_pan_tilt_grid__
+
+#include <stdio.h>
+#include <vector>
+#include <Eigen/Dense>
+
+namespace cvx_pgl {
+    using Eigen::Vector2d;
+    using Eigen::Vector3d;
+    using std::vector;
+    
+    // equirectangular grid of pan-tilt rays, pan in [-180, 180), tilt in [-90, 90]
+    // index of ray landmarks for visible-landmark culling of a ptz camera
+    // items are non-negative int ids, e.g., slots of a landmark store
+    class pan_tilt_grid {
+        double cell_size_;   // degree
+        int pan_cell_num_;
+        int tilt_cell_num_;
+        
+        vector<vector<int> > cells_;    // ids in each cell
+        
+        // per id, cell_ is -1 if the id is not in the grid
+        vector<int> cell_;
+        vector<int> position_;          // position in the cell
+        vector<Vector2d> pan_tilt_;
+        int size_;
+    
+    public:
+        explicit pan_tilt_grid(double cell_size = 2.0);
+        
+        // O(1)
+        void insert(int id, const Vector2d& pan_tilt);
+        
+        // O(1), return false if the id is not in the grid
+        bool remove(int id);
+        
+        // move an id to a new pan-tilt, O(1)
+        void update(int id, const Vector2d& pan_tilt);
+        
+        void clear();
+        
+        bool contains(int id) const { return id >= 0 && id < cell_.size() && cell_[id] != -1; }
+        int size() const { return size_; }
+        
+        // ids in cells that overlap the field of view of the camera, a super set of visible ids
+        // O(number of candidates + number of overlapped cells)
+        void query(const Vector2d& pp,
+                   const Vector3d& ptz,
+                   int width,
+                   int height,
+                   vector<int>& candidates) const;
+        
+        // ids in front of the camera whose projection are in the image, and the projections
+        void visible(const Vector2d& pp,
+                     const Vector3d& ptz,
+                     int width,
+                     int height,
+                     vector<int>& ids,
+                     vector<Vector2d>& points) const;
+    
+    private:
+        int cell_index(const Vector2d& pan_tilt) const;
+    };
+}
+
+#endif /* defined(__ptz_slam_dev__pgl_pan_tilt_grid__) */
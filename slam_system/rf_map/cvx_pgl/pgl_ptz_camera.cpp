@@ -97,9 +97,10 @@ namespace cvx_pgl  {
         Eigen::Vector3d p;      
         point_pan *= M_PI / 180.0;
         point_tilt *= M_PI/180.0;
-        p[0] = tan(point_pan);
-        p[1] = -tan(point_tilt)/sqrt(p[0] * p[0] + 1);
-        p[2] = 1;
+        // ray direction, inverse of point2PanTilt over the full circle of pan
+        p[0] = sin(point_pan);
+        p[1] = -tan(point_tilt);
+        p[2] = cos(point_pan);
         
         p = KR_tilt_R_pan_ * p;
         assert(p[2] != 0);
@@ -344,7 +345,7 @@ namespace cvx_pgl  {
         Eigen::Vector3d p(point[0], point[1], 1);
         p = r_pan_inv * r_tilt_inv * K_inv * p;
         
-        double point_pan = atan(p[0]/p[2]);
+        double point_pan = atan2(p[0], p[2]);   // (-180, 180], rays behind the pan origin are not folded
         double point_tilt = atan(-p[1]/sqrt(p[0]*p[0] + p[2]*p[2]));
         
         point_pan_tilt[0] = point_pan * 180.0 /M_PI;
@@ -372,9 +373,10 @@ namespace cvx_pgl  {
         double point_tilt = point_pan_tilt[1];
         point_pan *= M_PI / 180.0;
         point_tilt *= M_PI/180.0;
-        p[0] = tan(point_pan);
-        p[1] = -tan(point_tilt)/sqrt(p[0] * p[0] + 1);
-        p[2] = 1;
+        // ray direction, inverse of point2PanTilt over the full circle of pan
+        p[0] = sin(point_pan);
+        p[1] = -tan(point_tilt);
+        p[2] = cos(point_pan);
         
         double pan = ptz[0];
         double tilt = ptz[1];
@@ -394,6 +396,110 @@ namespace cvx_pgl  {
         return out_point;
     }
     
+    namespace {
+        // camera part of the projection, computed once for a batch of rays
+        // x = K * R_tilt * R_pan * p, p = [sin(a), -tan(b), cos(a)]
+        struct PanTiltProjector
+        {
+            Eigen::Vector2d pp_;
+            double fl_;
+            Eigen::Matrix3d r_;          // R_tilt * R_pan
+            Eigen::Matrix3d dr_pan_;     // d(R_tilt * R_pan)/d pan, per degree
+            Eigen::Matrix3d dr_tilt_;    // d(R_tilt * R_pan)/d tilt, per degree
+            
+            PanTiltProjector(const Eigen::Vector2d& pp, const Eigen::Vector3d& ptz):pp_(pp), fl_(ptz[2])
+            {
+                const double deg2rad = M_PI / 180.0;
+                const Eigen::Matrix3d r_pan = matrixFromPanY(ptz[0]);
+                const Eigen::Matrix3d r_tilt = matrixFromTiltX(ptz[1]);
+                
+                const double pan = ptz[0] * deg2rad, tilt = ptz[1] * deg2rad;
+                Eigen::Matrix3d d_pan = Eigen::Matrix3d::Zero();
+                d_pan(0, 0) = -sin(pan);   d_pan(0, 2) = -cos(pan);
+                d_pan(2, 0) = cos(pan);    d_pan(2, 2) = -sin(pan);
+                Eigen::Matrix3d d_tilt = Eigen::Matrix3d::Zero();
+                d_tilt(1, 1) = -sin(tilt);  d_tilt(1, 2) = cos(tilt);
+                d_tilt(2, 1) = -cos(tilt);  d_tilt(2, 2) = -sin(tilt);
+                
+                r_ = r_tilt * r_pan;
+                dr_pan_ = r_tilt * d_pan * deg2rad;
+                dr_tilt_ = d_tilt * r_pan * deg2rad;
+            }
+            
+            // jacobian_ptz, jacobian_ray: can be NULL
+            Eigen::Vector2d project(const Eigen::Vector2d& point_pan_tilt,
+                                    Eigen::Matrix<double, 2, 3> * jacobian_ptz,
+                                    Eigen::Matrix2d * jacobian_ray) const
+            {
+                const double deg2rad = M_PI / 180.0;
+                const double a = point_pan_tilt[0] * deg2rad;
+                const double b = point_pan_tilt[1] * deg2rad;
+                const double cos_a = cos(a), sin_a = sin(a);
+                const double tan_b = tan(b);
+                
+                // ray direction, the same as panTilt2Point
+                const Eigen::Vector3d p(sin_a, -tan_b, cos_a);
+                
+                // q: point in the camera coordinate, x = fl * q0/q2 + pp.x, y = fl * q1/q2 + pp.y
+                const Eigen::Vector3d q = r_ * p;
+                assert(q[2] != 0);
+                const double inv_q2 = 1.0/q[2];
+                const double u = q[0] * inv_q2, v = q[1] * inv_q2;
+                if (jacobian_ptz != NULL || jacobian_ray != NULL) {
+                    Eigen::Matrix<double, 2, 3> dx_dq;
+                    dx_dq << fl_ * inv_q2, 0, -fl_ * u * inv_q2,
+                             0, fl_ * inv_q2, -fl_ * v * inv_q2;
+                    if (jacobian_ptz != NULL) {
+                        jacobian_ptz->col(0) = dx_dq * (dr_pan_ * p);
+                        jacobian_ptz->col(1) = dx_dq * (dr_tilt_ * p);
+                        (*jacobian_ptz)(0, 2) = u;
+                        (*jacobian_ptz)(1, 2) = v;
+                    }
+                    if (jacobian_ray != NULL) {
+                        const Eigen::Vector3d dp_da(cos_a, 0.0, -sin_a);
+                        const Eigen::Vector3d dp_db(0.0, -(1.0 + tan_b * tan_b), 0.0);
+                        jacobian_ray->col(0) = dx_dq * (r_ * dp_da) * deg2rad;
+                        jacobian_ray->col(1) = dx_dq * (r_ * dp_db) * deg2rad;
+                    }
+                }
+                return Eigen::Vector2d(fl_ * u + pp_[0], fl_ * v + pp_[1]);
+            }
+        };
+    }
+    
+    Eigen::Vector2d panTilt2Point(const Eigen::Vector2d& pp,
+                                  const Eigen::Vector3d& ptz,
+                                  const Eigen::Vector2d& point_pan_tilt,
+                                  Eigen::Matrix<double, 2, 3> & jacobian_ptz,
+                                  Eigen::Matrix2d & jacobian_ray)
+    {
+        PanTiltProjector projector(pp, ptz);
+        return projector.project(point_pan_tilt, &jacobian_ptz, &jacobian_ray);
+    }
+    
+    void panTilt2Point(const Eigen::Vector2d& pp,
+                       const Eigen::Vector3d& ptz,
+                       const vector<Eigen::Vector2d>& pan_tilt,
+                       vector<Eigen::Vector2d>& points,
+                       vector<Eigen::Matrix<double, 2, 3> > * jacobian_ptz,
+                       vector<Eigen::Matrix2d> * jacobian_ray)
+    {
+        const int n = (int)pan_tilt.size();
+        PanTiltProjector projector(pp, ptz);
+        points.resize(n);
+        if (jacobian_ptz != NULL) {
+            jacobian_ptz->resize(n);
+        }
+        if (jacobian_ray != NULL) {
+            jacobian_ray->resize(n);
+        }
+        for (int i = 0; i < n; i++) {
+            points[i] = projector.project(pan_tilt[i],
+                                          jacobian_ptz != NULL ? &(*jacobian_ptz)[i] : NULL,
+                                          jacobian_ray != NULL ? &(*jacobian_ray)[i] : NULL);
+        }
+    }
+    
     struct SphericalPanTiltFunctor
     {
         typedef double Scalar;
@@ -414,6 +520,9 @@ namespace cvx_pgl  {
         int m_inputs;
         int m_values;
         
+        mutable vector<Eigen::Vector2d> projected_points_;
+        mutable vector<Eigen::Matrix<double, 2, 3> > jacobians_;
+        
         SphericalPanTiltFunctor(const Eigen::Vector2d & pp,
                                 const vector<Eigen::Vector2d> & pan_tilt,
                                 const vector<Eigen::Vector2d> & image_point):
@@ -433,13 +542,22 @@ namespace cvx_pgl  {
             double fl = x[2];
             Eigen::Vector3d ptz(pan, tilt, fl);
             
-            // loop each points
+            // projection from spherical space to image space
+            panTilt2Point(pp_, ptz, pan_tilt_, projected_points_, NULL, NULL);
+            for (int i = 0; i<pan_tilt_.size(); i++) {
+                fx[2*i + 0] = image_point_[i].x() - projected_points_[i].x();
+                fx[2*i + 1] = image_point_[i].y() - projected_points_[i].y();
+            }
+            return 0;
+        }
+        
+        // analytic Jacobian, fx is image point - projection
+        int df(const Eigen::VectorXd &x, Eigen::MatrixXd &fjac) const
+        {
+            Eigen::Vector3d ptz(x[0], x[1], x[2]);
+            panTilt2Point(pp_, ptz, pan_tilt_, projected_points_, &jacobians_, NULL);
             for (int i = 0; i<pan_tilt_.size(); i++) {
-                Vector2d cur_pan_tilt = pan_tilt_[i];
-                // projection from spherical space to image space
-                Vector2d projected_pan_tilt = panTilt2Point(pp_, ptz, cur_pan_tilt);
-                fx[2*i + 0] = image_point_[i].x() - projected_pan_tilt.x();
-                fx[2*i + 1] = image_point_[i].y() - projected_pan_tilt.y();
+                fjac.block(2*i, 0, 2, 3) = -jacobians_[i];
             }
             return 0;
         }
@@ -451,13 +569,11 @@ namespace cvx_pgl  {
             double fl = x[2];
             Eigen::Vector3d ptz(pan, tilt, fl);
             
-            // loop each points
+            // projection from spherical space to image space
+            panTilt2Point(pp_, ptz, pan_tilt_, projected_points_, NULL, NULL);
             double avg_dist = 0.0;
             for (int i = 0; i<pan_tilt_.size(); i++) {
-                Vector2d cur_pan_tilt = pan_tilt_[i];
-                // projection from spherical space to image space
-                Vector2d projected_pan_tilt = panTilt2Point(pp_, ptz, cur_pan_tilt);
-                double dist = (image_point_[i] - projected_pan_tilt).norm();
+                double dist = (image_point_[i] - projected_points_[i]).norm();
                 avg_dist += dist;
             }
             return avg_dist/pan_tilt_.size();
@@ -479,8 +595,7 @@ namespace cvx_pgl  {
         
         // optimize pan, tilt and focal length
         SphericalPanTiltFunctor opt_functor(pp, pan_tilt, image_point);
-        Eigen::NumericalDiff<SphericalPanTiltFunctor> dif_functor(opt_functor);
-        Eigen::LevenbergMarquardt<Eigen::NumericalDiff<SphericalPanTiltFunctor>, double> lm(dif_functor);
+        Eigen::LevenbergMarquardt<SphericalPanTiltFunctor, double> lm(opt_functor);
         lm.parameters.ftol = 1e-6;
         lm.parameters.xtol = 1e-6;
         lm.parameters.maxfev = 500;
@@ -526,10 +641,16 @@ namespace cvx_pgl  {
         const ptz_camera base_camera_;   // camera with location and base rotation
         const int num_camera_;     // unknown
         const int num_landmark_;  // unknown
+        const Eigen::Vector2d pp_;
         
         int m_inputs;
         int m_values;
         
+        mutable vector<Eigen::Vector2d> landmarks_;
+        mutable vector<Eigen::Vector2d> projected_points_;
+        mutable vector<Eigen::Matrix<double, 2, 3> > jacobian_ptz_;
+        mutable vector<Eigen::Matrix2d> jacobian_ray_;
+        
         PTZBAFunctor(const vector<Observation>& image_observations,
                      const vector<Eigen::Vector2d>& reference_landmarks,
                      const ptz_camera& camera,
@@ -539,7 +660,8 @@ namespace cvx_pgl  {
         reference_landmarks_(reference_landmarks),
         base_camera_(camera),
         num_camera_(num_camera),
-        num_landmark_(num_landmark)
+        num_landmark_(num_landmark),
+        pp_(camera.principal_point())
         {
             m_inputs = 3 * num_camera + 2 * num_landmark;
             m_values = 0;
@@ -555,47 +677,72 @@ namespace cvx_pgl  {
         int operator()(const Eigen::VectorXd &x, Eigen::VectorXd &fx) const
         {
             assert(x.size() == 3 * num_camera_ + 2 * num_landmark_);
-            // step 1: generate ptz from x
-            vector<ptz_camera> cameras(num_camera_);
-            for(int i = 0; i<num_camera_; i++) {
-                cameras[i] = base_camera_;
-                double pan = x[i*3+0];
-                double tilt = x[i*3+1];
-                double fl = x[i*3+2];
-                Vector3d cur_ptz(pan, tilt, fl);
-                cameras[i].set_ptz(cur_ptz);
-            }
             
-            // step 2: get all landmarks
-            const int start_index = 3 * num_camera_;
-            vector<Eigen::Vector2d> landmarks = reference_landmarks_;
-            for(int i = 0; i<num_landmark_; i++) {
-                int j = start_index + i*2;
-                Eigen::Vector2d m(x[j], x[j+1]);
-                landmarks.push_back(m);
+            // reprojection error, one batch projection for each image
+            int index = 0;
+            for(int i = 0; i<image_observations_.size(); i++) {
+                const Observation& obs = image_observations_[i];
+                const vector<Eigen::Vector2d> & image_points = obs.image_points_;
+                Eigen::Vector3d ptz = x.segment(3 * obs.camera_index_, 3);
+                collectLandmarks(x, obs);
+                panTilt2Point(pp_, ptz, landmarks_, projected_points_, NULL, NULL);
+                for(int j = 0; j<image_points.size(); j++) {
+                    fx[2*index + 0] = image_points[j].x() - projected_points_[j].x();
+                    fx[2*index + 1] = image_points[j].y() - projected_points_[j].y();
+                    index++;
+                }
             }
+            assert(2 * index == m_values);
+            return 0;
+        }
+        
+        // analytic Jacobian, reference landmarks are fixed
+        int df(const Eigen::VectorXd &x, Eigen::MatrixXd &fjac) const
+        {
+            assert(x.size() == 3 * num_camera_ + 2 * num_landmark_);
             
-            // step 3: reprojection error
+            fjac.setZero();
+            const int start_index = 3 * num_camera_;
+            const int num_reference = (int)reference_landmarks_.size();
             int index = 0;
             for(int i = 0; i<image_observations_.size(); i++) {
                 const Observation& obs = image_observations_[i];
-                const ptz_camera& camera = cameras[obs.camera_index_];
                 const vector<int>& landmark_indices = obs.landmark_indices_;
-                const vector<Eigen::Vector2d> & image_points = obs.image_points_;
+                Eigen::Vector3d ptz = x.segment(3 * obs.camera_index_, 3);
+                collectLandmarks(x, obs);
+                panTilt2Point(pp_, ptz, landmarks_, projected_points_, &jacobian_ptz_, &jacobian_ray_);
                 for(int j = 0; j<landmark_indices.size(); j++) {
-                    Eigen::Vector2d lanmark = landmarks[landmark_indices[j]];
-                    Eigen::Vector2d p = image_points[j];
-                    Eigen::Vector2d q = camera.project(lanmark[0], lanmark[1]);
-                    
-                    fx[2*index + 0] = p.x() - q.x();
-                    fx[2*index + 1] = p.y() - q.y();
+                    fjac.block(2*index, 3 * obs.camera_index_, 2, 3) = -jacobian_ptz_[j];
+                    if (landmark_indices[j] >= num_reference) {
+                        int col = start_index + 2 * (landmark_indices[j] - num_reference);
+                        fjac.block(2*index, col, 2, 2) = -jacobian_ray_[j];
+                    }
                     index++;
                 }
             }
-            assert(index == m_values);
+            assert(2 * index == m_values);
             return 0;
         }
         
+        // landmarks of an image, known landmarks first, then unknown landmarks in x
+        void collectLandmarks(const Eigen::VectorXd &x, const Observation& obs) const
+        {
+            const int start_index = 3 * num_camera_;
+            const int num_reference = (int)reference_landmarks_.size();
+            const vector<int>& landmark_indices = obs.landmark_indices_;
+            landmarks_.resize(landmark_indices.size());
+            for(int j = 0; j<landmark_indices.size(); j++) {
+                const int l_idx = landmark_indices[j];
+                if (l_idx < num_reference) {
+                    landmarks_[j] = reference_landmarks_[l_idx];
+                }
+                else {
+                    int k = start_index + 2 * (l_idx - num_reference);
+                    landmarks_[j] = Eigen::Vector2d(x[k], x[k+1]);
+                }
+            }
+        }
+        
         int inputs() const { return m_inputs; }// inputs is the dimension of x.
         int values() const { return m_values; } // "values" is the number of f_i and
     };
@@ -657,8 +804,7 @@ namespace cvx_pgl  {
          */
         PTZBAFunctor opt_functor(image_observations, reference_landmarks, base_camera,
                                  num_camera, num_landmark);
-        Eigen::NumericalDiff<PTZBAFunctor> dif_functor(opt_functor);
-        Eigen::LevenbergMarquardt<Eigen::NumericalDiff<PTZBAFunctor>, double> lm(dif_functor);
+        Eigen::LevenbergMarquardt<PTZBAFunctor, double> lm(opt_functor);
         lm.parameters.ftol = 1e-6;
         lm.parameters.xtol = 1e-6;
         lm.parameters.maxfev = 500;
@@ -666,7 +812,15 @@ namespace cvx_pgl  {
         Eigen::LevenbergMarquardtSpace::Status status = lm.minimize(x);
         //printf("LMQ status %d\n", status);
         
-       
+        refined_ptzs = init_ptzs;
+        for (int i = 0; i<num_camera; i++) {
+            refined_ptzs[i].set_ptz(Vector3d(x[i*3+0], x[i*3+1], x[i*3+2]));
+        }
+        refined_landmmarks.resize(num_landmark);
+        for (int i = 0; i<num_landmark; i++) {
+            int j = start_index + 2*i;
+            refined_landmmarks[i] = Eigen::Vector2d(x[j], x[j+1]);
+        }
         return true;
     }
 
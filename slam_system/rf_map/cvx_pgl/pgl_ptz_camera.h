@@ -58,6 +58,7 @@ namespace cvx_pgl {
         double tilt(void) const { return ptz_[1]; }
         double focal_length(void) const{ return ptz_[2];}
         Vector3d ptz(void) const { return ptz_; }
+        Vector2d principal_point(void) const { return pp_; }
         
         
         // project pan tilt ray to (x, y)
@@ -92,6 +93,7 @@ namespace cvx_pgl {
     Eigen::Matrix3d matrixFromTiltX(double tilt);
     
     // ptz: ptz of the camera
+    // return: pan in (-180, 180], tilt in (-90, 90), degree
     Eigen::Vector2d point2PanTilt(const Eigen::Vector2d& pp,
                                   const Eigen::Vector3d& ptz,
                                   const Eigen::Vector2d& point);
@@ -100,6 +102,25 @@ namespace cvx_pgl {
                                   const Eigen::Vector3d& ptz,
                                   const Eigen::Vector2d& pan_tilt);
     
+    // projection and its analytic Jacobians, angles in degree
+    // jacobian_ptz: 2 x 3, d(x, y)/d(pan, tilt, focal length) of the camera
+    // jacobian_ray: 2 x 2, d(x, y)/d(pan, tilt) of the ray
+    Eigen::Vector2d panTilt2Point(const Eigen::Vector2d& pp,
+                                  const Eigen::Vector3d& ptz,
+                                  const Eigen::Vector2d& pan_tilt,
+                                  Eigen::Matrix<double, 2, 3> & jacobian_ptz,
+                                  Eigen::Matrix2d & jacobian_ray);
+    
+    // batch projection, rotation of the camera is computed once for all rays
+    // points: projection of each ray
+    // jacobian_ptz, jacobian_ray: Jacobians of each ray, can be NULL
+    void panTilt2Point(const Eigen::Vector2d& pp,
+                       const Eigen::Vector3d& ptz,
+                       const vector<Eigen::Vector2d>& pan_tilt,
+                       vector<Eigen::Vector2d>& points,
+                       vector<Eigen::Matrix<double, 2, 3> > * jacobian_ptz,
+                       vector<Eigen::Matrix2d> * jacobian_ray);
+    
     // optimize pan, tilt and focal length by minimizing re-projection error
     // return: mean reprojection error
     double optimizePTZ(const Eigen::Vector2d & pp,
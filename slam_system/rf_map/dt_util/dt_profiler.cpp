@@ -0,0 +1,128 @@
+//
+//  dt_profiler.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-21.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#include "dt_profiler.hpp"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+namespace {
+    bool enabledFromEnvironment()
+    {
+        const char * value = getenv("RF_MAP_PROFILE");
+        return value != NULL && strcmp(value, "0") != 0 && strlen(value) > 0;
+    }
+    
+    const char * kStageNames[DTProfiler::STAGE_NUM] = {
+        "load", "predict", "candidate_filter", "hypothesis", "preemptive_round",
+        "lm_refine", "tree_build", "save", "relocalize"
+    };
+    
+    const char * kCounterNames[DTProfiler::COUNTER_NUM] = {
+        "keypoint", "candidate", "hypothesis", "inlier", "relocalize_fail", "tree", "tree_query"
+    };
+}
+
+std::atomic<bool> DTProfiler::enabled_(enabledFromEnvironment());
+std::atomic<int64_t> DTProfiler::stage_counts_[DTProfiler::STAGE_NUM];
+std::atomic<int64_t> DTProfiler::stage_total_ns_[DTProfiler::STAGE_NUM];
+std::atomic<int64_t> DTProfiler::stage_max_ns_[DTProfiler::STAGE_NUM];
+std::atomic<int64_t> DTProfiler::counters_[DTProfiler::COUNTER_NUM];
+
+void DTProfiler::setEnabled(bool enabled)
+{
+    enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+void DTProfiler::reset()
+{
+    for (int i = 0; i<STAGE_NUM; i++) {
+        stage_counts_[i].store(0, std::memory_order_relaxed);
+        stage_total_ns_[i].store(0, std::memory_order_relaxed);
+        stage_max_ns_[i].store(0, std::memory_order_relaxed);
+    }
+    for (int i = 0; i<COUNTER_NUM; i++) {
+        counters_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void DTProfiler::addTime(Stage stage, int64_t nanoseconds)
+{
+    assert(stage >= 0 && stage < STAGE_NUM);
+    stage_counts_[stage].fetch_add(1, std::memory_order_relaxed);
+    stage_total_ns_[stage].fetch_add(nanoseconds, std::memory_order_relaxed);
+    int64_t cur_max = stage_max_ns_[stage].load(std::memory_order_relaxed);
+    while (nanoseconds > cur_max &&
+           !stage_max_ns_[stage].compare_exchange_weak(cur_max, nanoseconds, std::memory_order_relaxed)) {
+    }
+}
+
+void DTProfiler::stageStatistics(Stage stage, int64_t & count, double & total_ms, double & max_ms)
+{
+    assert(stage >= 0 && stage < STAGE_NUM);
+    count = stage_counts_[stage].load(std::memory_order_relaxed);
+    total_ms = stage_total_ns_[stage].load(std::memory_order_relaxed) / 1.0e6;
+    max_ms = stage_max_ns_[stage].load(std::memory_order_relaxed) / 1.0e6;
+}
+
+int64_t DTProfiler::counterValue(Counter counter)
+{
+    assert(counter >= 0 && counter < COUNTER_NUM);
+    return counters_[counter].load(std::memory_order_relaxed);
+}
+
+const char * DTProfiler::stageName(Stage stage)
+{
+    assert(stage >= 0 && stage < STAGE_NUM);
+    return kStageNames[stage];
+}
+
+const char * DTProfiler::counterName(Counter counter)
+{
+    assert(counter >= 0 && counter < COUNTER_NUM);
+    return kCounterNames[counter];
+}
+
+std::string DTProfiler::toJSON()
+{
+    std::string json;
+    char buf[512] = {'\0'};
+    snprintf(buf, sizeof(buf), "{\"enabled\": %s, \"stages\": {", isEnabled() ? "true" : "false");
+    json += buf;
+    for (int i = 0; i<STAGE_NUM; i++) {
+        int64_t count = 0;
+        double total_ms = 0.0;
+        double max_ms = 0.0;
+        stageStatistics((Stage)i, count, total_ms, max_ms);
+        double mean_ms = count > 0 ? total_ms/count : 0.0;
+        snprintf(buf, sizeof(buf), "%s\"%s\": {\"count\": %lld, \"total_ms\": %.6f, \"mean_ms\": %.6f, \"max_ms\": %.6f}",
+                 i == 0 ? "" : ", ", kStageNames[i], (long long)count, total_ms, mean_ms, max_ms);
+        json += buf;
+    }
+    json += "}, \"counters\": {";
+    for (int i = 0; i<COUNTER_NUM; i++) {
+        snprintf(buf, sizeof(buf), "%s\"%s\": %lld",
+                 i == 0 ? "" : ", ", kCounterNames[i], (long long)counterValue((Counter)i));
+        json += buf;
+    }
+    json += "}}";
+    return json;
+}
+
+bool DTProfiler::saveJSON(const char * file_name)
+{
+    assert(file_name);
+    FILE *pf = fopen(file_name, "w");
+    if (!pf) {
+        printf("Error: can not write to %s\n", file_name);
+        return false;
+    }
+    fprintf(pf, "%s\n", toJSON().c_str());
+    fclose(pf);
+    return true;
+}
@@ -0,0 +1,122 @@
+//
+//  dt_profiler.hpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-21.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef dt_profiler_hpp
+#define dt_profiler_hpp
+
+// wall time of hot-path stages and event counters
+// process wide, thread safe, disabled by default
+// enable with DTProfiler::setEnabled(true) or environment variable RF_MAP_PROFILE=1
+// a disabled timer costs one relaxed atomic load
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+class DTProfiler
+{
+public:
+    enum Stage {
+        LOAD = 0,           // read model, feature and label files
+        PREDICT,            // forest prediction of all keypoints in a frame
+        CANDIDATE_FILTER,   // collect keypoints that have candidate pan, tilt
+        HYPOTHESIS,         // camera hypotheses from two points
+        PREEMPTIVE_ROUND,   // score hypotheses and remove half of them
+        LM_REFINE,          // Levenberg-Marquardt refinement of a hypothesis
+        TREE_BUILD,         // build or update a tree
+        SAVE,               // write model files
+        RELOCALIZE,         // whole relocalization of a frame
+        STAGE_NUM
+    };
+    
+    enum Counter {
+        KEYPOINT = 0,       // keypoints in relocalization
+        CANDIDATE,          // keypoints that have candidate pan, tilt
+        HYPOTHESIS_NUM,     // generated camera hypotheses
+        INLIER,             // inliers of estimated cameras
+        RELOCALIZE_FAIL,    // failed relocalization
+        TREE_NUM,           // built or updated trees
+        TREE_QUERY,         // trees queried in relocalization, sum over keypoints
+        COUNTER_NUM
+    };
+    
+    static inline bool isEnabled()
+    {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+    static void setEnabled(bool enabled);
+    
+    // set all timers and counters to zero
+    static void reset();
+    
+    static void addTime(Stage stage, int64_t nanoseconds);
+    
+    static inline void addCount(Counter counter, int64_t value = 1)
+    {
+        if (isEnabled()) {
+            counters_[counter].fetch_add(value, std::memory_order_relaxed);
+        }
+    }
+    
+    // count: number of timed scopes, total_ms and max_ms in milliseconds
+    static void stageStatistics(Stage stage, int64_t & count, double & total_ms, double & max_ms);
+    static int64_t counterValue(Counter counter);
+    
+    static const char * stageName(Stage stage);
+    static const char * counterName(Counter counter);
+    
+    // {"enabled": true, "stages": {"predict": {"count": 1, "total_ms": 2.0, "mean_ms": 2.0, "max_ms": 2.0}, ...},
+    //  "counters": {"keypoint": 100, ...}}
+    static std::string toJSON();
+    static bool saveJSON(const char * file_name);
+    
+private:
+    static std::atomic<bool> enabled_;
+    static std::atomic<int64_t> stage_counts_[STAGE_NUM];
+    static std::atomic<int64_t> stage_total_ns_[STAGE_NUM];
+    static std::atomic<int64_t> stage_max_ns_[STAGE_NUM];
+    static std::atomic<int64_t> counters_[COUNTER_NUM];
+};
+
+// time a scope, e.g.
+// {
+//     DTScopedTimer timer(DTProfiler::PREDICT);
+//     ...
+// }
+class DTScopedTimer
+{
+    typedef std::chrono::steady_clock Clock;
+    
+    DTProfiler::Stage stage_;
+    bool enabled_;
+    Clock::time_point start_;
+    
+public:
+    explicit DTScopedTimer(DTProfiler::Stage stage)
+    {
+        stage_ = stage;
+        enabled_ = DTProfiler::isEnabled();
+        if (enabled_) {
+            start_ = Clock::now();
+        }
+    }
+    
+    ~DTScopedTimer()
+    {
+        if (enabled_) {
+            DTProfiler::addTime(stage_, std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_).count());
+        }
+    }
+    
+private:
+    DTScopedTimer(const DTScopedTimer & other);
+    DTScopedTimer & operator = (const DTScopedTimer & other);
+};
+
+#endif /* dt_profiler_hpp */
@@ -7,39 +7,36 @@
 //
 
 #include "dt_random.hpp"
-#include "vnl_random.h"
 #include <cassert>
 
 
 DTRandom::DTRandom()
 {
-    rnd_generator_ = new vnl_random();
+    
+}
+
+DTRandom::DTRandom(uint64_t seed):rnd_generator_(seed)
+{
+    
 }
 
 DTRandom::~DTRandom()
 {
-    if (rnd_generator_) {
-        delete rnd_generator_;
-        rnd_generator_ = NULL;
-    }
+    
 }
 
 double DTRandom::getRandomNumber(const double min_v, const double max_v) const
 {
-    assert(rnd_generator_);
-    return rnd_generator_->drand32(min_v, max_v);
+    return rnd_generator_.uniform(min_v, max_v);
 }
 
 vector<double> DTRandom::getRandomNumbers(const double min_v, const double max_v, int num) const
 {
-    assert(rnd_generator_);
-    
     assert(min_v < max_v);
     
-    vector<double> values;
+    vector<double> values(num);
     for (int i = 0; i<num; i++) {
-        double v = rnd_generator_->drand32(min_v, max_v);
-        values.push_back(v);
+        values[i] = rnd_generator_.uniform(min_v, max_v);
     }
     return values;
 }
@@ -49,18 +46,7 @@ void DTRandom::outofBagSample(const unsigned int N,
                     vector<integerT> & bootstrapped,
                     vector<integerT> & outof_bag)
 {
-    vector<bool> isPicked(N, false);
-    for (int i = 0; i<N; i++) {
-        integerT idx = rnd_generator_->lrand32(0, N-1);
-        bootstrapped.push_back(idx);
-        isPicked[idx] = true;
-    }
-    
-    for (int i = 0; i<N; i++) {
-        if (!isPicked[i]) {
-            outof_bag.push_back(i);
-        }
-    }
+    DTRandom::outofBagSampling(N, bootstrapped, outof_bag, rnd_generator_);
 }
 
 template <class integerT>
@@ -68,11 +54,19 @@ void DTRandom::outofBagSampling(const unsigned int N,
                                   vector<integerT> & bootstrapped,
                                   vector<integerT> & outof_bag)
 {
-    vnl_random rnd;
-    
+    DTRandom::outofBagSampling(N, bootstrapped, outof_bag, DTRng::threadDefault());
+}
+
+template <class integerT>
+void DTRandom::outofBagSampling(const unsigned int N,
+                                vector<integerT> & bootstrapped,
+                                vector<integerT> & outof_bag,
+                                DTRng & rng)
+{
     vector<bool> isPicked(N, false);
+    bootstrapped.reserve(bootstrapped.size() + N);
     for (int i = 0; i<N; i++) {
-        integerT idx = rnd.lrand32(0, N-1);
+        integerT idx = rng.uniformInt(N);
         bootstrapped.push_back(idx);
         isPicked[idx] = true;
     }
@@ -86,14 +80,18 @@ void DTRandom::outofBagSampling(const unsigned int N,
 
 vector<double>
 DTRandom::generateRandomNumber(const double min_v, const double max_v, int num)
+{
+    return DTRandom::generateRandomNumber(min_v, max_v, num, DTRng::threadDefault());
+}
+
+vector<double>
+DTRandom::generateRandomNumber(const double min_v, const double max_v, int num, DTRng & rng)
 {
     assert(min_v < max_v);
     
-    vector<double> values;
-    vnl_random rnd;
+    vector<double> values(num);
     for (int i = 0; i<num; i++) {
-        double v = rnd.drand32(min_v, max_v);
-        values.push_back(v);
+        values[i] = rng.uniform(min_v, max_v);
     }
     return values;
 }
@@ -103,8 +101,7 @@ double
 DTRandom::randomNumber(const double min_v, const double max_v)
 {
     assert(min_v < max_v);
-    vnl_random rnd;
-    return rnd.drand32(min_v, max_v);
+    return DTRng::threadDefault().uniform(min_v, max_v);
 }
  */
 
@@ -122,3 +119,15 @@ template
 void DTRandom::outofBagSampling(const unsigned int N,
                                 vector<unsigned int> & bootstrapped,
                                 vector<unsigned int> & outof_bag);
+
+template
+void DTRandom::outofBagSampling(const unsigned int N,
+                                vector<int> & bootstrapped,
+                                vector<int> & outof_bag,
+                                DTRng & rng);
+
+template
+void DTRandom::outofBagSampling(const unsigned int N,
+                                vector<unsigned int> & bootstrapped,
+                                vector<unsigned int> & outof_bag,
+                                DTRng & rng);
@@ -6,17 +6,18 @@
 #define __Classifer_RF__DTRandom__
 
 #include <stdio.h>
+#include <stdint.h>
 #include <vector>
+#include "dt_rng.hpp"
 
 using std::vector;
 
-class vnl_random;
-
 class DTRandom
 {
-    vnl_random* rnd_generator_;
+    mutable DTRng rnd_generator_;
 public:
     DTRandom();
+    explicit DTRandom(uint64_t seed);
     ~DTRandom();
     
     double getRandomNumber(const double min_v, const double max_v) const;
@@ -30,16 +31,26 @@ public:
     
     
 public:
-    // out of bagging sampling, the random number generator is related to the machine time
+    // out of bagging sampling
+    // rng: random number generator, DTRng::threadDefault() if not provided
     template <class integerT>
     static void outofBagSampling(const unsigned int N,
                                    vector<integerT> & bootstrapped,
                                    vector<integerT> & outof_bag);
     
+    template <class integerT>
+    static void outofBagSampling(const unsigned int N,
+                                 vector<integerT> & bootstrapped,
+                                 vector<integerT> & outof_bag,
+                                 DTRng & rng);
+    
     
     static vector<double>
     generateRandomNumber(const double min_v, const double max_v, int num);
     
+    static vector<double>
+    generateRandomNumber(const double min_v, const double max_v, int num, DTRng & rng);
+    
     // generate one random number
     //static double randomNumber(const double min_v, const double max_v);
     
@@ -0,0 +1,66 @@
+//
+//  dt_rng.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-20.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#include "dt_rng.hpp"
+#include <atomic>
+
+namespace {
+    // expand a 64 bit seed to the 256 bit state
+    inline uint64_t splitMix64(uint64_t & x)
+    {
+        uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+}
+
+DTRng::DTRng(uint64_t seed, uint64_t stream)
+{
+    this->seed(seed, stream);
+}
+
+void DTRng::seed(uint64_t seed, uint64_t stream)
+{
+    uint64_t x = seed;
+    for (int i = 0; i<4; i++) {
+        s_[i] = splitMix64(x);
+    }
+    for (uint64_t i = 0; i<stream; i++) {
+        this->jump();
+    }
+}
+
+void DTRng::jump()
+{
+    static const uint64_t JUMP[] = { 0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                                     0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+    uint64_t s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (int i = 0; i<4; i++) {
+        for (int b = 0; b<64; b++) {
+            if (JUMP[i] & (1ULL << b)) {
+                s0 ^= s_[0];
+                s1 ^= s_[1];
+                s2 ^= s_[2];
+                s3 ^= s_[3];
+            }
+            this->next();
+        }
+    }
+    s_[0] = s0;
+    s_[1] = s1;
+    s_[2] = s2;
+    s_[3] = s3;
+}
+
+DTRng & DTRng::threadDefault()
+{
+    static std::atomic<uint64_t> thread_count(0);
+    thread_local DTRng rng(0, thread_count++);
+    return rng;
+}
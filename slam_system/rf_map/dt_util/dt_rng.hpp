@@ -0,0 +1,104 @@
+//
+//  dt_rng.hpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-20.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef dt_rng_hpp
+#define dt_rng_hpp
+
+// fast, seedable random number generator (xoshiro256**)
+// http://xoshiro.di.unimi.it
+// one generator per thread (or per tree), never shared between threads
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+#include <algorithm>
+
+class DTRng
+{
+    uint64_t s_[4];
+
+public:
+    typedef uint64_t result_type;
+
+    // seed: same seed produces the same sequence
+    // stream: independent sub-sequence of the seed, e.g., tree index or thread index
+    explicit DTRng(uint64_t seed = 0, uint64_t stream = 0);
+
+    void seed(uint64_t seed, uint64_t stream = 0);
+
+    // equivalent to 2^128 calls to next(), used to create non-overlapping streams
+    void jump();
+
+    // UniformRandomBitGenerator interface, e.g. std::shuffle(first, last, rng)
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT64_MAX; }
+    result_type operator()() { return next(); }
+
+    inline uint64_t next()
+    {
+        const uint64_t result = rotl(s_[1] * 5, 7) * 9;
+        const uint64_t t = s_[1] << 17;
+        s_[2] ^= s_[0];
+        s_[3] ^= s_[1];
+        s_[1] ^= s_[2];
+        s_[0] ^= s_[3];
+        s_[2] ^= t;
+        s_[3] = rotl(s_[3], 45);
+        return result;
+    }
+
+    // uniform integer in [0, n), n > 0
+    // Lemire's multiply-shift, no modulo
+    inline uint32_t uniformInt(uint32_t n)
+    {
+        assert(n > 0);
+        return (uint32_t)(((next() >> 32) * (uint64_t)n) >> 32);
+    }
+
+    // uniform real number in [0, 1)
+    inline double uniform()
+    {
+        return (next() >> 11) * (1.0/9007199254740992.0);
+    }
+
+    // uniform real number in [min_v, max_v)
+    inline double uniform(double min_v, double max_v)
+    {
+        return min_v + (max_v - min_v) * uniform();
+    }
+
+    // randomly select (middle - first) elements and move them to [first, middle)
+    // O(middle - first), the order of [middle, last) is not defined
+    template <class RandomIt>
+    void partialShuffle(RandomIt first, RandomIt middle, RandomIt last)
+    {
+        const uint32_t n = (uint32_t)(last - first);
+        const uint32_t m = (uint32_t)(middle - first);
+        for (uint32_t i = 0; i < m && i + 1 < n; i++) {
+            uint32_t j = i + uniformInt(n - i);
+            std::iter_swap(first + i, first + j);
+        }
+    }
+
+    template <class RandomIt>
+    void shuffle(RandomIt first, RandomIt last)
+    {
+        partialShuffle(first, last, last);
+    }
+
+    // generator for the calling thread
+    // each thread gets its own stream of the default seed
+    static DTRng & threadDefault();
+
+private:
+    static inline uint64_t rotl(const uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+};
+
+#endif /* dt_rng_hpp */
@@ -0,0 +1,97 @@
+//
+//  dt_spsc_queue.hpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-31.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef dt_spsc_queue_hpp
+#define dt_spsc_queue_hpp
+
+// bounded lock free queue of one producer thread and one consumer thread
+// push and pop never block, they fail if the queue is full or empty
+#include <stdio.h>
+#include <assert.h>
+#include <stddef.h>
+#include <vector>
+#include <atomic>
+#include <utility>
+
+template <class T>
+class DTSPSCQueue
+{
+    // an index and the owner's copy of the other index, padded to its own cache line
+    struct Index
+    {
+        char padding_[64];
+        std::atomic<size_t> index_;
+        size_t cached_other_;
+    };
+    
+    std::vector<T> buffer_;     // capacity + 1 slots, one slot is always empty
+    const size_t size_;
+    Index head_;                // next pop, written by the consumer
+    Index tail_;                // next push, written by the producer
+
+public:
+    explicit DTSPSCQueue(size_t capacity):
+    buffer_(capacity + 1), size_(capacity + 1)
+    {
+        assert(capacity > 0);
+        head_.index_.store(0, std::memory_order_relaxed);
+        head_.cached_other_ = 0;
+        tail_.index_.store(0, std::memory_order_relaxed);
+        tail_.cached_other_ = 0;
+    }
+    
+    // producer thread
+    // return: false if the queue is full, value is not moved
+    bool push(T & value)
+    {
+        const size_t tail = tail_.index_.load(std::memory_order_relaxed);
+        const size_t next = tail + 1 == size_ ? 0 : tail + 1;
+        if (next == tail_.cached_other_) {
+            tail_.cached_other_ = head_.index_.load(std::memory_order_acquire);
+            if (next == tail_.cached_other_) {
+                return false;
+            }
+        }
+        buffer_[tail] = std::move(value);
+        tail_.index_.store(next, std::memory_order_release);
+        return true;
+    }
+    
+    // consumer thread
+    // return: false if the queue is empty
+    bool pop(T & value)
+    {
+        const size_t head = head_.index_.load(std::memory_order_relaxed);
+        if (head == head_.cached_other_) {
+            head_.cached_other_ = tail_.index_.load(std::memory_order_acquire);
+            if (head == head_.cached_other_) {
+                return false;
+            }
+        }
+        value = std::move(buffer_[head]);
+        head_.index_.store(head + 1 == size_ ? 0 : head + 1, std::memory_order_release);
+        return true;
+    }
+    
+    // approximate if the other thread is running
+    size_t size() const
+    {
+        const size_t head = head_.index_.load(std::memory_order_acquire);
+        const size_t tail = tail_.index_.load(std::memory_order_acquire);
+        return tail >= head ? tail - head : tail + size_ - head;
+    }
+    
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return size_ - 1; }
+
+private:
+    DTSPSCQueue(const DTSPSCQueue & other);
+    DTSPSCQueue & operator = (const DTSPSCQueue & other);
+};
+
+#endif /* dt_spsc_queue_hpp */
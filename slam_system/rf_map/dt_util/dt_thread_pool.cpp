@@ -0,0 +1,116 @@
+//
+//  dt_thread_pool.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-20.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#include "dt_thread_pool.hpp"
+#include <assert.h>
+#include <algorithm>
+
+DTThreadPool::DTThreadPool(int thread_num)
+{
+    func_ = NULL;
+    n_ = 0;
+    generation_ = 0;
+    pending_ = 0;
+    stop_ = false;
+    
+    if (thread_num < 1) {
+        printf("Warning: thread number %d, changed to 1\n", thread_num);
+        thread_num = 1;
+    }
+    for (int i = 1; i<thread_num; i++) {
+        workers_.push_back(std::thread(&DTThreadPool::workerLoop, this, i));
+    }
+}
+
+DTThreadPool::~DTThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    start_cond_.notify_all();
+    for (int i = 0; i<workers_.size(); i++) {
+        workers_[i].join();
+    }
+}
+
+void DTThreadPool::parallelFor(int n, const RangeFunction & func)
+{
+    if (n <= 0) {
+        return;
+    }
+    if (workers_.empty()) {
+        func(0, 0, n);
+        return;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        assert(pending_ == 0);
+        func_ = &func;
+        n_ = n;
+        pending_ = (int)workers_.size();
+        generation_++;
+    }
+    start_cond_.notify_all();
+    
+    int begin = 0;
+    int end = 0;
+    this->range(n, 0, begin, end);
+    if (begin < end) {
+        func(0, begin, end);
+    }
+    
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cond_.wait(lock, [this]{ return pending_ == 0; });
+    func_ = NULL;
+}
+
+void DTThreadPool::workerLoop(int thread_id)
+{
+    uint64_t generation = 0;
+    while (true) {
+        const RangeFunction * func = NULL;
+        int n = 0;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_cond_.wait(lock, [&]{ return stop_ || generation_ != generation; });
+            if (stop_) {
+                return;
+            }
+            generation = generation_;
+            func = func_;
+            n = n_;
+        }
+        
+        int begin = 0;
+        int end = 0;
+        this->range(n, thread_id, begin, end);
+        if (begin < end) {
+            (*func)(thread_id, begin, end);
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_--;
+            if (pending_ == 0) {
+                done_cond_.notify_one();
+            }
+        }
+    }
+}
+
+void DTThreadPool::range(int n, int thread_id, int & begin, int & end) const
+{
+    const int thread_num = this->threadNum();
+    const int step = n / thread_num;
+    const int remainder = n % thread_num;
+    // the first remainder threads have one more element
+    begin = thread_id * step + std::min(thread_id, remainder);
+    end = begin + step + (thread_id < remainder ? 1 : 0);
+}
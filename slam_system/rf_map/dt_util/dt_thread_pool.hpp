@@ -0,0 +1,60 @@
+//
+//  dt_thread_pool.hpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-20.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef dt_thread_pool_hpp
+#define dt_thread_pool_hpp
+
+// fixed size thread pool for data parallel loops
+// threads are created once and wait between calls
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+using std::vector;
+
+class DTThreadPool
+{
+public:
+    // func(thread_id, begin, end)
+    typedef std::function<void (int, int, int)> RangeFunction;
+    
+    // thread_num: including the calling thread, 1 means no worker thread
+    explicit DTThreadPool(int thread_num = 1);
+    ~DTThreadPool();
+    
+    int threadNum() const { return (int)workers_.size() + 1; }
+    
+    // split [0, n) into threadNum() contiguous ranges and run them in parallel
+    // the calling thread runs thread_id 0, blocks until all ranges are done
+    // not reentrant: one parallelFor at a time
+    void parallelFor(int n, const RangeFunction & func);
+    
+private:
+    DTThreadPool(const DTThreadPool & other);
+    DTThreadPool & operator = (const DTThreadPool & other);
+    
+    void workerLoop(int thread_id);
+    void range(int n, int thread_id, int & begin, int & end) const;
+    
+    vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable start_cond_;
+    std::condition_variable done_cond_;
+    
+    const RangeFunction * func_;  // current task
+    int n_;
+    uint64_t generation_;         // increased by each parallelFor
+    int pending_;                 // number of workers that have not finished
+    bool stop_;
+};
+
+#endif /* dt_thread_pool_hpp */
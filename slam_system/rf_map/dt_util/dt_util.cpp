@@ -7,6 +7,7 @@
 //
 
 #include "dt_util.hpp"
+#include "dt_rng.hpp"
 #include <Eigen/QR>
 #include <iostream>
 #include <map>
@@ -17,7 +18,7 @@ using std::map;
 
 namespace dt {
     template< class T>
-    vector<T> randomDimension(const T dim, const T num)
+    vector<T> randomDimension(const T dim, const T num, DTRng & rng)
     {
         assert(dim > 0);
         assert(num > 0);
@@ -27,7 +28,11 @@ namespace dt {
         for (T i = 0; i<dim; i++) {
             dims.push_back(i);
         }
-        std::random_shuffle(dims.begin(), dims.end());
+        // partial Fisher-Yates shuffle, only the first num dimensions are needed
+        for (T i = 0; i<num; i++) {
+            T j = i + (T)rng.uniformInt((uint32_t)(dim - i));
+            std::swap(dims[i], dims[j]);
+        }
         vector<T> random_dim(dims.begin(), dims.begin() + num);
         assert(random_dim.size() > 0 && random_dim.size() <= dims.size());
         
@@ -212,7 +217,7 @@ namespace dt {
         return idx;
     }
     
-    template vector<int> randomDimension(int dim, int num);
+    template vector<int> randomDimension(int dim, int num, DTRng & rng);
     
     template void meanStd(const vector<Eigen::VectorXd> & labels, Eigen::VectorXd & mean, Eigen::VectorXd & sigma);
     template void meanStd(const vector<Eigen::Vector3d> & labels, Eigen::Vector3d & mean, Eigen::Vector3d & sigma);
@@ -241,7 +246,7 @@ namespace dt {
 
 
 
-vector<unsigned int> DTUtil::randomDimensions(const int dimension, const int candidate_dimension)
+vector<unsigned int> DTUtil::randomDimensions(const int dimension, const int candidate_dimension, DTRng & rng)
 {
     assert(dimension > 0);
     assert(candidate_dimension > 0);
@@ -251,7 +256,11 @@ vector<unsigned int> DTUtil::randomDimensions(const int dimension, const int can
     for (unsigned int i = 0; i<dimension; i++) {
         dims.push_back(i);
     }
-    std::random_shuffle(dims.begin(), dims.end());
+    // partial Fisher-Yates shuffle, only the first candidate_dimension dimensions are needed
+    for (unsigned int i = 0; i<candidate_dimension; i++) {
+        unsigned int j = i + rng.uniformInt(dimension - i);
+        std::swap(dims[i], dims[j]);
+    }
     vector<unsigned int> random_dim(dims.begin(), dims.begin() + candidate_dimension);
     assert(random_dim.size() > 0 && random_dim.size() <= dims.size());
     
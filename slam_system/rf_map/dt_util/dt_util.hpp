@@ -24,10 +24,12 @@ using Eigen::VectorXi;
 
 using std::vector;
 
+class DTRng;
+
 namespace dt {
-    // randomly generate a subset of dimensions
+    // randomly generate a subset of dimensions, reproducible with the seed of rng
     template<class intType>
-    vector<intType> randomDimension(const intType dim, const intType num);
+    vector<intType> randomDimension(const intType dim, const intType num, DTRng & rng);
     
     template <class intType>
     vector<intType> range(int start, int end, int step)
@@ -73,8 +75,8 @@ namespace dt {
 class DTUtil
 {
 public:
-    // randomly generate a subset of dimensions
-    static vector<unsigned int> randomDimensions(const int dimension, const int ccandidate_dimension);
+    // randomly generate a subset of dimensions, reproducible with the seed of rng
+    static vector<unsigned int> randomDimensions(const int dimension, const int ccandidate_dimension, DTRng & rng);
     
     template <class T>
     static double spatialVariance(const vector<T> & labels, const vector<unsigned int> & indices);
@@ -7,6 +7,7 @@
 //
 
 #include "mat_io.hpp"
+#include "dt_profiler.hpp"
 #ifdef __cplusplus
 extern "C" {
     #include "matio.h"
@@ -16,91 +17,200 @@ extern "C" {
 }
 #endif  // closing brace for extern "C"
 
+#include <algorithm>
+#include <type_traits>
+
 using Eigen::Matrix;
+using std::string;
+using std::vector;
 
 namespace matio {
     
-    template<class matrixT>
-    bool readMatrix(const char *file_name, const char *var_name, matrixT & mat_data, bool verbose)
+    MatReader::MatReader(const char *file_name)
     {
         assert(file_name);
-        assert(var_name);
+        DTScopedTimer timer(DTProfiler::LOAD);
         
-        mat_t    *matfp = NULL;
-        matvar_t *matvar = NULL;
-        bool is_read = false;
-        
-        matfp = Mat_Open(file_name, MAT_ACC_RDONLY);
-        if ( NULL == matfp ) {
+        file_name_ = string(file_name);
+        matfp_ = Mat_Open(file_name, MAT_ACC_RDONLY);
+        if ( NULL == matfp_ ) {
             printf("Error: opening MAT file \"%s\"!\n", file_name);
+        }
+    }
+    
+    MatReader::~MatReader()
+    {
+        for (auto it = variables_.begin(); it != variables_.end(); it++) {
+            Mat_VarFree(it->second);
+        }
+        variables_.clear();
+        if (matfp_ != NULL) {
+            Mat_Close(matfp_);
+            matfp_ = NULL;
+        }
+    }
+    
+    bool MatReader::read(const vector<string>& var_names)
+    {
+        DTScopedTimer timer(DTProfiler::LOAD);
+        return this->readVariables(var_names);
+    }
+    
+    template<class Scalar>
+    bool MatReader::mapMatrix(const char *var_name,
+                              Eigen::Map<const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> > & data)
+    {
+        typedef Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> MatrixType;
+        typedef Eigen::Map<const MatrixType> MapType;
+        assert(var_name);
+        DTScopedTimer timer(DTProfiler::LOAD);
+        
+        matvar_t *matvar = this->matrixVariable(var_name);
+        if (matvar == NULL) {
             return false;
         }
-        matvar = Mat_VarRead(matfp, var_name);
-        if ( NULL == matvar ) {
-            printf("Error: Variable %s not found, or error reading MAT file",
-                    var_name);
+        const long rows = (long)matvar->dims[0];
+        const long cols = (long)matvar->dims[1];
+        const matio_types file_type = std::is_same<Scalar, double>::value ? MAT_T_DOUBLE : MAT_T_SINGLE;
+        
+        // placement new changes the mapped array, see Eigen::Map
+        if (matvar->data_type == file_type) {
+            new (&data) MapType((const Scalar *)matvar->data, rows, cols);
+            return true;
         }
-        if (matvar->rank != 2) {
-            printf("Error: Variable %s is not a matrix!\n", var_name);
+        
+        MatrixType & converted = this->convertedData(string(var_name), Scalar());
+        if (converted.size() == 0 && rows * cols > 0) {
+            if (matvar->data_type == MAT_T_DOUBLE) {
+                converted = ConstMapXd((const double *)matvar->data, rows, cols).cast<Scalar>();
+            }
+            else {
+                converted = ConstMapXf((const float *)matvar->data, rows, cols).cast<Scalar>();
+            }
+        }
+        new (&data) MapType(converted.data(), rows, cols);
+        return true;
+    }
+    
+    template<class matrixT>
+    bool MatReader::readMatrix(const char *var_name, matrixT & mat_data, bool verbose)
+    {
+        typedef typename matrixT::Scalar Scalar;
+        assert(var_name);
+        DTScopedTimer timer(DTProfiler::LOAD);
+        
+        matvar_t *matvar = this->matrixVariable(var_name);
+        if (matvar == NULL) {
+            return false;
+        }
+        const long rows = (long)matvar->dims[0];
+        const long cols = (long)matvar->dims[1];
+        
+        // one pass, no conversion if the types are the same
+        if (matvar->data_type == MAT_T_DOUBLE) {
+            mat_data = ConstMapXd((const double *)matvar->data, rows, cols).cast<Scalar>();
         }
         else {
-            size_t rows = matvar->dims[0];
-            size_t cols = matvar->dims[1];
-            void *data = matvar->data;
-            assert(data);
-            matio_types data_type = matvar->data_type;
-            
-            switch (data_type) {
-                case MAT_T_DOUBLE:
-                {
-                    mat_data = matrixT::Zero(rows, cols);
-                    // colum wise
-                    double *pdata = (double *)data;
-                    // copy data
-                    for (int c = 0; c<cols; c++ ) {
-                        double * p = &pdata[c * rows];
-                        for (int r = 0; r<rows; r++) {
-                            mat_data(r, c) = p[r];
-                        }
-                    }
-                    is_read = true;
-                }                    
-                break;
-                    
-                case MAT_T_SINGLE:
-                {
-                    mat_data = matrixT::Zero(rows, cols);
-                    float *pdata = (float *)data;
-                    // copy data
-                    for (int c = 0; c<cols; c++ ) {
-                        float * p = &pdata[c * rows];
-                        for (int r = 0; r<rows; r++) {
-                            mat_data(r, c) = p[r];
-                        }
-                    }
-
-                    is_read = true;
-                }
-                break;
-                    
-                default:
-                    printf("Error: non-supported data type\n");
+            mat_data = ConstMapXf((const float *)matvar->data, rows, cols).cast<Scalar>();
+        }
+        if (verbose) {
+            printf("read a %ld x %ld matrix named %s. \n", (long)mat_data.rows(), (long)mat_data.cols(), var_name);
+        }
+        return true;
+    }
+    
+    bool MatReader::readVariables(const vector<string>& var_names)
+    {
+        if (matfp_ == NULL) {
+            return false;
+        }
+        
+        vector<string> missing;
+        for (const string & name: var_names) {
+            if (variables_.find(name) == variables_.end() &&
+                std::find(missing.begin(), missing.end(), name) == missing.end()) {
+                missing.push_back(name);
+            }
+        }
+        
+        if (missing.size() == 1) {
+            matvar_t *matvar = Mat_VarRead(matfp_, missing[0].c_str());
+            if (matvar != NULL) {
+                variables_[missing[0]] = matvar;
+                missing.clear();
+            }
+        }
+        else if (missing.size() > 1) {
+            // one pass of the file, Mat_VarRead searches from the beginning for each variable
+            Mat_Rewind(matfp_);
+            while (!missing.empty()) {
+                matvar_t *matvar = Mat_VarReadNext(matfp_);
+                if (matvar == NULL) {
                     break;
+                }
+                auto it = matvar->name == NULL ? missing.end() :
+                          std::find(missing.begin(), missing.end(), string(matvar->name));
+                if (it != missing.end()) {
+                    variables_[*it] = matvar;
+                    missing.erase(it);
+                }
+                else {
+                    Mat_VarFree(matvar);
+                }
             }
         }
         
-        // free data
-        if (matvar != NULL) {
-            Mat_VarFree(matvar);
-            matvar = NULL;
+        for (const string & name: missing) {
+            printf("Error: Variable %s not found, or error reading MAT file %s\n",
+                   name.c_str(), file_name_.c_str());
+        }
+        return missing.empty();
+    }
+    
+    matvar_t * MatReader::matrixVariable(const char *var_name)
+    {
+        auto it = variables_.find(string(var_name));
+        if (it == variables_.end()) {
+            if (!this->readVariables(vector<string>(1, string(var_name)))) {
+                return NULL;
+            }
+            it = variables_.find(string(var_name));
+        }
+        matvar_t *matvar = it->second;
+        assert(matvar);
+        if (matvar->rank != 2) {
+            printf("Error: Variable %s is not a matrix!\n", var_name);
+            return NULL;
         }
-        if (matfp != NULL) {
-            Mat_Close(matfp);
+        if (matvar->data_type != MAT_T_DOUBLE && matvar->data_type != MAT_T_SINGLE) {
+            printf("Error: non-supported data type\n");
+            return NULL;
         }
-        if (is_read && verbose) {
-            printf("read a %ld x %ld matrix named %s. \n", mat_data.rows(), mat_data.cols(), var_name);
+        assert(matvar->data || matvar->dims[0] * matvar->dims[1] == 0);
+        return matvar;
+    }
+    
+    Eigen::MatrixXd & MatReader::convertedData(const string & var_name, double)
+    {
+        return double_data_[var_name];
+    }
+    
+    Eigen::MatrixXf & MatReader::convertedData(const string & var_name, float)
+    {
+        return float_data_[var_name];
+    }
+    
+    template<class matrixT>
+    bool readMatrix(const char *file_name, const char *var_name, matrixT & mat_data, bool verbose)
+    {
+        assert(file_name);
+        assert(var_name);
+        
+        MatReader reader(file_name);
+        if (!reader.isOpen()) {
+            return false;
         }
-        return is_read;
+        return reader.readMatrix(var_name, mat_data, verbose);
     }
     
     template<class matrixT>
@@ -111,83 +221,16 @@ namespace matio {
         assert(var_names.size() > 0);
         assert(data.size() == 0);
         
-        mat_t    *matfp = NULL;
-        matfp = Mat_Open(file_name, MAT_ACC_RDONLY);
-        if ( NULL == matfp ) {
-            printf("Error: opening MAT file \"%s\"!\n", file_name);
+        MatReader reader(file_name);
+        if (!reader.isOpen()) {
             return false;
         }
-        
+        reader.read(var_names);
         for (int i = 0; i<var_names.size(); i++) {
-            bool is_read = false;
-            const char* var_name = var_names[i].c_str();
             matrixT mat_data;
-            
-            matvar_t *matvar = Mat_VarRead(matfp, var_name);
-            if ( NULL == matvar ) {
-                printf("Error: Variable %s not found, or error reading MAT file",
-                       var_name);
-            }
-            if (matvar->rank != 2) {
-                printf("Error: Variable %s is not a matrix!\n", var_name);
-            }
-            else {
-                size_t rows = matvar->dims[0];
-                size_t cols = matvar->dims[1];
-                void *data = matvar->data;
-                assert(data);
-                matio_types data_type = matvar->data_type;
-                
-                switch (data_type) {
-                    case MAT_T_DOUBLE:
-                    {
-                        mat_data = matrixT::Zero(rows, cols);
-                        // colum wise
-                        double *pdata = (double *)data;
-                        // copy data
-                        for (int c = 0; c<cols; c++ ) {
-                            double * p = &pdata[c * rows];
-                            for (int r = 0; r<rows; r++) {
-                                mat_data(r, c) = p[r];
-                            }
-                        }
-                        is_read = true;
-                    }
-                        break;
-                        
-                    case MAT_T_SINGLE:
-                    {
-                        mat_data = matrixT::Zero(rows, cols);
-                        float *pdata = (float *)data;
-                        // copy data
-                        for (int c = 0; c<cols; c++ ) {
-                            float * p = &pdata[c * rows];
-                            for (int r = 0; r<rows; r++) {
-                                mat_data(r, c) = p[r];
-                            }
-                        }
-                        
-                        is_read = true;
-                    }
-                        break;
-                        
-                    default:
-                        printf("Error: non-supported data type\n");
-                        break;
-                }
-            }
-            // free data
-            if (matvar != NULL) {
-                Mat_VarFree(matvar);
-                matvar = NULL;
+            if (reader.readMatrix(var_names[i].c_str(), mat_data, verbose)) {
+                data[var_names[i]] = mat_data;
             }
-            if (is_read && verbose) {
-                printf("read a %ld x %ld matrix named %s. \n", mat_data.rows(), mat_data.cols(), var_name);
-            }
-            data[var_names[i]] = mat_data;
-        }
-        if (matfp != NULL) {
-            Mat_Close(matfp);
         }
         return data.size() == var_names.size();
     }
@@ -300,6 +343,21 @@ namespace matio {
         return is_write;
     }
     
+    template
+    bool MatReader::mapMatrix(const char *var_name, ConstMapXd & data);
+    
+    template
+    bool MatReader::mapMatrix(const char *var_name, ConstMapXf & data);
+    
+    template
+    bool MatReader::readMatrix(const char *var_name, Eigen::MatrixXd & mat_data, bool verbose);
+    
+    template
+    bool MatReader::readMatrix(const char *var_name, Eigen::MatrixXf & mat_data, bool verbose);
+    
+    template
+    bool MatReader::readMatrix(const char *var_name, Eigen::MatrixXi & mat_data, bool verbose);
+    
     template
     bool readMatrix(const char *file_name, const char *var_name, Eigen::MatrixXd& mat_data, bool verbose);
    
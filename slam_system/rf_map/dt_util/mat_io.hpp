@@ -17,8 +17,60 @@
 #include <unordered_map>
 
 
+struct _mat_t;
+struct matvar_t;
+
 namespace matio {
     
+    typedef Eigen::Map<const Eigen::MatrixXd> ConstMapXd;
+    typedef Eigen::Map<const Eigen::MatrixXf> ConstMapXf;
+    
+    // a reader session of one .mat file
+    // the file is opened once, variables are decoded once and kept in matio's buffer
+    // e.g., keypoint, descriptor and ptz of a keyframe in one pass of the file
+    class MatReader
+    {
+        _mat_t * matfp_;
+        std::string file_name_;
+        std::unordered_map<std::string, matvar_t *> variables_;        // decoded variables
+        std::unordered_map<std::string, Eigen::MatrixXd> double_data_; // converted variables
+        std::unordered_map<std::string, Eigen::MatrixXf> float_data_;
+    
+    public:
+        explicit MatReader(const char *file_name);
+        ~MatReader();
+        
+        bool isOpen() const { return matfp_ != NULL; }
+        
+        // decode variables in one pass, decoded variables are skipped
+        // return: true if all variables are found
+        bool read(const std::vector<std::string>& var_names);
+        
+        // no copy view of a double or single matrix, column major
+        // Scalar: double or float, a variable of the other type is converted once
+        // data: valid until the reader is destroyed, e.g., matio::ConstMapXf data(NULL, 0, 0)
+        // the variable is decoded if it is not read
+        template<class Scalar>
+        bool mapMatrix(const char *var_name,
+                       Eigen::Map<const Eigen::Matrix<Scalar, Eigen::Dynamic, Eigen::Dynamic> > & data);
+        
+        // copy, support Eigen::MatrixXd, Eigen::MatrixXf and Eigen::MatrixXi
+        template<class matrixT>
+        bool readMatrix(const char *var_name, matrixT & data, bool verbose = true);
+    
+    private:
+        bool readVariables(const std::vector<std::string>& var_names);
+        
+        // a decoded double or single matrix, NULL if not found
+        matvar_t * matrixVariable(const char *var_name);
+        
+        Eigen::MatrixXd & convertedData(const std::string & var_name, double);
+        Eigen::MatrixXf & convertedData(const std::string & var_name, float);
+        
+        MatReader(const MatReader & other);
+        MatReader & operator = (const MatReader & other);
+    };
+    
     // suppport Eigen::MatrixXd, Eigen::MatrixXf and Eigen::MatrixXi
     template<class matrixT>
     bool readMatrix(const char *file_name, const char *var_name, matrixT & data, bool verbose = true);
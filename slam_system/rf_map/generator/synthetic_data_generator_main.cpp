@@ -0,0 +1,52 @@
+//
+//  synthetic_data_generator_main.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-31.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+// synthetic training data for scaling tests of RFMapBuilder and OnlineRFMapBuilder
+// usage: synthetic_data_generator parameter.txt output_folder feature_label_file.txt [sequence_file.txt]
+// sequence_file: camera trajectory in the format of readSequenceData, a random trajectory if not given
+#include <stdio.h>
+#include <string>
+#include <chrono>
+#include "ptz_synthetic_generator.h"
+
+int main(int argc, const char * argv[])
+{
+    if (argc < 4) {
+        printf("usage: %s parameter_file output_folder feature_label_file [sequence_file]\n", argv[0]);
+        return -1;
+    }
+    const char * parameter_file = argv[1];
+    const char * output_folder = argv[2];
+    const char * feature_label_file = argv[3];
+    
+    PTZSyntheticGeneratorParameter param;
+    if (!param.readFromFile(parameter_file)) {
+        return -1;
+    }
+    param.printSelf();
+    
+    PTZSyntheticGenerator generator(param);
+    vector<Eigen::Vector3d> ptzs;
+    if (argc >= 5) {
+        vector<string> files;
+        vector<Eigen::Vector3f> sequence_ptzs;
+        btdtr_ptz_util::readSequenceData(argv[4], "", files, sequence_ptzs);
+        for (int i = 0; i < sequence_ptzs.size(); i++) {
+            ptzs.push_back(sequence_ptzs[i].cast<double>());
+        }
+    }
+    else {
+        generator.generateTrajectory(ptzs);
+    }
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    long long sample_num = generator.writeSequence(ptzs, output_folder, feature_label_file);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%lld samples, cost time %f seconds\n", sample_num, seconds);
+    return sample_num > 0 ? 0 : -1;
+}
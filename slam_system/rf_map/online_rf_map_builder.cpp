@@ -10,13 +10,18 @@
 #include "dt_util.hpp"
 #include <iostream>
 #include <unordered_set>
+#include <algorithm>
+#include <climits>
 #include "mat_io.hpp"
+#include "dt_profiler.hpp"
 
 using namespace::std;
 
 OnlineRFMapBuilder::OnlineRFMapBuilder()
 {
-    
+    keyframe_num_ = 0;
+    random_seed_ = 0;
+    rng_.seed(random_seed_);
 }
 
 OnlineRFMapBuilder::~OnlineRFMapBuilder()
@@ -30,62 +35,145 @@ void OnlineRFMapBuilder::setTreeParameter(const TreeParameter& param)
     tree_param_.base_tree_param_.tree_num_ = 0; // initialization
 }
 
+void OnlineRFMapBuilder::setRandomSeed(uint64_t seed)
+{
+    random_seed_ = seed;
+    rng_.seed(seed);
+}
+
+void OnlineRFMapBuilder::setBudget(const OnlineRFMapBudget & budget)
+{
+    assert(budget.max_tree_num_ >= 0);
+    assert(budget.max_tree_keyframe_num_ >= 0);
+    budget_ = budget;
+}
+
+int OnlineRFMapBuilder::addKeyframe(const string & feature_label_file)
+{
+    auto it = file_keyframe_index_.find(feature_label_file);
+    if (it != file_keyframe_index_.end()) {
+        return it->second;
+    }
+    
+    const Eigen::Vector2f pp(tree_param_.pp_x_, tree_param_.pp_y_);
+    vector<btdtr_ptz_util::PTZTrainingSample> samples;
+    Eigen::Vector3f dummy_ptz;  // not used
+    btdtr_ptz_util::generatePTZSampleWithFeature(feature_label_file.c_str(), pp, dummy_ptz, samples);
+    
+    const int index = keyframe_num_;
+    keyframe_num_++;
+    KeyframeSample& keyframe = keyframes_[index];
+    keyframe.features_.reserve(samples.size());
+    keyframe.labels_.reserve(samples.size());
+    for (const auto& s: samples) {
+        keyframe.features_.push_back(s.descriptor_);
+        keyframe.labels_.push_back(s.pan_tilt_);
+    }
+    keyframe.frame_index_ = index;
+    file_keyframe_index_[feature_label_file] = index;
+    return index;
+}
+
+int OnlineRFMapBuilder::addKeyframe(const float* keypoints,
+                                    const float* descriptors,
+                                    const int n,
+                                    const int descriptor_dim,
+                                    const Eigen::Vector3f& ptz,
+                                    const int64_t frame_index)
+{
+    const Eigen::Vector2f pp(tree_param_.pp_x_, tree_param_.pp_y_);
+    vector<btdtr_ptz_util::PTZTrainingSample> samples;
+    btdtr_ptz_util::generatePTZSample(keypoints, descriptors, n, descriptor_dim, pp, ptz, samples);
+    
+    const int index = keyframe_num_;
+    keyframe_num_++;
+    KeyframeSample& keyframe = keyframes_[index];
+    keyframe.features_.reserve(samples.size());
+    keyframe.labels_.reserve(samples.size());
+    for (const auto& s: samples) {
+        keyframe.features_.push_back(s.descriptor_);
+        keyframe.labels_.push_back(s.pan_tilt_);
+    }
+    keyframe.frame_index_ = frame_index >= 0 ? frame_index : index;
+    return index;
+}
+
+void OnlineRFMapBuilder::collectSamples(const vector<int> & keyframe_indices,
+                                        vector<VectorXf> & features,
+                                        vector<VectorXf> & labels) const
+{
+    size_t num = 0;
+    for (int index: keyframe_indices) {
+        assert(keyframes_.find(index) != keyframes_.end());
+        num += keyframes_.at(index).features_.size();
+    }
+    features.reserve(features.size() + num);
+    labels.reserve(labels.size() + num);
+    for (int index: keyframe_indices) {
+        const KeyframeSample& keyframe = keyframes_.at(index);
+        features.insert(features.end(), keyframe.features_.begin(), keyframe.features_.end());
+        labels.insert(labels.end(), keyframe.labels_.begin(), keyframe.labels_.end());
+    }
+    assert(features.size() == labels.size());
+}
+
 bool OnlineRFMapBuilder::addTree(BTDTRegressor& model,
                               const string & feature_label_file,
                               const char *model_file_name,
                               bool verbose)
 {
-    // 1. get unique files
-    unordered_set<string> all_files;
-    for (const auto& files: tree_feature_label_files_) {
-        for (const string& f:files) {
-            all_files.insert(f);
+    const int keyframe_index = this->addKeyframe(feature_label_file);
+    return this->addTree(model, keyframe_index, model_file_name, verbose);
+}
+
+bool OnlineRFMapBuilder::addTree(BTDTRegressor& model,
+                                 const int keyframe_index,
+                                 const char *model_file_name,
+                                 bool verbose)
+{
+    assert(keyframes_.find(keyframe_index) != keyframes_.end());
+    
+    // 1. get unique keyframes
+    unordered_set<int> all_keyframes;
+    for (const auto& indices: tree_keyframe_indices_) {
+        for (int index: indices) {
+            all_keyframes.insert(index);
         }
     }
-    vector<string> unique_files;
-    for (const auto&f: all_files) {
-        unique_files.push_back(f);
-    }
+    all_keyframes.erase(keyframe_index);
+    vector<int> unique_keyframes(all_keyframes.begin(), all_keyframes.end());
+    std::sort(unique_keyframes.begin(), unique_keyframes.end());
     
-    // 2. sample training files
-    const int frame_num = (int)unique_files.size();
+    // 2. sample training keyframes
+    const int frame_num = (int)unique_keyframes.size();
     const int sampled_frame_num = std::min(frame_num, tree_param_.sampled_frame_num_) - 1;
-    vector<string> sampled_files;
+    vector<int> sampled_keyframes;
     for (int j = 0; j<sampled_frame_num; j++) {
-        int index = rand()%frame_num;
-        sampled_files.push_back(unique_files[index]);
+        int index = rng_.uniformInt(frame_num);
+        sampled_keyframes.push_back(unique_keyframes[index]);
     }
-    sampled_files.push_back(feature_label_file);
+    sampled_keyframes.push_back(keyframe_index);
     
-    return this->addTree(model, sampled_files, model_file_name, verbose);
+    return this->addTree(model, sampled_keyframes, model_file_name, verbose);
 }
 
 bool OnlineRFMapBuilder::addTree(BTDTRegressor& model,
-                              const vector<string> & feature_label_files,
+                              const vector<int> & keyframe_indices,
                               const char *model_file_name,
                               bool verbose)
 {
-    assert(feature_label_files.size() > 0);
-    assert(model.trees_.size() == tree_feature_label_files_.size());
+    assert(keyframe_indices.size() > 0);
+    assert(model.trees_.size() == tree_keyframe_indices_.size());
     
-    // book keep feature label files
+    // book keep keyframes
     tree_param_.base_tree_param_.tree_num_ += 1;
-    tree_feature_label_files_.push_back(feature_label_files);
+    tree_keyframe_indices_.push_back(keyframe_indices);
     model.reg_tree_param_ = tree_param_.base_tree_param_;
     
-    // 1. read training examples
-    const Eigen::Vector2f pp(tree_param_.pp_x_, tree_param_.pp_y_);
+    // 1. collect training examples
     vector<VectorXf> features;
     vector<VectorXf> labels;
-    for (int j = 0; j<feature_label_files.size(); j++) {
-        vector<btdtr_ptz_util::PTZTrainingSample> samples;
-        Eigen::Vector3f dummy_ptz;  // not used
-        btdtr_ptz_util::generatePTZSampleWithFeature(feature_label_files[j].c_str(), pp, dummy_ptz, samples);
-        for (int k = 0; k< samples.size(); k++) {
-            features.push_back(samples[k].descriptor_);
-            labels.push_back(samples[k].pan_tilt_);
-        }
-    }
+    this->collectSamples(keyframe_indices, features, labels);
     
     assert(features.size() == labels.size());
     
@@ -96,17 +184,17 @@ bool OnlineRFMapBuilder::addTree(BTDTRegressor& model,
     
     TreePtr pTree = new TreeType();
     assert(pTree);
-    double tt = clock();
-    pTree->buildTree(features, labels, indices, tree_param_.base_tree_param_);
-    
-    
-    if (verbose) {
-        printf("build a tree cost %lf seconds\n", (clock()-tt)/CLOCKS_PER_SEC );
+    pTree->setRandomGenerator(DTRng(random_seed_, model.trees_.size() + 1));
+    {
+        DTScopedTimer timer(DTProfiler::TREE_BUILD);
+        pTree->buildTree(features, labels, indices, tree_param_.base_tree_param_);
     }
+    DTProfiler::addCount(DTProfiler::TREE_NUM);
     
     // 3. update model
     model.trees_.push_back(pTree);
     assert(model.trees_.size() == model.reg_tree_param_.tree_num_);
+    this->applyBudget(model, verbose);
     
     if (model_file_name != NULL) {
         model.saveModel(model_file_name);
@@ -119,12 +207,10 @@ bool OnlineRFMapBuilder::addTree(BTDTRegressor& model,
     if (verbose) {
         vector<Eigen::VectorXf> errors;
         for (int k = 0; k< features.size(); k++) {
-            Eigen::VectorXf feat = features[k];
-            Eigen::VectorXf label = labels[k];
             Eigen::VectorXf pred;
             float dist = 0.0f;
-            pTree->predict(feat, 1, pred, dist);
-            errors.push_back(pred - label);
+            pTree->predict(features[k], 1, pred, dist);
+            errors.push_back(pred - labels[k]);
         }
         
         Eigen::VectorXf q1_error, q2_error, q3_error;
@@ -134,43 +220,50 @@ bool OnlineRFMapBuilder::addTree(BTDTRegressor& model,
         cout<<"Training third quartile error: \n"<<q3_error.transpose()<<endl<<endl;
     }
     
-    
-    //this->validationError(model, feature_label_files, 1);
     return true;
 }
 
 bool OnlineRFMapBuilder::updateTree(BTDTRegressor& model,
-                                    
                                     const string & feature_label_file,
                                     const char *model_file_name,
                                     bool verbose)
+{
+    const int keyframe_index = this->addKeyframe(feature_label_file);
+    return this->updateTree(model, keyframe_index, model_file_name, verbose);
+}
+
+bool OnlineRFMapBuilder::updateTree(BTDTRegressor& model,
+                                    const int keyframe_index,
+                                    const char *model_file_name,
+                                    bool verbose)
 {
     assert(model.trees_.size() > 0);
+    assert(keyframes_.find(keyframe_index) != keyframes_.end());
     
-    const int tree_index = rand()%model.trees_.size();
+    const int tree_index = rng_.uniformInt((uint32_t)model.trees_.size());
     
-    // add new file to book-keeper
-    tree_feature_label_files_[tree_index].push_back(feature_label_file);
+    // add new keyframe to book-keeper
+    vector<int>& tree_keyframes = tree_keyframe_indices_[tree_index];
+    tree_keyframes.push_back(keyframe_index);
+    if (budget_.max_tree_keyframe_num_ > 0) {
+        // the oldest keyframe leaves the tree
+        this->removeOldestKeyframes(tree_keyframes, budget_.max_tree_keyframe_num_);
+    }
     const int tree_num = model.treeNum();
     assert(tree_index < tree_num);
     
-    // 1. read training examples
-    const Eigen::Vector2f pp(tree_param_.pp_x_, tree_param_.pp_y_);
+    // 1. collect training examples
     vector<VectorXf> features;
     vector<VectorXf> labels;
-    for (int j = 0; j<tree_feature_label_files_[tree_index].size(); j++) {
-        vector<btdtr_ptz_util::PTZTrainingSample> samples;
-        Eigen::Vector3f dummy_ptz;  // not used
-        btdtr_ptz_util::generatePTZSampleWithFeature(tree_feature_label_files_[tree_index][j].c_str(),
-                                                     pp, dummy_ptz, samples);
-        for (int k = 0; k< samples.size(); k++) {
-            features.push_back(samples[k].descriptor_);
-            labels.push_back(samples[k].pan_tilt_);
-        }
+    this->collectSamples(tree_keyframe_indices_[tree_index], features, labels);
+    if (features.empty()) {
+        // e.g., keyframes without keypoints, the tree is not changed
+        printf("Warning: no example for tree %d, update is skipped.\n", tree_index);
+        this->applyBudget(model, verbose);
+        return false;
     }
-    assert(features.size() == labels.size());
     
-    // 1. update the tree
+    // 2. update the tree
     vector<unsigned int> indices = DTUtil::range<unsigned int>(0, (int)features.size(), 1);
     assert(indices.size() == features.size());
     model.feature_dim_ = (int)features[0].size();
@@ -178,9 +271,12 @@ bool OnlineRFMapBuilder::updateTree(BTDTRegressor& model,
     
     TreePtr pTree = model.trees_[tree_index];
     assert(pTree);
-    double tt = clock();
-    pTree->updateTree(features, labels, indices, tree_param_.base_tree_param_);
-    printf("update a tree cost %lf seconds\n", (clock()-tt)/CLOCKS_PER_SEC );
+    {
+        DTScopedTimer timer(DTProfiler::TREE_BUILD);
+        pTree->updateTree(features, labels, indices, tree_param_.base_tree_param_, budget_.isLimited());
+    }
+    DTProfiler::addCount(DTProfiler::TREE_NUM);
+    this->applyBudget(model, verbose);
     
     if (model_file_name != NULL) {
         model.saveModel(model_file_name);
@@ -198,9 +294,12 @@ bool OnlineRFMapBuilder::validationError(const BTDTRegressor & model,
     const Eigen::Vector2f pp(tree_param_.pp_x_, tree_param_.pp_y_);
     
     const int max_check = 4;
+    // rng_ uses stream 0 and trees count up from stream 1, the last stream is not used in training
+    const uint64_t validation_stream = UINT64_MAX;
+    DTRng rng(random_seed_, validation_stream);
     // sample from selected frames
     for (int i = 0; i<sample_frame_num; i++) {
-        int index = rand()%sample_frame_num;
+        int index = rng.uniformInt(sample_frame_num);
         string feature_file_name = ptz_keypoint_descriptor_files[index];
         vector<btdtr_ptz_util::PTZTrainingSample> samples;
         Eigen::Vector3f dummy_ptz;
@@ -240,9 +339,18 @@ bool OnlineRFMapBuilder::isAddTree(const BTDTRegressor & model,
                                          const string & feature_label_file,
                                          const double error_threshold,
                                          const double percentage_threshold)
+{
+    const int keyframe_index = this->addKeyframe(feature_label_file);
+    return this->isAddTree(model, keyframe_index, error_threshold, percentage_threshold);
+}
+
+bool OnlineRFMapBuilder::isAddTree(const BTDTRegressor & model,
+                                   const int keyframe_index,
+                                   const double error_threshold,
+                                   const double percentage_threshold)
 {
     vector<float> errors;
-    this->computePredictionError(model, feature_label_file, errors);
+    this->computePredictionError(model, keyframe_index, errors);
     
     double ratio = 0;
     for (const auto& e:errors) {
@@ -261,21 +369,12 @@ bool OnlineRFMapBuilder::isAddTree(const BTDTRegressor & model,
 }
 
 void OnlineRFMapBuilder::computePredictionError(const BTDTRegressor & model,
-                                               const string & feature_label_file,
-                                               vector<float> & prediction_error)
+                                               const int keyframe_index,
+                                               vector<float> & prediction_error) const
 {
-    // 1. read training examples
-    const Eigen::Vector2f pp(tree_param_.pp_x_, tree_param_.pp_y_);
-    vector<VectorXf> features;
-    vector<VectorXf> labels;
-    vector<btdtr_ptz_util::PTZTrainingSample> samples;
-    
-    Eigen::Vector3f dummy_ptz;  // not used
-    btdtr_ptz_util::generatePTZSampleWithFeature(feature_label_file.c_str(), pp, dummy_ptz, samples);
-    for (const auto &s:samples) {
-        features.push_back(s.descriptor_);
-        labels.push_back(s.pan_tilt_);
-    }    
+    assert(keyframes_.find(keyframe_index) != keyframes_.end());
+    const vector<VectorXf>& features = keyframes_.at(keyframe_index).features_;
+    const vector<VectorXf>& labels = keyframes_.at(keyframe_index).labels_;
     assert(features.size() == labels.size());
     
     // use a pre-trained the model to select new examples
@@ -292,4 +391,175 @@ void OnlineRFMapBuilder::computePredictionError(const BTDTRegressor & model,
     }
 }
 
+void OnlineRFMapBuilder::applyBudget(BTDTRegressor& model, bool verbose)
+{
+    assert(model.trees_.size() == tree_keyframe_indices_.size());
+    
+    // 1. merge the most overlapped pair of trees, at most one merge per call
+    if (budget_.merge_overlap_ratio_ > 0.0 && model.trees_.size() >= 2) {
+        const int tree_num = (int)tree_keyframe_indices_.size();
+        vector<vector<int> > keyframe_sets(tree_num);
+        for (int i = 0; i<tree_num; i++) {
+            keyframe_sets[i] = tree_keyframe_indices_[i];
+            std::sort(keyframe_sets[i].begin(), keyframe_sets[i].end());
+            keyframe_sets[i].erase(std::unique(keyframe_sets[i].begin(), keyframe_sets[i].end()),
+                                   keyframe_sets[i].end());
+        }
+        
+        int best_i = -1, best_j = -1;
+        double best_ratio = budget_.merge_overlap_ratio_;
+        vector<int> common;
+        for (int i = 0; i<tree_num; i++) {
+            for (int j = i+1; j<tree_num; j++) {
+                common.clear();
+                std::set_intersection(keyframe_sets[i].begin(), keyframe_sets[i].end(),
+                                      keyframe_sets[j].begin(), keyframe_sets[j].end(),
+                                      std::back_inserter(common));
+                const double union_num = keyframe_sets[i].size() + keyframe_sets[j].size() - common.size();
+                const double ratio = common.size()/union_num;
+                if (ratio >= best_ratio) {
+                    best_ratio = ratio;
+                    best_i = i;
+                    best_j = j;
+                }
+            }
+        }
+        
+        if (best_i != -1) {
+            // keep the newest keyframes
+            vector<int> merged;
+            std::set_union(keyframe_sets[best_i].begin(), keyframe_sets[best_i].end(),
+                           keyframe_sets[best_j].begin(), keyframe_sets[best_j].end(),
+                           std::back_inserter(merged));
+            if (budget_.max_tree_keyframe_num_ > 0) {
+                this->removeOldestKeyframes(merged, budget_.max_tree_keyframe_num_);
+            }
+            tree_keyframe_indices_[best_i] = merged;
+            this->retrainTree(model, best_i);
+            this->retireTree(model, best_j);
+            if (verbose) {
+                printf("merged tree %d into tree %d, keyframe overlap %.2f\n", best_j, best_i, best_ratio);
+            }
+        }
+    }
+    
+    // 2. retire stale trees, a tree is as fresh as its newest keyframe (frame index)
+    while (budget_.max_tree_num_ > 0 && model.trees_.size() > budget_.max_tree_num_) {
+        int stale_index = 0;
+        int64_t stale_frame = LLONG_MAX;
+        for (int i = 0; i<tree_keyframe_indices_.size(); i++) {
+            int64_t newest = -1;
+            for (int index: tree_keyframe_indices_[i]) {
+                newest = std::max(newest, keyframes_.at(index).frame_index_);
+            }
+            if (newest < stale_frame) {
+                stale_frame = newest;
+                stale_index = i;
+            }
+        }
+        this->retireTree(model, stale_index);
+        if (verbose) {
+            printf("retired tree %d, newest frame %lld\n", stale_index, (long long)stale_frame);
+        }
+    }
+    
+    // 3. release training examples
+    this->releaseKeyframes();
+    assert(model.trees_.size() == model.reg_tree_param_.tree_num_);
+}
+
+void OnlineRFMapBuilder::retireTree(BTDTRegressor& model, const int tree_index)
+{
+    assert(tree_index >= 0 && tree_index < model.trees_.size());
+    assert(model.trees_.size() == tree_keyframe_indices_.size());
+    
+    delete model.trees_[tree_index];
+    model.trees_.erase(model.trees_.begin() + tree_index);
+    
+    tree_keyframe_indices_.erase(tree_keyframe_indices_.begin() + tree_index);
+    
+    tree_param_.base_tree_param_.tree_num_ -= 1;
+    model.reg_tree_param_.tree_num_ = tree_param_.base_tree_param_.tree_num_;
+}
 
+void OnlineRFMapBuilder::retrainTree(BTDTRegressor& model, const int tree_index)
+{
+    assert(tree_index >= 0 && tree_index < model.trees_.size());
+    
+    vector<VectorXf> features;
+    vector<VectorXf> labels;
+    this->collectSamples(tree_keyframe_indices_[tree_index], features, labels);
+    if (features.empty()) {
+        // the tree is kept as it is, a tree without example is never trained
+        printf("Warning: no example for tree %d, retrain is skipped.\n", tree_index);
+        return;
+    }
+    
+    vector<unsigned int> indices = DTUtil::range<unsigned int>(0, (int)features.size(), 1);
+    TreePtr pTree = model.trees_[tree_index];
+    assert(pTree);
+    {
+        DTScopedTimer timer(DTProfiler::TREE_BUILD);
+        pTree->updateTree(features, labels, indices, tree_param_.base_tree_param_, budget_.isLimited());
+    }
+    DTProfiler::addCount(DTProfiler::TREE_NUM);
+}
+
+void OnlineRFMapBuilder::removeOldestKeyframes(vector<int> & keyframe_indices, const int max_num) const
+{
+    assert(max_num > 0);
+    if (keyframe_indices.size() <= max_num) {
+        return;
+    }
+    
+    // frame index of the max_num-th newest keyframe, ties are broken by the keyframe index
+    vector<std::pair<int64_t, int> > times;
+    for (int index: keyframe_indices) {
+        times.push_back(std::make_pair(keyframes_.at(index).frame_index_, index));
+    }
+    const int num = (int)times.size() - max_num;
+    std::nth_element(times.begin(), times.begin() + num, times.end());
+    const std::pair<int64_t, int> threshold = times[num];
+    
+    vector<int> kept_indices;
+    for (int index: keyframe_indices) {
+        if (std::make_pair(keyframes_.at(index).frame_index_, index) >= threshold) {
+            kept_indices.push_back(index);
+        }
+    }
+    keyframe_indices.swap(kept_indices);
+}
+
+void OnlineRFMapBuilder::releaseKeyframes()
+{
+    unordered_set<int> used_keyframes;
+    for (const auto& indices: tree_keyframe_indices_) {
+        used_keyframes.insert(indices.begin(), indices.end());
+    }
+    
+    // dropped from trees, retired with a tree or never used by a tree
+    unordered_set<int> released_keyframes;
+    for (auto it = keyframes_.begin(); it != keyframes_.end(); ) {
+        if (used_keyframes.find(it->first) == used_keyframes.end()) {
+            // no entry is left, indices of the other keyframes are not changed
+            released_keyframes.insert(it->first);
+            it = keyframes_.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    if (released_keyframes.empty()) {
+        return;
+    }
+    
+    // a released file is read again if it is added again
+    for (auto it = file_keyframe_index_.begin(); it != file_keyframe_index_.end(); ) {
+        if (released_keyframes.find(it->second) != released_keyframes.end()) {
+            it = file_keyframe_index_.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
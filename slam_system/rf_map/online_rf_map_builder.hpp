@@ -12,8 +12,31 @@
 #include <stdio.h>
 #include <Eigen/Dense>
 #include <string>
+#include <unordered_map>
 #include "bt_dt_regressor.h"
 #include "btdtr_ptz_util.h"
+#include "dt_rng.hpp"
+
+// memory and latency budget of an online map, 0 means no limit
+struct OnlineRFMapBudget
+{
+    int max_tree_num_;              // prediction cost is linear in the tree number, the stalest tree is retired
+    int max_tree_keyframe_num_;     // keyframes of a tree, the oldest keyframe (by frame index) leaves a full tree
+    double merge_overlap_ratio_;    // trees whose keyframes overlap more than this (Jaccard) are merged
+    
+    OnlineRFMapBudget()
+    {
+        max_tree_num_ = 0;
+        max_tree_keyframe_num_ = 0;
+        merge_overlap_ratio_ = 0.0;
+    }
+    
+    // keyframes leave trees only when a limit is set
+    bool isLimited() const
+    {
+        return max_tree_num_ > 0 || max_tree_keyframe_num_ > 0 || merge_overlap_ratio_ > 0.0;
+    }
+};
 
 
 class OnlineRFMapBuilder {
@@ -21,11 +44,30 @@ class OnlineRFMapBuilder {
     using TreeType = BTDTRTree;
     typedef TreeType* TreePtr;
     
+    // training examples from one keyframe
+    struct KeyframeSample {
+        vector<VectorXf> features_;
+        vector<VectorXf> labels_;
+        int64_t frame_index_;      // time of the keyframe, the oldest keyframe is evicted first
+    };
+    
 private:
     TreeParameter tree_param_;
     
-    // feature label files in each tree
-    vector<vector<string> > tree_feature_label_files_;
+    // training examples of keyframes in use, each keyframe is read (or copied) only once
+    // a keyframe that no tree uses is erased, so the memory is bounded by the keyframes of the trees
+    // without a budget every keyframe stays in a tree, the memory grows with the map
+    unordered_map<int, KeyframeSample> keyframes_;     // keyframe index --> training examples
+    int keyframe_num_;                                 // next keyframe index
+    unordered_map<string, int> file_keyframe_index_;   // feature label file --> keyframe index
+    
+    // keyframe indices in each tree
+    vector<vector<int> > tree_keyframe_indices_;
+    
+    OnlineRFMapBudget budget_;
+    
+    uint64_t random_seed_;
+    DTRng rng_;     // sample files and trees
     
 public:
     OnlineRFMapBuilder();
@@ -33,11 +75,48 @@ public:
     
     void setTreeParameter(const TreeParameter& param);
     
+    // the same seed and sequence of files produce the same model
+    void setRandomSeed(uint64_t seed);
+    
+    // add a keyframe to the sample store, use it in addTree or updateTree next
+    // after addTree and updateTree, keyframes that no tree uses are released
+    // feature_label_file: .mat file has 'keypoint', 'descriptor' and 'ptz', a file is only read once
+    //                     the order of reading is the frame index
+    // return: keyframe index
+    int addKeyframe(const string & feature_label_file);
+    
+    // keypoints: n x 2, row major
+    // descriptors: n x descriptor_dim, row major
+    // ptz: pan, tilt and focal length of the keyframe
+    // frame_index: time of the keyframe in the video, < 0 the order of adding
+    // return: keyframe index
+    int addKeyframe(const float* keypoints,
+                    const float* descriptors,
+                    const int n,
+                    const int descriptor_dim,
+                    const Eigen::Vector3f& ptz,
+                    const int64_t frame_index = -1);
+    
+    // added keyframes, released ones included
+    int keyframeNum(void) const {return keyframe_num_;}
+    
+    // keyframes used by at least one tree, the others are released
+    int activeKeyframeNum(void) const {return (int)keyframes_.size();}
+    
+    // checked after each addTree and updateTree
+    void setBudget(const OnlineRFMapBudget & budget);
+    
     bool addTree(BTDTRegressor& model,
                  const string & feature_label_file,
                  const char *model_file_name,
                  bool verbose = true);
     
+    // keyframe_index: from addKeyframe
+    bool addTree(BTDTRegressor& model,
+                 const int keyframe_index,
+                 const char *model_file_name,
+                 bool verbose = true);
+    
     // update the last tree in the model
     // feature_label_file: new added feature label file
     bool updateTree(BTDTRegressor& model,                    
@@ -45,30 +124,61 @@ public:
                     const char *model_file_name,
                     bool vervose = true);
     
+    bool updateTree(BTDTRegressor& model,
+                    const int keyframe_index,
+                    const char *model_file_name,
+                    bool vervose = true);
+    
     // add a tree or update a tree
     bool isAddTree(const BTDTRegressor & model,
                         const string & feature_label_file,
                         const double error_threshold,
                         const double percentage_threshold);
     
+    bool isAddTree(const BTDTRegressor & model,
+                   const int keyframe_index,
+                   const double error_threshold,
+                   const double percentage_threshold);
+    
 private:
     // Add one tree to the init model
-    // using files from all feature_label_files and part of init_feature_label_files
+    // using examples from keyframes
     // model: input and output
-    // feature_label_files: new added files
+    // keyframe_indices: keyframes used to train the tree
     // model_file_name: output, new model
     bool addTree(BTDTRegressor& model,
-                 const vector<string> & feature_label_files,
+                 const vector<int> & keyframe_indices,
                  const char *model_file_name,
                  bool verbose = true);
     
+    // concatenate training examples of keyframes
+    void collectSamples(const vector<int> & keyframe_indices,
+                        vector<VectorXf> & features,
+                        vector<VectorXf> & labels) const;
+    
     bool validationError(const BTDTRegressor & model,
                          const vector<string> & ptz_keypoint_descriptor_files,
                          const int sample_frame_num = 10) const;
     
     void computePredictionError(const BTDTRegressor & model,
-                                const string & feature_label_file,
-                                vector<float> & prediction_error);
+                                const int keyframe_index,
+                                vector<float> & prediction_error) const;
+    
+    // merge overlapping trees, retire stale trees and release unused keyframes
+    // trees that lose keyframes are updated, their dead leaf nodes are removed
+    void applyBudget(BTDTRegressor& model, bool verbose);
+    
+    // remove tree_index from the model and the book keeper
+    void retireTree(BTDTRegressor& model, const int tree_index);
+    
+    // update tree_index from its keyframes
+    void retrainTree(BTDTRegressor& model, const int tree_index);
+    
+    // keep the newest max_num keyframes by frame index, the order of the others is kept
+    void removeOldestKeyframes(vector<int> & keyframe_indices, const int max_num) const;
+    
+    // free the examples of keyframes that no tree uses
+    void releaseKeyframes();
 };
 
 
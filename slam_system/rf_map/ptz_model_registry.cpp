@@ -0,0 +1,207 @@
+//
+//  ptz_model_registry.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-26.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#include "ptz_model_registry.hpp"
+#include <assert.h>
+
+PTZModelRegistry::PTZModelRegistry(size_t memory_budget)
+{
+    memory_budget_ = memory_budget;
+    memory_size_ = 0;
+    is_stopped_ = false;
+}
+
+PTZModelRegistry::~PTZModelRegistry()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        is_stopped_ = true;
+    }
+    prefetch_.notify_all();
+    if (prefetch_thread_.joinable()) {
+        prefetch_thread_.join();
+    }
+}
+
+bool PTZModelRegistry::registerVenue(const string & venue, const string & model_file)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    Venue & v = venues_[venue];
+    if (v.model_file_ == model_file) {
+        return true;
+    }
+    if (v.model_ || v.is_loading_) {
+        printf("Error: venue %s is resident with model %s\n", venue.c_str(), v.model_file_.c_str());
+        return false;
+    }
+    v.model_file_ = model_file;
+    return true;
+}
+
+PTZModelRegistry::ModelHandle PTZModelRegistry::acquire(const string & venue)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = venues_.find(venue);
+    if (it == venues_.end()) {
+        printf("Error: venue %s is not registered\n", venue.c_str());
+        return ModelHandle();
+    }
+
+    Venue & v = it->second;
+    if (v.model_) {
+        statistics_.hit_num_++;
+        lru_.splice(lru_.begin(), lru_, v.lru_position_);
+        return v.model_;
+    }
+    statistics_.miss_num_++;
+    return this->load(lock, venue, false);
+}
+
+bool PTZModelRegistry::prefetch(const string & venue)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = venues_.find(venue);
+        if (it == venues_.end()) {
+            printf("Error: venue %s is not registered\n", venue.c_str());
+            return false;
+        }
+        if (it->second.model_ || it->second.is_loading_) {
+            return true;
+        }
+        prefetch_queue_.push_back(venue);
+        if (!prefetch_thread_.joinable()) {
+            prefetch_thread_ = std::thread(&PTZModelRegistry::prefetchLoop, this);
+        }
+    }
+    prefetch_.notify_one();
+    return true;
+}
+
+void PTZModelRegistry::setMemoryBudget(size_t memory_budget)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    memory_budget_ = memory_budget;
+    this->evict(string());
+}
+
+bool PTZModelRegistry::isResident(const string & venue) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = venues_.find(venue);
+    return it != venues_.end() && it->second.model_;
+}
+
+int PTZModelRegistry::residentNum() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return (int)lru_.size();
+}
+
+size_t PTZModelRegistry::memorySize() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return memory_size_;
+}
+
+PTZModelRegistry::Statistics PTZModelRegistry::statistics() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return statistics_;
+}
+
+PTZModelRegistry::ModelHandle PTZModelRegistry::load(std::unique_lock<std::mutex> & lock,
+                                                     const string & venue,
+                                                     bool is_prefetch)
+{
+    assert(lock.owns_lock());
+    // element references of unordered_map are stable, venues are never erased
+    Venue & v = venues_[venue];
+
+    // the model is loaded by another thread
+    while (v.is_loading_) {
+        loaded_.wait(lock);
+    }
+    if (v.model_) {
+        lru_.splice(lru_.begin(), lru_, v.lru_position_);
+        return v.model_;
+    }
+
+    // 1. load without the lock, other venues are still served
+    v.is_loading_ = true;
+    const string model_file = v.model_file_;
+    lock.unlock();
+    BTDTRegressor * model = new BTDTRegressor();
+    const bool is_loaded = model->load(model_file.c_str());
+    const size_t memory_size = model->memorySize();
+    lock.lock();
+    v.is_loading_ = false;
+
+    if (!is_loaded) {
+        delete model;
+        loaded_.notify_all();
+        return ModelHandle();
+    }
+
+    // 2. make it the most recently used model
+    v.model_ = ModelHandle(model);
+    v.memory_size_ = memory_size;
+    memory_size_ += memory_size;
+    lru_.push_front(venue);
+    v.lru_position_ = lru_.begin();
+    if (is_prefetch) {
+        statistics_.prefetch_num_++;
+    }
+
+    this->evict(venue);
+    loaded_.notify_all();
+    return v.model_;
+}
+
+void PTZModelRegistry::evict(const string & keep_venue)
+{
+    if (memory_budget_ == 0) {
+        return;
+    }
+    auto it = lru_.end();
+    while (memory_size_ > memory_budget_ && it != lru_.begin()) {
+        --it;
+        Venue & v = venues_[*it];
+        // the registry holds the only handle, no query uses the model
+        if (*it == keep_venue || v.model_.use_count() > 1) {
+            continue;
+        }
+        memory_size_ -= v.memory_size_;
+        v.memory_size_ = 0;
+        v.model_.reset();
+        it = lru_.erase(it);
+        statistics_.evict_num_++;
+    }
+    if (memory_size_ > memory_budget_) {
+        printf("Warning: resident models %lu bytes, budget %lu bytes, models are in use\n",
+               memory_size_, memory_budget_);
+    }
+}
+
+void PTZModelRegistry::prefetchLoop()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        while (!is_stopped_ && prefetch_queue_.empty()) {
+            prefetch_.wait(lock);
+        }
+        if (is_stopped_) {
+            break;
+        }
+        const string venue = prefetch_queue_.front();
+        prefetch_queue_.pop_front();
+        if (!venues_[venue].model_) {
+            this->load(lock, venue, true);
+        }
+    }
+}
@@ -0,0 +1,121 @@
+//
+//  ptz_model_registry.hpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-26.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef ptz_model_registry_hpp
+#define ptz_model_registry_hpp
+
+// random forest models of many venues, loaded on demand
+// resident models are kept under a memory budget, the least recently used one is evicted first
+// models held by in-flight queries are never evicted
+#include <stdio.h>
+#include <string>
+#include <list>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <unordered_map>
+#include "bt_dt_regressor.h"
+
+using std::string;
+
+class PTZModelRegistry
+{
+public:
+    // a model stays in memory while a handle is alive
+    typedef std::shared_ptr<const BTDTRegressor> ModelHandle;
+
+    struct Statistics
+    {
+        long long hit_num_;        // acquired models that were resident
+        long long miss_num_;       // acquired models that were loaded in acquire
+        long long prefetch_num_;   // models loaded by prefetch
+        long long evict_num_;
+
+        Statistics()
+        {
+            hit_num_ = 0;
+            miss_num_ = 0;
+            prefetch_num_ = 0;
+            evict_num_ = 0;
+        }
+    };
+
+private:
+    struct Venue
+    {
+        string model_file_;
+        ModelHandle model_;                 // NULL if it is not resident
+        size_t memory_size_;
+        bool is_loading_;
+        std::list<string>::iterator lru_position_;   // valid if the model is resident
+
+        Venue()
+        {
+            memory_size_ = 0;
+            is_loading_ = false;
+        }
+    };
+
+    std::unordered_map<string, Venue> venues_;
+    std::list<string> lru_;      // resident venues, most recently used first
+    size_t memory_budget_;       // bytes, 0 means no limit
+    size_t memory_size_;         // bytes of resident models
+    Statistics statistics_;
+
+    // prefetch in a background thread
+    std::deque<string> prefetch_queue_;
+    std::thread prefetch_thread_;
+    bool is_stopped_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable loaded_;     // a model is loaded
+    std::condition_variable prefetch_;   // a venue is added to the prefetch queue
+
+public:
+    // memory_budget: bytes, 0 means no limit
+    explicit PTZModelRegistry(size_t memory_budget = 0);
+    ~PTZModelRegistry();
+
+    // model_file: saved by BTDTRegressor::saveModel
+    // a registered venue is updated only if its model is not resident
+    // return: false if the venue is resident with another model file
+    bool registerVenue(const string & venue, const string & model_file);
+
+    // load the model if it is not resident, the caller blocks until the model is ready
+    // return: NULL if the venue is unknown or the model can not be loaded
+    ModelHandle acquire(const string & venue);
+
+    // load the model in the background, e.g., the game in the venue starts soon
+    // return: false if the venue is unknown
+    bool prefetch(const string & venue);
+
+    // evict models until the budget is met
+    void setMemoryBudget(size_t memory_budget);
+
+    bool isResident(const string & venue) const;
+    int residentNum() const;
+    size_t memorySize() const;
+    Statistics statistics() const;
+
+private:
+    // load the model of a venue, the lock is released during loading
+    ModelHandle load(std::unique_lock<std::mutex> & lock, const string & venue, bool is_prefetch);
+
+    // evict unused models from the tail of the LRU list, keep_venue is not evicted
+    // caller holds the lock
+    void evict(const string & keep_venue);
+
+    void prefetchLoop();
+
+    PTZModelRegistry(const PTZModelRegistry & other);
+    PTZModelRegistry & operator = (const PTZModelRegistry & other);
+};
+
+#endif /* ptz_model_registry_hpp */
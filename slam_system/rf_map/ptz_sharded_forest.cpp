@@ -0,0 +1,323 @@
+//
+//  ptz_sharded_forest.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-23.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#include "ptz_sharded_forest.hpp"
+#include <string>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "rf_map_builder.hpp"
+#include "pgl_ptz_camera.h"
+
+using std::string;
+
+namespace {
+    // angle in [0, 360)
+    inline double wrap360(const double angle)
+    {
+        double a = std::fmod(angle, 360.0);
+        return a < 0.0 ? a + 360.0 : a;
+    }
+    
+    // pan range [a0, a1] overlaps [b0, b1] on the circle, ranges can go beyond [-180, 180]
+    inline bool isPanOverlap(const double a0, const double a1, const double b0, const double b1)
+    {
+        if (a1 - a0 >= 360.0 || b1 - b0 >= 360.0) {
+            return true;
+        }
+        // move a to start in [b0, b0 + 360)
+        const double start = b0 + wrap360(a0 - b0);
+        const double end = start + (a1 - a0);
+        return start <= b1 || end >= b0 + 360.0;
+    }
+    
+    // region a overlaps region b, (pan_min, pan_max, tilt_min, tilt_max)
+    inline bool isOverlap(const Eigen::Vector4d & a, const Eigen::Vector4d & b)
+    {
+        return isPanOverlap(a[0], a[1], b[0], b[1]) && a[2] <= b[3] && b[2] <= a[3];
+    }
+    
+    inline bool isInside(const Eigen::Vector4d & region, const Eigen::VectorXf & pan_tilt)
+    {
+        return wrap360(pan_tilt[0] - region[0]) <= region[1] - region[0] &&
+               pan_tilt[1] >= region[2] && pan_tilt[1] <= region[3];
+    }
+    
+    // directory of a file with the trailing '/', empty for the current directory
+    inline string directoryName(const string & file_name)
+    {
+        size_t pos = file_name.find_last_of('/');
+        return pos == string::npos ? string("") : file_name.substr(0, pos + 1);
+    }
+    
+    // file name without directory and extension
+    inline string stemName(const string & file_name)
+    {
+        string name = file_name.substr(directoryName(file_name).size());
+        size_t pos = name.find_last_of('.');
+        return (pos == string::npos || pos == 0) ? name : name.substr(0, pos);
+    }
+}
+
+PTZShardedForest::PTZShardedForest()
+{
+    
+}
+
+PTZShardedForest::~PTZShardedForest()
+{
+    this->clear();
+}
+
+void PTZShardedForest::clear()
+{
+    for (int i = 0; i<shards_.size(); i++) {
+        delete shards_[i].model_;
+        shards_[i].model_ = NULL;
+    }
+    shards_.clear();
+}
+
+bool PTZShardedForest::build(const btdtr_ptz_util::PTZTreeParameter & tree_param,
+                             const PTZShardParameter & shard_param,
+                             const vector<vector<btdtr_ptz_util::PTZTrainingSample> > & keyframe_samples,
+                             uint64_t random_seed,
+                             bool verbose)
+{
+    assert(keyframe_samples.size() > 0);
+    assert(shard_param.pan_size_ > 0 && shard_param.tilt_size_ > 0);
+    this->clear();
+    
+    // 1. pan-tilt range of all training examples
+    vector<double> pans;
+    double tilt_min = std::numeric_limits<double>::max();
+    double tilt_max = -tilt_min;
+    for (int i = 0; i<keyframe_samples.size(); i++) {
+        for (int j = 0; j<keyframe_samples[i].size(); j++) {
+            const Eigen::VectorXf & pan_tilt = keyframe_samples[i][j].pan_tilt_;
+            pans.push_back(wrap360(pan_tilt[0]));
+            tilt_min = std::min(tilt_min, (double)pan_tilt[1]);
+            tilt_max = std::max(tilt_max, (double)pan_tilt[1]);
+        }
+    }
+    if (pans.empty()) {
+        printf("Error: no training example\n");
+        return false;
+    }
+    
+    // the pan range starts after the largest empty gap on the circle, a venue can cross -180/180
+    std::sort(pans.begin(), pans.end());
+    double max_gap = pans.front() + 360.0 - pans.back();
+    double pan_min = pans.front();
+    for (int i = 1; i<pans.size(); i++) {
+        if (pans[i] - pans[i-1] > max_gap) {
+            max_gap = pans[i] - pans[i-1];
+            pan_min = pans[i];
+        }
+    }
+    if (pan_min > 180.0) {
+        pan_min -= 360.0;
+    }
+    const double pan_max = pan_min + (360.0 - max_gap);
+    
+    const int pan_num = std::max(1, (int)std::ceil((pan_max - pan_min) / shard_param.pan_size_));
+    const int tilt_num = std::max(1, (int)std::ceil((tilt_max - tilt_min) / shard_param.tilt_size_));
+    
+    RFMapBuilder builder;
+    builder.setTreeParameter(tree_param);
+    builder.setRandomSeed(random_seed);
+    
+    // 2. a forest for each cell of the grid
+    for (int i = 0; i<pan_num; i++) {
+        for (int j = 0; j<tilt_num; j++) {
+            Eigen::Vector4d region(pan_min + i * shard_param.pan_size_,
+                                   pan_min + (i + 1) * shard_param.pan_size_,
+                                   tilt_min + j * shard_param.tilt_size_,
+                                   tilt_min + (j + 1) * shard_param.tilt_size_);
+            Eigen::Vector4d train_region = region;
+            train_region[0] -= shard_param.overlap_;
+            train_region[1] += shard_param.overlap_;
+            train_region[2] -= shard_param.overlap_;
+            train_region[3] += shard_param.overlap_;
+            
+            // training examples in the region, keyframes without examples are removed
+            vector<vector<btdtr_ptz_util::PTZTrainingSample> > shard_samples;
+            int sample_num = 0;
+            for (int k = 0; k<keyframe_samples.size(); k++) {
+                vector<btdtr_ptz_util::PTZTrainingSample> cur_samples;
+                for (int m = 0; m<keyframe_samples[k].size(); m++) {
+                    if (isInside(train_region, keyframe_samples[k][m].pan_tilt_)) {
+                        cur_samples.push_back(keyframe_samples[k][m]);
+                    }
+                }
+                if (!cur_samples.empty()) {
+                    sample_num += (int)cur_samples.size();
+                    shard_samples.push_back(cur_samples);
+                }
+            }
+            if (sample_num < shard_param.min_sample_num_) {
+                continue;
+            }
+            
+            Shard shard;
+            shard.region_ = region;
+            shard.model_ = new BTDTRegressor();
+            if (!builder.buildModel(*shard.model_, shard_samples, NULL, false)) {
+                delete shard.model_;
+                continue;
+            }
+            shards_.push_back(shard);
+            if (verbose) {
+                printf("shard %d: pan [%.1f %.1f] tilt [%.1f %.1f], %lu keyframes, %d examples\n",
+                       (int)shards_.size() - 1, region[0], region[1], region[2], region[3],
+                       shard_samples.size(), sample_num);
+            }
+        }
+    }
+    if (verbose) {
+        printf("build %d shards from %d x %d grid\n", (int)shards_.size(), pan_num, tilt_num);
+    }
+    return shards_.size() > 0;
+}
+
+bool PTZShardedForest::save(const char *file_name) const
+{
+    assert(file_name);
+    FILE *pf = fopen(file_name, "w");
+    if (!pf) {
+        printf("Error: can not open file %s\n", file_name);
+        return false;
+    }
+    fprintf(pf, "%d\n", (int)shards_.size());
+    
+    // shard files are next to the index file, the index has names relative to its directory
+    const string directory = directoryName(string(file_name));
+    const string stem = stemName(string(file_name));
+    bool is_saved = true;
+    for (int i = 0; i<shards_.size() && is_saved; i++) {
+        char buf[1024] = {'\0'};
+        sprintf(buf, "_shard_%03d.txt", i);
+        string model_name = stem + string(buf);
+        const Eigen::Vector4d & r = shards_[i].region_;
+        fprintf(pf, "%f %f %f %f %s\n", r[0], r[1], r[2], r[3], model_name.c_str());
+        is_saved = shards_[i].model_->saveModel((directory + model_name).c_str());
+    }
+    fclose(pf);
+    if (!is_saved) {
+        printf("Error: save shards of %s failed\n", file_name);
+    }
+    return is_saved;
+}
+
+bool PTZShardedForest::load(const char *file_name)
+{
+    assert(file_name);
+    FILE *pf = fopen(file_name, "r");
+    if (!pf) {
+        printf("Error: can not open file %s\n", file_name);
+        return false;
+    }
+    this->clear();
+    
+    int shard_num = 0;
+    int ret = fscanf(pf, "%d", &shard_num);
+    if (ret != 1) {
+        printf("Error: read shard number from %s failed\n", file_name);
+        fclose(pf);
+        return false;
+    }
+    for (int i = 0; i<shard_num; i++) {
+        Shard shard;
+        char buf[1024] = {'\0'};
+        ret = fscanf(pf, "%lf %lf %lf %lf %1023s", &shard.region_[0], &shard.region_[1],
+                     &shard.region_[2], &shard.region_[3], buf);
+        if (ret != 5) {
+            printf("Error: read shard %d from %s failed\n", i, file_name);
+            break;
+        }
+        // relative to the index file
+        string model_file = string(buf);
+        if (model_file[0] != '/') {
+            model_file = directoryName(string(file_name)) + model_file;
+        }
+        shard.model_ = new BTDTRegressor();
+        if (!shard.model_->load(model_file.c_str())) {
+            delete shard.model_;
+            break;
+        }
+        shards_.push_back(shard);
+    }
+    fclose(pf);
+    if (shards_.size() != shard_num) {
+        this->clear();
+        return false;
+    }
+    return true;
+}
+
+void PTZShardedForest::selectShards(const Eigen::Vector4d & region,
+                                    vector<const BTDTRegressor *> & models) const
+{
+    models.clear();
+    for (int i = 0; i<shards_.size(); i++) {
+        if (isOverlap(region, shards_[i].region_)) {
+            models.push_back(shards_[i].model_);
+        }
+    }
+}
+
+int PTZShardedForest::treeNum() const
+{
+    int tree_num = 0;
+    for (int i = 0; i<shards_.size(); i++) {
+        tree_num = std::max(tree_num, shards_[i].model_->treeNum());
+    }
+    return tree_num;
+}
+
+void PTZShardedForest::allShards(vector<const BTDTRegressor *> & models) const
+{
+    models.clear();
+    for (int i = 0; i<shards_.size(); i++) {
+        models.push_back(shards_[i].model_);
+    }
+}
+
+Eigen::Vector4d PTZShardedForest::viewRegion(const Eigen::Vector2d & pp,
+                                             const Eigen::Vector3d & ptz,
+                                             const double pan_tilt_uncertainty,
+                                             const double zoom_uncertainty)
+{
+    // shorter focal length, wider field of view
+    Eigen::Vector3d wide_ptz = ptz;
+    wide_ptz[2] = ptz[2] * std::max(0.1, 1.0 - zoom_uncertainty);
+    
+    // image corners and middle of edges, tilt is not linear along the horizontal edges
+    const double w = 2.0 * pp.x();
+    const double h = 2.0 * pp.y();
+    const double xs[] = {0.0, pp.x(), w};
+    const double ys[] = {0.0, pp.y(), h};
+    Eigen::Vector4d region(std::numeric_limits<double>::max(), -std::numeric_limits<double>::max(),
+                           std::numeric_limits<double>::max(), -std::numeric_limits<double>::max());
+    for (int i = 0; i<3; i++) {
+        for (int j = 0; j<3; j++) {
+            Eigen::Vector2d pan_tilt = cvx_pgl::point2PanTilt(pp, wide_ptz, Eigen::Vector2d(xs[i], ys[j]));
+            // pan relative to the camera, the region is continuous when the view crosses -180/180
+            const double pan = ptz[0] + wrap360(pan_tilt[0] - ptz[0] + 180.0) - 180.0;
+            region[0] = std::min(region[0], pan);
+            region[1] = std::max(region[1], pan);
+            region[2] = std::min(region[2], pan_tilt[1]);
+            region[3] = std::max(region[3], pan_tilt[1]);
+        }
+    }
+    region[0] -= pan_tilt_uncertainty;
+    region[1] += pan_tilt_uncertainty;
+    region[2] -= pan_tilt_uncertainty;
+    region[3] += pan_tilt_uncertainty;
+    return region;
+}
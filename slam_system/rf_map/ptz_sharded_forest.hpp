@@ -0,0 +1,92 @@
+//
+//  ptz_sharded_forest.hpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-23.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef ptz_sharded_forest_hpp
+#define ptz_sharded_forest_hpp
+
+// random forest map partitioned by pan-tilt region
+// with a camera prior, only shards that overlap the field of view are queried
+#include <stdio.h>
+#include <vector>
+#include <Eigen/Dense>
+#include "bt_dt_regressor.h"
+#include "btdtr_ptz_util.h"
+
+using std::vector;
+
+struct PTZShardParameter
+{
+    double pan_size_;     // shard size in pan, degree
+    double tilt_size_;    // shard size in tilt, degree
+    double overlap_;      // training examples within overlap (degree) of a shard are also used
+    int min_sample_num_;  // shards with fewer training examples are not built
+    
+    PTZShardParameter()
+    {
+        pan_size_ = 20.0;
+        tilt_size_ = 90.0;
+        overlap_ = 5.0;
+        min_sample_num_ = 100;
+    }
+};
+
+class PTZShardedForest
+{
+    struct Shard
+    {
+        Eigen::Vector4d region_;    // pan_min, pan_max, tilt_min, tilt_max, without overlap, pan can go beyond 180
+        BTDTRegressor * model_;
+    };
+    
+    vector<Shard> shards_;
+    
+public:
+    PTZShardedForest();
+    ~PTZShardedForest();
+    
+    // keyframe_samples: training examples of each keyframe, pan_tilt_ is the label
+    // random_seed: every shard uses the same seed
+    bool build(const btdtr_ptz_util::PTZTreeParameter & tree_param,
+               const PTZShardParameter & shard_param,
+               const vector<vector<btdtr_ptz_util::PTZTrainingSample> > & keyframe_samples,
+               uint64_t random_seed = 0,
+               bool verbose = false);
+    
+    // an index file and one model file for each shard in the same directory, e.g., map.txt, map_shard_000.txt ...
+    // return: false if the index or a shard can not be written
+    bool save(const char *file_name) const;
+    bool load(const char *file_name);
+    
+    // shards that overlap the region (pan_min, pan_max, tilt_min, tilt_max), pan wraps around at -180/180
+    void selectShards(const Eigen::Vector4d & region,
+                      vector<const BTDTRegressor *> & models) const;
+    
+    void allShards(vector<const BTDTRegressor *> & models) const;
+    
+    int shardNum() const { return (int)shards_.size(); }
+    
+    // tree number of the largest shard
+    int treeNum() const;
+    
+    // pan-tilt region of the image of a camera, image size is 2 * pp
+    // pan is continuous around the camera pan, e.g., [170, 200] instead of [-180, 180]
+    // pan_tilt_uncertainty: degree, added to the region
+    // zoom_uncertainty: relative focal length error, the region is computed from the shortest focal length
+    static Eigen::Vector4d viewRegion(const Eigen::Vector2d & pp,
+                                      const Eigen::Vector3d & ptz,
+                                      const double pan_tilt_uncertainty,
+                                      const double zoom_uncertainty);
+    
+private:
+    void clear();
+    
+    PTZShardedForest(const PTZShardedForest & other);
+    PTZShardedForest & operator = (const PTZShardedForest & other);
+};
+
+#endif /* ptz_sharded_forest_hpp */
@@ -0,0 +1,674 @@
+//
+//  ptz_slam_runtime.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-31.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#include "ptz_slam_runtime.hpp"
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+
+namespace {
+    inline int64_t nowNanoseconds()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    
+    // background threads check the stop flag at least this often
+    const std::chrono::milliseconds WAKE_INTERVAL(10);
+    
+    // sleep of a blocked tracking stage
+    const std::chrono::microseconds BLOCK_INTERVAL(100);
+}
+
+PTZSlamRuntimeParameter::PTZSlamRuntimeParameter()
+{
+    image_width_ = 1280;
+    image_height_ = 720;
+    descriptor_dim_ = 128;
+    
+    min_tracked_num_ = 10;
+    max_bad_frame_num_ = 3;
+    keyframe_min_overlap_ = 10.0;
+    keyframe_max_overlap_ = 15.0;
+    min_keyframe_feature_num_ = 50;
+    
+    add_tree_error_threshold_ = 0.1;
+    add_tree_percentage_threshold_ = 0.5;
+    max_unpublished_keyframe_num_ = 8;
+    
+    min_relocalization_inlier_num_ = 10;
+    
+    keyframe_queue_size_ = 4;
+    relocalization_queue_size_ = 2;
+    block_on_full_queue_ = false;
+}
+
+bool PTZSlamRuntimeParameter::readFromFile(FILE *pf)
+{
+    assert(pf);
+    
+    std::unordered_map<string, double> imap;
+    while (true) {
+        char s[1024] = {'\0'};
+        double val = 0;
+        int ret = fscanf(pf, "%1023s %lf", s, &val);
+        if (ret != 2) {
+            break;
+        }
+        imap[string(s)] = val;
+    }
+    
+    for (auto it = imap.begin(); it != imap.end(); it++) {
+        const string & name = it->first;
+        const double val = it->second;
+        if (name == "image_width") {
+            image_width_ = (int)val;
+        }
+        else if (name == "image_height") {
+            image_height_ = (int)val;
+        }
+        else if (name == "descriptor_dim") {
+            descriptor_dim_ = (int)val;
+        }
+        else if (name == "min_tracked_num") {
+            min_tracked_num_ = (int)val;
+        }
+        else if (name == "max_bad_frame_num") {
+            max_bad_frame_num_ = (int)val;
+        }
+        else if (name == "keyframe_min_overlap") {
+            keyframe_min_overlap_ = val;
+        }
+        else if (name == "keyframe_max_overlap") {
+            keyframe_max_overlap_ = val;
+        }
+        else if (name == "min_keyframe_feature_num") {
+            min_keyframe_feature_num_ = (int)val;
+        }
+        else if (name == "add_tree_error_threshold") {
+            add_tree_error_threshold_ = val;
+        }
+        else if (name == "add_tree_percentage_threshold") {
+            add_tree_percentage_threshold_ = val;
+        }
+        else if (name == "max_unpublished_keyframe_num") {
+            max_unpublished_keyframe_num_ = (int)val;
+        }
+        else if (name == "min_relocalization_inlier_num") {
+            min_relocalization_inlier_num_ = (int)val;
+        }
+        else if (name == "keyframe_queue_size") {
+            keyframe_queue_size_ = (int)val;
+        }
+        else if (name == "relocalization_queue_size") {
+            relocalization_queue_size_ = (int)val;
+        }
+        else if (name == "block_on_full_queue") {
+            block_on_full_queue_ = (val != 0.0);
+        }
+        else {
+            printf("Warning: unknown runtime parameter %s\n", name.c_str());
+        }
+    }
+    return true;
+}
+
+bool PTZSlamRuntimeParameter::readFromFile(const char *file_name)
+{
+    assert(file_name);
+    FILE *pf = fopen(file_name, "r");
+    if (!pf) {
+        printf("can not open %s\n", file_name);
+        return false;
+    }
+    this->readFromFile(pf);
+    fclose(pf);
+    return true;
+}
+
+bool PTZSlamRuntimeParameter::writeToFile(FILE *pf) const
+{
+    assert(pf);
+    fprintf(pf, "image_width %d\n", image_width_);
+    fprintf(pf, "image_height %d\n", image_height_);
+    fprintf(pf, "descriptor_dim %d\n", descriptor_dim_);
+    fprintf(pf, "min_tracked_num %d\n", min_tracked_num_);
+    fprintf(pf, "max_bad_frame_num %d\n", max_bad_frame_num_);
+    fprintf(pf, "keyframe_min_overlap %f\n", keyframe_min_overlap_);
+    fprintf(pf, "keyframe_max_overlap %f\n", keyframe_max_overlap_);
+    fprintf(pf, "min_keyframe_feature_num %d\n", min_keyframe_feature_num_);
+    fprintf(pf, "add_tree_error_threshold %f\n", add_tree_error_threshold_);
+    fprintf(pf, "add_tree_percentage_threshold %f\n", add_tree_percentage_threshold_);
+    fprintf(pf, "max_unpublished_keyframe_num %d\n", max_unpublished_keyframe_num_);
+    fprintf(pf, "min_relocalization_inlier_num %d\n", min_relocalization_inlier_num_);
+    fprintf(pf, "keyframe_queue_size %d\n", keyframe_queue_size_);
+    fprintf(pf, "relocalization_queue_size %d\n", relocalization_queue_size_);
+    fprintf(pf, "block_on_full_queue %d\n", block_on_full_queue_ ? 1 : 0);
+    return true;
+}
+
+void PTZSlamRuntimeParameter::printSelf() const
+{
+    writeToFile(stdout);
+}
+
+/******************-----------stage statistics--------------******************/
+PTZSlamRuntime::StageStatistics::StageStatistics()
+{
+    count_ = 0;
+    total_ns_ = 0;
+    max_ns_ = 0;
+    for (int i = 0; i<BIN_NUM; i++) {
+        bins_[i] = 0;
+    }
+}
+
+void PTZSlamRuntime::StageStatistics::add(int64_t nanoseconds)
+{
+    count_.fetch_add(1, std::memory_order_relaxed);
+    total_ns_.fetch_add(nanoseconds, std::memory_order_relaxed);
+    int64_t max_ns = max_ns_.load(std::memory_order_relaxed);
+    while (nanoseconds > max_ns &&
+           !max_ns_.compare_exchange_weak(max_ns, nanoseconds, std::memory_order_relaxed)) {
+    }
+    
+    // bin i: [2^(i/4), 2^((i+1)/4)) microseconds, bin 0 also has shorter times
+    const double us = nanoseconds * 1e-3;
+    int bin = us > 1.0 ? (int)(4.0 * log2(us)) : 0;
+    bin = std::min(bin, (int)BIN_NUM - 1);
+    bins_[bin].fetch_add(1, std::memory_order_relaxed);
+}
+
+string PTZSlamRuntime::StageStatistics::toJSON() const
+{
+    int64_t bins[BIN_NUM];
+    int64_t count = 0;
+    for (int i = 0; i<BIN_NUM; i++) {
+        bins[i] = bins_[i].load(std::memory_order_relaxed);
+        count += bins[i];
+    }
+    
+    // geometric center of the bin
+    auto percentile = [&](double p) {
+        if (count == 0) {
+            return 0.0;
+        }
+        const int64_t rank = std::min(count - 1, (int64_t)(p * count));
+        int64_t num = 0;
+        for (int i = 0; i<BIN_NUM; i++) {
+            num += bins[i];
+            if (num > rank) {
+                return pow(2.0, (i + 0.5)/4.0) * 1e-3;
+            }
+        }
+        return pow(2.0, BIN_NUM/4.0) * 1e-3;
+    };
+    
+    const double total_ms = total_ns_.load(std::memory_order_relaxed) * 1e-6;
+    char buf[512] = {'\0'};
+    snprintf(buf, sizeof(buf),
+             "{\"count\": %lld, \"mean_ms\": %.3f, \"p50_ms\": %.3f, \"p90_ms\": %.3f, \"p99_ms\": %.3f, \"max_ms\": %.3f}",
+             (long long)count, count > 0 ? total_ms / count : 0.0,
+             percentile(0.5), percentile(0.9), percentile(0.99),
+             max_ns_.load(std::memory_order_relaxed) * 1e-6);
+    return string(buf);
+}
+
+/******************-----------runtime--------------******************/
+PTZSlamRuntime::PTZSlamRuntime(const PTZSlamRuntimeParameter & param,
+                               const BTDTRegressor * base_model):
+base_model_(base_model),
+tracker_(param.ekf_param_),
+keyframe_database_(param.descriptor_dim_, param.image_width_),
+relocalizer_(param.relocalizer_param_),
+keyframe_queue_(param.keyframe_queue_size_),
+keyframe_return_(param.keyframe_queue_size_ + 2),
+request_queue_(param.relocalization_queue_size_),
+result_queue_(param.relocalization_queue_size_)
+{
+    assert(param.descriptor_dim_ > 0);
+    assert(param.keyframe_queue_size_ > 0);
+    assert(param.relocalization_queue_size_ > 0);
+    assert(param.max_unpublished_keyframe_num_ > 0);
+    assert(base_model == NULL || base_model->treeNum() == 0 || base_model->featureDim() == param.descriptor_dim_);
+    
+    param_ = param;
+    is_lost_ = true;
+    bad_frame_num_ = 0;
+    pending_request_num_ = 0;
+    last_ptz_ = Eigen::Vector3d(0, 0, 0);
+    
+    builder_.setTreeParameter(param_.tree_param_);
+    builder_.setBudget(param_.budget_);
+    
+    is_stopped_ = true;
+    frame_num_ = 0;
+    lost_frame_num_ = 0;
+    keyframe_num_ = 0;
+    dropped_keyframe_num_ = 0;
+    mapped_keyframe_num_ = 0;
+    added_tree_num_ = 0;
+    request_num_ = 0;
+    dropped_request_num_ = 0;
+    relocalized_num_ = 0;
+    failed_relocalization_num_ = 0;
+    stale_result_num_ = 0;
+    model_version_ = 0;
+    model_tree_num_ = 0;
+}
+
+PTZSlamRuntime::~PTZSlamRuntime()
+{
+    this->stop();
+    for (Keyframe * keyframe: all_keyframes_) {
+        delete keyframe;
+    }
+    for (Request * request: all_requests_) {
+        delete request;
+    }
+}
+
+void PTZSlamRuntime::start()
+{
+    assert(is_stopped_);
+    is_stopped_ = false;
+    mapping_thread_ = std::thread(&PTZSlamRuntime::mappingLoop, this);
+    relocalization_thread_ = std::thread(&PTZSlamRuntime::relocalizationLoop, this);
+}
+
+void PTZSlamRuntime::stop()
+{
+    if (is_stopped_) {
+        return;
+    }
+    is_stopped_ = true;
+    mapping_cond_.notify_all();
+    relocalization_cond_.notify_all();
+    if (mapping_thread_.joinable()) {
+        mapping_thread_.join();
+    }
+    if (relocalization_thread_.joinable()) {
+        relocalization_thread_.join();
+    }
+}
+
+void PTZSlamRuntime::init(const Eigen::Vector3d & ptz)
+{
+    tracker_.init(ptz);
+    last_ptz_ = ptz;
+    is_lost_ = false;
+    bad_frame_num_ = 0;
+}
+
+PTZSlamTrackingResult PTZSlamRuntime::track(int frame_index,
+                                            const vector<Eigen::Vector2d> & points,
+                                            const vector<int> & ray_indices,
+                                            const vector<int> & removed_rays,
+                                            const vector<Eigen::Vector2d> & new_points,
+                                            const float * keypoints,
+                                            const float * descriptors,
+                                            int n)
+{
+    assert(points.size() == ray_indices.size());
+    assert(n == 0 || (keypoints != NULL && descriptors != NULL));
+    const int64_t start_ns = nowNanoseconds();
+    frame_num_.fetch_add(1, std::memory_order_relaxed);
+    
+    PTZSlamTrackingResult result;
+    result.state_ = PTZSlamTrackingResult::TRACKING;
+    result.observation_num_ = 0;
+    result.first_new_ray_ = tracker_.rayNum();
+    result.is_keyframe_ = false;
+    result.is_keyframe_dropped_ = false;
+    result.is_relocalization_requested_ = false;
+    
+    // 1. relocalization results of previous frames
+    const bool is_relocalized = this->collectResults();
+    
+    // 2. EKF, lost after several bad frames as ptz_slam.py
+    if (is_relocalized) {
+        result.state_ = PTZSlamTrackingResult::RELOCALIZED;
+    }
+    else if (!is_lost_) {
+        tracker_.predict();
+        result.observation_num_ = tracker_.update(points, ray_indices);
+        bad_frame_num_ = result.observation_num_ < param_.min_tracked_num_ ? bad_frame_num_ + 1 : 0;
+        if (bad_frame_num_ > param_.max_bad_frame_num_) {
+            is_lost_ = true;
+            bad_frame_num_ = 0;
+        }
+        else if (!removed_rays.empty()) {
+            tracker_.removeRays(removed_rays);
+        }
+    }
+    
+    if (!is_lost_) {
+        result.first_new_ray_ = tracker_.addRays(new_points);
+        last_ptz_ = tracker_.ptz();
+        
+        // 3. keyframe, the mapping stage is never waited for unless block_on_full_queue_
+        const bool is_keyframe = n >= param_.min_keyframe_feature_num_ &&
+                                 (keyframe_database_.size() == 0 ||
+                                  keyframe_database_.isGoodNewKeyframe(last_ptz_,
+                                                                       param_.keyframe_min_overlap_,
+                                                                       param_.keyframe_max_overlap_));
+        if (is_keyframe) {
+            const bool is_blocking = param_.block_on_full_queue_ && !is_stopped_;
+            Keyframe * keyframe = this->newKeyframe();
+            while (keyframe == NULL && is_blocking) {
+                std::this_thread::sleep_for(BLOCK_INTERVAL);
+                keyframe = this->newKeyframe();
+            }
+            bool is_pushed = false;
+            if (keyframe != NULL) {
+                keyframe->frame_index_ = frame_index;
+                keyframe->ptz_ = last_ptz_.cast<float>();
+                keyframe->keypoints_.assign(keypoints, keypoints + (size_t)n * 2);
+                keyframe->descriptors_.assign(descriptors, descriptors + (size_t)n * param_.descriptor_dim_);
+                keyframe->n_ = n;
+                keyframe->enqueue_ns_ = nowNanoseconds();
+                is_pushed = keyframe_queue_.push(keyframe);
+                while (!is_pushed && is_blocking) {
+                    mapping_cond_.notify_one();
+                    std::this_thread::sleep_for(BLOCK_INTERVAL);
+                    is_pushed = keyframe_queue_.push(keyframe);
+                }
+                if (!is_pushed) {
+                    free_keyframes_.push_back(keyframe);
+                }
+            }
+            if (is_pushed) {
+                // features are kept by the mapping stage
+                keyframe_database_.addKeyframe(last_ptz_, NULL, NULL, 0);
+                keyframe_num_.fetch_add(1, std::memory_order_relaxed);
+                mapping_cond_.notify_one();
+                result.is_keyframe_ = true;
+            }
+            else {
+                dropped_keyframe_num_.fetch_add(1, std::memory_order_relaxed);
+                result.is_keyframe_dropped_ = true;
+            }
+        }
+    }
+    else {
+        // 4. lost, the frame goes to the relocalization stage if the queue has room
+        result.state_ = PTZSlamTrackingResult::LOST;
+        lost_frame_num_.fetch_add(1, std::memory_order_relaxed);
+        if (n > 0) {
+            result.is_relocalization_requested_ = this->pushRequest(frame_index, keypoints, descriptors, n);
+        }
+    }
+    result.ptz_ = last_ptz_;
+    
+    tracking_latency_.add(nowNanoseconds() - start_ns);
+    return result;
+}
+
+bool PTZSlamRuntime::requestRelocalization(int frame_index,
+                                           const float * keypoints,
+                                           const float * descriptors,
+                                           int n)
+{
+    assert(n > 0 && keypoints != NULL && descriptors != NULL);
+    is_lost_ = true;
+    bad_frame_num_ = 0;
+    return this->pushRequest(frame_index, keypoints, descriptors, n);
+}
+
+void PTZSlamRuntime::flushMapping()
+{
+    assert(!is_stopped_);
+    while (mapped_keyframe_num_.load() < keyframe_num_.load()) {
+        mapping_cond_.notify_one();
+        std::this_thread::sleep_for(BLOCK_INTERVAL);
+    }
+}
+
+std::shared_ptr<const BTDTRegressor> PTZSlamRuntime::publishedModel() const
+{
+    return std::atomic_load(&published_model_);
+}
+
+string PTZSlamRuntime::statisticsJSON() const
+{
+    char buf[1024] = {'\0'};
+    snprintf(buf, sizeof(buf),
+             "\"frame_num\": %lld, \"lost_frame_num\": %lld, "
+             "\"keyframe_num\": %lld, \"dropped_keyframe_num\": %lld, \"mapped_keyframe_num\": %lld, "
+             "\"added_tree_num\": %lld, \"model_version\": %lld, \"model_tree_num\": %d, "
+             "\"relocalization_request_num\": %lld, \"dropped_request_num\": %lld, "
+             "\"relocalized_num\": %lld, \"failed_relocalization_num\": %lld, \"stale_result_num\": %lld, "
+             "\"keyframe_queue_size\": %lu, \"relocalization_queue_size\": %lu",
+             (long long)frame_num_.load(), (long long)lost_frame_num_.load(),
+             (long long)keyframe_num_.load(), (long long)dropped_keyframe_num_.load(),
+             (long long)mapped_keyframe_num_.load(),
+             (long long)added_tree_num_.load(), (long long)model_version_.load(), model_tree_num_.load(),
+             (long long)request_num_.load(), (long long)dropped_request_num_.load(),
+             (long long)relocalized_num_.load(), (long long)failed_relocalization_num_.load(),
+             (long long)stale_result_num_.load(),
+             keyframe_queue_.size(), request_queue_.size());
+    
+    string json = "{\"counters\": {" + string(buf) + "}, \"stages\": {";
+    json += "\"tracking\": " + tracking_latency_.toJSON() + ", ";
+    json += "\"mapping\": " + mapping_latency_.toJSON() + ", ";
+    json += "\"mapping_wait\": " + mapping_wait_.toJSON() + ", ";
+    json += "\"publish\": " + publish_latency_.toJSON() + ", ";
+    json += "\"relocalization\": " + relocalization_latency_.toJSON() + ", ";
+    json += "\"relocalization_wait\": " + relocalization_wait_.toJSON() + ", ";
+    json += "\"relocalization_return\": " + relocalization_return_.toJSON() + "}}";
+    return json;
+}
+
+void PTZSlamRuntime::mappingLoop()
+{
+    Keyframe * keyframe = NULL;
+    int unpublished_num = 0;
+    while (true) {
+        // read the flag before pop, keyframes pushed before stop are still mapped
+        const bool is_stopped = is_stopped_.load();
+        if (!keyframe_queue_.pop(keyframe)) {
+            if (is_stopped) {
+                break;
+            }
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            mapping_cond_.wait_for(lock, WAKE_INTERVAL);
+            continue;
+        }
+        
+        const int64_t start_ns = nowNanoseconds();
+        mapping_wait_.add(start_ns - keyframe->enqueue_ns_);
+        this->mapKeyframe(*keyframe);
+        
+        // a copy of a large map takes longer than a tree update, intermediate copies are skipped
+        // when the mapping stage is behind
+        unpublished_num++;
+        if (keyframe_queue_.empty() || unpublished_num >= param_.max_unpublished_keyframe_num_) {
+            const int64_t publish_ns = nowNanoseconds();
+            this->publishModel();
+            publish_latency_.add(nowNanoseconds() - publish_ns);
+            unpublished_num = 0;
+        }
+        mapping_latency_.add(nowNanoseconds() - start_ns);
+        
+        // at most keyframe_queue_size_ + 2 keyframes exist, the return queue is never full
+        bool is_returned = keyframe_return_.push(keyframe);
+        assert(is_returned);
+        (void)is_returned;
+        mapped_keyframe_num_.fetch_add(1);
+    }
+}
+
+void PTZSlamRuntime::mapKeyframe(const Keyframe & keyframe)
+{
+    // the same decision as OnlineRFMap::updateMap
+    const int keyframe_index = builder_.addKeyframe(keyframe.keypoints_.data(), keyframe.descriptors_.data(),
+                                                    keyframe.n_, param_.descriptor_dim_, keyframe.ptz_,
+                                                    keyframe.frame_index_);
+    const bool is_add = model_.treeNum() == 0 ||
+                        builder_.isAddTree(model_, keyframe_index,
+                                           param_.add_tree_error_threshold_,
+                                           param_.add_tree_percentage_threshold_);
+    if (is_add) {
+        builder_.addTree(model_, keyframe_index, NULL, false);
+        added_tree_num_.fetch_add(1, std::memory_order_relaxed);
+    }
+    else {
+        builder_.updateTree(model_, keyframe_index, NULL, false);
+    }
+}
+
+void PTZSlamRuntime::publishModel()
+{
+    // relocalization keeps using the previous copy until it loads this one
+    BTDTRegressor * snapshot = new BTDTRegressor();
+    model_.copyTo(*snapshot);
+    std::shared_ptr<const BTDTRegressor> published(snapshot);
+    std::atomic_store(&published_model_, published);
+    model_tree_num_ = model_.treeNum();
+    model_version_.fetch_add(1);
+}
+
+void PTZSlamRuntime::relocalizationLoop()
+{
+    Request * request = NULL;
+    vector<const BTDTRegressor *> models;
+    while (true) {
+        const bool is_stopped = is_stopped_.load();
+        if (!request_queue_.pop(request)) {
+            if (is_stopped) {
+                break;
+            }
+            std::unique_lock<std::mutex> lock(wake_mutex_);
+            relocalization_cond_.wait_for(lock, WAKE_INTERVAL);
+            continue;
+        }
+        
+        const int64_t start_ns = nowNanoseconds();
+        relocalization_wait_.add(start_ns - request->enqueue_ns_);
+        
+        // the base map and the latest online map, the online map is kept alive by the shared pointer
+        std::shared_ptr<const BTDTRegressor> online_model = std::atomic_load(&published_model_);
+        models.clear();
+        if (base_model_ != NULL && base_model_->treeNum() > 0) {
+            models.push_back(base_model_);
+        }
+        if (online_model && online_model->treeNum() > 0) {
+            models.push_back(online_model.get());
+        }
+        
+        request->inlier_num_ = 0;
+        if (models.size() == 1) {
+            request->inlier_num_ = relocalizer_.relocalize(*models[0], request->keypoints_.data(),
+                                                           request->descriptors_.data(), request->n_,
+                                                           param_.descriptor_dim_, request->pan_tilt_zoom_);
+        }
+        else if (models.size() > 1) {
+            request->inlier_num_ = relocalizer_.relocalize(models, request->keypoints_.data(),
+                                                           request->descriptors_.data(), request->n_,
+                                                           param_.descriptor_dim_, request->pan_tilt_zoom_);
+        }
+        relocalization_latency_.add(nowNanoseconds() - start_ns);
+        
+        // requests in flight are at most the queue size, the result queue is never full
+        bool is_returned = result_queue_.push(request);
+        assert(is_returned);
+        (void)is_returned;
+    }
+}
+
+bool PTZSlamRuntime::collectResults()
+{
+    bool is_relocalized = false;
+    Request * request = NULL;
+    while (result_queue_.pop(request)) {
+        pending_request_num_--;
+        relocalization_return_.add(nowNanoseconds() - request->enqueue_ns_);
+        if (request->inlier_num_ >= param_.min_relocalization_inlier_num_) {
+            // results are in request order, the latest successful one is used
+            if (is_lost_ || is_relocalized) {
+                Eigen::Vector3d ptz(request->pan_tilt_zoom_[0], request->pan_tilt_zoom_[1], request->pan_tilt_zoom_[2]);
+                this->init(ptz);
+                is_relocalized = true;
+                relocalized_num_.fetch_add(1, std::memory_order_relaxed);
+            }
+            else {
+                stale_result_num_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        else {
+            failed_relocalization_num_.fetch_add(1, std::memory_order_relaxed);
+        }
+        free_requests_.push_back(request);
+    }
+    return is_relocalized;
+}
+
+PTZSlamRuntime::Keyframe * PTZSlamRuntime::newKeyframe()
+{
+    Keyframe * keyframe = NULL;
+    while (keyframe_return_.pop(keyframe)) {
+        free_keyframes_.push_back(keyframe);
+    }
+    if (!free_keyframes_.empty()) {
+        keyframe = free_keyframes_.back();
+        free_keyframes_.pop_back();
+        return keyframe;
+    }
+    // queued keyframes, one in the mapping stage and one in the return queue
+    if ((int)all_keyframes_.size() < param_.keyframe_queue_size_ + 2) {
+        keyframe = new Keyframe();
+        all_keyframes_.push_back(keyframe);
+        return keyframe;
+    }
+    return NULL;
+}
+
+PTZSlamRuntime::Request * PTZSlamRuntime::newRequest()
+{
+    if (!free_requests_.empty()) {
+        Request * request = free_requests_.back();
+        free_requests_.pop_back();
+        return request;
+    }
+    assert((int)all_requests_.size() < param_.relocalization_queue_size_);
+    Request * request = new Request();
+    all_requests_.push_back(request);
+    return request;
+}
+
+bool PTZSlamRuntime::pushRequest(int frame_index,
+                                 const float * keypoints,
+                                 const float * descriptors,
+                                 int n)
+{
+    if (pending_request_num_ >= param_.relocalization_queue_size_) {
+        dropped_request_num_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    
+    Request * request = this->newRequest();
+    request->frame_index_ = frame_index;
+    for (int i = 0; i<3; i++) {
+        request->pan_tilt_zoom_[i] = last_ptz_[i];
+    }
+    request->keypoints_.assign(keypoints, keypoints + (size_t)n * 2);
+    request->descriptors_.assign(descriptors, descriptors + (size_t)n * param_.descriptor_dim_);
+    request->n_ = n;
+    request->inlier_num_ = 0;
+    request->enqueue_ns_ = nowNanoseconds();
+    
+    bool is_pushed = request_queue_.push(request);
+    assert(is_pushed);
+    (void)is_pushed;
+    pending_request_num_++;
+    request_num_.fetch_add(1, std::memory_order_relaxed);
+    relocalization_cond_.notify_one();
+    return true;
+}
@@ -0,0 +1,291 @@
+//
+//  ptz_slam_runtime.hpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-31.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef ptz_slam_runtime_hpp
+#define ptz_slam_runtime_hpp
+
+// pipelined runtime of PtzSlam in ptz_slam.py: tracking, mapping and relocalization run on different threads
+// 1. tracking: the calling thread, EKF update of each frame, keyframe selection and lost detection
+// 2. mapping: a background thread, builds or updates the online random forest map from keyframes,
+//    publishes a copy of the map once it catches up with the queue
+// 3. relocalization: a background thread, relocalizes lost frames with the latest published map
+// stages communicate through bounded lock free queues, the tracking stage never waits for the other stages:
+// a keyframe is dropped if the mapping queue is full (backpressure), a lost frame is not sent
+// if the relocalization queue is full
+// keyframe and request memory goes back to the tracking stage through return queues, it is reused
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <Eigen/Dense>
+#include "bt_dt_regressor.h"
+#include "btdtr_ptz_util.h"
+#include "online_rf_map_builder.hpp"
+#include "ptz_ekf_tracker.h"
+#include "ptz_keyframe_database.h"
+#include "ptz_relocalizer.h"
+#include "dt_spsc_queue.hpp"
+
+using std::string;
+using std::vector;
+
+struct PTZSlamRuntimeParameter
+{
+    int image_width_;
+    int image_height_;
+    int descriptor_dim_;
+    
+    PTZEKFParameter ekf_param_;
+    PTZRelocalizerParameter relocalizer_param_;
+    btdtr_ptz_util::PTZTreeParameter tree_param_;
+    OnlineRFMapBudget budget_;
+    
+    // tracking
+    int min_tracked_num_;               // a bad frame if the EKF update uses fewer observations
+    int max_bad_frame_num_;             // lost after more consecutive bad frames
+    double keyframe_min_overlap_;       // pan overlap (degree) with existing keyframes, isGoodNewKeyframe
+    double keyframe_max_overlap_;
+    int min_keyframe_feature_num_;      // a frame with fewer keypoints is not a keyframe
+    
+    // mapping, add a tree if fewer than percentage of keyframe samples have error below error threshold
+    double add_tree_error_threshold_;
+    double add_tree_percentage_threshold_;
+    int max_unpublished_keyframe_num_;  // the map is copied for relocalization when the keyframe queue is empty
+                                        // or after this number of keyframes
+    
+    // relocalization
+    int min_relocalization_inlier_num_;
+    
+    // queues
+    int keyframe_queue_size_;           // keyframes waiting for the mapping stage
+    int relocalization_queue_size_;     // lost frames waiting for the relocalization stage
+    bool block_on_full_queue_;          // true: tracking waits for a full keyframe queue, e.g., offline processing
+    
+    // default: 1280 x 720 image, SIFT descriptor, thresholds of ptz_slam.py and OnlineRFMap
+    PTZSlamRuntimeParameter();
+    
+    // text file, one "name value" pair per line, missing names keep default values
+    // the EKF, relocalizer, tree parameters and the budget are not in the file
+    // image_width, image_height, descriptor_dim, min_tracked_num, max_bad_frame_num,
+    // keyframe_min_overlap, keyframe_max_overlap, min_keyframe_feature_num,
+    // add_tree_error_threshold, add_tree_percentage_threshold, max_unpublished_keyframe_num,
+    // min_relocalization_inlier_num, keyframe_queue_size, relocalization_queue_size, block_on_full_queue
+    bool readFromFile(FILE *pf);
+    bool readFromFile(const char *file_name);
+    bool writeToFile(FILE *pf) const;
+    void printSelf() const;
+};
+
+// result of the tracking stage
+struct PTZSlamTrackingResult
+{
+    enum State {
+        TRACKING = 0,
+        LOST,
+        RELOCALIZED     // a relocalization result is applied, rays are removed
+    };
+    
+    State state_;
+    Eigen::Vector3d ptz_;
+    int observation_num_;       // observations used in the EKF update
+    int first_new_ray_;         // ray index of the first new point
+    bool is_keyframe_;          // sent to the mapping stage
+    bool is_keyframe_dropped_;  // a keyframe, but the mapping queue was full
+    bool is_relocalization_requested_;
+};
+
+// the tracking stage (init, track, requestRelocalization) is called from one thread
+// statisticsJSON is thread safe
+class PTZSlamRuntime
+{
+    // work item of the mapping stage
+    struct Keyframe
+    {
+        int frame_index_;
+        Eigen::Vector3f ptz_;
+        vector<float> keypoints_;
+        vector<float> descriptors_;
+        int n_;
+        int64_t enqueue_ns_;
+    };
+    
+    // work item of the relocalization stage, returned to the tracking stage with the result
+    struct Request
+    {
+        int frame_index_;
+        double pan_tilt_zoom_[3];   // prior pose, then relocalized pose
+        vector<float> keypoints_;
+        vector<float> descriptors_;
+        int n_;
+        int inlier_num_;
+        int64_t enqueue_ns_;
+    };
+    
+    // lock free latency statistics of a stage
+    // 4 histogram bins per octave from 1 microsecond, percentiles are within 10%
+    struct StageStatistics
+    {
+        enum {BIN_NUM = 112};
+        std::atomic<int64_t> count_;
+        std::atomic<int64_t> total_ns_;
+        std::atomic<int64_t> max_ns_;
+        std::atomic<int64_t> bins_[BIN_NUM];
+        
+        StageStatistics();
+        void add(int64_t nanoseconds);
+        
+        // {"count": 1, "mean_ms": 1.0, "p50_ms": 1.0, "p90_ms": 1.0, "p99_ms": 1.0, "max_ms": 1.0}
+        string toJSON() const;
+    };
+    
+    PTZSlamRuntimeParameter param_;
+    const BTDTRegressor * base_model_;      // pre-built map, can be NULL
+    
+    // tracking stage, only the calling thread
+    PTZEKFTracker tracker_;
+    PTZKeyframeDatabase keyframe_database_;
+    bool is_lost_;
+    int bad_frame_num_;                     // consecutive bad frames
+    int pending_request_num_;
+    Eigen::Vector3d last_ptz_;              // prior of relocalization
+    
+    // mapping stage
+    OnlineRFMapBuilder builder_;
+    BTDTRegressor model_;
+    std::shared_ptr<const BTDTRegressor> published_model_;   // std::atomic_load, std::atomic_store
+    
+    // relocalization stage
+    PTZRelocalizer relocalizer_;
+    
+    // queues, the first one is the producer
+    DTSPSCQueue<Keyframe *> keyframe_queue_;        // tracking --> mapping
+    DTSPSCQueue<Keyframe *> keyframe_return_;       // mapping --> tracking
+    DTSPSCQueue<Request *> request_queue_;          // tracking --> relocalization
+    DTSPSCQueue<Request *> result_queue_;           // relocalization --> tracking
+    vector<Keyframe *> free_keyframes_;             // tracking stage
+    vector<Request *> free_requests_;               // tracking stage
+    vector<Keyframe *> all_keyframes_;
+    vector<Request *> all_requests_;
+    
+    // background threads sleep when their queue is empty
+    // the tracking stage only notifies, it never holds the mutex
+    std::thread mapping_thread_;
+    std::thread relocalization_thread_;
+    std::mutex wake_mutex_;
+    std::condition_variable mapping_cond_;
+    std::condition_variable relocalization_cond_;
+    std::atomic<bool> is_stopped_;
+    
+    // statistics
+    StageStatistics tracking_latency_;
+    StageStatistics mapping_latency_;
+    StageStatistics mapping_wait_;               // time in the keyframe queue
+    StageStatistics publish_latency_;            // copy of the map
+    StageStatistics relocalization_latency_;
+    StageStatistics relocalization_wait_;        // time in the request queue
+    StageStatistics relocalization_return_;      // from request to the result applied in tracking
+    std::atomic<int64_t> frame_num_;
+    std::atomic<int64_t> lost_frame_num_;
+    std::atomic<int64_t> keyframe_num_;
+    std::atomic<int64_t> dropped_keyframe_num_;
+    std::atomic<int64_t> mapped_keyframe_num_;
+    std::atomic<int64_t> added_tree_num_;
+    std::atomic<int64_t> request_num_;
+    std::atomic<int64_t> dropped_request_num_;
+    std::atomic<int64_t> relocalized_num_;
+    std::atomic<int64_t> failed_relocalization_num_;
+    std::atomic<int64_t> stale_result_num_;      // results that arrive after tracking is recovered
+    std::atomic<int64_t> model_version_;
+    std::atomic<int> model_tree_num_;
+
+public:
+    // base_model: a pre-built map, outlives the runtime, can be NULL
+    // relocalization queries the base model and the online map together
+    explicit PTZSlamRuntime(const PTZSlamRuntimeParameter & param,
+                            const BTDTRegressor * base_model = NULL);
+    ~PTZSlamRuntime();
+    
+    // start the mapping and relocalization threads
+    void start();
+    
+    // queued keyframes and requests are finished
+    void stop();
+    
+    // start tracking from a camera pose, e.g., the first frame
+    // without init, the runtime is lost and the first frames are relocalized
+    void init(const Eigen::Vector3d & ptz);
+    
+    // the tracking stage of a frame
+    // points, ray_indices: observations of existing rays, e.g., optical flow of keypoints in the previous frame
+    // removed_rays: rays that are removed after the update, e.g., outliers
+    // new_points: new rays after the update, the first one is result.first_new_ray_
+    // keypoints, descriptors: n x 2 and n x descriptor_dim, row major, copied only if the frame is a keyframe or lost
+    // RELOCALIZED: points and removed_rays are ignored, the tracker restarts from the relocalized pose
+    PTZSlamTrackingResult track(int frame_index,
+                                const vector<Eigen::Vector2d> & points,
+                                const vector<int> & ray_indices,
+                                const vector<int> & removed_rays,
+                                const vector<Eigen::Vector2d> & new_points,
+                                const float * keypoints,
+                                const float * descriptors,
+                                int n);
+    
+    // the caller detects a tracking failure, e.g., a shot change
+    // the runtime is lost until a relocalization result arrives, the frame is sent to the relocalization stage
+    // return: false if the relocalization queue is full, a later lost frame is sent by track
+    bool requestRelocalization(int frame_index,
+                               const float * keypoints,
+                               const float * descriptors,
+                               int n);
+    
+    // wait until all queued keyframes are in the published map, e.g., before evaluation
+    void flushMapping();
+    
+    // latest published map, can be NULL, thread safe
+    std::shared_ptr<const BTDTRegressor> publishedModel() const;
+    
+    // per stage latency, queue waiting time and counters
+    string statisticsJSON() const;
+    
+    const PTZEKFTracker & tracker() const { return tracker_; }
+    bool isLost() const { return is_lost_; }
+
+private:
+    void mappingLoop();
+    void relocalizationLoop();
+    
+    // build or update the online map from a keyframe
+    void mapKeyframe(const Keyframe & keyframe);
+    
+    // copy the online map for the relocalization stage
+    void publishModel();
+    
+    // apply relocalization results in the tracking stage
+    // return: true if the tracker restarts from a relocalized pose
+    bool collectResults();
+    
+    // recycle keyframe memory from the mapping stage
+    Keyframe * newKeyframe();
+    Request * newRequest();
+    
+    // copy a frame to a request and push it to the relocalization queue
+    bool pushRequest(int frame_index,
+                     const float * keypoints,
+                     const float * descriptors,
+                     int n);
+    
+    PTZSlamRuntime(const PTZSlamRuntime & other);
+    PTZSlamRuntime & operator = (const PTZSlamRuntime & other);
+};
+
+#endif /* ptz_slam_runtime_hpp */
@@ -0,0 +1,78 @@
+//
+//  descriptor_index.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-29.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#include "descriptor_index.hpp"
+#include <assert.h>
+
+EXPORTIT PTZDescriptorIndex* DescriptorIndex_new(int descriptor_dim)
+{
+    return new PTZDescriptorIndex(descriptor_dim);
+}
+
+EXPORTIT void DescriptorIndex_delete(PTZDescriptorIndex* index)
+{
+    assert(index != nullptr);
+    delete index;
+}
+
+EXPORTIT void addDescriptors(PTZDescriptorIndex* index,
+                             const float* descriptors,
+                             const double* rays,
+                             int n)
+{
+    assert(index != nullptr);
+    vector<Eigen::Vector2d> ptz_rays(n);
+    for (int i = 0; i < n; i++) {
+        ptz_rays[i] = Eigen::Vector2d(rays[2*i], rays[2*i+1]);
+    }
+    index->add(descriptors, ptz_rays);
+}
+
+EXPORTIT int getDescriptorNum(PTZDescriptorIndex* index)
+{
+    assert(index != nullptr);
+    return index->size();
+}
+
+EXPORTIT int matchDescriptors(PTZDescriptorIndex* index,
+                              const float* queries,
+                              int n,
+                              float max_distance,
+                              int* query_indices,
+                              int* ray_indices,
+                              double* rays)
+{
+    assert(index != nullptr);
+    vector<int> matched_queries;
+    vector<int> matched_indices;
+    index->match(queries, n, max_distance, matched_queries, matched_indices);
+    for (int i = 0; i < matched_queries.size(); i++) {
+        query_indices[i] = matched_queries[i];
+        ray_indices[i] = matched_indices[i];
+        if (rays != NULL) {
+            const Eigen::Vector2d & ray = index->ray(matched_indices[i]);
+            rays[2*i] = ray.x();
+            rays[2*i+1] = ray.y();
+        }
+    }
+    return (int)matched_queries.size();
+}
+
+EXPORTIT void getDescriptorRays(PTZDescriptorIndex* index,
+                                const int* ray_indices,
+                                int n,
+                                double* rays)
+{
+    assert(index != nullptr);
+    for (int i = 0; i < n; i++) {
+        assert(ray_indices[i] >= 0 && ray_indices[i] < index->size());
+        const Eigen::Vector2d & ray = index->ray(ray_indices[i]);
+        rays[2*i] = ray.x();
+        rays[2*i+1] = ray.y();
+    }
+}
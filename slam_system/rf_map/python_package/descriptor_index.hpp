@@ -0,0 +1,55 @@
+//
+//  descriptor_index.hpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-29.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef descriptor_index_hpp
+#define descriptor_index_hpp
+
+// C interface of PTZDescriptorIndex for nearest_neighbor.py
+#include <stdio.h>
+#include "ptz_descriptor_index.h"
+
+#ifdef _WIN32
+#define EXPORTIT __declspec( dllexport )
+#else
+#define EXPORTIT
+#endif
+
+extern "C" {
+    EXPORTIT PTZDescriptorIndex* DescriptorIndex_new(int descriptor_dim);
+    
+    EXPORTIT void DescriptorIndex_delete(PTZDescriptorIndex* index);
+    
+    // descriptors: n x descriptor_dim float, row major
+    // rays: n x 2 double, pan and tilt of each descriptor
+    EXPORTIT void addDescriptors(PTZDescriptorIndex* index,
+                                 const float* descriptors,
+                                 const double* rays,
+                                 int n);
+    
+    EXPORTIT int getDescriptorNum(PTZDescriptorIndex* index);
+    
+    // queries: n x descriptor_dim float, row major
+    // query_indices, ray_indices: output, n at most
+    // rays: output, n x 2 at most, rays of matched descriptors, can be NULL
+    // return: number of matches with squared distance < max_distance
+    EXPORTIT int matchDescriptors(PTZDescriptorIndex* index,
+                                  const float* queries,
+                                  int n,
+                                  float max_distance,
+                                  int* query_indices,
+                                  int* ray_indices,
+                                  double* rays);
+    
+    // ray_indices: n, rays: output n x 2
+    EXPORTIT void getDescriptorRays(PTZDescriptorIndex* index,
+                                    const int* ray_indices,
+                                    int n,
+                                    double* rays);
+}
+
+#endif /* descriptor_index_hpp */
@@ -0,0 +1,77 @@
+# native incremental descriptor index for the nearest neighbor based map, see util/ptz_descriptor_index.h
+import numpy as np
+from ctypes import cdll
+from ctypes import c_int
+from ctypes import c_float
+from ctypes import c_void_p
+import platform
+
+system = platform.system()
+
+#@todo hardcode library
+if system == "Windows":
+    lib = cdll.LoadLibrary('C:/graduate_design/Pan-tilt-zoom-SLAM/slam_system/rf_map/build/x64/Debug/rf_map_python.dll')
+else:
+    lib = cdll.LoadLibrary('/Users/jimmy/Code/ptz_slam/Pan-tilt-zoom-SLAM/slam_system/rf_map/build/librf_map_python.dylib')
+
+lib.DescriptorIndex_new.restype = c_void_p
+lib.DescriptorIndex_new.argtypes = [c_int]
+lib.DescriptorIndex_delete.argtypes = [c_void_p]
+lib.addDescriptors.argtypes = [c_void_p, c_void_p, c_void_p, c_int]
+lib.getDescriptorNum.restype = c_int
+lib.getDescriptorNum.argtypes = [c_void_p]
+lib.matchDescriptors.restype = c_int
+lib.matchDescriptors.argtypes = [c_void_p, c_void_p, c_int, c_float, c_void_p, c_void_p, c_void_p]
+lib.getDescriptorRays.argtypes = [c_void_p, c_void_p, c_int, c_void_p]
+
+
+class DescriptorIndex:
+    def __init__(self, descriptor_dim=128):
+        self.descriptor_dim = descriptor_dim
+        self.index = lib.DescriptorIndex_new(descriptor_dim)
+
+    def __del__(self):
+        lib.DescriptorIndex_delete(self.index)
+
+    def __len__(self):
+        return lib.getDescriptorNum(self.index)
+
+    def add(self, descriptors, rays):
+        """
+        replace np.row_stack on global_des and global_ray, and build_kdtree
+        :param descriptors: N x descriptor_dim, e.g. SIFT descriptors of a keyframe
+        :param rays: N x 2, back projected keypoints of the keyframe
+        """
+        descriptors = np.ascontiguousarray(descriptors, dtype=np.float32).reshape((-1, self.descriptor_dim))
+        rays = np.ascontiguousarray(rays, dtype=np.float64).reshape((-1, 2))
+        assert descriptors.shape[0] == rays.shape[0]
+        lib.addDescriptors(self.index, c_void_p(descriptors.ctypes.data), c_void_p(rays.ctypes.data),
+                           descriptors.shape[0])
+
+    def find_nearest(self, des, max_distance=2000):
+        """
+        the same as NNBasedMap.find_nearest
+        :param des: N x descriptor_dim
+        :param max_distance: squared L2 distance threshold
+        :return: matched keypoint index, matched ray index, rays of the matches (M x 2)
+        """
+        des = np.ascontiguousarray(des, dtype=np.float32).reshape((-1, self.descriptor_dim))
+        n = des.shape[0]
+        keypoint_index = np.zeros(n, dtype=np.int32)
+        ray_index = np.zeros(n, dtype=np.int32)
+        rays = np.zeros((n, 2))
+        m = lib.matchDescriptors(self.index, c_void_p(des.ctypes.data), n, max_distance,
+                                 c_void_p(keypoint_index.ctypes.data), c_void_p(ray_index.ctypes.data),
+                                 c_void_p(rays.ctypes.data))
+        return keypoint_index[:m], ray_index[:m], rays[:m]
+
+    def rays(self, ray_index):
+        """
+        :param ray_index: M, result of find_nearest
+        :return: M x 2 rays
+        """
+        ray_index = np.ascontiguousarray(ray_index, dtype=np.int32).reshape(-1)
+        rays = np.zeros((ray_index.shape[0], 2))
+        lib.getDescriptorRays(self.index, c_void_p(ray_index.ctypes.data), ray_index.shape[0],
+                              c_void_p(rays.ctypes.data))
+        return rays
@@ -0,0 +1,141 @@
+//
+//  ekf_tracker.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-28.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#include "ekf_tracker.hpp"
+#include <assert.h>
+
+EXPORTIT PTZEKFTracker* EKFTracker_new(double pp_x,
+                                       double pp_y,
+                                       double observation_variance,
+                                       double angle_variance,
+                                       double focal_length_variance)
+{
+    PTZEKFParameter param;
+    param.pp_x_ = pp_x;
+    param.pp_y_ = pp_y;
+    param.observation_variance_ = observation_variance;
+    param.angle_variance_ = angle_variance;
+    param.focal_length_variance_ = focal_length_variance;
+    return new PTZEKFTracker(param);
+}
+
+EXPORTIT void EKFTracker_delete(PTZEKFTracker* tracker)
+{
+    assert(tracker != nullptr);
+    delete tracker;
+}
+
+EXPORTIT void initEKFTracker(PTZEKFTracker* tracker,
+                             const double* pan_tilt_zoom)
+{
+    assert(tracker != nullptr);
+    tracker->init(Eigen::Vector3d(pan_tilt_zoom[0], pan_tilt_zoom[1], pan_tilt_zoom[2]));
+}
+
+EXPORTIT int addEKFRays(PTZEKFTracker* tracker,
+                        const double* points,
+                        int n)
+{
+    assert(tracker != nullptr);
+    vector<Eigen::Vector2d> pts(n);
+    for (int i = 0; i < n; i++) {
+        pts[i] = Eigen::Vector2d(points[2*i], points[2*i+1]);
+    }
+    return tracker->addRays(pts);
+}
+
+EXPORTIT void removeEKFRays(PTZEKFTracker* tracker,
+                            const int* indices,
+                            int n)
+{
+    assert(tracker != nullptr);
+    vector<int> ind(indices, indices + n);
+    tracker->removeRays(ind);
+}
+
+EXPORTIT void predictEKFTracker(PTZEKFTracker* tracker)
+{
+    assert(tracker != nullptr);
+    tracker->predict();
+}
+
+EXPORTIT int updateEKFTracker(PTZEKFTracker* tracker,
+                              const double* points,
+                              const int* ray_indices,
+                              int n)
+{
+    assert(tracker != nullptr);
+    vector<Eigen::Vector2d> pts(n);
+    vector<int> ind(ray_indices, ray_indices + n);
+    for (int i = 0; i < n; i++) {
+        pts[i] = Eigen::Vector2d(points[2*i], points[2*i+1]);
+        if (ind[i] < 0 || ind[i] >= tracker->rayNum()) {
+            printf("Error: invalid ray index %d, ray number %d\n", ind[i], tracker->rayNum());
+            return 0;
+        }
+    }
+    return tracker->update(pts, ind);
+}
+
+EXPORTIT void getEKFState(PTZEKFTracker* tracker,
+                          double* pan_tilt_zoom,
+                          double* velocity,
+                          double* covariance)
+{
+    assert(tracker != nullptr);
+    for (int i = 0; i < 3; i++) {
+        pan_tilt_zoom[i] = tracker->ptz()[i];
+        velocity[i] = tracker->velocity()[i];
+        for (int j = 0; j < 3; j++) {
+            covariance[i * 3 + j] = tracker->cameraCovariance()(i, j);
+        }
+    }
+}
+
+EXPORTIT int getEKFRayNum(PTZEKFTracker* tracker)
+{
+    assert(tracker != nullptr);
+    return tracker->rayNum();
+}
+
+EXPORTIT void getEKFRays(PTZEKFTracker* tracker,
+                         double* rays,
+                         double* covariances)
+{
+    assert(tracker != nullptr);
+    const vector<Eigen::Vector2d> & ptz_rays = tracker->rays();
+    const vector<Eigen::Matrix2d> & ray_covs = tracker->rayCovariances();
+    for (int i = 0; i < ptz_rays.size(); i++) {
+        rays[2*i] = ptz_rays[i].x();
+        rays[2*i+1] = ptz_rays[i].y();
+        if (covariances != NULL) {
+            covariances[4*i]   = ray_covs[i](0, 0);
+            covariances[4*i+1] = ray_covs[i](0, 1);
+            covariances[4*i+2] = ray_covs[i](1, 0);
+            covariances[4*i+3] = ray_covs[i](1, 1);
+        }
+    }
+}
+
+EXPORTIT int projectEKFRays(PTZEKFTracker* tracker,
+                            int width,
+                            int height,
+                            double* points,
+                            int* ray_indices)
+{
+    assert(tracker != nullptr);
+    vector<Eigen::Vector2d> pts;
+    vector<int> ind;
+    tracker->projectRays(width, height, pts, ind);
+    for (int i = 0; i < pts.size(); i++) {
+        points[2*i] = pts[i].x();
+        points[2*i+1] = pts[i].y();
+        ray_indices[i] = ind[i];
+    }
+    return (int)pts.size();
+}
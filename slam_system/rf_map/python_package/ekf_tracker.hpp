@@ -0,0 +1,81 @@
+//
+//  ekf_tracker.hpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-28.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef ekf_tracker_hpp
+#define ekf_tracker_hpp
+
+// C interface of PTZEKFTracker for ptz_slam.py
+#include <stdio.h>
+#include "ptz_ekf_tracker.h"
+
+#ifdef _WIN32
+#define EXPORTIT __declspec( dllexport )
+#else
+#define EXPORTIT
+#endif
+
+extern "C" {
+    // observation_variance: pixel^2
+    // angle_variance: degree^2
+    // focal_length_variance: pixel^2
+    EXPORTIT PTZEKFTracker* EKFTracker_new(double pp_x,
+                                           double pp_y,
+                                           double observation_variance,
+                                           double angle_variance,
+                                           double focal_length_variance);
+    
+    EXPORTIT void EKFTracker_delete(PTZEKFTracker* tracker);
+    
+    EXPORTIT void initEKFTracker(PTZEKFTracker* tracker,
+                                 const double* pan_tilt_zoom);
+    
+    // points: n x 2 double, row major
+    // return: index of the first new ray
+    EXPORTIT int addEKFRays(PTZEKFTracker* tracker,
+                            const double* points,
+                            int n);
+    
+    EXPORTIT void removeEKFRays(PTZEKFTracker* tracker,
+                                const int* indices,
+                                int n);
+    
+    EXPORTIT void predictEKFTracker(PTZEKFTracker* tracker);
+    
+    // points: n x 2 double, row major, observed locations
+    // ray_indices: n, ray index of each point
+    // return: number of used observations
+    EXPORTIT int updateEKFTracker(PTZEKFTracker* tracker,
+                                  const double* points,
+                                  const int* ray_indices,
+                                  int n);
+    
+    // pan_tilt_zoom, velocity: 3
+    // covariance: 3 x 3, camera covariance
+    EXPORTIT void getEKFState(PTZEKFTracker* tracker,
+                              double* pan_tilt_zoom,
+                              double* velocity,
+                              double* covariance);
+    
+    EXPORTIT int getEKFRayNum(PTZEKFTracker* tracker);
+    
+    // rays: ray_num x 2 (pan, tilt)
+    // covariances: ray_num x 4, can be NULL
+    EXPORTIT void getEKFRays(PTZEKFTracker* tracker,
+                             double* rays,
+                             double* covariances);
+    
+    // points: ray_num x 2, ray_indices: ray_num, only the first returned number are valid
+    // return: number of rays in the image
+    EXPORTIT int projectEKFRays(PTZEKFTracker* tracker,
+                                int width,
+                                int height,
+                                double* points,
+                                int* ray_indices);
+}
+
+#endif /* ekf_tracker_hpp */
@@ -0,0 +1,118 @@
+# native EKF of a PTZ camera and ray landmarks, see util/ptz_ekf_tracker.h
+import numpy as np
+from ctypes import cdll
+from ctypes import c_int
+from ctypes import c_double
+from ctypes import c_void_p
+import platform
+
+system = platform.system()
+
+#@todo hardcode library
+if system == "Windows":
+    lib = cdll.LoadLibrary('C:/graduate_design/Pan-tilt-zoom-SLAM/slam_system/rf_map/build/x64/Debug/rf_map_python.dll')
+else:
+    lib = cdll.LoadLibrary('/Users/jimmy/Code/ptz_slam/Pan-tilt-zoom-SLAM/slam_system/rf_map/build/librf_map_python.dylib')
+
+lib.EKFTracker_new.restype = c_void_p
+lib.EKFTracker_new.argtypes = [c_double, c_double, c_double, c_double, c_double]
+lib.EKFTracker_delete.argtypes = [c_void_p]
+lib.initEKFTracker.argtypes = [c_void_p, c_void_p]
+lib.addEKFRays.restype = c_int
+lib.addEKFRays.argtypes = [c_void_p, c_void_p, c_int]
+lib.removeEKFRays.argtypes = [c_void_p, c_void_p, c_int]
+lib.predictEKFTracker.argtypes = [c_void_p]
+lib.updateEKFTracker.restype = c_int
+lib.updateEKFTracker.argtypes = [c_void_p, c_void_p, c_void_p, c_int]
+lib.getEKFState.argtypes = [c_void_p, c_void_p, c_void_p, c_void_p]
+lib.getEKFRayNum.restype = c_int
+lib.getEKFRayNum.argtypes = [c_void_p]
+lib.getEKFRays.argtypes = [c_void_p, c_void_p, c_void_p]
+lib.projectEKFRays.restype = c_int
+lib.projectEKFRays.argtypes = [c_void_p, c_int, c_int, c_void_p, c_void_p]
+
+
+class EKFTracker:
+    def __init__(self, principal_point=(640, 360), observe_var=0.1, angle_var=0.001, f_var=1.0):
+        """
+        default values are the same as ptz_slam.py
+        :param principal_point: image center
+        :param observe_var: observation variance, pixel^2
+        :param angle_var: ray and camera angle variance, degree^2
+        :param f_var: focal length variance, pixel^2
+        """
+        self.tracker = lib.EKFTracker_new(principal_point[0], principal_point[1],
+                                          observe_var, angle_var, f_var)
+
+    def __del__(self):
+        lib.EKFTracker_delete(self.tracker)
+
+    def init(self, pan_tilt_zoom):
+        """
+        start tracking, all rays are removed
+        :param pan_tilt_zoom: 3 x 1, camera pose of the first frame
+        """
+        ptz = np.ascontiguousarray(np.array(pan_tilt_zoom, dtype=np.float64).reshape(3))
+        lib.initEKFTracker(self.tracker, c_void_p(ptz.ctypes.data))
+
+    def add_rays(self, points):
+        """
+        :param points: N x 2, keypoint locations, back projected with the current camera
+        :return: index of the first new ray
+        """
+        points = np.ascontiguousarray(points, dtype=np.float64).reshape((-1, 2))
+        return lib.addEKFRays(self.tracker, c_void_p(points.ctypes.data), points.shape[0])
+
+    def remove_rays(self, indices):
+        """
+        :param indices: ray indices, the other rays keep their order
+        """
+        indices = np.ascontiguousarray(indices, dtype=np.int32).reshape(-1)
+        lib.removeEKFRays(self.tracker, c_void_p(indices.ctypes.data), indices.shape[0])
+
+    def predict(self):
+        lib.predictEKFTracker(self.tracker)
+
+    def update(self, points, ray_indices):
+        """
+        :param points: N x 2, observed keypoint locations
+        :param ray_indices: N, ray index of each point, a ray is observed at most once
+        :return: number of used observations
+        """
+        points = np.ascontiguousarray(points, dtype=np.float64).reshape((-1, 2))
+        ray_indices = np.ascontiguousarray(ray_indices, dtype=np.int32).reshape(-1)
+        assert points.shape[0] == ray_indices.shape[0]
+        return lib.updateEKFTracker(self.tracker, c_void_p(points.ctypes.data),
+                                    c_void_p(ray_indices.ctypes.data), points.shape[0])
+
+    def get_state(self):
+        """
+        :return: pan_tilt_zoom (3 x 1), velocity (3 x 1), camera covariance (3 x 3)
+        """
+        ptz = np.zeros(3)
+        velocity = np.zeros(3)
+        cov = np.zeros((3, 3))
+        lib.getEKFState(self.tracker, c_void_p(ptz.ctypes.data),
+                        c_void_p(velocity.ctypes.data), c_void_p(cov.ctypes.data))
+        return ptz.reshape((3, 1)), velocity.reshape((3, 1)), cov
+
+    def get_rays(self):
+        """
+        :return: rays (N x 2, pan and tilt), covariances (N x 2 x 2)
+        """
+        n = lib.getEKFRayNum(self.tracker)
+        rays = np.zeros((n, 2))
+        covs = np.zeros((n, 2, 2))
+        lib.getEKFRays(self.tracker, c_void_p(rays.ctypes.data), c_void_p(covs.ctypes.data))
+        return rays, covs
+
+    def project_rays(self, width=1280, height=720):
+        """
+        :return: image points (M x 2) and ray indices (M) of rays in the image
+        """
+        n = lib.getEKFRayNum(self.tracker)
+        points = np.zeros((n, 2))
+        indices = np.zeros(n, dtype=np.int32)
+        m = lib.projectEKFRays(self.tracker, width, height,
+                               c_void_p(points.ctypes.data), c_void_p(indices.ctypes.data))
+        return points[:m], indices[:m]
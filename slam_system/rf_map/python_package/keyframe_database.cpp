@@ -0,0 +1,105 @@
+//
+//  keyframe_database.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-30.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#include "keyframe_database.hpp"
+#include <assert.h>
+#include <string.h>
+
+EXPORTIT PTZKeyframeDatabase* KeyframeDatabase_new(int descriptor_dim, double image_width)
+{
+    return new PTZKeyframeDatabase(descriptor_dim, image_width);
+}
+
+EXPORTIT void KeyframeDatabase_delete(PTZKeyframeDatabase* database)
+{
+    assert(database != nullptr);
+    delete database;
+}
+
+EXPORTIT int addKeyframe(PTZKeyframeDatabase* database,
+                         const double* ptz,
+                         const float* keypoints,
+                         const float* descriptors,
+                         int n)
+{
+    assert(database != nullptr);
+    return database->addKeyframe(Eigen::Vector3d(ptz[0], ptz[1], ptz[2]), keypoints, descriptors, n);
+}
+
+EXPORTIT int getKeyframeNum(PTZKeyframeDatabase* database)
+{
+    assert(database != nullptr);
+    return database->size();
+}
+
+EXPORTIT int overlapKeyframes(PTZKeyframeDatabase* database,
+                              const double* ptz,
+                              int* keyframe_ids,
+                              double* overlaps)
+{
+    assert(database != nullptr);
+    vector<int> ids;
+    vector<double> angles;
+    database->overlapKeyframes(Eigen::Vector3d(ptz[0], ptz[1], ptz[2]), ids, angles);
+    for (int i = 0; i < ids.size(); i++) {
+        keyframe_ids[i] = ids[i];
+        overlaps[i] = angles[i];
+    }
+    return (int)ids.size();
+}
+
+EXPORTIT double maxKeyframeOverlap(PTZKeyframeDatabase* database,
+                                   const double* ptz)
+{
+    assert(database != nullptr);
+    return database->maxOverlap(Eigen::Vector3d(ptz[0], ptz[1], ptz[2]));
+}
+
+EXPORTIT bool isGoodNewKeyframe(PTZKeyframeDatabase* database,
+                                const double* ptz,
+                                double threshold1,
+                                double threshold2)
+{
+    assert(database != nullptr);
+    return database->isGoodNewKeyframe(Eigen::Vector3d(ptz[0], ptz[1], ptz[2]), threshold1, threshold2);
+}
+
+EXPORTIT int nearestKeyframe(PTZKeyframeDatabase* database,
+                             const double* ptz)
+{
+    assert(database != nullptr);
+    return database->nearestKeyframe(Eigen::Vector3d(ptz[0], ptz[1], ptz[2]));
+}
+
+EXPORTIT int getKeyframe(PTZKeyframeDatabase* database,
+                         int keyframe_id,
+                         double* ptz)
+{
+    assert(database != nullptr);
+    assert(keyframe_id >= 0 && keyframe_id < database->size());
+    const Eigen::Vector3d & keyframe_ptz = database->ptz(keyframe_id);
+    for (int i = 0; i < 3; i++) {
+        ptz[i] = keyframe_ptz[i];
+    }
+    return database->featureNum(keyframe_id);
+}
+
+EXPORTIT void getKeyframeFeatures(PTZKeyframeDatabase* database,
+                                  int keyframe_id,
+                                  float* keypoints,
+                                  float* descriptors)
+{
+    assert(database != nullptr);
+    assert(keyframe_id >= 0 && keyframe_id < database->size());
+    const int n = database->featureNum(keyframe_id);
+    if (n == 0) {
+        return;
+    }
+    memcpy(keypoints, database->keypoints(keyframe_id), sizeof(float) * n * 2);
+    memcpy(descriptors, database->descriptors(keyframe_id), sizeof(float) * n * database->descriptorDim());
+}
@@ -0,0 +1,69 @@
+//
+//  keyframe_database.hpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-30.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef keyframe_database_hpp
+#define keyframe_database_hpp
+
+// C interface of PTZKeyframeDatabase for scene_map.py and relocalization.py
+#include <stdio.h>
+#include "ptz_keyframe_database.h"
+
+#ifdef _WIN32
+#define EXPORTIT __declspec( dllexport )
+#else
+#define EXPORTIT
+#endif
+
+extern "C" {
+    EXPORTIT PTZKeyframeDatabase* KeyframeDatabase_new(int descriptor_dim, double image_width);
+    
+    EXPORTIT void KeyframeDatabase_delete(PTZKeyframeDatabase* database);
+    
+    // ptz: 3, keypoints: n x 2 float, descriptors: n x descriptor_dim float, row major
+    // return: keyframe id
+    EXPORTIT int addKeyframe(PTZKeyframeDatabase* database,
+                             const double* ptz,
+                             const float* keypoints,
+                             const float* descriptors,
+                             int n);
+    
+    EXPORTIT int getKeyframeNum(PTZKeyframeDatabase* database);
+    
+    // keyframe_ids, overlaps: output, getKeyframeNum() at most
+    // return: number of keyframes that overlap the view of ptz
+    EXPORTIT int overlapKeyframes(PTZKeyframeDatabase* database,
+                                  const double* ptz,
+                                  int* keyframe_ids,
+                                  double* overlaps);
+    
+    EXPORTIT double maxKeyframeOverlap(PTZKeyframeDatabase* database,
+                                       const double* ptz);
+    
+    EXPORTIT bool isGoodNewKeyframe(PTZKeyframeDatabase* database,
+                                    const double* ptz,
+                                    double threshold1,
+                                    double threshold2);
+    
+    // return: keyframe id, -1 if the database is empty
+    EXPORTIT int nearestKeyframe(PTZKeyframeDatabase* database,
+                                 const double* ptz);
+    
+    // ptz: output 3
+    // return: number of keypoints of the keyframe
+    EXPORTIT int getKeyframe(PTZKeyframeDatabase* database,
+                             int keyframe_id,
+                             double* ptz);
+    
+    // keypoints: output n x 2, descriptors: output n x descriptor_dim, n is from getKeyframe
+    EXPORTIT void getKeyframeFeatures(PTZKeyframeDatabase* database,
+                                      int keyframe_id,
+                                      float* keypoints,
+                                      float* descriptors);
+}
+
+#endif /* keyframe_database_hpp */
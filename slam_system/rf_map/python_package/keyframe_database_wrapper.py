@@ -0,0 +1,107 @@
+# native keyframe database keyed by ptz, see util/ptz_keyframe_database.h
+import numpy as np
+from ctypes import cdll
+from ctypes import c_int
+from ctypes import c_double
+from ctypes import c_bool
+from ctypes import c_void_p
+import platform
+
+system = platform.system()
+
+#@todo hardcode library
+if system == "Windows":
+    lib = cdll.LoadLibrary('C:/graduate_design/Pan-tilt-zoom-SLAM/slam_system/rf_map/build/x64/Debug/rf_map_python.dll')
+else:
+    lib = cdll.LoadLibrary('/Users/jimmy/Code/ptz_slam/Pan-tilt-zoom-SLAM/slam_system/rf_map/build/librf_map_python.dylib')
+
+lib.KeyframeDatabase_new.restype = c_void_p
+lib.KeyframeDatabase_new.argtypes = [c_int, c_double]
+lib.KeyframeDatabase_delete.argtypes = [c_void_p]
+lib.addKeyframe.restype = c_int
+lib.addKeyframe.argtypes = [c_void_p, c_void_p, c_void_p, c_void_p, c_int]
+lib.getKeyframeNum.restype = c_int
+lib.getKeyframeNum.argtypes = [c_void_p]
+lib.overlapKeyframes.restype = c_int
+lib.overlapKeyframes.argtypes = [c_void_p, c_void_p, c_void_p, c_void_p]
+lib.maxKeyframeOverlap.restype = c_double
+lib.maxKeyframeOverlap.argtypes = [c_void_p, c_void_p]
+lib.isGoodNewKeyframe.restype = c_bool
+lib.isGoodNewKeyframe.argtypes = [c_void_p, c_void_p, c_double, c_double]
+lib.nearestKeyframe.restype = c_int
+lib.nearestKeyframe.argtypes = [c_void_p, c_void_p]
+lib.getKeyframe.restype = c_int
+lib.getKeyframe.argtypes = [c_void_p, c_int, c_void_p]
+lib.getKeyframeFeatures.argtypes = [c_void_p, c_int, c_void_p, c_void_p]
+
+
+class KeyframeDatabase:
+    def __init__(self, descriptor_dim=128, im_width=1280):
+        self.descriptor_dim = descriptor_dim
+        self.database = lib.KeyframeDatabase_new(descriptor_dim, im_width)
+
+    def __del__(self):
+        lib.KeyframeDatabase_delete(self.database)
+
+    def __len__(self):
+        return lib.getKeyframeNum(self.database)
+
+    def add(self, ptz, keypoints, descriptors):
+        """
+        :param ptz: array [3], pan, tilt, focal length of the keyframe
+        :param keypoints: N x 2
+        :param descriptors: N x descriptor_dim
+        :return: keyframe id, the same as the index in Map.keyframe_list
+        """
+        ptz = np.ascontiguousarray(ptz, dtype=np.float64).reshape(3)
+        keypoints = np.ascontiguousarray(keypoints, dtype=np.float32).reshape((-1, 2))
+        descriptors = np.ascontiguousarray(descriptors, dtype=np.float32).reshape((-1, self.descriptor_dim))
+        assert keypoints.shape[0] == descriptors.shape[0]
+        return lib.addKeyframe(self.database, c_void_p(ptz.ctypes.data), c_void_p(keypoints.ctypes.data),
+                               c_void_p(descriptors.ctypes.data), keypoints.shape[0])
+
+    def overlap_keyframes(self, ptz):
+        """
+        keyframes overlapping the view, e.g., candidates in relocalization_camera
+        :param ptz: array [3]
+        :return: keyframe ids and overlapped pan angles (degree), sorted by overlap in descending order
+        """
+        ptz = np.ascontiguousarray(ptz, dtype=np.float64).reshape(3)
+        n = len(self)
+        ids = np.zeros(n, dtype=np.int32)
+        overlaps = np.zeros(n)
+        m = lib.overlapKeyframes(self.database, c_void_p(ptz.ctypes.data), c_void_p(ids.ctypes.data),
+                                 c_void_p(overlaps.ctypes.data))
+        order = np.argsort(-overlaps[:m])
+        return ids[:m][order], overlaps[:m][order]
+
+    def max_overlap(self, ptz):
+        ptz = np.ascontiguousarray(ptz, dtype=np.float64).reshape(3)
+        return lib.maxKeyframeOverlap(self.database, c_void_p(ptz.ctypes.data))
+
+    def good_new_keyframe(self, ptz, threshold1=5, threshold2=20):
+        """
+        the same as Map.good_new_keyframe, im_width is set in the constructor
+        """
+        ptz = np.ascontiguousarray(ptz, dtype=np.float64).reshape(3)
+        return lib.isGoodNewKeyframe(self.database, c_void_p(ptz.ctypes.data), threshold1, threshold2)
+
+    def nearest_keyframe(self, ptz):
+        """
+        :param ptz: array [3]
+        :return: keyframe id, -1 if the database is empty
+        """
+        ptz = np.ascontiguousarray(ptz, dtype=np.float64).reshape(3)
+        return lib.nearestKeyframe(self.database, c_void_p(ptz.ctypes.data))
+
+    def keyframe(self, keyframe_id):
+        """
+        :return: ptz, keypoints (N x 2), descriptors (N x descriptor_dim)
+        """
+        ptz = np.zeros(3)
+        n = lib.getKeyframe(self.database, keyframe_id, c_void_p(ptz.ctypes.data))
+        keypoints = np.zeros((n, 2), dtype=np.float32)
+        descriptors = np.zeros((n, self.descriptor_dim), dtype=np.float32)
+        lib.getKeyframeFeatures(self.database, keyframe_id, c_void_p(keypoints.ctypes.data),
+                                c_void_p(descriptors.ctypes.data))
+        return ptz, keypoints, descriptors
@@ -0,0 +1,167 @@
+//
+//  landmark_store.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-29.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#include "landmark_store.hpp"
+#include <assert.h>
+#include <string.h>
+
+EXPORTIT PTZLandmarkStore* LandmarkStore_new(int descriptor_dim)
+{
+    return new PTZLandmarkStore(descriptor_dim);
+}
+
+EXPORTIT void LandmarkStore_delete(PTZLandmarkStore* store)
+{
+    assert(store != nullptr);
+    delete store;
+}
+
+EXPORTIT void clearLandmarks(PTZLandmarkStore* store)
+{
+    assert(store != nullptr);
+    store->clear();
+}
+
+EXPORTIT void addLandmarks(PTZLandmarkStore* store,
+                           const double* rays,
+                           const float* descriptors,
+                           const double* covariances,
+                           const double* cross_covariances,
+                           int n,
+                           long long* handles)
+{
+    assert(store != nullptr);
+    const int dim = store->descriptorDim();
+    for (int i = 0; i < n; i++) {
+        Eigen::Vector2d ray(rays[2*i], rays[2*i+1]);
+        Eigen::Matrix2d cov = Eigen::Matrix2d::Zero();
+        if (covariances != NULL) {
+            cov = Eigen::Map<const Eigen::Matrix<double, 2, 2, Eigen::RowMajor> >(covariances + 4*i);
+        }
+        Eigen::Matrix<double, 3, 2> cross_cov = Eigen::Matrix<double, 3, 2>::Zero();
+        if (cross_covariances != NULL) {
+            cross_cov = Eigen::Map<const Eigen::Matrix<double, 3, 2, Eigen::RowMajor> >(cross_covariances + 6*i);
+        }
+        const float* desc = descriptors != NULL ? descriptors + (size_t)i * dim : NULL;
+        handles[i] = store->add(ray, desc, cov, &cross_cov);
+    }
+}
+
+EXPORTIT int removeLandmarks(PTZLandmarkStore* store,
+                             const long long* handles,
+                             int n)
+{
+    assert(store != nullptr);
+    int num = 0;
+    for (int i = 0; i < n; i++) {
+        if (store->remove(handles[i])) {
+            num++;
+        }
+    }
+    return num;
+}
+
+EXPORTIT int getLandmarkNum(PTZLandmarkStore* store)
+{
+    assert(store != nullptr);
+    return store->size();
+}
+
+EXPORTIT void getLandmarkHandles(PTZLandmarkStore* store,
+                                 long long* handles)
+{
+    assert(store != nullptr);
+    for (int i = 0; i < store->size(); i++) {
+        handles[i] = store->handle(i);
+    }
+}
+
+EXPORTIT int getLandmarks(PTZLandmarkStore* store,
+                          const long long* handles,
+                          int n,
+                          double* rays,
+                          float* descriptors,
+                          double* covariances,
+                          double* cross_covariances)
+{
+    assert(store != nullptr);
+    const int dim = store->descriptorDim();
+    int num = 0;
+    for (int i = 0; i < n; i++) {
+        if (!store->isValid(handles[i])) {
+            continue;
+        }
+        num++;
+        const int s = store->slot(handles[i]);
+        if (rays != NULL) {
+            rays[2*i] = store->ray(s).x();
+            rays[2*i+1] = store->ray(s).y();
+        }
+        if (descriptors != NULL) {
+            memcpy(descriptors + (size_t)i * dim, store->descriptor(s), sizeof(float) * dim);
+        }
+        if (covariances != NULL) {
+            Eigen::Map<Eigen::Matrix<double, 2, 2, Eigen::RowMajor> >(covariances + 4*i) = store->covariance(s);
+        }
+        if (cross_covariances != NULL) {
+            Eigen::Map<Eigen::Matrix<double, 3, 2, Eigen::RowMajor> >(cross_covariances + 6*i) = store->crossCovariance(s);
+        }
+    }
+    return num;
+}
+
+EXPORTIT int setLandmarks(PTZLandmarkStore* store,
+                          const long long* handles,
+                          int n,
+                          const double* rays,
+                          const double* covariances,
+                          const double* cross_covariances)
+{
+    assert(store != nullptr);
+    int num = 0;
+    for (int i = 0; i < n; i++) {
+        if (!store->isValid(handles[i])) {
+            continue;
+        }
+        num++;
+        const int s = store->slot(handles[i]);
+        if (rays != NULL) {
+            store->setRay(s, Eigen::Vector2d(rays[2*i], rays[2*i+1]));
+        }
+        if (covariances != NULL) {
+            store->covariance(s) = Eigen::Map<const Eigen::Matrix<double, 2, 2, Eigen::RowMajor> >(covariances + 4*i);
+        }
+        if (cross_covariances != NULL) {
+            store->crossCovariance(s) = Eigen::Map<const Eigen::Matrix<double, 3, 2, Eigen::RowMajor> >(cross_covariances + 6*i);
+        }
+    }
+    return num;
+}
+
+EXPORTIT int getVisibleLandmarks(PTZLandmarkStore* store,
+                                 double pp_x,
+                                 double pp_y,
+                                 const double* pan_tilt_zoom,
+                                 int width,
+                                 int height,
+                                 long long* handles,
+                                 double* points)
+{
+    assert(store != nullptr);
+    vector<PTZLandmarkStore::Handle> visible_handles;
+    vector<Eigen::Vector2d> visible_points;
+    store->visibleLandmarks(Eigen::Vector2d(pp_x, pp_y),
+                            Eigen::Vector3d(pan_tilt_zoom[0], pan_tilt_zoom[1], pan_tilt_zoom[2]),
+                            width, height, visible_handles, visible_points);
+    for (int i = 0; i < visible_handles.size(); i++) {
+        handles[i] = visible_handles[i];
+        points[2*i] = visible_points[i].x();
+        points[2*i+1] = visible_points[i].y();
+    }
+    return (int)visible_handles.size();
+}
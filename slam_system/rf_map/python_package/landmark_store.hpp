@@ -0,0 +1,86 @@
+//
+//  landmark_store.hpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-29.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef landmark_store_hpp
+#define landmark_store_hpp
+
+// C interface of PTZLandmarkStore for ptz_slam.py
+// handles are long long, -1 is invalid
+#include <stdio.h>
+#include "ptz_landmark_store.h"
+
+#ifdef _WIN32
+#define EXPORTIT __declspec( dllexport )
+#else
+#define EXPORTIT
+#endif
+
+extern "C" {
+    EXPORTIT PTZLandmarkStore* LandmarkStore_new(int descriptor_dim);
+    
+    EXPORTIT void LandmarkStore_delete(PTZLandmarkStore* store);
+    
+    EXPORTIT void clearLandmarks(PTZLandmarkStore* store);
+    
+    // rays: n x 2, pan and tilt
+    // descriptors: n x descriptor_dim float, can be NULL
+    // covariances: n x 4, 2 x 2 row major, can be NULL
+    // cross_covariances: n x 6, 3 x 2 row major, can be NULL
+    // handles: output, n
+    EXPORTIT void addLandmarks(PTZLandmarkStore* store,
+                               const double* rays,
+                               const float* descriptors,
+                               const double* covariances,
+                               const double* cross_covariances,
+                               int n,
+                               long long* handles);
+    
+    // return: number of removed landmarks, invalid handles are ignored
+    EXPORTIT int removeLandmarks(PTZLandmarkStore* store,
+                                 const long long* handles,
+                                 int n);
+    
+    EXPORTIT int getLandmarkNum(PTZLandmarkStore* store);
+    
+    // handles of all landmarks, getLandmarkNum() long long
+    EXPORTIT void getLandmarkHandles(PTZLandmarkStore* store,
+                                     long long* handles);
+    
+    // read landmarks, outputs can be NULL
+    // return: number of valid handles, values of invalid handles are not written
+    EXPORTIT int getLandmarks(PTZLandmarkStore* store,
+                              const long long* handles,
+                              int n,
+                              double* rays,
+                              float* descriptors,
+                              double* covariances,
+                              double* cross_covariances);
+    
+    // write back updated landmarks, inputs can be NULL
+    // return: number of valid handles
+    EXPORTIT int setLandmarks(PTZLandmarkStore* store,
+                              const long long* handles,
+                              int n,
+                              const double* rays,
+                              const double* covariances,
+                              const double* cross_covariances);
+    
+    // landmarks whose projection are in the image, only landmarks around the field of view are projected
+    // handles, points: output, getLandmarkNum() and getLandmarkNum() x 2 at most
+    // return: number of visible landmarks
+    EXPORTIT int getVisibleLandmarks(PTZLandmarkStore* store,
+                                     double pp_x,
+                                     double pp_y,
+                                     const double* pan_tilt_zoom,
+                                     int width,
+                                     int height,
+                                     long long* handles,
+                                     double* points);
+}
+
+#endif /* landmark_store_hpp */
@@ -0,0 +1,135 @@
+# native landmark store of ray landmarks, see util/ptz_landmark_store.h
+import numpy as np
+from ctypes import cdll
+from ctypes import c_int
+from ctypes import c_double
+from ctypes import c_void_p
+import platform
+
+system = platform.system()
+
+#@todo hardcode library
+if system == "Windows":
+    lib = cdll.LoadLibrary('C:/graduate_design/Pan-tilt-zoom-SLAM/slam_system/rf_map/build/x64/Debug/rf_map_python.dll')
+else:
+    lib = cdll.LoadLibrary('/Users/jimmy/Code/ptz_slam/Pan-tilt-zoom-SLAM/slam_system/rf_map/build/librf_map_python.dylib')
+
+lib.LandmarkStore_new.restype = c_void_p
+lib.LandmarkStore_new.argtypes = [c_int]
+lib.LandmarkStore_delete.argtypes = [c_void_p]
+lib.clearLandmarks.argtypes = [c_void_p]
+lib.addLandmarks.argtypes = [c_void_p, c_void_p, c_void_p, c_void_p, c_void_p, c_int, c_void_p]
+lib.removeLandmarks.restype = c_int
+lib.removeLandmarks.argtypes = [c_void_p, c_void_p, c_int]
+lib.getLandmarkNum.restype = c_int
+lib.getLandmarkNum.argtypes = [c_void_p]
+lib.getLandmarkHandles.argtypes = [c_void_p, c_void_p]
+lib.getLandmarks.restype = c_int
+lib.getLandmarks.argtypes = [c_void_p, c_void_p, c_int, c_void_p, c_void_p, c_void_p, c_void_p]
+lib.setLandmarks.restype = c_int
+lib.setLandmarks.argtypes = [c_void_p, c_void_p, c_int, c_void_p, c_void_p, c_void_p]
+lib.getVisibleLandmarks.restype = c_int
+lib.getVisibleLandmarks.argtypes = [c_void_p, c_double, c_double, c_void_p, c_int, c_int, c_void_p, c_void_p]
+
+
+def _pointer(array):
+    return None if array is None else c_void_p(array.ctypes.data)
+
+
+class LandmarkStore:
+    def __init__(self, descriptor_dim=128):
+        self.descriptor_dim = descriptor_dim
+        self.store = lib.LandmarkStore_new(descriptor_dim)
+
+    def __del__(self):
+        lib.LandmarkStore_delete(self.store)
+
+    def __len__(self):
+        return lib.getLandmarkNum(self.store)
+
+    def clear(self):
+        lib.clearLandmarks(self.store)
+
+    def add(self, rays, descriptors=None, covariances=None, cross_covariances=None):
+        """
+        replace np.row_stack on rays, descriptors and the covariance matrix
+        :param rays: N x 2, pan and tilt
+        :param descriptors: N x descriptor_dim or None
+        :param covariances: N x 2 x 2 or None (zeros)
+        :param cross_covariances: N x 3 x 2, camera-ray covariance, or None (zeros)
+        :return: N handles (int64), stable until the landmark is removed
+        """
+        rays = np.ascontiguousarray(rays, dtype=np.float64).reshape((-1, 2))
+        n = rays.shape[0]
+        if descriptors is not None:
+            descriptors = np.ascontiguousarray(descriptors, dtype=np.float32).reshape((n, self.descriptor_dim))
+        if covariances is not None:
+            covariances = np.ascontiguousarray(covariances, dtype=np.float64).reshape((n, 2, 2))
+        if cross_covariances is not None:
+            cross_covariances = np.ascontiguousarray(cross_covariances, dtype=np.float64).reshape((n, 3, 2))
+        handles = np.zeros(n, dtype=np.int64)
+        lib.addLandmarks(self.store, _pointer(rays), _pointer(descriptors), _pointer(covariances),
+                         _pointer(cross_covariances), n, _pointer(handles))
+        return handles
+
+    def remove(self, handles):
+        """
+        replace np.delete, other handles are not changed
+        :param handles: handles of removed landmarks
+        :return: number of removed landmarks
+        """
+        handles = np.ascontiguousarray(handles, dtype=np.int64).reshape(-1)
+        return lib.removeLandmarks(self.store, _pointer(handles), handles.shape[0])
+
+    def handles(self):
+        """
+        :return: handles of all landmarks
+        """
+        handles = np.zeros(len(self), dtype=np.int64)
+        lib.getLandmarkHandles(self.store, _pointer(handles))
+        return handles
+
+    def get(self, handles):
+        """
+        :return: rays (N x 2), descriptors (N x descriptor_dim), covariances (N x 2 x 2),
+        cross covariances (N x 3 x 2)
+        """
+        handles = np.ascontiguousarray(handles, dtype=np.int64).reshape(-1)
+        n = handles.shape[0]
+        rays = np.zeros((n, 2))
+        descriptors = np.zeros((n, self.descriptor_dim), dtype=np.float32)
+        covariances = np.zeros((n, 2, 2))
+        cross_covariances = np.zeros((n, 3, 2))
+        valid_num = lib.getLandmarks(self.store, _pointer(handles), n, _pointer(rays), _pointer(descriptors),
+                                     _pointer(covariances), _pointer(cross_covariances))
+        assert valid_num == n
+        return rays, descriptors, covariances, cross_covariances
+
+    def set(self, handles, rays=None, covariances=None, cross_covariances=None):
+        """
+        write back the landmarks after an EKF update
+        """
+        handles = np.ascontiguousarray(handles, dtype=np.int64).reshape(-1)
+        n = handles.shape[0]
+        if rays is not None:
+            rays = np.ascontiguousarray(rays, dtype=np.float64).reshape((n, 2))
+        if covariances is not None:
+            covariances = np.ascontiguousarray(covariances, dtype=np.float64).reshape((n, 2, 2))
+        if cross_covariances is not None:
+            cross_covariances = np.ascontiguousarray(cross_covariances, dtype=np.float64).reshape((n, 3, 2))
+        return lib.setLandmarks(self.store, _pointer(handles), n, _pointer(rays),
+                                _pointer(covariances), _pointer(cross_covariances))
+
+    def visible(self, pan_tilt_zoom, width=1280, height=720, principal_point=(640, 360)):
+        """
+        replace PTZCamera.project_rays on all rays, only landmarks around the field of view are projected
+        :param pan_tilt_zoom: 3 x 1, current camera
+        :return: image points (M x 2) and handles (M) of landmarks in the image
+        """
+        ptz = np.ascontiguousarray(np.array(pan_tilt_zoom, dtype=np.float64).reshape(3))
+        n = len(self)
+        handles = np.zeros(n, dtype=np.int64)
+        points = np.zeros((n, 2))
+        m = lib.getVisibleLandmarks(self.store, principal_point[0], principal_point[1], _pointer(ptz),
+                                    width, height, _pointer(handles), _pointer(points))
+        return points[:m], handles[:m]
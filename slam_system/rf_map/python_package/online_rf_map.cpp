@@ -7,7 +7,7 @@
 //
 
 #include "online_rf_map.hpp"
-#include "ptz_pose_estimation.h"
+#include <string.h>
 
 OnlineRFMap::OnlineRFMap()
 {
@@ -49,65 +49,105 @@ void OnlineRFMap::updateMap(const char * feature_label_file,
 
 
 
+void OnlineRFMap::createMap(const float* keypoints,
+                            const float* descriptors,
+                            const int n,
+                            const int descriptor_dim,
+                            const double* pan_tilt_zoom,
+                            const char * model_parameter_file,
+                            const char * model_name)
+{
+    btdtr_ptz_util::PTZTreeParameter tree_param;
+    tree_param.readFromFile(model_parameter_file);
+    
+    builder_.setTreeParameter(tree_param);
+    Eigen::Vector3f ptz(pan_tilt_zoom[0], pan_tilt_zoom[1], pan_tilt_zoom[2]);
+    int keyframe_index = builder_.addKeyframe(keypoints, descriptors, n, descriptor_dim, ptz);
+    builder_.addTree(model_, keyframe_index, model_name, false);
+}
+
+void OnlineRFMap::updateMap(const float* keypoints,
+                            const float* descriptors,
+                            const int n,
+                            const int descriptor_dim,
+                            const double* pan_tilt_zoom,
+                            const char * model_name)
+{
+    const double error_threshold = 0.1;
+    const double percentage_threshold = 0.5;
+    Eigen::Vector3f ptz(pan_tilt_zoom[0], pan_tilt_zoom[1], pan_tilt_zoom[2]);
+    int keyframe_index = builder_.addKeyframe(keypoints, descriptors, n, descriptor_dim, ptz);
+    bool is_add = builder_.isAddTree(model_, keyframe_index,
+                                     error_threshold, percentage_threshold);
+    if (is_add) {
+        builder_.addTree(model_, keyframe_index, model_name, false);
+    }
+    else {
+        builder_.updateTree(model_, keyframe_index, model_name, false);
+    }
+}
+
+void OnlineRFMap::setBudget(const OnlineRFMapBudget & budget)
+{
+    builder_.setBudget(budget);
+}
+
+void OnlineRFMap::setRelocalizerParameter(const PTZRelocalizerParameter & param)
+{
+    relocalizer_.setParameter(param);
+}
+
 void OnlineRFMap::relocalizeCamera(const char* feature_location_file_name,
                                  const char* test_parameter_file,
                                  double* pan_tilt_zoom)
 {
-    //@todo the same code as in RFMap
-    int max_check = 4;
-    double distance_threshold = 0.2;
-    Eigen::Vector2f pp(1280/2.0, 720/2.0);
-    ptz_pose_opt::PTZPreemptiveRANSACParameter ransac_param;
-    ransac_param.reprojection_error_threshold_ = 2.0;
-    ransac_param.sample_number_ = 32;
+    // the testing parameter is for this call only, the configured parameter is restored
+    const PTZRelocalizerParameter configured_param = relocalizer_.getParameter();
+    if (test_parameter_file != NULL && strlen(test_parameter_file) > 0) {
+        PTZRelocalizerParameter param = configured_param;
+        if (param.readFromFile(test_parameter_file)) {
+            relocalizer_.setParameter(param);
+        }
+    }
+    const PTZRelocalizerParameter & param = relocalizer_.getParameter();
+    Eigen::Vector2f pp(param.pp_x_, param.pp_y_);
     
     vector<btdtr_ptz_util::PTZSample> samples;
     btdtr_ptz_util::generatePTZSampleWithFeature(feature_location_file_name,
                                                  pp, samples);
-    printf("feature number is %lu\n", samples.size());
     
-    vector<Eigen::Vector2d> image_points;
-    vector<vector<Eigen::Vector2d> > candidate_pan_tilt;
-    Eigen::Vector3d estimated_ptz(pan_tilt_zoom[0], pan_tilt_zoom[1], pan_tilt_zoom[2]);
-    // predict from observation (descriptors)
-    double tt = clock();
-    for (int j = 0; j<samples.size(); j++) {
-        btdtr_ptz_util::PTZSample s = samples[j];
-        Eigen::VectorXf feat = s.descriptor_;
-        vector<Eigen::VectorXf> cur_predictions;
-        vector<float> cur_dists;
-        model_.predict(feat, max_check, cur_predictions, cur_dists);
-        assert(cur_predictions.size() == cur_dists.size());
-        
-        //cout<<"minimum feature distance "<<cur_dists[0]<<endl;
-        if (cur_dists[0] < distance_threshold) {
-            image_points.push_back(Eigen::Vector2d(s.loc_.x(), s.loc_.y()));
-            vector<Eigen::Vector2d> cur_candidate;
-            for (int k = 0; k<cur_predictions.size(); k++) {
-                assert(cur_predictions[k].size() == 2);
-                if (cur_dists[k] < distance_threshold) {
-                    cur_candidate.push_back(Eigen::Vector2d(cur_predictions[k][0], cur_predictions[k][1]));
-                }
-            }
-            //printf("min feature distance is %lf\n", cur_dists[0]);
-            candidate_pan_tilt.push_back(cur_candidate);
-        }
-    }
-    printf("candidate point number %lu\n", candidate_pan_tilt.size());
-    // estimate camera pose
-    bool is_opt = ptz_pose_opt::preemptiveRANSACOneToMany(image_points, candidate_pan_tilt,
-                                                          pp.cast<double>(),
-                                                          ransac_param, estimated_ptz, false);
-    printf("Prediction and camera pose estimation cost time: %f seconds.\n", (clock() - tt)/CLOCKS_PER_SEC);
-    if (!is_opt) {
-        printf("-------------------------------------------- Optimize PTZ failed.\n");
-        printf("valid feature number is %lu\n\n", image_points.size());
-    }
-    else {
-        pan_tilt_zoom[0] = estimated_ptz[0];
-        pan_tilt_zoom[1] = estimated_ptz[1];
-        pan_tilt_zoom[2] = estimated_ptz[2];
-    }
+    // keypoint, candidate and failure numbers are in DTProfiler
+    relocalizer_.relocalize(model_, samples, pan_tilt_zoom);
+    relocalizer_.setParameter(configured_param);
+}
+
+int OnlineRFMap::relocalizeCamera(const float* keypoints,
+                                  const float* descriptors,
+                                  const int n,
+                                  const int descriptor_dim,
+                                  const Eigen::Vector2d& pp,
+                                  const ptz_pose_opt::PTZPreemptiveRANSACParameter& ransac_param,
+                                  double* pan_tilt_zoom)
+{
+    // per call principal point and RANSAC parameter, the configured parameter is restored
+    const PTZRelocalizerParameter configured_param = relocalizer_.getParameter();
+    PTZRelocalizerParameter param = configured_param;
+    param.pp_x_ = pp.x();
+    param.pp_y_ = pp.y();
+    param.ransac_param_ = ransac_param;
+    relocalizer_.setParameter(param);
+    int inlier_num = relocalizer_.relocalize(model_, keypoints, descriptors, n, descriptor_dim, pan_tilt_zoom);
+    relocalizer_.setParameter(configured_param);
+    return inlier_num;
+}
+
+int OnlineRFMap::relocalizeCamera(const float* keypoints,
+                                  const float* descriptors,
+                                  const int n,
+                                  const int descriptor_dim,
+                                  double* pan_tilt_zoom)
+{
+    return relocalizer_.relocalize(model_, keypoints, descriptors, n, descriptor_dim, pan_tilt_zoom);
 }
 
 
@@ -142,6 +182,45 @@ EXPORTIT void updateOnlineMap(OnlineRFMap* ol_rf_map,
     ol_rf_map->updateMap(feature_label_file, model_name);
 }
 
+EXPORTIT void createOnlineMapFromBuffer(OnlineRFMap* ol_rf_map,
+                                        const float* keypoints,
+                                        const float* descriptors,
+                                        int n,
+                                        int descriptor_dim,
+                                        const double* pan_tilt_zoom,
+                                        const char * model_parameter_file,
+                                        const char * model_name)
+{
+    assert(ol_rf_map != nullptr);
+    ol_rf_map->createMap(keypoints, descriptors, n, descriptor_dim, pan_tilt_zoom,
+                         model_parameter_file, model_name);
+}
+
+EXPORTIT void updateOnlineMapFromBuffer(OnlineRFMap* ol_rf_map,
+                                        const float* keypoints,
+                                        const float* descriptors,
+                                        int n,
+                                        int descriptor_dim,
+                                        const double* pan_tilt_zoom,
+                                        const char * model_name)
+{
+    assert(ol_rf_map != nullptr);
+    ol_rf_map->updateMap(keypoints, descriptors, n, descriptor_dim, pan_tilt_zoom, model_name);
+}
+
+EXPORTIT void setOnlineMapBudget(OnlineRFMap* ol_rf_map,
+                                 int max_tree_num,
+                                 int max_tree_keyframe_num,
+                                 double merge_overlap_ratio)
+{
+    assert(ol_rf_map != nullptr);
+    OnlineRFMapBudget budget;
+    budget.max_tree_num_ = max_tree_num;
+    budget.max_tree_keyframe_num_ = max_tree_keyframe_num;
+    budget.merge_overlap_ratio_ = merge_overlap_ratio;
+    ol_rf_map->setBudget(budget);
+}
+
 EXPORTIT void relocalizeCameraOnline(OnlineRFMap* ol_rf_map,
                                const char* feature_location_file_name,
                                const char* test_parameter_file,
@@ -150,3 +229,74 @@ EXPORTIT void relocalizeCameraOnline(OnlineRFMap* ol_rf_map,
     assert(ol_rf_map != nullptr);
     ol_rf_map->relocalizeCamera(feature_location_file_name, test_parameter_file, pan_tilt_zoom);
 }
+
+EXPORTIT int relocalizeCameraOnlineFromBuffer(OnlineRFMap* ol_rf_map,
+                                              const float* keypoints,
+                                              const float* descriptors,
+                                              int n,
+                                              int descriptor_dim,
+                                              double pp_x,
+                                              double pp_y,
+                                              double reprojection_error_threshold,
+                                              int ransac_sample_number,
+                                              double* pan_tilt_zoom)
+{
+    assert(ol_rf_map != nullptr);
+    if (descriptor_dim != ol_rf_map->model_.featureDim()) {
+        printf("Error: descriptor dimension %d, model %d\n", descriptor_dim, ol_rf_map->model_.featureDim());
+        return 0;
+    }
+    ptz_pose_opt::PTZPreemptiveRANSACParameter ransac_param;
+    ransac_param.reprojection_error_threshold_ = reprojection_error_threshold;
+    ransac_param.sample_number_ = ransac_sample_number;
+    return ol_rf_map->relocalizeCamera(keypoints, descriptors, n, descriptor_dim,
+                                       Eigen::Vector2d(pp_x, pp_y), ransac_param, pan_tilt_zoom);
+}
+
+EXPORTIT void configureOnlineRelocalizer(OnlineRFMap* ol_rf_map,
+                                         double pp_x,
+                                         double pp_y,
+                                         int max_check,
+                                         double distance_threshold,
+                                         double reprojection_error_threshold,
+                                         int ransac_sample_number,
+                                         int thread_num)
+{
+    assert(ol_rf_map != nullptr);
+    PTZRelocalizerParameter param = ol_rf_map->relocalizer_.getParameter();
+    param.pp_x_ = pp_x;
+    param.pp_y_ = pp_y;
+    param.max_check_ = max_check;
+    param.distance_threshold_ = distance_threshold;
+    param.ransac_param_.reprojection_error_threshold_ = reprojection_error_threshold;
+    param.ransac_param_.sample_number_ = ransac_sample_number;
+    param.thread_num_ = thread_num;
+    ol_rf_map->setRelocalizerParameter(param);
+}
+
+EXPORTIT int configureOnlineRelocalizerFromFile(OnlineRFMap* ol_rf_map,
+                                                const char* test_parameter_file)
+{
+    assert(ol_rf_map != nullptr);
+    PTZRelocalizerParameter param = ol_rf_map->relocalizer_.getParameter();
+    if (!param.readFromFile(test_parameter_file)) {
+        return 0;
+    }
+    ol_rf_map->setRelocalizerParameter(param);
+    return 1;
+}
+
+EXPORTIT int relocalizeCameraOnlineConfigured(OnlineRFMap* ol_rf_map,
+                                              const float* keypoints,
+                                              const float* descriptors,
+                                              int n,
+                                              int descriptor_dim,
+                                              double* pan_tilt_zoom)
+{
+    assert(ol_rf_map != nullptr);
+    if (descriptor_dim != ol_rf_map->model_.featureDim()) {
+        printf("Error: descriptor dimension %d, model %d\n", descriptor_dim, ol_rf_map->model_.featureDim());
+        return 0;
+    }
+    return ol_rf_map->relocalizeCamera(keypoints, descriptors, n, descriptor_dim, pan_tilt_zoom);
+}
@@ -11,6 +11,8 @@
 
 #include <stdio.h>
 #include "online_rf_map_builder.hpp"
+#include "ptz_pose_estimation.h"
+#include "ptz_relocalizer.h"
 
 #ifdef _WIN32
 #define EXPORTIT __declspec( dllexport )
@@ -22,6 +24,7 @@ class OnlineRFMap {
 public:
     OnlineRFMapBuilder builder_;
     BTDTRegressor model_;
+    PTZRelocalizer relocalizer_;  // configured once, reused by every relocalization
 public:
     OnlineRFMap();
     ~OnlineRFMap();
@@ -36,13 +39,58 @@ public:
     void updateMap(const char * feature_label_file,
                    const char * model_name);
     
+    // create/update a map from a keyframe in memory
+    // keypoints: n x 2, row major
+    // descriptors: n x descriptor_dim, row major
+    // pan_tilt_zoom: camera pose of the keyframe
+    // model_name: can be NULL, then the model is not saved
+    void createMap(const float* keypoints,
+                   const float* descriptors,
+                   const int n,
+                   const int descriptor_dim,
+                   const double* pan_tilt_zoom,
+                   const char * model_parameter_file,
+                   const char * model_name);
+    
+    void updateMap(const float* keypoints,
+                   const float* descriptors,
+                   const int n,
+                   const int descriptor_dim,
+                   const double* pan_tilt_zoom,
+                   const char * model_name);
+    
+    
+    // bound the tree number and the keyframes kept in memory
+    void setBudget(const OnlineRFMapBudget & budget);
+    
+    // configure image geometry, thresholds and threads of relocalization
+    void setRelocalizerParameter(const PTZRelocalizerParameter & param);
     
     // relocalize a camera using the model
-    // parameter_file: testing parameter
+    // parameter_file: testing parameter of this call, see PTZRelocalizerParameter, ignored if empty
+    //                 the configured parameter is kept
     // pan_tilt_zoom: input output
     void relocalizeCamera(const char* feature_location_file_name,
                           const char* test_parameter_file,
-                          double* pan_tilt_zoom);    
+                          double* pan_tilt_zoom);
+    
+    // relocalize a camera from keypoints and descriptors in memory
+    // pp, ransac_param: used in this call only, the configured parameter is kept
+    // return: number of inliers, 0 if failed
+    int relocalizeCamera(const float* keypoints,
+                         const float* descriptors,
+                         const int n,
+                         const int descriptor_dim,
+                         const Eigen::Vector2d& pp,
+                         const ptz_pose_opt::PTZPreemptiveRANSACParameter& ransac_param,
+                         double* pan_tilt_zoom);
+    
+    // use the configured relocalizer parameter
+    int relocalizeCamera(const float* keypoints,
+                         const float* descriptors,
+                         const int n,
+                         const int descriptor_dim,
+                         double* pan_tilt_zoom);
 };
 
 extern "C" {
@@ -59,10 +107,74 @@ extern "C" {
                                   const char * feature_label_file,
                                   const char * model_name);
     
+    // keypoints: n x 2 float, row major
+    // descriptors: n x descriptor_dim float, row major
+    // pan_tilt_zoom: camera pose of the keyframe
+    // model_name: can be NULL, then the model is not saved
+    EXPORTIT void createOnlineMapFromBuffer(OnlineRFMap* ol_rf_map,
+                                            const float* keypoints,
+                                            const float* descriptors,
+                                            int n,
+                                            int descriptor_dim,
+                                            const double* pan_tilt_zoom,
+                                            const char * model_parameter_file,
+                                            const char * model_name);
+    
+    EXPORTIT void updateOnlineMapFromBuffer(OnlineRFMap* ol_rf_map,
+                                            const float* keypoints,
+                                            const float* descriptors,
+                                            int n,
+                                            int descriptor_dim,
+                                            const double* pan_tilt_zoom,
+                                            const char * model_name);
+    
+    // 0 means no limit, see OnlineRFMapBudget
+    EXPORTIT void setOnlineMapBudget(OnlineRFMap* ol_rf_map,
+                                     int max_tree_num,
+                                     int max_tree_keyframe_num,
+                                     double merge_overlap_ratio);
+    
     EXPORTIT void relocalizeCameraOnline(OnlineRFMap* ol_rf_map,
                                    const char* feature_location_file_name,
                                    const char* test_parameter_file,
                                    double* pan_tilt_zoom);
+    
+    // keypoints: n x 2 float, row major
+    // descriptors: n x descriptor_dim float, row major
+    // pan_tilt_zoom: input output
+    // return: number of inliers, 0 if failed or descriptor_dim is not the feature dimension of the model
+    EXPORTIT int relocalizeCameraOnlineFromBuffer(OnlineRFMap* ol_rf_map,
+                                                  const float* keypoints,
+                                                  const float* descriptors,
+                                                  int n,
+                                                  int descriptor_dim,
+                                                  double pp_x,
+                                                  double pp_y,
+                                                  double reprojection_error_threshold,
+                                                  int ransac_sample_number,
+                                                  double* pan_tilt_zoom);
+    
+    // configure relocalization once, then call relocalizeCameraOnlineConfigured for each frame
+    // thread_num: number of threads in prediction
+    EXPORTIT void configureOnlineRelocalizer(OnlineRFMap* ol_rf_map,
+                                             double pp_x,
+                                             double pp_y,
+                                             int max_check,
+                                             double distance_threshold,
+                                             double reprojection_error_threshold,
+                                             int ransac_sample_number,
+                                             int thread_num);
+    
+    // return: 1 success, 0 can not read the file
+    EXPORTIT int configureOnlineRelocalizerFromFile(OnlineRFMap* ol_rf_map,
+                                                    const char* test_parameter_file);
+    
+    EXPORTIT int relocalizeCameraOnlineConfigured(OnlineRFMap* ol_rf_map,
+                                                  const float* keypoints,
+                                                  const float* descriptors,
+                                                  int n,
+                                                  int descriptor_dim,
+                                                  double* pan_tilt_zoom);
 }
 
 #endif /* online_rf_map_hpp */
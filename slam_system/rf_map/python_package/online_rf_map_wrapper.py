@@ -2,6 +2,7 @@
 import numpy as np
 from ctypes import cdll
 from ctypes import c_int
+from ctypes import c_double
 from ctypes import c_void_p
 from ctypes import c_char_p
 from ctypes import Structure
@@ -54,6 +55,66 @@ class OnlineRFMap:
         lib.updateOnlineMap.argtypes = [c_void_p, c_char_p, c_char_p]
         lib.updateOnlineMap(self.rf_map, fl_file, rf_file)
 
+    def create_map_from_buffer(self, keypoints, descriptors, pan_tilt_zoom, tree_param_file, save_model=True):
+        """
+        create a map from one keyframe without writing a .mat file
+        :param keypoints: N x 2, keypoint locations
+        :param descriptors: N x 128, e.g. SIFT descriptors
+        :param pan_tilt_zoom: 3 x 1, camera pose of the keyframe
+        :param tree_param_file:
+        :param save_model: save model to self.rf_file
+        :return:
+        """
+        keypoints = np.ascontiguousarray(keypoints, dtype=np.float32)
+        descriptors = np.ascontiguousarray(descriptors, dtype=np.float32)
+        ptz = np.ascontiguousarray(np.array(pan_tilt_zoom, dtype=np.float64).reshape(3))
+        assert keypoints.shape[0] == descriptors.shape[0]
+
+        tr_file = tree_param_file.encode('utf-8')
+        rf_file = self.rf_file.encode('utf-8') if save_model else None
+        lib.createOnlineMapFromBuffer.argtypes = [c_void_p, c_void_p, c_void_p, c_int, c_int,
+                                                  c_void_p, c_char_p, c_char_p]
+        lib.createOnlineMapFromBuffer(self.rf_map,
+                                      c_void_p(keypoints.ctypes.data),
+                                      c_void_p(descriptors.ctypes.data),
+                                      keypoints.shape[0], descriptors.shape[1],
+                                      c_void_p(ptz.ctypes.data),
+                                      tr_file, rf_file)
+
+    def update_map_from_buffer(self, keypoints, descriptors, pan_tilt_zoom, save_model=True):
+        """
+        add a keyframe to the model without writing a .mat file
+        :param keypoints: N x 2, keypoint locations
+        :param descriptors: N x 128, e.g. SIFT descriptors
+        :param pan_tilt_zoom: 3 x 1, camera pose of the keyframe
+        :param save_model: save model to self.rf_file
+        :return:
+        """
+        keypoints = np.ascontiguousarray(keypoints, dtype=np.float32)
+        descriptors = np.ascontiguousarray(descriptors, dtype=np.float32)
+        ptz = np.ascontiguousarray(np.array(pan_tilt_zoom, dtype=np.float64).reshape(3))
+        assert keypoints.shape[0] == descriptors.shape[0]
+
+        rf_file = self.rf_file.encode('utf-8') if save_model else None
+        lib.updateOnlineMapFromBuffer.argtypes = [c_void_p, c_void_p, c_void_p, c_int, c_int,
+                                                  c_void_p, c_char_p]
+        lib.updateOnlineMapFromBuffer(self.rf_map,
+                                      c_void_p(keypoints.ctypes.data),
+                                      c_void_p(descriptors.ctypes.data),
+                                      keypoints.shape[0], descriptors.shape[1],
+                                      c_void_p(ptz.ctypes.data),
+                                      rf_file)
+
+    def set_budget(self, max_tree_num=0, max_tree_keyframe_num=0, merge_overlap_ratio=0.0):
+        """
+        Bound the memory of a long-running map, 0 means no limit
+        :param max_tree_num: the stalest tree is retired when the map has more trees
+        :param max_tree_keyframe_num: the oldest keyframe leaves a full tree
+        :param merge_overlap_ratio: trees whose keyframes overlap more than this are merged
+        :return:
+        """
+        lib.setOnlineMapBudget.argtypes = [c_void_p, c_int, c_int, c_double]
+        lib.setOnlineMapBudget(self.rf_map, max_tree_num, max_tree_keyframe_num, merge_overlap_ratio)
 
     def relocalization(self, feature_location_file, init_pan_tilt_zoom):
         """
@@ -76,6 +137,87 @@ class OnlineRFMap:
                                 c_void_p(pan_tilt_zoom.ctypes.data))
         return pan_tilt_zoom
 
+    def relocalization_from_buffer(self, keypoints, descriptors, init_pan_tilt_zoom,
+                                   principal_point=(1280/2.0, 720/2.0),
+                                   reprojection_error_threshold=2.0,
+                                   ransac_sample_number=32):
+        """
+        relocalization without writing a .mat file
+        :param keypoints: N x 2, keypoint locations
+        :param descriptors: N x 128, e.g. SIFT descriptors
+        :param init_pan_tilt_zoom, 3 x 1, initial camera parameter
+        :return: estimated pan_tilt_zoom (3 x 1) and number of inliers
+        """
+        keypoints = np.ascontiguousarray(keypoints, dtype=np.float32)
+        descriptors = np.ascontiguousarray(descriptors, dtype=np.float32)
+        assert keypoints.shape[0] == descriptors.shape[0]
+        pan_tilt_zoom = np.zeros((3, 1))
+        for i in range(3):
+            pan_tilt_zoom[i] = init_pan_tilt_zoom[i]
+
+        lib.relocalizeCameraOnlineFromBuffer.argtypes = [c_void_p, c_void_p, c_void_p, c_int, c_int,
+                                                         c_double, c_double, c_double, c_int, c_void_p]
+        lib.relocalizeCameraOnlineFromBuffer.restype = c_int
+        inlier_num = lib.relocalizeCameraOnlineFromBuffer(self.rf_map,
+                                                          c_void_p(keypoints.ctypes.data),
+                                                          c_void_p(descriptors.ctypes.data),
+                                                          keypoints.shape[0], descriptors.shape[1],
+                                                          principal_point[0], principal_point[1],
+                                                          reprojection_error_threshold,
+                                                          ransac_sample_number,
+                                                          c_void_p(pan_tilt_zoom.ctypes.data))
+        return pan_tilt_zoom, inlier_num
+
+    def configure_relocalizer(self, principal_point=(1280/2.0, 720/2.0),
+                              max_check=4, distance_threshold=0.2,
+                              reprojection_error_threshold=2.0,
+                              ransac_sample_number=32, thread_num=1):
+        """
+        configure relocalization once, e.g. for a 1920 x 1080 video
+        principal_point=(1920/2.0, 1080/2.0)
+        :return:
+        """
+        lib.configureOnlineRelocalizer.argtypes = [c_void_p, c_double, c_double, c_int, c_double,
+                                                   c_double, c_int, c_int]
+        lib.configureOnlineRelocalizer(self.rf_map, principal_point[0], principal_point[1],
+                                       max_check, distance_threshold,
+                                       reprojection_error_threshold,
+                                       ransac_sample_number, thread_num)
+
+    def configure_relocalizer_from_file(self, test_parameter_file):
+        """
+        :param test_parameter_file: text file, one 'name value' pair per line
+        :return: True if the file is read
+        """
+        lib.configureOnlineRelocalizerFromFile.argtypes = [c_void_p, c_char_p]
+        lib.configureOnlineRelocalizerFromFile.restype = c_int
+        return lib.configureOnlineRelocalizerFromFile(self.rf_map, test_parameter_file.encode('utf-8')) == 1
+
+    def relocalization_configured(self, keypoints, descriptors, init_pan_tilt_zoom):
+        """
+        relocalization using the configured parameters
+        :param keypoints: N x 2, keypoint locations
+        :param descriptors: N x 128, e.g. SIFT descriptors
+        :param init_pan_tilt_zoom, 3 x 1, initial camera parameter
+        :return: estimated pan_tilt_zoom (3 x 1) and number of inliers
+        """
+        keypoints = np.ascontiguousarray(keypoints, dtype=np.float32)
+        descriptors = np.ascontiguousarray(descriptors, dtype=np.float32)
+        assert keypoints.shape[0] == descriptors.shape[0]
+        pan_tilt_zoom = np.zeros((3, 1))
+        for i in range(3):
+            pan_tilt_zoom[i] = init_pan_tilt_zoom[i]
+
+        lib.relocalizeCameraOnlineConfigured.argtypes = [c_void_p, c_void_p, c_void_p, c_int, c_int, c_void_p]
+        lib.relocalizeCameraOnlineConfigured.restype = c_int
+        inlier_num = lib.relocalizeCameraOnlineConfigured(self.rf_map,
+                                                          c_void_p(keypoints.ctypes.data),
+                                                          c_void_p(descriptors.ctypes.data),
+                                                          keypoints.shape[0], descriptors.shape[1],
+                                                          c_void_p(pan_tilt_zoom.ctypes.data))
+        return pan_tilt_zoom, inlier_num
+
+
 def ut_create_update_map():
     rf_map = OnlineRFMap('debug.txt')
 
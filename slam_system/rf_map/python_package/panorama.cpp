@@ -0,0 +1,64 @@
+//
+//  panorama.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-30.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#include "panorama.hpp"
+#include <assert.h>
+
+EXPORTIT PTZPanorama* Panorama_new(double pan_min,
+                                   double pan_max,
+                                   double tilt_min,
+                                   double tilt_max,
+                                   double pixels_per_degree,
+                                   int blend_method,
+                                   int thread_num)
+{
+    PTZPanoramaParameter param;
+    param.pan_min_ = pan_min;
+    param.pan_max_ = pan_max;
+    param.tilt_min_ = tilt_min;
+    param.tilt_max_ = tilt_max;
+    param.pixels_per_degree_ = pixels_per_degree;
+    param.blend_method_ = blend_method;
+    param.thread_num_ = thread_num;
+    return new PTZPanorama(param, 3);
+}
+
+EXPORTIT void Panorama_delete(PTZPanorama* panorama)
+{
+    assert(panorama != nullptr);
+    delete panorama;
+}
+
+EXPORTIT void addPanoramaImage(PTZPanorama* panorama,
+                               const unsigned char* image,
+                               int width,
+                               int height,
+                               const double* pp,
+                               const double* ptz)
+{
+    assert(panorama != nullptr);
+    cvx_pgl::ptz_camera camera(Eigen::Vector2d(pp[0], pp[1]), Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(0, 0, 0));
+    camera.set_ptz(Eigen::Vector3d(ptz[0], ptz[1], ptz[2]));
+    panorama->addImage(image, width, height, camera);
+}
+
+EXPORTIT void getPanoramaSize(PTZPanorama* panorama,
+                              int* width,
+                              int* height)
+{
+    assert(panorama != nullptr);
+    *width = panorama->width();
+    *height = panorama->height();
+}
+
+EXPORTIT void getPanorama(PTZPanorama* panorama,
+                          unsigned char* image)
+{
+    assert(panorama != nullptr);
+    panorama->getPanorama(image);
+}
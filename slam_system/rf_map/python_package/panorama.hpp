@@ -0,0 +1,53 @@
+//
+//  panorama.hpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-30.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef panorama_hpp
+#define panorama_hpp
+
+// C interface of PTZPanorama for map_image.py
+#include <stdio.h>
+#include "ptz_panorama.h"
+
+#ifdef _WIN32
+#define EXPORTIT __declspec( dllexport )
+#else
+#define EXPORTIT
+#endif
+
+extern "C" {
+    // canvas range and resolution in degree, blend_method: 0 average, 1 median
+    EXPORTIT PTZPanorama* Panorama_new(double pan_min,
+                                       double pan_max,
+                                       double tilt_min,
+                                       double tilt_max,
+                                       double pixels_per_degree,
+                                       int blend_method,
+                                       int thread_num);
+    
+    EXPORTIT void Panorama_delete(PTZPanorama* panorama);
+    
+    // image: height x width x 3 uint8, e.g., from cv.imread
+    // pp: principal point, ptz: pan, tilt and focal length of the image
+    EXPORTIT void addPanoramaImage(PTZPanorama* panorama,
+                                   const unsigned char* image,
+                                   int width,
+                                   int height,
+                                   const double* pp,
+                                   const double* ptz);
+    
+    // canvas size
+    EXPORTIT void getPanoramaSize(PTZPanorama* panorama,
+                                  int* width,
+                                  int* height);
+    
+    // image: output, height x width x 3 uint8, size from getPanoramaSize
+    EXPORTIT void getPanorama(PTZPanorama* panorama,
+                              unsigned char* image);
+}
+
+#endif /* panorama_hpp */
@@ -0,0 +1,79 @@
+# native panorama generation on a spherical canvas, see util/ptz_panorama.h
+import numpy as np
+from ctypes import cdll
+from ctypes import c_int
+from ctypes import c_double
+from ctypes import c_void_p
+from ctypes import byref
+import platform
+
+system = platform.system()
+
+#@todo hardcode library
+if system == "Windows":
+    lib = cdll.LoadLibrary('C:/graduate_design/Pan-tilt-zoom-SLAM/slam_system/rf_map/build/x64/Debug/rf_map_python.dll')
+else:
+    lib = cdll.LoadLibrary('/Users/jimmy/Code/ptz_slam/Pan-tilt-zoom-SLAM/slam_system/rf_map/build/librf_map_python.dylib')
+
+lib.Panorama_new.restype = c_void_p
+lib.Panorama_new.argtypes = [c_double, c_double, c_double, c_double, c_double, c_int, c_int]
+lib.Panorama_delete.argtypes = [c_void_p]
+lib.addPanoramaImage.argtypes = [c_void_p, c_void_p, c_int, c_int, c_void_p, c_void_p]
+lib.getPanoramaSize.argtypes = [c_void_p, c_void_p, c_void_p]
+lib.getPanorama.argtypes = [c_void_p, c_void_p]
+
+
+class Panorama:
+    def __init__(self, pan_range=(-90, 90), tilt_range=(-45, 15), pixels_per_degree=20, median=False, thread_num=4):
+        """
+        :param pan_range: canvas pan range in degree
+        :param tilt_range: canvas tilt range in degree
+        :param pixels_per_degree: canvas resolution
+        :param median: True, approximate median blending (blending_with_median), False, average (blending_with_avg)
+        :param thread_num: number of threads
+        """
+        self.panorama = lib.Panorama_new(pan_range[0], pan_range[1], tilt_range[0], tilt_range[1],
+                                         pixels_per_degree, 1 if median else 0, thread_num)
+
+    def __del__(self):
+        lib.Panorama_delete(self.panorama)
+
+    def add(self, img, principal_point, ptz):
+        """
+        blend an image into the canvas, the image can be released after this
+        :param img: H x W x 3 uint8
+        :param principal_point: array [2]
+        :param ptz: array [3], pan, tilt, focal length of the image
+        """
+        assert len(img.shape) == 3 and img.shape[2] == 3
+        img = np.ascontiguousarray(img, dtype=np.uint8)
+        pp = np.ascontiguousarray(principal_point, dtype=np.float64).reshape(2)
+        ptz = np.ascontiguousarray(ptz, dtype=np.float64).reshape(3)
+        lib.addPanoramaImage(self.panorama, c_void_p(img.ctypes.data), img.shape[1], img.shape[0],
+                             c_void_p(pp.ctypes.data), c_void_p(ptz.ctypes.data))
+
+    def image(self):
+        """
+        :return: panorama, H x W x 3 uint8, 0 if no image covers a pixel
+        """
+        width = c_int(0)
+        height = c_int(0)
+        lib.getPanoramaSize(self.panorama, byref(width), byref(height))
+        panorama = np.zeros((height.value, width.value, 3), dtype=np.uint8)
+        lib.getPanorama(self.panorama, c_void_p(panorama.ctypes.data))
+        return panorama
+
+
+def generate_panoramic_image(standard_camera, img_list, ptz_list, median=False):
+    """
+    the same input as map_image.generate_panoramic_image, the output is on a spherical canvas
+    :param standard_camera: a instance of PTZCamera, including shared parameters.
+    :param img_list: image list of length N.
+    :param ptz_list: Corresponding pan-tilt-zoom angles of length N.
+    :return: a panoramic image.
+    """
+    assert len(img_list) == len(ptz_list)
+    panorama = Panorama(median=median)
+    for img, ptz in zip(img_list, ptz_list):
+        panorama.add(img, standard_camera.principal_point, ptz)
+    return panorama.image()
@@ -0,0 +1,59 @@
+# client of the relocalization server (service/relocalization_server_main.cpp)
+import json
+import socket
+import struct
+import numpy as np
+
+PTZ_MESSAGE_MAGIC = 0x525a5450
+PTZ_MESSAGE_RELOCALIZE = 0
+PTZ_MESSAGE_STATISTICS = 1
+
+# see service/ptz_relocalization_protocol.h, native byte order, packed
+request_header = struct.Struct('=Iiii3d')
+response_header = struct.Struct('=Iiii3d')
+
+
+class RelocalizationClient:
+    def __init__(self, socket_path='/tmp/ptz_relocalization.sock'):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(socket_path)
+
+    def close(self):
+        self.sock.close()
+
+    def _receive(self, size):
+        data = b''
+        while len(data) < size:
+            chunk = self.sock.recv(size - len(data))
+            if not chunk:
+                raise ConnectionError('relocalization server closed the connection')
+            data += chunk
+        return data
+
+    def relocalization(self, keypoints, descriptors, init_pan_tilt_zoom):
+        """
+        :param keypoints: N x 2, keypoint locations
+        :param descriptors: N x 128, e.g. SIFT descriptors, the same dimension as the model
+        :param init_pan_tilt_zoom: 3 x 1, initial camera parameter
+        :return: estimated pan_tilt_zoom (3 x 1) and number of inliers
+        """
+        keypoints = np.ascontiguousarray(keypoints, dtype=np.float32)
+        descriptors = np.ascontiguousarray(descriptors, dtype=np.float32)
+        assert keypoints.shape[0] == descriptors.shape[0]
+        ptz = [float(init_pan_tilt_zoom[i]) for i in range(3)]
+        header = request_header.pack(PTZ_MESSAGE_MAGIC, PTZ_MESSAGE_RELOCALIZE,
+                                     keypoints.shape[0], descriptors.shape[1], *ptz)
+        self.sock.sendall(header + keypoints.tobytes() + descriptors.tobytes())
+
+        magic, _, inlier_num, _, pan, tilt, zoom = response_header.unpack(self._receive(response_header.size))
+        assert magic == PTZ_MESSAGE_MAGIC
+        return np.array([pan, tilt, zoom]).reshape((3, 1)), inlier_num
+
+    def statistics(self):
+        """
+        :return: dictionary of request number, batch size, throughput and latency percentiles
+        """
+        self.sock.sendall(request_header.pack(PTZ_MESSAGE_MAGIC, PTZ_MESSAGE_STATISTICS, 0, 0, 0.0, 0.0, 0.0))
+        magic, _, _, json_size, _, _, _ = response_header.unpack(self._receive(response_header.size))
+        assert magic == PTZ_MESSAGE_MAGIC
+        return json.loads(self._receive(json_size).decode('utf-8'))
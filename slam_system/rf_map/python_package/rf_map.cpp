@@ -9,16 +9,44 @@
 #include <string>
 #include <vector>
 #include <fstream>
+#include <algorithm>
+#include <string.h>
 #include "rf_map.hpp"
 #include "rf_map_builder.hpp"
 #include "btdtr_ptz_util.h"
 #include "ptz_pose_estimation.h"
+#include "pgl_ptz_camera.h"
 
 using namespace std;
 
+namespace {
+    // training examples of keyframes in memory, keypoints and descriptors of all keyframes are stacked
+    void keyframeTrainingSamples(const float* keypoints,
+                                 const float* descriptors,
+                                 const double* ptzs,
+                                 const int* keypoint_nums,
+                                 const int keyframe_num,
+                                 const int descriptor_dim,
+                                 const Eigen::Vector2f & pp,
+                                 vector<vector<btdtr_ptz_util::PTZTrainingSample> > & keyframe_samples)
+    {
+        keyframe_samples.resize(keyframe_num);
+        int offset = 0;
+        for (int i = 0; i<keyframe_num; i++) {
+            Eigen::Vector3f ptz(ptzs[3*i], ptzs[3*i+1], ptzs[3*i+2]);
+            btdtr_ptz_util::generatePTZSample(keypoints + 2 * offset,
+                                              descriptors + (size_t)descriptor_dim * offset,
+                                              keypoint_nums[i], descriptor_dim,
+                                              pp, ptz, keyframe_samples[i]);
+            offset += keypoint_nums[i];
+        }
+        printf("read %d keyframes, %d keypoints\n", keyframe_num, offset);
+    }
+}
+
 RFMap::RFMap()
 {
-    
+    binary_descriptor_bytes_ = 0;
 }
 
 RFMap::~RFMap()
@@ -45,12 +73,186 @@ void RFMap::createMap(const char * feature_label_file,
     
     RFMapBuilder builder;
     builder.setTreeParameter(tree_param);
+    builder.setThreadNum(std::max(1, relocalizer_.getParameter().thread_num_));
     
     //printf("start build model\n");
     
-    builder.buildModel(model_, feature_files, model_name, false);
-    model_.saveModel(model_name);
-    printf("save model to file %s\n", model_name);
+    // the model is saved after each tree
+    if (builder.buildModel(model_, feature_files, model_name, false)) {
+        printf("save model to file %s\n", model_name);
+    }
+}
+
+bool RFMap::createMap(const float* keypoints,
+                      const float* descriptors,
+                      const double* ptzs,
+                      const int* keypoint_nums,
+                      const int keyframe_num,
+                      const int descriptor_dim,
+                      const char * model_parameter_file,
+                      const char * model_name)
+{
+    assert(keyframe_num > 0);
+    
+    btdtr_ptz_util::PTZTreeParameter tree_param;
+    tree_param.readFromFile(model_parameter_file);
+    const Eigen::Vector2f pp(tree_param.pp_x_, tree_param.pp_y_);
+    
+    // 1. training examples of each keyframe
+    vector<vector<btdtr_ptz_util::PTZTrainingSample> > keyframe_samples;
+    keyframeTrainingSamples(keypoints, descriptors, ptzs, keypoint_nums, keyframe_num, descriptor_dim,
+                            pp, keyframe_samples);
+    
+    // 2. build model
+    RFMapBuilder builder;
+    builder.setTreeParameter(tree_param);
+    builder.setThreadNum(std::max(1, relocalizer_.getParameter().thread_num_));
+    bool is_built = builder.buildModel(model_, keyframe_samples, model_name, false);
+    if (is_built && model_name != NULL) {
+        printf("save model to file %s\n", model_name);
+    }
+    return is_built;
+}
+
+bool RFMap::createShardedMap(const float* keypoints,
+                             const float* descriptors,
+                             const double* ptzs,
+                             const int* keypoint_nums,
+                             const int keyframe_num,
+                             const int descriptor_dim,
+                             const char * model_parameter_file,
+                             const PTZShardParameter & shard_param,
+                             const char * model_name)
+{
+    assert(keyframe_num > 0);
+    
+    btdtr_ptz_util::PTZTreeParameter tree_param;
+    tree_param.readFromFile(model_parameter_file);
+    const Eigen::Vector2f pp(tree_param.pp_x_, tree_param.pp_y_);
+    
+    vector<vector<btdtr_ptz_util::PTZTrainingSample> > keyframe_samples;
+    keyframeTrainingSamples(keypoints, descriptors, ptzs, keypoint_nums, keyframe_num, descriptor_dim,
+                            pp, keyframe_samples);
+    
+    bool is_built = sharded_model_.build(tree_param, shard_param, keyframe_samples);
+    if (is_built && model_name != NULL) {
+        is_built = sharded_model_.save(model_name);
+        if (is_built) {
+            printf("save model to file %s\n", model_name);
+        }
+    }
+    return is_built;
+}
+
+bool RFMap::loadShardedMap(const char * model_name)
+{
+    return sharded_model_.load(model_name);
+}
+
+template <int WordNum>
+bool RFMap::buildBinaryModel(BTHammingRegressor<WordNum> & model,
+                             const float* keypoints,
+                             const unsigned char* descriptors,
+                             const double* ptzs,
+                             const int* keypoint_nums,
+                             const int keyframe_num,
+                             const char * model_parameter_file,
+                             const char * model_name)
+{
+    typedef BTHammingTree<WordNum> TreeType;
+    
+    btdtr_ptz_util::PTZTreeParameter tree_param;
+    tree_param.readFromFile(model_parameter_file);
+    const Eigen::Vector2d pp(tree_param.pp_x_, tree_param.pp_y_);
+    
+    // 1. packed descriptors and pan, tilt of each keyframe
+    vector<vector<typename TreeType::Descriptor> > keyframe_descriptors(keyframe_num);
+    vector<vector<Eigen::VectorXf> > keyframe_labels(keyframe_num);
+    int offset = 0;
+    for (int i = 0; i<keyframe_num; i++) {
+        Eigen::Vector3d ptz(ptzs[3*i], ptzs[3*i+1], ptzs[3*i+2]);
+        const int num = keypoint_nums[i];
+        keyframe_descriptors[i].resize(num);
+        keyframe_labels[i].resize(num);
+        for (int j = 0; j<num; j++) {
+            const int index = offset + j;
+            TreeType::pack(descriptors + (size_t)TreeType::BYTE_NUM * index, keyframe_descriptors[i][j]);
+            Eigen::Vector2d loc(keypoints[2*index], keypoints[2*index+1]);
+            Eigen::Vector2d pan_tilt = cvx_pgl::point2PanTilt(pp, ptz, loc);
+            keyframe_labels[i][j] = Eigen::Vector2f(pan_tilt[0], pan_tilt[1]);
+        }
+        offset += num;
+    }
+    printf("read %d keyframes, %d keypoints\n", keyframe_num, offset);
+    
+    // 2. build model
+    RFMapBuilder builder;
+    builder.setTreeParameter(tree_param);
+    bool is_built = builder.buildModel(model, keyframe_descriptors, keyframe_labels, model_name, false);
+    if (is_built && model_name != NULL) {
+        printf("save model to file %s\n", model_name);
+    }
+    return is_built;
+}
+
+bool RFMap::createBinaryMap(const float* keypoints,
+                            const unsigned char* descriptors,
+                            const double* ptzs,
+                            const int* keypoint_nums,
+                            const int keyframe_num,
+                            const int descriptor_bytes,
+                            const char * model_parameter_file,
+                            const char * model_name)
+{
+    assert(keyframe_num > 0);
+    bool is_built = false;
+    if (descriptor_bytes == 32) {
+        is_built = buildBinaryModel(binary_model_256_, keypoints, descriptors, ptzs, keypoint_nums, keyframe_num,
+                                    model_parameter_file, model_name);
+    }
+    else if (descriptor_bytes == 64) {
+        is_built = buildBinaryModel(binary_model_512_, keypoints, descriptors, ptzs, keypoint_nums, keyframe_num,
+                                    model_parameter_file, model_name);
+    }
+    else {
+        printf("Error: binary descriptor must be 32 or 64 bytes, %d\n", descriptor_bytes);
+        return false;
+    }
+    if (is_built) {
+        binary_descriptor_bytes_ = descriptor_bytes;
+    }
+    return is_built;
+}
+
+bool RFMap::loadBinaryMap(const char * model_name)
+{
+    // the first number is descriptor bit number
+    FILE *pf = fopen(model_name, "r");
+    if (!pf) {
+        printf("Error: can not open file %s\n", model_name);
+        return false;
+    }
+    int bit_num = 0;
+    int ret = fscanf(pf, "%d", &bit_num);
+    fclose(pf);
+    
+    bool is_read = false;
+    if (ret == 1 && bit_num == 256) {
+        is_read = binary_model_256_.load(model_name);
+    }
+    else if (ret == 1 && bit_num == 512) {
+        is_read = binary_model_512_.load(model_name);
+    }
+    else {
+        printf("Error: unsupported binary descriptor bit number %d in %s\n", bit_num, model_name);
+    }
+    binary_descriptor_bytes_ = is_read ? bit_num/8 : 0;
+    return is_read;
+}
+
+void RFMap::setRelocalizerParameter(const PTZRelocalizerParameter & param)
+{
+    relocalizer_.setParameter(param);
 }
 
 // relocalize a camera using the model
@@ -60,60 +262,126 @@ void RFMap::relocalizeCamera(const char* feature_location_file_name,
                             const char* test_parameter_file,
                             double* pan_tilt_zoom)
 {
-    int max_check = 4;
-    double distance_threshold = 0.2;
-    Eigen::Vector2f pp(1280/2.0, 720/2.0);
-    ptz_pose_opt::PTZPreemptiveRANSACParameter ransac_param;
-    ransac_param.reprojection_error_threshold_ = 2.0;
-    ransac_param.sample_number_ = 32;
+    // the testing parameter is for this call only, the configured parameter is restored
+    const PTZRelocalizerParameter configured_param = relocalizer_.getParameter();
+    if (test_parameter_file != NULL && strlen(test_parameter_file) > 0) {
+        PTZRelocalizerParameter param = configured_param;
+        if (param.readFromFile(test_parameter_file)) {
+            relocalizer_.setParameter(param);
+        }
+    }
+    const PTZRelocalizerParameter & param = relocalizer_.getParameter();
+    Eigen::Vector2f pp(param.pp_x_, param.pp_y_);
     
     vector<btdtr_ptz_util::PTZSample> samples;
     btdtr_ptz_util::generatePTZSampleWithFeature(feature_location_file_name,
                                                  pp, samples);
-    printf("feature number is %lu\n", samples.size());
     
-    vector<Eigen::Vector2d> image_points;
-    vector<vector<Eigen::Vector2d> > candidate_pan_tilt;
-    Eigen::Vector3d estimated_ptz(pan_tilt_zoom[0], pan_tilt_zoom[1], pan_tilt_zoom[2]);
-    // predict from observation (descriptors)
-    double tt = clock();
-    for (int j = 0; j<samples.size(); j++) {
-        btdtr_ptz_util::PTZSample s = samples[j];
-        Eigen::VectorXf feat = s.descriptor_;
-        vector<Eigen::VectorXf> cur_predictions;
-        vector<float> cur_dists;
-        model_.predict(feat, max_check, cur_predictions, cur_dists);
-        assert(cur_predictions.size() == cur_dists.size());
-        
-        //cout<<"minimum feature distance "<<cur_dists[0]<<endl;
-        if (cur_dists[0] < distance_threshold) {
-            image_points.push_back(Eigen::Vector2d(s.loc_.x(), s.loc_.y()));
-            vector<Eigen::Vector2d> cur_candidate;
-            for (int k = 0; k<cur_predictions.size(); k++) {
-                assert(cur_predictions[k].size() == 2);
-                if (cur_dists[k] < distance_threshold) {
-                    cur_candidate.push_back(Eigen::Vector2d(cur_predictions[k][0], cur_predictions[k][1]));
-                }
-            }
-            //printf("min feature distance is %lf\n", cur_dists[0]);
-            candidate_pan_tilt.push_back(cur_candidate);
-        }
+    // keypoint, candidate and failure numbers are in DTProfiler
+    relocalizer_.relocalize(model_, samples, pan_tilt_zoom);
+    relocalizer_.setParameter(configured_param);
+}
+
+int RFMap::relocalizeCamera(const float* keypoints,
+                            const float* descriptors,
+                            const int n,
+                            const int descriptor_dim,
+                            const Eigen::Vector2d& pp,
+                            const ptz_pose_opt::PTZPreemptiveRANSACParameter& ransac_param,
+                            double* pan_tilt_zoom)
+{
+    // per call principal point and RANSAC parameter, the configured parameter is restored
+    const PTZRelocalizerParameter configured_param = relocalizer_.getParameter();
+    PTZRelocalizerParameter param = configured_param;
+    param.pp_x_ = pp.x();
+    param.pp_y_ = pp.y();
+    param.ransac_param_ = ransac_param;
+    relocalizer_.setParameter(param);
+    int inlier_num = relocalizer_.relocalize(model_, keypoints, descriptors, n, descriptor_dim, pan_tilt_zoom);
+    relocalizer_.setParameter(configured_param);
+    return inlier_num;
+}
+
+int RFMap::relocalizeCamera(const float* keypoints,
+                            const float* descriptors,
+                            const int n,
+                            const int descriptor_dim,
+                            double* pan_tilt_zoom)
+{
+    return relocalizer_.relocalize(model_, keypoints, descriptors, n, descriptor_dim, pan_tilt_zoom);
+}
+
+int RFMap::relocalizeCameraBinary(const float* keypoints,
+                                  const unsigned char* descriptors,
+                                  const int n,
+                                  const int descriptor_bytes,
+                                  double* pan_tilt_zoom)
+{
+    if (descriptor_bytes != binary_descriptor_bytes_) {
+        printf("Error: descriptor is %d bytes, binary model is %d bytes\n", descriptor_bytes, binary_descriptor_bytes_);
+        return 0;
     }
-    printf("candidate point number %lu\n", candidate_pan_tilt.size());
-    // estimate camera pose
-    bool is_opt = ptz_pose_opt::preemptiveRANSACOneToMany(image_points, candidate_pan_tilt,
-                                                          pp.cast<double>(),
-                                                          ransac_param, estimated_ptz, false);
-    printf("Prediction and camera pose estimation cost time: %f seconds.\n", (clock() - tt)/CLOCKS_PER_SEC);
-    if (!is_opt) {
-        printf("-------------------------------------------- Optimize PTZ failed.\n");
-        printf("valid feature number is %lu\n\n", image_points.size());
+    if (descriptor_bytes == 32) {
+        return relocalizer_.relocalize(binary_model_256_, keypoints, descriptors, n, pan_tilt_zoom);
     }
     else {
-        pan_tilt_zoom[0] = estimated_ptz[0];
-        pan_tilt_zoom[1] = estimated_ptz[1];
-        pan_tilt_zoom[2] = estimated_ptz[2];
+        return relocalizer_.relocalize(binary_model_512_, keypoints, descriptors, n, pan_tilt_zoom);
+    }
+}
+
+int RFMap::relocalizeCameraWithPrior(const float* keypoints,
+                                     const float* descriptors,
+                                     const int n,
+                                     const int descriptor_dim,
+                                     const double pan_tilt_uncertainty,
+                                     const double zoom_uncertainty,
+                                     double* pan_tilt_zoom)
+{
+    if (sharded_model_.shardNum() == 0) {
+        printf("Error: sharded map is empty\n");
+        return 0;
+    }
+    const PTZRelocalizerParameter & param = relocalizer_.getParameter();
+    const Eigen::Vector2d pp(param.pp_x_, param.pp_y_);
+    const Eigen::Vector3d prior(pan_tilt_zoom[0], pan_tilt_zoom[1], pan_tilt_zoom[2]);
+    
+    // 1. shards in the field of view
+    vector<const BTDTRegressor *> models;
+    Eigen::Vector4d region = PTZShardedForest::viewRegion(pp, prior, pan_tilt_uncertainty, zoom_uncertainty);
+    sharded_model_.selectShards(region, models);
+    
+    int inlier_num = 0;
+    if (!models.empty() && models.size() < sharded_model_.shardNum()) {
+        inlier_num = relocalizer_.relocalize(models, keypoints, descriptors, n, descriptor_dim, pan_tilt_zoom,
+                                             sharded_model_.treeNum());
+        if (inlier_num >= param.prior_min_inlier_num_) {
+            return inlier_num;
+        }
     }
+    
+    // 2. global search
+    pan_tilt_zoom[0] = prior[0];
+    pan_tilt_zoom[1] = prior[1];
+    pan_tilt_zoom[2] = prior[2];
+    sharded_model_.allShards(models);
+    return relocalizer_.relocalize(models, keypoints, descriptors, n, descriptor_dim, pan_tilt_zoom,
+                                   sharded_model_.treeNum());
+}
+
+int RFMap::relocalizeCameraInVenue(PTZModelRegistry & registry,
+                                   const char* venue,
+                                   const float* keypoints,
+                                   const float* descriptors,
+                                   const int n,
+                                   const int descriptor_dim,
+                                   double* pan_tilt_zoom)
+{
+    // the handle keeps the model resident during relocalization
+    PTZModelRegistry::ModelHandle model = registry.acquire(string(venue));
+    if (!model) {
+        return 0;
+    }
+    return relocalizer_.relocalize(*model, keypoints, descriptors, n, descriptor_dim, pan_tilt_zoom);
 }
 
 void RFMap::estimateCameraRANSAC(const char* pixel_ray_file_name,
@@ -140,13 +408,11 @@ void RFMap::estimateCameraRANSAC(const char* pixel_ray_file_name,
     Eigen::Vector3d estimated_ptz(pan_tilt_zoom[0], pan_tilt_zoom[1], pan_tilt_zoom[2]);
     
     // estimate camera pose
-    double tt = clock();
     bool is_opt = ptz_pose_opt::preemptiveRANSACOneToMany(image_points, candidate_pan_tilt,
                                                           pp,
                                                           ransac_param, estimated_ptz, false);
-    printf("Prediction and camera pose estimation cost time: %f seconds.\n", (clock() - tt)/CLOCKS_PER_SEC);
     if (!is_opt) {
-        printf("-------------------------------------------- Optimize PTZ failed.\n");
+        DTProfiler::addCount(DTProfiler::RELOCALIZE_FAIL);
     }
     else {
         pan_tilt_zoom[0] = estimated_ptz[0];
@@ -190,8 +456,263 @@ EXPORTIT void createMap(RFMap* rf_map,
     //printf("after 1 1: address %p\n", (void*)rf_map);
 }
 
+EXPORTIT int createMapFromBuffer(RFMap* rf_map,
+                                 const float* keypoints,
+                                 const float* descriptors,
+                                 const double* ptzs,
+                                 const int* keypoint_nums,
+                                 int keyframe_num,
+                                 int descriptor_dim,
+                                 const char * model_parameter_file,
+                                 const char * model_name)
+{
+    assert(rf_map != nullptr);
+    bool is_built = rf_map->createMap(keypoints, descriptors, ptzs, keypoint_nums, keyframe_num, descriptor_dim,
+                                      model_parameter_file, model_name);
+    return is_built ? 1 : 0;
+}
+
+EXPORTIT int createBinaryMapFromBuffer(RFMap* rf_map,
+                                       const float* keypoints,
+                                       const unsigned char* descriptors,
+                                       const double* ptzs,
+                                       const int* keypoint_nums,
+                                       int keyframe_num,
+                                       int descriptor_bytes,
+                                       const char * model_parameter_file,
+                                       const char * model_name)
+{
+    assert(rf_map != nullptr);
+    bool is_built = rf_map->createBinaryMap(keypoints, descriptors, ptzs, keypoint_nums, keyframe_num,
+                                            descriptor_bytes, model_parameter_file, model_name);
+    return is_built ? 1 : 0;
+}
+
+EXPORTIT int loadBinaryMap(RFMap* rf_map,
+                           const char * model_name)
+{
+    assert(rf_map != nullptr);
+    return rf_map->loadBinaryMap(model_name) ? 1 : 0;
+}
+
+EXPORTIT int createShardedMapFromBuffer(RFMap* rf_map,
+                                        const float* keypoints,
+                                        const float* descriptors,
+                                        const double* ptzs,
+                                        const int* keypoint_nums,
+                                        int keyframe_num,
+                                        int descriptor_dim,
+                                        const char * model_parameter_file,
+                                        double shard_pan_size,
+                                        double shard_tilt_size,
+                                        double overlap,
+                                        const char * model_name)
+{
+    assert(rf_map != nullptr);
+    PTZShardParameter shard_param;
+    shard_param.pan_size_ = shard_pan_size;
+    shard_param.tilt_size_ = shard_tilt_size;
+    shard_param.overlap_ = overlap;
+    bool is_built = rf_map->createShardedMap(keypoints, descriptors, ptzs, keypoint_nums, keyframe_num,
+                                             descriptor_dim, model_parameter_file, shard_param, model_name);
+    return is_built ? 1 : 0;
+}
+
+EXPORTIT int loadShardedMap(RFMap* rf_map,
+                            const char * model_name)
+{
+    assert(rf_map != nullptr);
+    return rf_map->loadShardedMap(model_name) ? 1 : 0;
+}
+
+EXPORTIT int relocalizeCameraWithPrior(RFMap* rf_map,
+                                       const float* keypoints,
+                                       const float* descriptors,
+                                       int n,
+                                       int descriptor_dim,
+                                       double pan_tilt_uncertainty,
+                                       double zoom_uncertainty,
+                                       double* pan_tilt_zoom)
+{
+    assert(rf_map != nullptr);
+    return rf_map->relocalizeCameraWithPrior(keypoints, descriptors, n, descriptor_dim,
+                                             pan_tilt_uncertainty, zoom_uncertainty, pan_tilt_zoom);
+}
+
 EXPORTIT void estimateCameraRANSAC(const char* pixel_ray_file_name,
                                    double* pan_tilt_zoom)
 {
     RFMap::estimateCameraRANSAC(pixel_ray_file_name, pan_tilt_zoom);
 }
+
+EXPORTIT int relocalizeCameraFromBuffer(RFMap* rf_map,
+                                        const float* keypoints,
+                                        const float* descriptors,
+                                        int n,
+                                        int descriptor_dim,
+                                        double pp_x,
+                                        double pp_y,
+                                        double reprojection_error_threshold,
+                                        int ransac_sample_number,
+                                        double* pan_tilt_zoom)
+{
+    assert(rf_map != nullptr);
+    if (descriptor_dim != rf_map->model_.featureDim()) {
+        printf("Error: descriptor dimension %d, model %d\n", descriptor_dim, rf_map->model_.featureDim());
+        return 0;
+    }
+    ptz_pose_opt::PTZPreemptiveRANSACParameter ransac_param;
+    ransac_param.reprojection_error_threshold_ = reprojection_error_threshold;
+    ransac_param.sample_number_ = ransac_sample_number;
+    return rf_map->relocalizeCamera(keypoints, descriptors, n, descriptor_dim,
+                                    Eigen::Vector2d(pp_x, pp_y), ransac_param, pan_tilt_zoom);
+}
+
+EXPORTIT void configureRelocalizer(RFMap* rf_map,
+                                   double pp_x,
+                                   double pp_y,
+                                   int max_check,
+                                   double distance_threshold,
+                                   double reprojection_error_threshold,
+                                   int ransac_sample_number,
+                                   int thread_num)
+{
+    assert(rf_map != nullptr);
+    PTZRelocalizerParameter param = rf_map->relocalizer_.getParameter();
+    param.pp_x_ = pp_x;
+    param.pp_y_ = pp_y;
+    param.max_check_ = max_check;
+    param.distance_threshold_ = distance_threshold;
+    param.ransac_param_.reprojection_error_threshold_ = reprojection_error_threshold;
+    param.ransac_param_.sample_number_ = ransac_sample_number;
+    param.thread_num_ = thread_num;
+    rf_map->setRelocalizerParameter(param);
+}
+
+EXPORTIT int configureRelocalizerFromFile(RFMap* rf_map,
+                                          const char* test_parameter_file)
+{
+    assert(rf_map != nullptr);
+    PTZRelocalizerParameter param = rf_map->relocalizer_.getParameter();
+    if (!param.readFromFile(test_parameter_file)) {
+        return 0;
+    }
+    rf_map->setRelocalizerParameter(param);
+    return 1;
+}
+
+EXPORTIT int relocalizeCameraConfigured(RFMap* rf_map,
+                                        const float* keypoints,
+                                        const float* descriptors,
+                                        int n,
+                                        int descriptor_dim,
+                                        double* pan_tilt_zoom)
+{
+    assert(rf_map != nullptr);
+    if (descriptor_dim != rf_map->model_.featureDim()) {
+        printf("Error: descriptor dimension %d, model %d\n", descriptor_dim, rf_map->model_.featureDim());
+        return 0;
+    }
+    return rf_map->relocalizeCamera(keypoints, descriptors, n, descriptor_dim, pan_tilt_zoom);
+}
+
+EXPORTIT PTZModelRegistry* ModelRegistry_new(double memory_budget_mb)
+{
+    assert(memory_budget_mb >= 0);
+    return new PTZModelRegistry((size_t)(memory_budget_mb * 1024 * 1024));
+}
+
+EXPORTIT void ModelRegistry_delete(PTZModelRegistry* registry)
+{
+    if (registry) {
+        delete registry;
+    }
+}
+
+EXPORTIT int registerVenueModel(PTZModelRegistry* registry,
+                                const char* venue,
+                                const char* model_name)
+{
+    assert(registry != nullptr);
+    return registry->registerVenue(string(venue), string(model_name)) ? 1 : 0;
+}
+
+EXPORTIT int prefetchVenueModel(PTZModelRegistry* registry,
+                                const char* venue)
+{
+    assert(registry != nullptr);
+    return registry->prefetch(string(venue)) ? 1 : 0;
+}
+
+EXPORTIT int relocalizeCameraInVenue(RFMap* rf_map,
+                                     PTZModelRegistry* registry,
+                                     const char* venue,
+                                     const float* keypoints,
+                                     const float* descriptors,
+                                     int n,
+                                     int descriptor_dim,
+                                     double* pan_tilt_zoom)
+{
+    assert(rf_map != nullptr);
+    assert(registry != nullptr);
+    return rf_map->relocalizeCameraInVenue(*registry, venue, keypoints, descriptors, n, descriptor_dim, pan_tilt_zoom);
+}
+
+EXPORTIT int relocalizeCameraBinary(RFMap* rf_map,
+                                    const float* keypoints,
+                                    const unsigned char* descriptors,
+                                    int n,
+                                    int descriptor_bytes,
+                                    double* pan_tilt_zoom)
+{
+    assert(rf_map != nullptr);
+    return rf_map->relocalizeCameraBinary(keypoints, descriptors, n, descriptor_bytes, pan_tilt_zoom);
+}
+
+EXPORTIT void setProfilingEnabled(int enabled)
+{
+    DTProfiler::setEnabled(enabled != 0);
+}
+
+EXPORTIT void resetProfiling()
+{
+    DTProfiler::reset();
+}
+
+EXPORTIT int getProfilingStage(int stage,
+                               long long* count,
+                               double* total_ms,
+                               double* max_ms)
+{
+    if (stage < 0 || stage >= DTProfiler::STAGE_NUM) {
+        return 0;
+    }
+    int64_t cur_count = 0;
+    DTProfiler::stageStatistics((DTProfiler::Stage)stage, cur_count, *total_ms, *max_ms);
+    *count = (long long)cur_count;
+    return 1;
+}
+
+EXPORTIT long long getProfilingCounter(int counter)
+{
+    if (counter < 0 || counter >= DTProfiler::COUNTER_NUM) {
+        return 0;
+    }
+    return (long long)DTProfiler::counterValue((DTProfiler::Counter)counter);
+}
+
+EXPORTIT int getProfilingJSON(char* buffer, int buffer_size)
+{
+    string json = DTProfiler::toJSON();
+    if (buffer != NULL && buffer_size > 0) {
+        int len = std::min((int)json.size(), buffer_size - 1);
+        memcpy(buffer, json.c_str(), len);
+        buffer[len] = '\0';
+    }
+    return (int)json.size() + 1;
+}
+
+EXPORTIT int saveProfilingJSON(const char* file_name)
+{
+    return DTProfiler::saveJSON(file_name) ? 1 : 0;
+}
@@ -11,6 +11,13 @@
 
 #include <stdio.h>
 #include "bt_dt_regressor.h"
+#include "bt_hamming_regressor.h"
+#include "btdtr_ptz_util.h"
+#include "ptz_pose_estimation.h"
+#include "ptz_relocalizer.h"
+#include "ptz_sharded_forest.hpp"
+#include "ptz_model_registry.hpp"
+#include "dt_profiler.hpp"
 
 #ifdef _WIN32
 #define EXPORTIT __declspec( dllexport )
@@ -21,6 +28,14 @@
 class RFMap {
 public:
     BTDTRegressor model_;
+    PTZRelocalizer relocalizer_;  // configured once, reused by every relocalization
+    
+    // Hamming forests of binary descriptors, only one is used
+    BTHammingRegressor256 binary_model_256_;   // ORB, 32 bytes
+    BTHammingRegressor512 binary_model_512_;   // LATCH, 64 bytes
+    int binary_descriptor_bytes_;              // 0, 32 or 64
+    
+    PTZShardedForest sharded_model_;   // partitioned by pan-tilt, used with a camera prior
     
 public:
     RFMap();
@@ -29,18 +44,133 @@ public:
                    const char * model_parameter_file,
                    const char * model_name);
     
+    // create a model from keyframes in memory
+    // keypoints: keypoints of all keyframes, (sum of keypoint_nums) x 2, row major
+    // descriptors: (sum of keypoint_nums) x descriptor_dim, row major
+    // ptzs: keyframe_num x 3, pan, tilt and focal length of each keyframe
+    // keypoint_nums: keypoint number in each keyframe
+    // model_name: can be NULL, then the model is not saved
+    // return: false if the sampled keyframes have no keypoint
+    bool createMap(const float* keypoints,
+                   const float* descriptors,
+                   const double* ptzs,
+                   const int* keypoint_nums,
+                   const int keyframe_num,
+                   const int descriptor_dim,
+                   const char * model_parameter_file,
+                   const char * model_name);
+    
+    
+    // create a Hamming forest from binary descriptors in memory
+    // descriptors: (sum of keypoint_nums) x descriptor_bytes, row major
+    // descriptor_bytes: 32 (ORB) or 64 (LATCH)
+    // other parameters are the same as createMap
+    // return: false if the descriptor size is not supported or sampled keyframes have no keypoint
+    bool createBinaryMap(const float* keypoints,
+                         const unsigned char* descriptors,
+                         const double* ptzs,
+                         const int* keypoint_nums,
+                         const int keyframe_num,
+                         const int descriptor_bytes,
+                         const char * model_parameter_file,
+                         const char * model_name);
+    
+    // descriptor size is read from the model file
+    bool loadBinaryMap(const char * model_name);
+    
+    // create a map partitioned by pan-tilt, parameters are the same as createMap
+    bool createShardedMap(const float* keypoints,
+                          const float* descriptors,
+                          const double* ptzs,
+                          const int* keypoint_nums,
+                          const int keyframe_num,
+                          const int descriptor_dim,
+                          const char * model_parameter_file,
+                          const PTZShardParameter & shard_param,
+                          const char * model_name);
+    
+    bool loadShardedMap(const char * model_name);
+    
+    // configure image geometry, thresholds and threads of relocalization
+    void setRelocalizerParameter(const PTZRelocalizerParameter & param);
     
     // relocalize a camera using the model
-    // parameter_file: testing parameter
+    // parameter_file: testing parameter of this call, see PTZRelocalizerParameter, ignored if empty
+    //                 the configured parameter is kept, see configureRelocalizerFromFile
     // pan_tilt_zoom: input output
     void relocalizeCamera(const char* feature_location_file_name,
                           const char* test_parameter_file,
                           double* pan_tilt_zoom);
     
+    // relocalize a camera from keypoints and descriptors in memory
+    // keypoints: n x 2, row major
+    // descriptors: n x descriptor_dim, row major
+    // pp, ransac_param: used in this call only, the configured parameter is kept
+    // pan_tilt_zoom: input output
+    // return: number of inliers, 0 if failed
+    int relocalizeCamera(const float* keypoints,
+                         const float* descriptors,
+                         const int n,
+                         const int descriptor_dim,
+                         const Eigen::Vector2d& pp,
+                         const ptz_pose_opt::PTZPreemptiveRANSACParameter& ransac_param,
+                         double* pan_tilt_zoom);
+    
+    // use the configured relocalizer parameter
+    int relocalizeCamera(const float* keypoints,
+                         const float* descriptors,
+                         const int n,
+                         const int descriptor_dim,
+                         double* pan_tilt_zoom);
+    
+    // relocalize a camera from binary descriptors, use the Hamming forest
+    // descriptors: n x descriptor_bytes, row major
+    // return: number of inliers, 0 if failed
+    int relocalizeCameraBinary(const float* keypoints,
+                               const unsigned char* descriptors,
+                               const int n,
+                               const int descriptor_bytes,
+                               double* pan_tilt_zoom);
+    
+    // relocalize a camera with a prior, only shards that overlap the field of view are used
+    // the trees of one shard are split among the used shards, so the number of queried trees does not grow
+    // global search of all shards if inliers are fewer than prior_min_inlier_num
+    // pan_tilt_zoom: input prior, output estimated camera pose
+    // pan_tilt_uncertainty: degree
+    // zoom_uncertainty: relative focal length error, e.g., 0.2
+    // return: number of inliers, 0 if failed
+    int relocalizeCameraWithPrior(const float* keypoints,
+                                  const float* descriptors,
+                                  const int n,
+                                  const int descriptor_dim,
+                                  const double pan_tilt_uncertainty,
+                                  const double zoom_uncertainty,
+                                  double* pan_tilt_zoom);
+    
+    // relocalize a camera with the model of a venue, the model is shared by all RFMaps of the registry
+    // return: number of inliers, 0 if failed or the model is not available
+    int relocalizeCameraInVenue(PTZModelRegistry & registry,
+                                const char* venue,
+                                const float* keypoints,
+                                const float* descriptors,
+                                const int n,
+                                const int descriptor_dim,
+                                double* pan_tilt_zoom);
+    
     // estimate camera pose by given pixel-ray correcpondence
     static void estimateCameraRANSAC(const char* pixel_ray_file_name,
                                     double* pan_tilt_zoom);
     
+private:
+    template <int WordNum>
+    bool buildBinaryModel(BTHammingRegressor<WordNum> & model,
+                          const float* keypoints,
+                          const unsigned char* descriptors,
+                          const double* ptzs,
+                          const int* keypoint_nums,
+                          const int keyframe_num,
+                          const char * model_parameter_file,
+                          const char * model_name);
 };
 
 
@@ -54,6 +184,34 @@ extern "C" {
                             const char * model_parameter_file,
                             const char * model_name);
     
+    // return: 1 success, 0 the sampled keyframes have no keypoint
+    EXPORTIT int createMapFromBuffer(RFMap* rf_map,
+                                     const float* keypoints,
+                                     const float* descriptors,
+                                     const double* ptzs,
+                                     const int* keypoint_nums,
+                                     int keyframe_num,
+                                     int descriptor_dim,
+                                     const char * model_parameter_file,
+                                     const char * model_name);
+    
+    // binary descriptors (ORB 32 bytes, LATCH 64 bytes), Hamming forest
+    // descriptors: (sum of keypoint_nums) x descriptor_bytes uint8, row major
+    // return: 1 success, 0 unsupported descriptor size or no keypoint in sampled keyframes
+    EXPORTIT int createBinaryMapFromBuffer(RFMap* rf_map,
+                                           const float* keypoints,
+                                           const unsigned char* descriptors,
+                                           const double* ptzs,
+                                           const int* keypoint_nums,
+                                           int keyframe_num,
+                                           int descriptor_bytes,
+                                           const char * model_parameter_file,
+                                           const char * model_name);
+    
+    // return: 1 success, 0 failed
+    EXPORTIT int loadBinaryMap(RFMap* rf_map,
+                               const char * model_name);
+    
     EXPORTIT void relocalizeCamera(RFMap* rf_map,
                                  const char* feature_location_file_name,
                                  const char* test_parameter_file,
@@ -61,6 +219,137 @@ extern "C" {
     
     EXPORTIT void estimateCameraRANSAC(const char* pixel_ray_file_name,
                                        double* pan_tilt_zoom);
+    
+    // keypoints: n x 2 float, row major
+    // descriptors: n x descriptor_dim float, row major
+    // pan_tilt_zoom: input output
+    // return: number of inliers, 0 if failed or descriptor_dim is not the feature dimension of the model
+    EXPORTIT int relocalizeCameraFromBuffer(RFMap* rf_map,
+                                            const float* keypoints,
+                                            const float* descriptors,
+                                            int n,
+                                            int descriptor_dim,
+                                            double pp_x,
+                                            double pp_y,
+                                            double reprojection_error_threshold,
+                                            int ransac_sample_number,
+                                            double* pan_tilt_zoom);
+    
+    // map partitioned by pan-tilt region
+    // shard_pan_size, shard_tilt_size: degree, e.g., 20 and 90
+    // overlap: degree, training examples near a shard are also used
+    // return: 1 success, 0 failed
+    EXPORTIT int createShardedMapFromBuffer(RFMap* rf_map,
+                                            const float* keypoints,
+                                            const float* descriptors,
+                                            const double* ptzs,
+                                            const int* keypoint_nums,
+                                            int keyframe_num,
+                                            int descriptor_dim,
+                                            const char * model_parameter_file,
+                                            double shard_pan_size,
+                                            double shard_tilt_size,
+                                            double overlap,
+                                            const char * model_name);
+    
+    // return: 1 success, 0 failed
+    EXPORTIT int loadShardedMap(RFMap* rf_map,
+                                const char * model_name);
+    
+    // pan_tilt_zoom: input prior, output estimated camera pose
+    // return: number of inliers, 0 if failed
+    EXPORTIT int relocalizeCameraWithPrior(RFMap* rf_map,
+                                           const float* keypoints,
+                                           const float* descriptors,
+                                           int n,
+                                           int descriptor_dim,
+                                           double pan_tilt_uncertainty,
+                                           double zoom_uncertainty,
+                                           double* pan_tilt_zoom);
+    
+    // models of many venues, loaded on demand and evicted in LRU order
+    // memory_budget_mb: 0 means no limit
+    EXPORTIT PTZModelRegistry* ModelRegistry_new(double memory_budget_mb);
+    
+    EXPORTIT void ModelRegistry_delete(PTZModelRegistry* registry);
+    
+    // model_name: saved by createMap
+    // return: 1 success, 0 the venue is resident with another model
+    EXPORTIT int registerVenueModel(PTZModelRegistry* registry,
+                                    const char* venue,
+                                    const char* model_name);
+    
+    // load the model in the background
+    // return: 1 success, 0 unknown venue
+    EXPORTIT int prefetchVenueModel(PTZModelRegistry* registry,
+                                    const char* venue);
+    
+    // use the configured relocalizer and the model of the venue
+    // return: number of inliers, 0 if failed
+    EXPORTIT int relocalizeCameraInVenue(RFMap* rf_map,
+                                         PTZModelRegistry* registry,
+                                         const char* venue,
+                                         const float* keypoints,
+                                         const float* descriptors,
+                                         int n,
+                                         int descriptor_dim,
+                                         double* pan_tilt_zoom);
+    
+    // use the configured relocalizer, binary_distance_threshold is a fraction of descriptor bits
+    // descriptors: n x descriptor_bytes uint8, row major
+    // return: number of inliers, 0 if failed
+    EXPORTIT int relocalizeCameraBinary(RFMap* rf_map,
+                                        const float* keypoints,
+                                        const unsigned char* descriptors,
+                                        int n,
+                                        int descriptor_bytes,
+                                        double* pan_tilt_zoom);
+    
+    // configure relocalization once, then call relocalizeCameraConfigured for each frame
+    // thread_num: number of threads in prediction
+    EXPORTIT void configureRelocalizer(RFMap* rf_map,
+                                       double pp_x,
+                                       double pp_y,
+                                       int max_check,
+                                       double distance_threshold,
+                                       double reprojection_error_threshold,
+                                       int ransac_sample_number,
+                                       int thread_num);
+    
+    // return: 1 success, 0 can not read the file
+    EXPORTIT int configureRelocalizerFromFile(RFMap* rf_map,
+                                              const char* test_parameter_file);
+    
+    EXPORTIT int relocalizeCameraConfigured(RFMap* rf_map,
+                                            const float* keypoints,
+                                            const float* descriptors,
+                                            int n,
+                                            int descriptor_dim,
+                                            double* pan_tilt_zoom);
+    
+    // profiling of the whole library (RFMap and OnlineRFMap), see DTProfiler
+    // stage: 0 load, 1 predict, 2 candidate filter, 3 hypothesis, 4 preemptive round,
+    //        5 LM refinement, 6 tree build, 7 save, 8 relocalize
+    EXPORTIT void setProfilingEnabled(int enabled);
+    
+    EXPORTIT void resetProfiling();
+    
+    // return: 1 success, 0 invalid stage
+    EXPORTIT int getProfilingStage(int stage,
+                                   long long* count,
+                                   double* total_ms,
+                                   double* max_ms);
+    
+    // counter: 0 keypoint, 1 candidate, 2 hypothesis, 3 inlier, 4 relocalize fail, 5 tree,
+    //          6 tree query (trees queried in relocalization)
+    EXPORTIT long long getProfilingCounter(int counter);
+    
+    // write JSON string to buffer (null terminated, truncated if it is short)
+    // return: buffer size needed, including the null character
+    EXPORTIT int getProfilingJSON(char* buffer, int buffer_size);
+    
+    // return: 1 success, 0 failed
+    EXPORTIT int saveProfilingJSON(const char* file_name);
 }
 
 
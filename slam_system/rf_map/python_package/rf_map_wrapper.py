@@ -2,10 +2,15 @@
 import numpy as np
 from ctypes import cdll
 from ctypes import c_int
+from ctypes import c_double
 from ctypes import c_void_p
 from ctypes import c_char_p
 from ctypes import Structure
 from ctypes import POINTER
+from ctypes import c_longlong
+from ctypes import byref
+from ctypes import create_string_buffer
+import json
 import platform
 
 system = platform.system()
@@ -40,6 +45,36 @@ class RFMap:
         lib.createMap(self.rf_map, fl_file, tr_file, rf_file)
         print('rf_map value 3 {}'.format(self.rf_map))
 
+    def create_map_from_buffer(self, keypoints, descriptors, pan_tilt_zooms, tree_param_file, save_model=True):
+        """
+        create a map without writing .mat files
+        :param keypoints: list of N_i x 2 arrays, keypoint locations of each keyframe
+        :param descriptors: list of N_i x 128 arrays, e.g. SIFT descriptors
+        :param pan_tilt_zooms: list of 3 x 1 arrays, camera pose of each keyframe
+        :param tree_param_file:
+        :param save_model: save model to self.rf_file
+        :return: False if the sampled keyframes have no keypoint
+        """
+        assert len(keypoints) == len(descriptors) and len(keypoints) == len(pan_tilt_zooms)
+        keypoint_nums = np.array([kp.shape[0] for kp in keypoints], dtype=np.int32)
+        all_keypoints = np.ascontiguousarray(np.vstack(keypoints), dtype=np.float32)
+        all_descriptors = np.ascontiguousarray(np.vstack(descriptors), dtype=np.float32)
+        ptzs = np.ascontiguousarray(np.array(pan_tilt_zooms, dtype=np.float64).reshape(-1, 3))
+        assert all_keypoints.shape[0] == all_descriptors.shape[0]
+
+        tr_file = tree_param_file.encode('utf-8')
+        rf_file = self.rf_file.encode('utf-8') if save_model else None
+        lib.createMapFromBuffer.argtypes = [c_void_p, c_void_p, c_void_p, c_void_p, c_void_p,
+                                            c_int, c_int, c_char_p, c_char_p]
+        lib.createMapFromBuffer.restype = c_int
+        return lib.createMapFromBuffer(self.rf_map,
+                                       c_void_p(all_keypoints.ctypes.data),
+                                       c_void_p(all_descriptors.ctypes.data),
+                                       c_void_p(ptzs.ctypes.data),
+                                       c_void_p(keypoint_nums.ctypes.data),
+                                       len(keypoint_nums), all_descriptors.shape[1],
+                                       tr_file, rf_file) == 1
+
     def relocalization(self, feature_location_file, init_pan_tilt_zoom):
         """
         :param feature_file: .mat file has 'keypoint' and 'descriptor'
@@ -61,6 +96,37 @@ class RFMap:
                              c_void_p(pan_tilt_zoom.ctypes.data))
         return pan_tilt_zoom
 
+    def relocalization_from_buffer(self, keypoints, descriptors, init_pan_tilt_zoom,
+                                   principal_point=(1280/2.0, 720/2.0),
+                                   reprojection_error_threshold=2.0,
+                                   ransac_sample_number=32):
+        """
+        relocalization without writing a .mat file
+        :param keypoints: N x 2, keypoint locations
+        :param descriptors: N x 128, e.g. SIFT descriptors
+        :param init_pan_tilt_zoom, 3 x 1, initial camera parameter
+        :return: estimated pan_tilt_zoom (3 x 1) and number of inliers
+        """
+        keypoints = np.ascontiguousarray(keypoints, dtype=np.float32)
+        descriptors = np.ascontiguousarray(descriptors, dtype=np.float32)
+        assert keypoints.shape[0] == descriptors.shape[0]
+        pan_tilt_zoom = np.zeros((3, 1))
+        for i in range(3):
+            pan_tilt_zoom[i] = init_pan_tilt_zoom[i]
+
+        lib.relocalizeCameraFromBuffer.argtypes = [c_void_p, c_void_p, c_void_p, c_int, c_int,
+                                                   c_double, c_double, c_double, c_int, c_void_p]
+        lib.relocalizeCameraFromBuffer.restype = c_int
+        inlier_num = lib.relocalizeCameraFromBuffer(self.rf_map,
+                                                    c_void_p(keypoints.ctypes.data),
+                                                    c_void_p(descriptors.ctypes.data),
+                                                    keypoints.shape[0], descriptors.shape[1],
+                                                    principal_point[0], principal_point[1],
+                                                    reprojection_error_threshold,
+                                                    ransac_sample_number,
+                                                    c_void_p(pan_tilt_zoom.ctypes.data))
+        return pan_tilt_zoom, inlier_num
+
     @staticmethod
     def estimateCameraRANSAC(keypoint_ray_file_name, init_pan_tilt_zoom):
         """
@@ -81,6 +147,299 @@ class RFMap:
 
         return pan_tilt_zoom
 
+    def configure_relocalizer(self, principal_point=(1280/2.0, 720/2.0),
+                              max_check=4, distance_threshold=0.2,
+                              reprojection_error_threshold=2.0,
+                              ransac_sample_number=32, thread_num=1):
+        """
+        configure relocalization once, e.g. for a 1920 x 1080 video
+        principal_point=(1920/2.0, 1080/2.0)
+        :return:
+        """
+        lib.configureRelocalizer.argtypes = [c_void_p, c_double, c_double, c_int, c_double,
+                                             c_double, c_int, c_int]
+        lib.configureRelocalizer(self.rf_map, principal_point[0], principal_point[1],
+                                 max_check, distance_threshold,
+                                 reprojection_error_threshold,
+                                 ransac_sample_number, thread_num)
+
+    def configure_relocalizer_from_file(self, test_parameter_file):
+        """
+        :param test_parameter_file: text file, one 'name value' pair per line
+        :return: True if the file is read
+        """
+        lib.configureRelocalizerFromFile.argtypes = [c_void_p, c_char_p]
+        lib.configureRelocalizerFromFile.restype = c_int
+        return lib.configureRelocalizerFromFile(self.rf_map, test_parameter_file.encode('utf-8')) == 1
+
+    def relocalization_configured(self, keypoints, descriptors, init_pan_tilt_zoom):
+        """
+        relocalization using the configured parameters
+        :param keypoints: N x 2, keypoint locations
+        :param descriptors: N x 128, e.g. SIFT descriptors
+        :param init_pan_tilt_zoom, 3 x 1, initial camera parameter
+        :return: estimated pan_tilt_zoom (3 x 1) and number of inliers
+        """
+        keypoints = np.ascontiguousarray(keypoints, dtype=np.float32)
+        descriptors = np.ascontiguousarray(descriptors, dtype=np.float32)
+        assert keypoints.shape[0] == descriptors.shape[0]
+        pan_tilt_zoom = np.zeros((3, 1))
+        for i in range(3):
+            pan_tilt_zoom[i] = init_pan_tilt_zoom[i]
+
+        lib.relocalizeCameraConfigured.argtypes = [c_void_p, c_void_p, c_void_p, c_int, c_int, c_void_p]
+        lib.relocalizeCameraConfigured.restype = c_int
+        inlier_num = lib.relocalizeCameraConfigured(self.rf_map,
+                                                    c_void_p(keypoints.ctypes.data),
+                                                    c_void_p(descriptors.ctypes.data),
+                                                    keypoints.shape[0], descriptors.shape[1],
+                                                    c_void_p(pan_tilt_zoom.ctypes.data))
+        return pan_tilt_zoom, inlier_num
+
+
+    def create_binary_map_from_buffer(self, keypoints, descriptors, pan_tilt_zooms, tree_param_file, save_model=True):
+        """
+        create a Hamming forest from binary descriptors
+        :param keypoints: list of N_i x 2 arrays, keypoint locations of each keyframe
+        :param descriptors: list of N_i x 32 (ORB) or N_i x 64 (LATCH) uint8 arrays
+        :param pan_tilt_zooms: list of 3 x 1 arrays, camera pose of each keyframe
+        :param tree_param_file: candidate_dim_num is the number of candidate bits
+        :param save_model: save model to self.rf_file
+        :return: True if the model is built
+        """
+        assert len(keypoints) == len(descriptors) and len(keypoints) == len(pan_tilt_zooms)
+        keypoint_nums = np.array([kp.shape[0] for kp in keypoints], dtype=np.int32)
+        all_keypoints = np.ascontiguousarray(np.vstack(keypoints), dtype=np.float32)
+        all_descriptors = np.ascontiguousarray(np.vstack(descriptors), dtype=np.uint8)
+        ptzs = np.ascontiguousarray(np.array(pan_tilt_zooms, dtype=np.float64).reshape(-1, 3))
+        assert all_keypoints.shape[0] == all_descriptors.shape[0]
+
+        tr_file = tree_param_file.encode('utf-8')
+        rf_file = self.rf_file.encode('utf-8') if save_model else None
+        lib.createBinaryMapFromBuffer.argtypes = [c_void_p, c_void_p, c_void_p, c_void_p, c_void_p,
+                                                  c_int, c_int, c_char_p, c_char_p]
+        lib.createBinaryMapFromBuffer.restype = c_int
+        return lib.createBinaryMapFromBuffer(self.rf_map,
+                                             c_void_p(all_keypoints.ctypes.data),
+                                             c_void_p(all_descriptors.ctypes.data),
+                                             c_void_p(ptzs.ctypes.data),
+                                             c_void_p(keypoint_nums.ctypes.data),
+                                             len(keypoint_nums), all_descriptors.shape[1],
+                                             tr_file, rf_file) == 1
+
+    def load_binary_map(self):
+        """
+        load the Hamming forest from self.rf_file
+        :return: True if the model is read
+        """
+        lib.loadBinaryMap.argtypes = [c_void_p, c_char_p]
+        lib.loadBinaryMap.restype = c_int
+        return lib.loadBinaryMap(self.rf_map, self.rf_file.encode('utf-8')) == 1
+
+    def relocalization_binary(self, keypoints, descriptors, init_pan_tilt_zoom):
+        """
+        relocalization from binary descriptors using the configured parameters
+        :param keypoints: N x 2, keypoint locations
+        :param descriptors: N x 32 (ORB) or N x 64 (LATCH) uint8 array
+        :param init_pan_tilt_zoom, 3 x 1, initial camera parameter
+        :return: estimated pan_tilt_zoom (3 x 1) and number of inliers
+        """
+        keypoints = np.ascontiguousarray(keypoints, dtype=np.float32)
+        descriptors = np.ascontiguousarray(descriptors, dtype=np.uint8)
+        assert keypoints.shape[0] == descriptors.shape[0]
+        pan_tilt_zoom = np.zeros((3, 1))
+        for i in range(3):
+            pan_tilt_zoom[i] = init_pan_tilt_zoom[i]
+
+        lib.relocalizeCameraBinary.argtypes = [c_void_p, c_void_p, c_void_p, c_int, c_int, c_void_p]
+        lib.relocalizeCameraBinary.restype = c_int
+        inlier_num = lib.relocalizeCameraBinary(self.rf_map,
+                                                c_void_p(keypoints.ctypes.data),
+                                                c_void_p(descriptors.ctypes.data),
+                                                keypoints.shape[0], descriptors.shape[1],
+                                                c_void_p(pan_tilt_zoom.ctypes.data))
+        return pan_tilt_zoom, inlier_num
+
+    def create_sharded_map_from_buffer(self, keypoints, descriptors, pan_tilt_zooms, tree_param_file,
+                                       shard_pan_size=20.0, shard_tilt_size=90.0, overlap=5.0, save_model=True):
+        """
+        create a map partitioned by pan-tilt region, used by relocalization_with_prior
+        :param keypoints: list of N_i x 2 arrays, keypoint locations of each keyframe
+        :param descriptors: list of N_i x 128 arrays, e.g. SIFT descriptors
+        :param pan_tilt_zooms: list of 3 x 1 arrays, camera pose of each keyframe
+        :param tree_param_file:
+        :param shard_pan_size: degree
+        :param shard_tilt_size: degree
+        :param overlap: degree, training examples near a shard are also used
+        :param save_model: save model to self.rf_file
+        :return: True if the model is built
+        """
+        assert len(keypoints) == len(descriptors) and len(keypoints) == len(pan_tilt_zooms)
+        keypoint_nums = np.array([kp.shape[0] for kp in keypoints], dtype=np.int32)
+        all_keypoints = np.ascontiguousarray(np.vstack(keypoints), dtype=np.float32)
+        all_descriptors = np.ascontiguousarray(np.vstack(descriptors), dtype=np.float32)
+        ptzs = np.ascontiguousarray(np.array(pan_tilt_zooms, dtype=np.float64).reshape(-1, 3))
+        assert all_keypoints.shape[0] == all_descriptors.shape[0]
+
+        tr_file = tree_param_file.encode('utf-8')
+        rf_file = self.rf_file.encode('utf-8') if save_model else None
+        lib.createShardedMapFromBuffer.argtypes = [c_void_p, c_void_p, c_void_p, c_void_p, c_void_p,
+                                                   c_int, c_int, c_char_p, c_double, c_double, c_double,
+                                                   c_char_p]
+        lib.createShardedMapFromBuffer.restype = c_int
+        return lib.createShardedMapFromBuffer(self.rf_map,
+                                              c_void_p(all_keypoints.ctypes.data),
+                                              c_void_p(all_descriptors.ctypes.data),
+                                              c_void_p(ptzs.ctypes.data),
+                                              c_void_p(keypoint_nums.ctypes.data),
+                                              len(keypoint_nums), all_descriptors.shape[1],
+                                              tr_file, shard_pan_size, shard_tilt_size, overlap,
+                                              rf_file) == 1
+
+    def load_sharded_map(self):
+        """
+        load the sharded map from self.rf_file
+        :return: True if the model is read
+        """
+        lib.loadShardedMap.argtypes = [c_void_p, c_char_p]
+        lib.loadShardedMap.restype = c_int
+        return lib.loadShardedMap(self.rf_map, self.rf_file.encode('utf-8')) == 1
+
+    def relocalization_with_prior(self, keypoints, descriptors, prior_pan_tilt_zoom,
+                                  pan_tilt_uncertainty=5.0, zoom_uncertainty=0.2):
+        """
+        relocalization in shards that overlap the field of view of the prior, global search if it fails
+        :param keypoints: N x 2, keypoint locations
+        :param descriptors: N x 128, e.g. SIFT descriptors
+        :param prior_pan_tilt_zoom: 3 x 1, e.g. from the tracker
+        :param pan_tilt_uncertainty: degree
+        :param zoom_uncertainty: relative focal length error
+        :return: estimated pan_tilt_zoom (3 x 1) and number of inliers
+        """
+        keypoints = np.ascontiguousarray(keypoints, dtype=np.float32)
+        descriptors = np.ascontiguousarray(descriptors, dtype=np.float32)
+        assert keypoints.shape[0] == descriptors.shape[0]
+        pan_tilt_zoom = np.zeros((3, 1))
+        for i in range(3):
+            pan_tilt_zoom[i] = prior_pan_tilt_zoom[i]
+
+        lib.relocalizeCameraWithPrior.argtypes = [c_void_p, c_void_p, c_void_p, c_int, c_int,
+                                                  c_double, c_double, c_void_p]
+        lib.relocalizeCameraWithPrior.restype = c_int
+        inlier_num = lib.relocalizeCameraWithPrior(self.rf_map,
+                                                   c_void_p(keypoints.ctypes.data),
+                                                   c_void_p(descriptors.ctypes.data),
+                                                   keypoints.shape[0], descriptors.shape[1],
+                                                   pan_tilt_uncertainty, zoom_uncertainty,
+                                                   c_void_p(pan_tilt_zoom.ctypes.data))
+        return pan_tilt_zoom, inlier_num
+
+    def relocalization_in_venue(self, registry, venue, keypoints, descriptors, init_pan_tilt_zoom):
+        """
+        relocalization using the configured parameters and the model of a venue
+        :param registry: ModelRegistry
+        :param venue: venue name, registered in the registry
+        :param keypoints: N x 2, keypoint locations
+        :param descriptors: N x 128, e.g. SIFT descriptors
+        :param init_pan_tilt_zoom, 3 x 1, initial camera parameter
+        :return: estimated pan_tilt_zoom (3 x 1) and number of inliers
+        """
+        keypoints = np.ascontiguousarray(keypoints, dtype=np.float32)
+        descriptors = np.ascontiguousarray(descriptors, dtype=np.float32)
+        assert keypoints.shape[0] == descriptors.shape[0]
+        pan_tilt_zoom = np.zeros((3, 1))
+        for i in range(3):
+            pan_tilt_zoom[i] = init_pan_tilt_zoom[i]
+
+        lib.relocalizeCameraInVenue.argtypes = [c_void_p, c_void_p, c_char_p, c_void_p, c_void_p, c_int, c_int,
+                                                c_void_p]
+        lib.relocalizeCameraInVenue.restype = c_int
+        inlier_num = lib.relocalizeCameraInVenue(self.rf_map, registry.registry,
+                                                 venue.encode('utf-8'),
+                                                 c_void_p(keypoints.ctypes.data),
+                                                 c_void_p(descriptors.ctypes.data),
+                                                 keypoints.shape[0], descriptors.shape[1],
+                                                 c_void_p(pan_tilt_zoom.ctypes.data))
+        return pan_tilt_zoom, inlier_num
+
+
+class ModelRegistry:
+    """
+    models of many venues, loaded on demand and evicted in least recently used order
+    """
+    def __init__(self, memory_budget_mb=0):
+        lib.ModelRegistry_new.argtypes = [c_double]
+        lib.ModelRegistry_new.restype = c_void_p
+        self.registry = lib.ModelRegistry_new(memory_budget_mb)
+
+    def __del__(self):
+        lib.ModelRegistry_delete.argtypes = [c_void_p]
+        lib.ModelRegistry_delete(self.registry)
+
+    def register_venue(self, venue, model_file):
+        """
+        :param venue: venue name
+        :param model_file: model saved by RFMap.create_map
+        :return: True if success
+        """
+        lib.registerVenueModel.argtypes = [c_void_p, c_char_p, c_char_p]
+        lib.registerVenueModel.restype = c_int
+        return lib.registerVenueModel(self.registry, venue.encode('utf-8'), model_file.encode('utf-8')) == 1
+
+    def prefetch(self, venue):
+        """
+        load the model in the background, e.g. the game in the venue starts soon
+        :param venue: venue name
+        :return: True if the venue is registered
+        """
+        lib.prefetchVenueModel.argtypes = [c_void_p, c_char_p]
+        lib.prefetchVenueModel.restype = c_int
+        return lib.prefetchVenueModel(self.registry, venue.encode('utf-8')) == 1
+
+profiling_stages = ['load', 'predict', 'candidate_filter', 'hypothesis', 'preemptive_round',
+                    'lm_refine', 'tree_build', 'save', 'relocalize']
+
+
+def set_profiling(enabled):
+    """
+    enable/disable wall time profiling of the library (RFMap and OnlineRFMap)
+    :param enabled: True or False
+    :return:
+    """
+    lib.setProfilingEnabled.argtypes = [c_int]
+    lib.setProfilingEnabled(1 if enabled else 0)
+
+
+def reset_profiling():
+    lib.resetProfiling()
+
+
+def profiling_stage(stage_name):
+    """
+    :param stage_name: one of profiling_stages
+    :return: count, total time and max time in milliseconds
+    """
+    count = c_longlong(0)
+    total_ms = c_double(0)
+    max_ms = c_double(0)
+    lib.getProfilingStage.argtypes = [c_int, c_void_p, c_void_p, c_void_p]
+    lib.getProfilingStage.restype = c_int
+    lib.getProfilingStage(profiling_stages.index(stage_name), byref(count), byref(total_ms), byref(max_ms))
+    return count.value, total_ms.value, max_ms.value
+
+
+def profiling_json():
+    """
+    :return: dictionary of stages and counters
+    """
+    lib.getProfilingJSON.argtypes = [c_char_p, c_int]
+    lib.getProfilingJSON.restype = c_int
+    size = lib.getProfilingJSON(None, 0)
+    buffer = create_string_buffer(size)
+    lib.getProfilingJSON(buffer, size)
+    return json.loads(buffer.value.decode('utf-8'))
+
+
 def ut_create_map_relocalization():
     rf_map = RFMap('debug.txt')
 
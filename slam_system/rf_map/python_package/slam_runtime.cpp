@@ -0,0 +1,183 @@
+//
+//  slam_runtime.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-31.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#include "slam_runtime.hpp"
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+
+SlamRuntime::SlamRuntime()
+{
+    runtime_ = NULL;
+}
+
+SlamRuntime::~SlamRuntime()
+{
+    if (runtime_) {
+        delete runtime_;
+        runtime_ = NULL;
+    }
+}
+
+namespace {
+    inline bool isFileName(const char* file_name)
+    {
+        return file_name != NULL && strlen(file_name) > 0;
+    }
+    
+    void toPoints(const double* data, int n, vector<Eigen::Vector2d> & points)
+    {
+        points.resize(n);
+        for (int i = 0; i<n; i++) {
+            points[i] = Eigen::Vector2d(data[2*i], data[2*i+1]);
+        }
+    }
+}
+
+EXPORTIT SlamRuntime* SlamRuntime_new(int descriptor_dim,
+                                      int image_width,
+                                      int image_height,
+                                      const char* runtime_parameter_file,
+                                      const char* tree_parameter_file,
+                                      const char* relocalizer_parameter_file,
+                                      const char* base_model_file)
+{
+    PTZSlamRuntimeParameter param;
+    param.descriptor_dim_ = descriptor_dim;
+    param.image_width_ = image_width;
+    param.image_height_ = image_height;
+    if (isFileName(runtime_parameter_file)) {
+        param.readFromFile(runtime_parameter_file);
+    }
+    
+    // principal point from the image size, parameter files can overwrite it
+    const double pp_x = param.image_width_/2.0;
+    const double pp_y = param.image_height_/2.0;
+    param.ekf_param_.pp_x_ = pp_x;
+    param.ekf_param_.pp_y_ = pp_y;
+    param.tree_param_.pp_x_ = pp_x;
+    param.tree_param_.pp_y_ = pp_y;
+    param.relocalizer_param_.pp_x_ = pp_x;
+    param.relocalizer_param_.pp_y_ = pp_y;
+    if (isFileName(tree_parameter_file)) {
+        param.tree_param_.readFromFile(tree_parameter_file);
+    }
+    if (isFileName(relocalizer_parameter_file)) {
+        param.relocalizer_param_.readFromFile(relocalizer_parameter_file);
+    }
+    
+    SlamRuntime* runtime = new SlamRuntime();
+    if (isFileName(base_model_file)) {
+        if (!runtime->base_model_.load(base_model_file)) {
+            printf("Warning: can not load base model %s\n", base_model_file);
+        }
+    }
+    const BTDTRegressor* base_model = runtime->base_model_.treeNum() > 0 ? &runtime->base_model_ : NULL;
+    runtime->runtime_ = new PTZSlamRuntime(param, base_model);
+    runtime->runtime_->start();
+    return runtime;
+}
+
+EXPORTIT void SlamRuntime_delete(SlamRuntime* runtime)
+{
+    assert(runtime != nullptr);
+    delete runtime;
+}
+
+EXPORTIT void initSlamRuntime(SlamRuntime* runtime,
+                              const double* ptz)
+{
+    assert(runtime != nullptr);
+    assert(ptz != nullptr);
+    runtime->runtime_->init(Eigen::Vector3d(ptz[0], ptz[1], ptz[2]));
+}
+
+EXPORTIT int trackSlamFrame(SlamRuntime* runtime,
+                            int frame_index,
+                            const double* points,
+                            const int* ray_indices,
+                            int m,
+                            const int* removed_rays,
+                            int r,
+                            const double* new_points,
+                            int k,
+                            const float* keypoints,
+                            const float* descriptors,
+                            int n,
+                            double* pan_tilt_zoom,
+                            int* result)
+{
+    assert(runtime != nullptr);
+    assert(pan_tilt_zoom != nullptr);
+    
+    toPoints(points, m, runtime->points_);
+    runtime->ray_indices_.assign(ray_indices, ray_indices + m);
+    runtime->removed_rays_.assign(removed_rays, removed_rays + r);
+    toPoints(new_points, k, runtime->new_points_);
+    
+    PTZSlamTrackingResult res = runtime->runtime_->track(frame_index,
+                                                         runtime->points_,
+                                                         runtime->ray_indices_,
+                                                         runtime->removed_rays_,
+                                                         runtime->new_points_,
+                                                         keypoints, descriptors, n);
+    for (int i = 0; i<3; i++) {
+        pan_tilt_zoom[i] = res.ptz_[i];
+    }
+    if (result != NULL) {
+        result[0] = res.observation_num_;
+        result[1] = res.first_new_ray_;
+        result[2] = res.is_keyframe_ ? 1 : 0;
+        result[3] = res.is_relocalization_requested_ ? 1 : 0;
+    }
+    return (int)res.state_;
+}
+
+EXPORTIT int requestSlamRelocalization(SlamRuntime* runtime,
+                                       int frame_index,
+                                       const float* keypoints,
+                                       const float* descriptors,
+                                       int n)
+{
+    assert(runtime != nullptr);
+    return runtime->runtime_->requestRelocalization(frame_index, keypoints, descriptors, n) ? 1 : 0;
+}
+
+EXPORTIT void flushSlamMapping(SlamRuntime* runtime)
+{
+    assert(runtime != nullptr);
+    runtime->runtime_->flushMapping();
+}
+
+EXPORTIT int saveSlamMap(SlamRuntime* runtime,
+                         const char* model_file)
+{
+    assert(runtime != nullptr);
+    assert(model_file != nullptr);
+    runtime->runtime_->flushMapping();
+    std::shared_ptr<const BTDTRegressor> model = runtime->runtime_->publishedModel();
+    if (!model || model->treeNum() == 0) {
+        printf("Warning: the map is empty, %s is not saved\n", model_file);
+        return 0;
+    }
+    return model->saveModel(model_file) ? 1 : 0;
+}
+
+EXPORTIT int getSlamRuntimeStatistics(SlamRuntime* runtime,
+                                      char* buffer,
+                                      int buffer_size)
+{
+    assert(runtime != nullptr);
+    string json = runtime->runtime_->statisticsJSON();
+    if (buffer != NULL && buffer_size > 0) {
+        int len = std::min((int)json.size(), buffer_size - 1);
+        memcpy(buffer, json.c_str(), len);
+        buffer[len] = '\0';
+    }
+    return (int)json.size() + 1;
+}
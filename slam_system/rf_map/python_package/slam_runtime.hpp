@@ -0,0 +1,98 @@
+//
+//  slam_runtime.hpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-31.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef slam_runtime_hpp
+#define slam_runtime_hpp
+
+// C interface of PTZSlamRuntime for ptz_slam.py
+// feature detection, optical flow and matching stay in python, tracking, mapping and relocalization are native
+#include <stdio.h>
+#include "ptz_slam_runtime.hpp"
+
+#ifdef _WIN32
+#define EXPORTIT __declspec( dllexport )
+#else
+#define EXPORTIT
+#endif
+
+class SlamRuntime {
+public:
+    BTDTRegressor base_model_;      // empty if there is no pre-built map
+    PTZSlamRuntime * runtime_;
+    
+    vector<Eigen::Vector2d> points_;       // reused between frames
+    vector<int> ray_indices_;
+    vector<int> removed_rays_;
+    vector<Eigen::Vector2d> new_points_;
+public:
+    SlamRuntime();
+    ~SlamRuntime();
+};
+
+extern "C" {
+    // parameter files and base_model_file can be NULL or empty, then default values are used
+    // the principal point of tracking and relocalization is the image center
+    // mapping and relocalization threads are started
+    EXPORTIT SlamRuntime* SlamRuntime_new(int descriptor_dim,
+                                          int image_width,
+                                          int image_height,
+                                          const char* runtime_parameter_file,
+                                          const char* tree_parameter_file,
+                                          const char* relocalizer_parameter_file,
+                                          const char* base_model_file);
+    
+    EXPORTIT void SlamRuntime_delete(SlamRuntime* runtime);
+    
+    // ptz: 3, pose of the first frame
+    EXPORTIT void initSlamRuntime(SlamRuntime* runtime,
+                                  const double* ptz);
+    
+    // points: m x 2, observations of rays in ray_indices
+    // removed_rays: r
+    // new_points: k x 2, new rays after the update
+    // keypoints: n x 2 float, descriptors: n x descriptor_dim float, row major
+    // pan_tilt_zoom: output 3
+    // result: output 4, observation number, first new ray, is keyframe, is relocalization requested
+    // return: 0 tracking, 1 lost, 2 relocalized, see PTZSlamTrackingResult
+    EXPORTIT int trackSlamFrame(SlamRuntime* runtime,
+                                int frame_index,
+                                const double* points,
+                                const int* ray_indices,
+                                int m,
+                                const int* removed_rays,
+                                int r,
+                                const double* new_points,
+                                int k,
+                                const float* keypoints,
+                                const float* descriptors,
+                                int n,
+                                double* pan_tilt_zoom,
+                                int* result);
+    
+    // return: 1 the frame is sent to relocalization, 0 the queue is full
+    EXPORTIT int requestSlamRelocalization(SlamRuntime* runtime,
+                                           int frame_index,
+                                           const float* keypoints,
+                                           const float* descriptors,
+                                           int n);
+    
+    EXPORTIT void flushSlamMapping(SlamRuntime* runtime);
+    
+    // wait for the mapping stage and save the published map
+    // return: 1 success, 0 empty map or can not write the file
+    EXPORTIT int saveSlamMap(SlamRuntime* runtime,
+                             const char* model_file);
+    
+    // buffer: output, null terminated JSON, truncated if buffer_size is too small
+    // return: buffer size of the full JSON
+    EXPORTIT int getSlamRuntimeStatistics(SlamRuntime* runtime,
+                                          char* buffer,
+                                          int buffer_size);
+}
+
+#endif /* slam_runtime_hpp */
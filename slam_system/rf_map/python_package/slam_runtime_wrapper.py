@@ -0,0 +1,120 @@
+# pipelined tracking, mapping and relocalization, see ptz_slam_runtime.hpp
+import json
+import numpy as np
+from ctypes import cdll
+from ctypes import c_int
+from ctypes import c_void_p
+from ctypes import c_char_p
+from ctypes import create_string_buffer
+import platform
+
+system = platform.system()
+
+#@todo hardcode library
+if system == "Windows":
+    lib = cdll.LoadLibrary('C:/graduate_design/Pan-tilt-zoom-SLAM/slam_system/rf_map/build/x64/Debug/rf_map_python.dll')
+else:
+    lib = cdll.LoadLibrary('/Users/jimmy/Code/ptz_slam/Pan-tilt-zoom-SLAM/slam_system/rf_map/build/librf_map_python.dylib')
+
+lib.SlamRuntime_new.restype = c_void_p
+lib.SlamRuntime_new.argtypes = [c_int, c_int, c_int, c_char_p, c_char_p, c_char_p, c_char_p]
+lib.SlamRuntime_delete.argtypes = [c_void_p]
+lib.initSlamRuntime.argtypes = [c_void_p, c_void_p]
+lib.trackSlamFrame.restype = c_int
+lib.trackSlamFrame.argtypes = [c_void_p, c_int, c_void_p, c_void_p, c_int, c_void_p, c_int,
+                               c_void_p, c_int, c_void_p, c_void_p, c_int, c_void_p, c_void_p]
+lib.requestSlamRelocalization.restype = c_int
+lib.requestSlamRelocalization.argtypes = [c_void_p, c_int, c_void_p, c_void_p, c_int]
+lib.flushSlamMapping.argtypes = [c_void_p]
+lib.saveSlamMap.restype = c_int
+lib.saveSlamMap.argtypes = [c_void_p, c_char_p]
+lib.getSlamRuntimeStatistics.restype = c_int
+lib.getSlamRuntimeStatistics.argtypes = [c_void_p, c_void_p, c_int]
+
+TRACKING = 0
+LOST = 1
+RELOCALIZED = 2
+
+
+def _encode(file_name):
+    return file_name.encode('utf-8') if file_name else None
+
+
+class SlamRuntime:
+    def __init__(self, descriptor_dim=128, im_width=1280, im_height=720, runtime_param_file=None,
+                 tree_param_file=None, relocalizer_param_file=None, base_model_file=None):
+        """
+        mapping and relocalization threads start here
+        :param runtime_param_file: see PTZSlamRuntimeParameter, None for default values
+        :param tree_param_file: see PTZTreeParameter
+        :param relocalizer_param_file: see PTZRelocalizerParameter
+        :param base_model_file: a pre-built map, relocalization uses it and the online map
+        """
+        self.descriptor_dim = descriptor_dim
+        self.runtime = lib.SlamRuntime_new(descriptor_dim, im_width, im_height,
+                                           _encode(runtime_param_file), _encode(tree_param_file),
+                                           _encode(relocalizer_param_file), _encode(base_model_file))
+
+    def __del__(self):
+        lib.SlamRuntime_delete(self.runtime)
+
+    def init(self, ptz):
+        ptz = np.ascontiguousarray(ptz, dtype=np.float64).reshape(3)
+        lib.initSlamRuntime(self.runtime, c_void_p(ptz.ctypes.data))
+
+    def track(self, frame_index, points, ray_indices, removed_rays, new_points, keypoints, descriptors):
+        """
+        tracking stage of one frame, keyframes and lost frames are sent to the background threads
+        :param points: M x 2, observations of existing rays, e.g., optical flow
+        :param ray_indices: M, ray index of each observation
+        :param removed_rays: rays removed after the update, e.g., outliers
+        :param new_points: K x 2, new rays after the update
+        :param keypoints: N x 2, keypoints of the frame
+        :param descriptors: N x descriptor_dim
+        :return: state (TRACKING, LOST, RELOCALIZED), ptz, index of the first new ray, is keyframe
+        """
+        points = np.ascontiguousarray(points, dtype=np.float64).reshape((-1, 2))
+        ray_indices = np.ascontiguousarray(ray_indices, dtype=np.int32).reshape(-1)
+        removed_rays = np.ascontiguousarray(removed_rays, dtype=np.int32).reshape(-1)
+        new_points = np.ascontiguousarray(new_points, dtype=np.float64).reshape((-1, 2))
+        keypoints = np.ascontiguousarray(keypoints, dtype=np.float32).reshape((-1, 2))
+        descriptors = np.ascontiguousarray(descriptors, dtype=np.float32).reshape((-1, self.descriptor_dim))
+        assert points.shape[0] == ray_indices.shape[0]
+        assert keypoints.shape[0] == descriptors.shape[0]
+
+        ptz = np.zeros(3)
+        result = np.zeros(4, dtype=np.int32)
+        state = lib.trackSlamFrame(self.runtime, frame_index,
+                                   c_void_p(points.ctypes.data), c_void_p(ray_indices.ctypes.data), points.shape[0],
+                                   c_void_p(removed_rays.ctypes.data), removed_rays.shape[0],
+                                   c_void_p(new_points.ctypes.data), new_points.shape[0],
+                                   c_void_p(keypoints.ctypes.data), c_void_p(descriptors.ctypes.data),
+                                   keypoints.shape[0],
+                                   c_void_p(ptz.ctypes.data), c_void_p(result.ctypes.data))
+        return state, ptz, int(result[1]), bool(result[2])
+
+    def request_relocalization(self, frame_index, keypoints, descriptors):
+        """
+        the caller detects a tracking failure, e.g., a shot change
+        :return: False if the relocalization queue is full
+        """
+        keypoints = np.ascontiguousarray(keypoints, dtype=np.float32).reshape((-1, 2))
+        descriptors = np.ascontiguousarray(descriptors, dtype=np.float32).reshape((-1, self.descriptor_dim))
+        assert keypoints.shape[0] == descriptors.shape[0]
+        return lib.requestSlamRelocalization(self.runtime, frame_index, c_void_p(keypoints.ctypes.data),
+                                             c_void_p(descriptors.ctypes.data), keypoints.shape[0]) == 1
+
+    def flush_mapping(self):
+        lib.flushSlamMapping(self.runtime)
+
+    def save_map(self, model_file):
+        return lib.saveSlamMap(self.runtime, _encode(model_file)) == 1
+
+    def statistics(self):
+        """
+        :return: dict, counters and per stage latency (mean, p50, p90, p99, max in ms)
+        """
+        size = lib.getSlamRuntimeStatistics(self.runtime, None, 0)
+        buffer = create_string_buffer(size)
+        lib.getSlamRuntimeStatistics(self.runtime, buffer, size)
+        return json.loads(buffer.value.decode('utf-8'))
@@ -10,12 +10,16 @@
 #include "dt_util.hpp"
 #include <iostream>
 #include "mat_io.hpp"
+#include "dt_rng.hpp"
+#include "dt_profiler.hpp"
+#include "dt_thread_pool.hpp"
 
 using namespace::std;
 
 RFMapBuilder::RFMapBuilder()
 {
-    
+    random_seed_ = 0;
+    thread_num_ = 1;
 }
 
 RFMapBuilder::~RFMapBuilder()
@@ -28,6 +32,17 @@ void RFMapBuilder::setTreeParameter(const TreeParameter& param)
     tree_param_ = param;
 }
 
+void RFMapBuilder::setRandomSeed(uint64_t seed)
+{
+    random_seed_ = seed;
+}
+
+void RFMapBuilder::setThreadNum(int thread_num)
+{
+    assert(thread_num >= 1);
+    thread_num_ = thread_num;
+}
+
 bool  RFMapBuilder::buildModel(BTDTRegressor& model,
                              const vector<string> & feature_label_files,
                              const char *model_file_name,
@@ -52,11 +67,15 @@ bool  RFMapBuilder::buildModel(BTDTRegressor& model,
     const int tree_num = tree_param_.base_tree_param_.tree_num_;
     
     const Eigen::Vector2f pp(tree_param_.pp_x_, tree_param_.pp_y_);
+    DTThreadPool pool(tree_param_.out_of_bag_sampling_ ? thread_num_ : 1);
     for (int n = 0; n<tree_num; n++) {
+        // each tree has its own random stream
+        DTRng rng(random_seed_, n);
+        
         // randomly sample frames
         vector<string> sampled_files;
         for (int j = 0; j<sampled_frame_num; j++) {
-            int index = rand()%frame_num;
+            int index = rng.uniformInt(frame_num);
             sampled_files.push_back(feature_label_files[index]);
         }
         
@@ -81,44 +100,224 @@ bool  RFMapBuilder::buildModel(BTDTRegressor& model,
             printf("training sample number is %lu\n", features.size());
         }
         
+        if (features.size() == 0) {
+            printf("Error: no training example in sampled frames, tree %d is not built\n", n);
+            return false;
+        }
         model.feature_dim_ = (int)features[0].size();
         model.label_dim_   = (int)labels[0].size();
         
-        vector<unsigned int> indices = DTUtil::range<unsigned int>(0, (int)features.size(), 1);
-        assert(indices.size() == features.size());
+        vector<unsigned int> indices;
+        if (!this->selectTrainingExamples(model, features, labels, pool, indices, verbose)) {
+            break;
+        }
+        TreePtr pTree = this->trainTree(features, labels, indices, rng, verbose);
+        model.trees_.push_back(pTree);
+        if (model_file_name != NULL) {
+            model.saveModel(model_file_name);
+        }
+        //this->validationError(model, feature_label_files, std::min(4, frame_num));
+    }
+    return true;
+}
+
+bool RFMapBuilder::buildModel(BTDTRegressor& model,
+                              const vector<vector<btdtr_ptz_util::PTZTrainingSample> > & keyframe_samples,
+                              const char *model_file_name,
+                              bool verbose) const
+{
+    assert(keyframe_samples.size() > 0);
+    
+    model.trees_.clear();
+    if (verbose) {
+        tree_param_.printSelf();
+    }
+    
+    model.reg_tree_param_ = tree_param_.base_tree_param_;
+    
+    const int frame_num = (int)keyframe_samples.size();
+    const int sampled_frame_num = std::min(frame_num, tree_param_.sampled_frame_num_);
+    const int tree_num = tree_param_.base_tree_param_.tree_num_;
+    
+    DTThreadPool pool(tree_param_.out_of_bag_sampling_ ? thread_num_ : 1);
+    for (int n = 0; n<tree_num; n++) {
+        // each tree has its own random stream
+        DTRng rng(random_seed_, n);
+        
+        // randomly sample keyframes
+        vector<VectorXf> features;
+        vector<VectorXf> labels;
+        for (int j = 0; j<sampled_frame_num; j++) {
+            const int index = rng.uniformInt(frame_num);
+            for (const auto& s: keyframe_samples[index]) {
+                features.push_back(s.descriptor_);
+                labels.push_back(s.pan_tilt_);
+            }
+        }
+        assert(features.size() == labels.size());
         
-        TreePtr pTree = new TreeType();
-        assert(pTree);
-        double tt = clock();
-        pTree->buildTree(features, labels, indices, tree_param_.base_tree_param_);
         if (verbose) {
-            printf("build a tree cost %lf seconds\n", (clock()-tt)/CLOCKS_PER_SEC );
-        }       
+            printf("training sample number is %lu\n", features.size());
+        }
         
-        // test training error
+        if (features.size() == 0) {
+            printf("Error: no training example in sampled frames, tree %d is not built\n", n);
+            return false;
+        }
+        model.feature_dim_ = (int)features[0].size();
+        model.label_dim_   = (int)labels[0].size();
+        
+        vector<unsigned int> indices;
+        if (!this->selectTrainingExamples(model, features, labels, pool, indices, verbose)) {
+            break;
+        }
+        TreePtr pTree = this->trainTree(features, labels, indices, rng, verbose);
+        model.trees_.push_back(pTree);
+        if (model_file_name != NULL) {
+            model.saveModel(model_file_name);
+        }
+    }
+    return true;
+}
+
+template <int WordNum>
+bool RFMapBuilder::buildModel(BTHammingRegressor<WordNum>& model,
+                              const vector<vector<typename BTHammingTree<WordNum>::Descriptor> > & keyframe_descriptors,
+                              const vector<vector<VectorXf> > & keyframe_labels,
+                              const char *model_file_name,
+                              bool verbose) const
+{
+    typedef typename BTHammingTree<WordNum>::Descriptor Descriptor;
+    assert(keyframe_descriptors.size() > 0);
+    assert(keyframe_descriptors.size() == keyframe_labels.size());
+    
+    model.trees_.clear();
+    if (verbose) {
+        tree_param_.printSelf();
+    }
+    
+    model.reg_tree_param_ = tree_param_.base_tree_param_;
+    
+    const int frame_num = (int)keyframe_descriptors.size();
+    const int sampled_frame_num = std::min(frame_num, tree_param_.sampled_frame_num_);
+    const int tree_num = tree_param_.base_tree_param_.tree_num_;
+    
+    model.trees_.resize(tree_num);
+    for (int n = 0; n<tree_num; n++) {
+        // each tree has its own random stream
+        DTRng rng(random_seed_, n);
+        
+        // randomly sample keyframes
+        vector<Descriptor> features;
+        vector<VectorXf> labels;
+        for (int j = 0; j<sampled_frame_num; j++) {
+            const int index = rng.uniformInt(frame_num);
+            assert(keyframe_descriptors[index].size() == keyframe_labels[index].size());
+            features.insert(features.end(), keyframe_descriptors[index].begin(), keyframe_descriptors[index].end());
+            labels.insert(labels.end(), keyframe_labels[index].begin(), keyframe_labels[index].end());
+        }
+        
+        if (verbose) {
+            printf("training sample number is %lu\n", features.size());
+        }
+        if (labels.size() == 0) {
+            printf("Error: no training example in sampled frames, tree %d is not built\n", n);
+            return false;
+        }
+        model.label_dim_ = (int)labels[0].size();
+        
+        vector<unsigned int> indices = DTUtil::range<unsigned int>(0, (int)features.size(), 1);
+        model.trees_[n].setRandomGenerator(rng);
+        {
+            DTScopedTimer timer(DTProfiler::TREE_BUILD);
+            model.trees_[n].buildTree(features, labels, indices, tree_param_.base_tree_param_);
+        }
+        DTProfiler::addCount(DTProfiler::TREE_NUM);
+        
+        if (verbose) {
+            printf("tree %d has %d leaf nodes\n", n, model.trees_[n].leafNodeNum());
+        }
+    }
+    if (model_file_name != NULL) {
+        model.saveModel(model_file_name);
+    }
+    return true;
+}
+
+template bool RFMapBuilder::buildModel<4>(BTHammingRegressor<4>& model,
+                                          const vector<vector<BTHammingTree<4>::Descriptor> > & keyframe_descriptors,
+                                          const vector<vector<VectorXf> > & keyframe_labels,
+                                          const char *model_file_name,
+                                          bool verbose) const;
+template bool RFMapBuilder::buildModel<8>(BTHammingRegressor<8>& model,
+                                          const vector<vector<BTHammingTree<8>::Descriptor> > & keyframe_descriptors,
+                                          const vector<vector<VectorXf> > & keyframe_labels,
+                                          const char *model_file_name,
+                                          bool verbose) const;
+
+RFMapBuilder::TreePtr RFMapBuilder::trainTree(const vector<VectorXf> & features,
+                                              const vector<VectorXf> & labels,
+                                              const vector<unsigned int> & indices,
+                                              const DTRng & rng,
+                                              bool verbose) const
+{
+    assert(indices.size() <= features.size());
+    
+    TreePtr pTree = new TreeType();
+    assert(pTree);
+    pTree->setRandomGenerator(rng);
+    {
+        DTScopedTimer timer(DTProfiler::TREE_BUILD);
+        pTree->buildTree(features, labels, indices, tree_param_.base_tree_param_);
+    }
+    DTProfiler::addCount(DTProfiler::TREE_NUM);
+    
+    // test training error
+    if (verbose) {
         vector<Eigen::VectorXf> errors;
-        for (int k = 0; k< features.size(); k++) {
-            Eigen::VectorXf feat = features[k];
-            Eigen::VectorXf label = labels[k];
+        for (int k = 0; k< indices.size(); k++) {
             Eigen::VectorXf pred;
             float dist = 0.0f;
-            pTree->predict(feat, 1, pred, dist);
-            errors.push_back(pred - label);
+            pTree->predict(features[indices[k]], 1, pred, dist);
+            errors.push_back(pred - labels[indices[k]]);
         }
         Eigen::VectorXf q1_error, q2_error, q3_error;
         DTUtil::quartileError(errors, q1_error, q2_error, q3_error);
+        cout<<"Training first quartile error: \n"<<q1_error.transpose()<<endl;
+        cout<<"Training second quartile (median) error: \n"<<q2_error.transpose()<<endl;
+        cout<<"Training third quartile error: \n"<<q3_error.transpose()<<endl<<endl;
+    }
+    return pTree;
+}
+
+bool RFMapBuilder::selectTrainingExamples(const BTDTRegressor & model,
+                                          const vector<VectorXf> & features,
+                                          const vector<VectorXf> & labels,
+                                          DTThreadPool & pool,
+                                          vector<unsigned int> & indices,
+                                          bool verbose) const
+{
+    indices.clear();
+    if (!tree_param_.out_of_bag_sampling_ || model.treeNum() == 0) {
+        indices = DTUtil::range<unsigned int>(0, (int)features.size(), 1);
+        return true;
+    }
+    
+    this->outOfBagSampling(model, features, labels, pool, indices,
+                           tree_param_.out_of_bag_distance_threshold_,
+                           tree_param_.out_of_bag_error_threshold_);
+    const double ratio = features.empty() ? 0.0 : 1.0 * indices.size() / features.size();
+    if (verbose) {
+        printf("select %lu from %lu examples, about %f of data\n", indices.size(), features.size(), ratio);
+    }
+    
+    // a tree from a few examples is one leaf node
+    if (ratio < tree_param_.out_of_bag_stop_ratio_ ||
+        (int)indices.size() < tree_param_.base_tree_param_.min_leaf_node_) {
         if (verbose) {
-            cout<<"Training first quartile error: \n"<<q1_error.transpose()<<endl;
-            cout<<"Training second quartile (median) error: \n"<<q2_error.transpose()<<endl;
-            cout<<"Training third quartile error: \n"<<q3_error.transpose()<<endl<<endl;
+            printf("forest predicts the training examples well, stop at %d trees\n", model.treeNum());
         }
-        
-                
-        model.trees_.push_back(pTree);
-        if (model_file_name != NULL) {
-            model.saveModel(model_file_name);
-        }
-        //this->validationError(model, feature_label_files, std::min(4, frame_num));
+        return false;
     }
     return true;
 }
@@ -130,9 +329,11 @@ bool RFMapBuilder::validationError(const BTDTRegressor & model,
     const Eigen::Vector2f pp(tree_param_.pp_x_, tree_param_.pp_y_);
     
     const int max_check = 4;
+    // tree n uses stream n, the stream after the last tree is not used in training
+    DTRng rng(random_seed_, tree_param_.base_tree_param_.tree_num_);
     // sample from selected frames
     for (int i = 0; i<sample_frame_num; i++) {
-        int index = rand()%sample_frame_num;
+        int index = rng.uniformInt(sample_frame_num);
         string feature_file_name = ptz_keypoint_descriptor_files[index];
         vector<btdtr_ptz_util::PTZTrainingSample> samples;
         Eigen::Vector3f dummy_ptz;
@@ -169,11 +370,12 @@ bool RFMapBuilder::validationError(const BTDTRegressor & model,
 }
 
 void RFMapBuilder::outOfBagSampling(const BTDTRegressor & model,
-                                     vector<VectorXf>& features,
-                                     vector<VectorXf>& labels,
-                                     vector<unsigned int> & selected_indices,
-                                     float feature_dist_threshold,
-                                     float out_of_bag_error_threshold)
+                                    const vector<VectorXf>& features,
+                                    const vector<VectorXf>& labels,
+                                    DTThreadPool & pool,
+                                    vector<unsigned int> & selected_indices,
+                                    float feature_dist_threshold,
+                                    float out_of_bag_error_threshold) const
 {
     assert(features.size() == labels.size());
     assert(selected_indices.size() == 0);
@@ -182,24 +384,32 @@ void RFMapBuilder::outOfBagSampling(const BTDTRegressor & model,
     // if the prediction error is smaller than a threshold, then the new example is discarded
     
     const int max_check = 4;
-    for (int i = 0; i<features.size(); i++) {        
+    const int n = (int)features.size();
+    vector<char> is_selected(n, 0);
+    vector<BTDTRTree::SearchBuffer> buffers(pool.threadNum());
+    pool.parallelFor(n, [&](int thread_id, int begin, int end) {
+        BTDTRTree::SearchBuffer & buffer = buffers[thread_id];
         vector<VectorXf> preds;
         vector<float> dists;
-        
-        bool is_pred = model.predict(features[i], max_check, preds, dists);
-        assert(is_pred);
-        
-        VectorXf dif = labels[i] - preds[0];
-        float pred_error = dif.norm();
-        
-        if (dists[0] < feature_dist_threshold &&
-            pred_error < out_of_bag_error_threshold) {
-            continue;
+        for (int i = begin; i<end; i++) {
+            bool is_pred = model.predict(features[i], max_check, buffer, preds, dists);
+            assert(is_pred);
+            
+            // dists are in non-decrease order
+            VectorXf dif = labels[i] - preds[0];
+            float pred_error = dif.norm();
+            
+            if (dists[0] < feature_dist_threshold &&
+                pred_error < out_of_bag_error_threshold) {
+                continue;
+            }
+            is_selected[i] = 1;
+        }
+    });
+    
+    for (int i = 0; i<n; i++) {
+        if (is_selected[i]) {
+            selected_indices.push_back(i);
         }
-        selected_indices.push_back(i);
     }
-    printf("select %lu from %lu, about %f\n of dada \n",
-           selected_indices.size(),
-           features.size(),
-           1.0*selected_indices.size()/features.size());    
 }
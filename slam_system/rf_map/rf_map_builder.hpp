@@ -13,8 +13,11 @@
 #include <Eigen/Dense>
 #include <string>
 #include "bt_dt_regressor.h"
+#include "bt_hamming_regressor.h"
 #include "btdtr_ptz_util.h"
 
+class DTThreadPool;
+
 
 class RFMapBuilder {
     using TreeParameter = btdtr_ptz_util::PTZTreeParameter;
@@ -23,6 +26,8 @@ class RFMapBuilder {
     
 private:
     TreeParameter tree_param_;
+    uint64_t random_seed_;    // tree n uses stream n of this seed
+    int thread_num_;          // threads of out-of-bag prediction
     
 public:
     RFMapBuilder();
@@ -31,27 +36,72 @@ public:
     
     void setTreeParameter(const TreeParameter& param);
     
+    // the same seed and training files produce the same model
+    void setRandomSeed(uint64_t seed);
+    
+    // out-of-bag prediction runs in parallel, the model does not depend on it
+    void setThreadNum(int thread_num);
+    
     // build model from subset of images    
     // sift feature are precomputed to save time
     // feature_label_files: .mat file has ptz, keypoint location and descriptor
+    // model_file_name: can be NULL, otherwise the model is saved after each tree
+    // return: false if the sampled frames have no training example
     bool buildModel(BTDTRegressor& model,
                     const vector<string> & feature_label_files,
                     const char *model_file_name,
-                    bool verbose = true) const;   
+                    bool verbose = true) const;
+    
+    // build model from training examples in memory
+    // keyframe_samples: training examples of each keyframe (image)
+    bool buildModel(BTDTRegressor& model,
+                    const vector<vector<btdtr_ptz_util::PTZTrainingSample> > & keyframe_samples,
+                    const char *model_file_name,
+                    bool verbose = true) const;
     
-private:    
+    // build Hamming forest from binary descriptors in memory
+    // keyframe_descriptors: packed descriptors of each keyframe
+    // keyframe_labels: pan and tilt of each descriptor
+    template <int WordNum>
+    bool buildModel(BTHammingRegressor<WordNum>& model,
+                    const vector<vector<typename BTHammingTree<WordNum>::Descriptor> > & keyframe_descriptors,
+                    const vector<vector<VectorXf> > & keyframe_labels,
+                    const char *model_file_name,
+                    bool verbose = true) const;
+    
+private:
+    // train one tree from examples of indices and report training error
+    // rng: random stream of the tree
+    TreePtr trainTree(const vector<VectorXf> & features,
+                      const vector<VectorXf> & labels,
+                      const vector<unsigned int> & indices,
+                      const DTRng & rng,
+                      bool verbose) const;
+    
+    // examples used to create tree n, all of them or the out-of-bag selected ones
+    // return: false if the forest predicts almost all of them well, no more trees are needed
+    bool selectTrainingExamples(const BTDTRegressor & model,
+                                const vector<VectorXf> & features,
+                                const vector<VectorXf> & labels,
+                                DTThreadPool & pool,
+                                vector<unsigned int> & indices,
+                                bool verbose) const;
+    
+
     bool validationError(const BTDTRegressor & model,
                          const vector<string> & ptz_keypoint_descriptor_files,
                          const int sample_frame_num = 10) const;
     
     // output: selected_indices, examples used to create a new tree
     // selected examples that have large out-of-bag errors
+    // prediction is batched over the threads of pool
     void outOfBagSampling(const BTDTRegressor & model,
-                           vector<VectorXf>& features,
-                           vector<VectorXf>& labels,
-                           vector<unsigned int> & selected_indices,
-                           float feature_dist_threshold = 0.05,
-                           float out_of_bag_error_threshold = 0.02);
+                          const vector<VectorXf>& features,
+                          const vector<VectorXf>& labels,
+                          DTThreadPool & pool,
+                          vector<unsigned int> & selected_indices,
+                          float feature_dist_threshold = 0.05,
+                          float out_of_bag_error_threshold = 0.02) const;
 
     
 };
@@ -0,0 +1,49 @@
+//
+//  ptz_relocalization_protocol.h
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-27.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef ptz_relocalization_protocol_h
+#define ptz_relocalization_protocol_h
+
+// messages between the relocalization server and camera processes on the same machine
+// native byte order, a client sends a request and waits for its response
+//
+// relocalization request: PTZRequestHeader, n x 2 float keypoints, n x descriptor_dim float descriptors
+// relocalization response: PTZResponseHeader
+// statistics request: PTZRequestHeader with n = 0
+// statistics response: PTZResponseHeader, json_size bytes of JSON
+#include <stdint.h>
+
+enum PTZMessageType
+{
+    PTZ_MESSAGE_RELOCALIZE = 0,
+    PTZ_MESSAGE_STATISTICS = 1
+};
+
+static const uint32_t PTZ_MESSAGE_MAGIC = 0x525a5450;   // "PTZR"
+
+#pragma pack(push, 1)
+struct PTZRequestHeader
+{
+    uint32_t magic_;
+    int32_t type_;              // PTZMessageType
+    int32_t n_;                 // keypoint number
+    int32_t descriptor_dim_;
+    double pan_tilt_zoom_[3];   // initial camera pose
+};
+
+struct PTZResponseHeader
+{
+    uint32_t magic_;
+    int32_t type_;
+    int32_t inlier_num_;        // 0 if failed
+    int32_t json_size_;         // statistics response only
+    double pan_tilt_zoom_[3];   // estimated camera pose
+};
+#pragma pack(pop)
+
+#endif /* ptz_relocalization_protocol_h */
@@ -0,0 +1,415 @@
+//
+//  ptz_relocalization_server.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-27.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#include "ptz_relocalization_server.hpp"
+#include "ptz_relocalization_protocol.h"
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <chrono>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0   // SIGPIPE is ignored by the caller
+#endif
+
+namespace {
+    inline int64_t nowNanoseconds()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+    
+    // return: false if the peer closed the connection
+    bool readAll(int fd, void * data, size_t size)
+    {
+        char * p = (char *)data;
+        while (size > 0) {
+            ssize_t num = recv(fd, p, size, 0);
+            if (num < 0 && errno == EINTR) {
+                continue;
+            }
+            if (num <= 0) {
+                return false;
+            }
+            p += num;
+            size -= num;
+        }
+        return true;
+    }
+    
+    bool writeAll(int fd, const void * data, size_t size)
+    {
+        const char * p = (const char *)data;
+        while (size > 0) {
+            ssize_t num = send(fd, p, size, MSG_NOSIGNAL);
+            if (num < 0 && errno == EINTR) {
+                continue;
+            }
+            if (num <= 0) {
+                return false;
+            }
+            p += num;
+            size -= num;
+        }
+        return true;
+    }
+    
+    // a frame has at most this number of keypoints
+    const int MAX_KEYPOINT_NUM = 1 << 16;
+}
+
+PTZRelocalizationServer::PTZRelocalizationServer(const BTDTRegressor & model,
+                                                 const PTZRelocalizerParameter & relocalizer_param,
+                                                 const PTZRelocalizationServerParameter & server_param):
+model_(model), relocalizer_(relocalizer_param)
+{
+    assert(server_param.max_batch_size_ > 0);
+    assert(server_param.latency_window_ > 0);
+    param_ = server_param;
+    listen_fd_ = -1;
+    is_stopped_ = true;
+    
+    start_ns_ = nowNanoseconds();
+    request_num_ = 0;
+    failed_num_ = 0;
+    batched_num_ = 0;
+    batch_num_ = 0;
+    max_batch_size_ = 0;
+    latency_index_ = 0;
+}
+
+PTZRelocalizationServer::~PTZRelocalizationServer()
+{
+    this->stop();
+}
+
+bool PTZRelocalizationServer::start(const char * socket_path)
+{
+    assert(socket_path);
+    assert(is_stopped_);
+    
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        printf("Error: socket path %s is too long\n", socket_path);
+        return false;
+    }
+    strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+    
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd_ < 0) {
+        printf("Error: can not create socket, %s\n", strerror(errno));
+        return false;
+    }
+    // remove a stale socket of a previous server, never a regular file
+    struct stat status;
+    if (lstat(socket_path, &status) == 0) {
+        if (!S_ISSOCK(status.st_mode)) {
+            printf("Error: %s exists and is not a socket\n", socket_path);
+            close(listen_fd_);
+            listen_fd_ = -1;
+            return false;
+        }
+        unlink(socket_path);
+    }
+    if (bind(listen_fd_, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(listen_fd_, param_.max_connection_num_) != 0) {
+        printf("Error: can not listen on %s, %s\n", socket_path, strerror(errno));
+        close(listen_fd_);
+        listen_fd_ = -1;
+        return false;
+    }
+    
+    socket_path_ = string(socket_path);
+    start_ns_ = nowNanoseconds();
+    is_stopped_ = false;
+    batch_thread_ = std::thread(&PTZRelocalizationServer::batchLoop, this);
+    accept_thread_ = std::thread(&PTZRelocalizationServer::acceptLoop, this);
+    return true;
+}
+
+void PTZRelocalizationServer::stop()
+{
+    if (listen_fd_ < 0) {
+        return;
+    }
+    is_stopped_ = true;
+    
+    // 1. no new connection
+    if (accept_thread_.joinable()) {
+        accept_thread_.join();
+    }
+    close(listen_fd_);
+    listen_fd_ = -1;
+    unlink(socket_path_.c_str());
+    
+    // 2. wake up connections that wait for a request, pending requests are still processed
+    vector<Connection *> connections;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        connections.swap(connections_);
+        for (Connection * c: connections) {
+            shutdown(c->fd_, SHUT_RDWR);
+        }
+    }
+    for (Connection * c: connections) {
+        c->thread_.join();
+        close(c->fd_);
+        delete c;
+    }
+    
+    // 3. batch thread exits once the queue is empty
+    request_cond_.notify_all();
+    if (batch_thread_.joinable()) {
+        batch_thread_.join();
+    }
+}
+
+string PTZRelocalizationServer::statisticsJSON()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const double seconds = (nowNanoseconds() - start_ns_) * 1e-9;
+    vector<double> latencies = latencies_ms_;
+    const int latency_num = (int)latencies.size();
+    std::sort(latencies.begin(), latencies.end());
+    
+    double mean_latency = 0.0;
+    for (double v: latencies) {
+        mean_latency += v;
+    }
+    auto percentile = [&](double p) {
+        return latencies.empty() ? 0.0 : latencies[std::min(latency_num - 1, (int)(p * latency_num))];
+    };
+    
+    int connection_num = 0;
+    for (const Connection * c: connections_) {
+        connection_num += c->is_done_ ? 0 : 1;
+    }
+    
+    char buf[1024] = {'\0'};
+    snprintf(buf, sizeof(buf),
+             "{\"request_num\": %lld, \"failed_num\": %lld, \"batch_num\": %lld, "
+             "\"mean_batch_size\": %.3f, \"max_batch_size\": %d, \"connection_num\": %d, "
+             "\"requests_per_second\": %.3f, "
+             "\"latency_ms\": {\"mean\": %.3f, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}}",
+             (long long)request_num_, (long long)failed_num_, (long long)batch_num_,
+             batch_num_ > 0 ? (double)batched_num_ / batch_num_ : 0.0,
+             max_batch_size_, connection_num,
+             seconds > 0 ? request_num_ / seconds : 0.0,
+             latency_num > 0 ? mean_latency / latency_num : 0.0,
+             percentile(0.5), percentile(0.9), percentile(0.99),
+             latencies.empty() ? 0.0 : latencies.back());
+    return string(buf);
+}
+
+void PTZRelocalizationServer::acceptLoop()
+{
+    while (!is_stopped_) {
+        // wake up regularly to check the stop flag
+        struct pollfd pfd;
+        pfd.fd = listen_fd_;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+        int fd = accept(listen_fd_, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        
+        std::lock_guard<std::mutex> lock(mutex_);
+        // release finished connections
+        for (int i = (int)connections_.size() - 1; i >= 0; i--) {
+            if (connections_[i]->is_done_) {
+                connections_[i]->thread_.join();
+                close(connections_[i]->fd_);
+                delete connections_[i];
+                connections_.erase(connections_.begin() + i);
+            }
+        }
+        if (connections_.size() >= param_.max_connection_num_) {
+            printf("Warning: %lu connections, a new connection is refused\n", connections_.size());
+            close(fd);
+            continue;
+        }
+        Connection * c = new Connection();
+        c->fd_ = fd;
+        c->is_done_ = false;
+        c->thread_ = std::thread(&PTZRelocalizationServer::connectionLoop, this, c);
+        connections_.push_back(c);
+    }
+}
+
+void PTZRelocalizationServer::connectionLoop(Connection * connection)
+{
+    const int fd = connection->fd_;
+    Request request;
+    while (true) {
+        PTZRequestHeader header;
+        if (!readAll(fd, &header, sizeof(header)) || header.magic_ != PTZ_MESSAGE_MAGIC) {
+            break;
+        }
+        
+        PTZResponseHeader response;
+        memset(&response, 0, sizeof(response));
+        response.magic_ = PTZ_MESSAGE_MAGIC;
+        response.type_ = header.type_;
+        
+        if (header.type_ == PTZ_MESSAGE_STATISTICS) {
+            string json = this->statisticsJSON();
+            response.json_size_ = (int32_t)json.size();
+            if (!writeAll(fd, &response, sizeof(response)) ||
+                !writeAll(fd, json.c_str(), json.size())) {
+                break;
+            }
+            continue;
+        }
+        if (header.type_ != PTZ_MESSAGE_RELOCALIZE ||
+            header.n_ < 0 || header.n_ > MAX_KEYPOINT_NUM) {
+            printf("Error: invalid request, type %d, %d keypoints\n", header.type_, header.n_);
+            break;
+        }
+        // checked before the payload is allocated, a wrong dimension closes the connection
+        if (header.descriptor_dim_ != model_.featureDim()) {
+            printf("Error: invalid request, descriptor dimension %d, model %d\n",
+                   header.descriptor_dim_, model_.featureDim());
+            break;
+        }
+        
+        // 1. read keypoints and descriptors, memory is reused by the next request
+        const int n = header.n_;
+        request.n_ = n;
+        request.descriptor_dim_ = header.descriptor_dim_;
+        request.keypoints_.resize((size_t)n * 2);
+        request.descriptors_.resize((size_t)n * header.descriptor_dim_);
+        if (!readAll(fd, request.keypoints_.data(), request.keypoints_.size() * sizeof(float)) ||
+            !readAll(fd, request.descriptors_.data(), request.descriptors_.size() * sizeof(float))) {
+            break;
+        }
+        for (int i = 0; i<3; i++) {
+            request.pan_tilt_zoom_[i] = header.pan_tilt_zoom_[i];
+        }
+        request.inlier_num_ = 0;
+        
+        // 2. wait for the batch
+        if (n > 0) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            request.is_done_ = false;
+            request.arrival_ns_ = nowNanoseconds();
+            queue_.push_back(&request);
+            request_cond_.notify_one();
+            while (!request.is_done_) {
+                done_cond_.wait(lock);
+            }
+        }
+        else {
+            std::lock_guard<std::mutex> lock(mutex_);
+            request_num_++;
+            failed_num_++;
+        }
+        
+        // 3. response
+        response.inlier_num_ = request.inlier_num_;
+        for (int i = 0; i<3; i++) {
+            response.pan_tilt_zoom_[i] = request.pan_tilt_zoom_[i];
+        }
+        if (!writeAll(fd, &response, sizeof(response))) {
+            break;
+        }
+    }
+    
+    // the client sees the end of the connection now, the socket is closed by acceptLoop or stop
+    shutdown(fd, SHUT_RDWR);
+    std::lock_guard<std::mutex> lock(mutex_);
+    connection->is_done_ = true;
+}
+
+void PTZRelocalizationServer::batchLoop()
+{
+    const int64_t window_ns = (int64_t)(param_.batch_window_ms_ * 1e6);
+    vector<Request *> batch;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        while (!is_stopped_ && queue_.empty()) {
+            request_cond_.wait_for(lock, std::chrono::milliseconds(100));
+        }
+        if (queue_.empty()) {
+            break;   // stopped
+        }
+        
+        // 1. wait for more requests, at most the window after the first request
+        const std::chrono::steady_clock::time_point deadline =
+            std::chrono::steady_clock::time_point(std::chrono::nanoseconds(queue_.front()->arrival_ns_ + window_ns));
+        while (queue_.size() < param_.max_batch_size_ && !is_stopped_) {
+            if (request_cond_.wait_until(lock, deadline) == std::cv_status::timeout) {
+                break;
+            }
+        }
+        
+        // 2. run the batch without the lock, connections keep queueing requests
+        const int batch_size = std::min((int)queue_.size(), param_.max_batch_size_);
+        batch.assign(queue_.begin(), queue_.begin() + batch_size);
+        queue_.erase(queue_.begin(), queue_.begin() + batch_size);
+        lock.unlock();
+        this->processBatch(batch);
+        lock.lock();
+        
+        // 3. statistics
+        const int64_t done_ns = nowNanoseconds();
+        for (Request * r: batch) {
+            const double latency = (done_ns - r->arrival_ns_) * 1e-6;
+            if (latencies_ms_.size() < param_.latency_window_) {
+                latencies_ms_.push_back(latency);
+            }
+            else {
+                latencies_ms_[latency_index_] = latency;
+                latency_index_ = (latency_index_ + 1) % param_.latency_window_;
+            }
+            failed_num_ += r->inlier_num_ == 0 ? 1 : 0;
+            r->is_done_ = true;
+        }
+        request_num_ += batch_size;
+        batched_num_ += batch_size;
+        batch_num_++;
+        max_batch_size_ = std::max(max_batch_size_, batch_size);
+        done_cond_.notify_all();
+    }
+}
+
+void PTZRelocalizationServer::processBatch(vector<Request *> & batch)
+{
+    vector<PTZRelocalizationFrame> frames(batch.size());
+    for (int i = 0; i<batch.size(); i++) {
+        const Request * r = batch[i];
+        assert(r->descriptor_dim_ == model_.featureDim());
+        frames[i].keypoints_ = r->keypoints_.data();
+        frames[i].descriptors_ = r->descriptors_.data();
+        frames[i].n_ = r->n_;
+        for (int j = 0; j<3; j++) {
+            frames[i].pan_tilt_zoom_[j] = r->pan_tilt_zoom_[j];
+        }
+    }
+    
+    relocalizer_.relocalizeBatch(model_, model_.featureDim(), frames);
+    
+    for (int i = 0; i<batch.size(); i++) {
+        Request * r = batch[i];
+        r->inlier_num_ = frames[i].inlier_num_;
+        for (int j = 0; j<3; j++) {
+            r->pan_tilt_zoom_[j] = frames[i].pan_tilt_zoom_[j];
+        }
+    }
+}
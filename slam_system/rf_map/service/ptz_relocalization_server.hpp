@@ -0,0 +1,122 @@
+//
+//  ptz_relocalization_server.hpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-27.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef ptz_relocalization_server_hpp
+#define ptz_relocalization_server_hpp
+
+// relocalization service on a UNIX domain socket
+// one warm forest serves many camera processes
+// concurrent requests are micro-batched: keypoints of all requests in a batch are predicted together
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "bt_dt_regressor.h"
+#include "ptz_relocalizer.h"
+
+using std::string;
+using std::vector;
+
+struct PTZRelocalizationServerParameter
+{
+    int max_batch_size_;        // maximum number of requests in a batch
+    double batch_window_ms_;    // wait at most this long for more requests after the first one
+    int max_connection_num_;
+    int latency_window_;        // number of recent requests in latency percentiles
+    
+    PTZRelocalizationServerParameter()
+    {
+        max_batch_size_ = 16;
+        batch_window_ms_ = 2.0;
+        max_connection_num_ = 64;
+        latency_window_ = 1024;
+    }
+};
+
+class PTZRelocalizationServer
+{
+    // a request waiting in the batch queue
+    struct Request
+    {
+        vector<float> keypoints_;
+        vector<float> descriptors_;
+        int n_;
+        int descriptor_dim_;
+        double pan_tilt_zoom_[3];
+        int inlier_num_;
+        bool is_done_;
+        int64_t arrival_ns_;
+    };
+    
+    struct Connection
+    {
+        int fd_;
+        std::thread thread_;
+        bool is_done_;
+    };
+    
+    const BTDTRegressor & model_;
+    PTZRelocalizer relocalizer_;
+    PTZRelocalizationServerParameter param_;
+    
+    string socket_path_;
+    int listen_fd_;
+    std::atomic<bool> is_stopped_;
+    std::thread accept_thread_;
+    std::thread batch_thread_;
+    vector<Connection *> connections_;       // protected by mutex_
+    
+    std::mutex mutex_;
+    std::condition_variable request_cond_;   // a request is queued
+    std::condition_variable done_cond_;      // a batch is done
+    std::deque<Request *> queue_;
+    
+    // statistics, protected by mutex_
+    int64_t start_ns_;
+    int64_t request_num_;
+    int64_t failed_num_;
+    int64_t batched_num_;                    // requests in batches, invalid requests are not batched
+    int64_t batch_num_;
+    int max_batch_size_;
+    vector<double> latencies_ms_;            // ring buffer of recent requests
+    int latency_index_;
+    
+public:
+    // model: outlives the server
+    PTZRelocalizationServer(const BTDTRegressor & model,
+                            const PTZRelocalizerParameter & relocalizer_param,
+                            const PTZRelocalizationServerParameter & server_param);
+    ~PTZRelocalizationServer();
+    
+    // listen on socket_path, an existing socket file is replaced, any other file is kept and start fails
+    // return: false if the socket can not be created
+    bool start(const char * socket_path);
+    
+    // close all connections, pending requests are finished
+    void stop();
+    
+    // requests, batches, throughput and latency percentiles
+    string statisticsJSON();
+    
+private:
+    void acceptLoop();
+    void connectionLoop(Connection * connection);
+    void batchLoop();
+    
+    // run one batch, then wake up connections
+    void processBatch(vector<Request *> & batch);
+    
+    PTZRelocalizationServer(const PTZRelocalizationServer & other);
+    PTZRelocalizationServer & operator = (const PTZRelocalizationServer & other);
+};
+
+#endif /* ptz_relocalization_server_hpp */
@@ -0,0 +1,68 @@
+//
+//  relocalization_server_main.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-27.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+// relocalization daemon: one warm forest serves camera processes on the same machine
+// usage: relocalization_server model.txt /tmp/ptz_relocalization.sock [test_parameter.txt] [max_batch_size] [batch_window_ms]
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <atomic>
+#include "ptz_relocalization_server.hpp"
+
+static std::atomic<bool> is_running(true);
+
+static void onSignal(int)
+{
+    is_running = false;
+}
+
+int main(int argc, const char * argv[])
+{
+    if (argc < 3) {
+        printf("usage: %s model_file socket_path [test_parameter_file] [max_batch_size] [batch_window_ms]\n", argv[0]);
+        return -1;
+    }
+    const char * model_file = argv[1];
+    const char * socket_path = argv[2];
+    
+    PTZRelocalizerParameter relocalizer_param;
+    if (argc >= 4 && !relocalizer_param.readFromFile(argv[3])) {
+        return -1;
+    }
+    PTZRelocalizationServerParameter server_param;
+    if (argc >= 5) {
+        server_param.max_batch_size_ = atoi(argv[4]);
+    }
+    if (argc >= 6) {
+        server_param.batch_window_ms_ = atof(argv[5]);
+    }
+    
+    BTDTRegressor model;
+    if (!model.load(model_file)) {
+        return -1;
+    }
+    
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    
+    PTZRelocalizationServer server(model, relocalizer_param, server_param);
+    if (!server.start(socket_path)) {
+        return -1;
+    }
+    printf("relocalization server is listening on %s, max batch size %d, batch window %.1f ms\n",
+           socket_path, server_param.max_batch_size_, server_param.batch_window_ms_);
+    
+    while (is_running) {
+        usleep(100 * 1000);
+    }
+    server.stop();
+    printf("%s\n", server.statisticsJSON().c_str());
+    return 0;
+}
@@ -17,6 +17,10 @@ PTZTreeParameter::PTZTreeParameter()
     sampled_frame_num_ = 5;
     pp_x_ = 1280.0/2;
     pp_y_ = 720.0/2;
+    out_of_bag_sampling_ = false;
+    out_of_bag_distance_threshold_ = 0.05;
+    out_of_bag_error_threshold_ = 0.02;
+    out_of_bag_stop_ratio_ = 0.05;
 }
 
     PTZTreeParameter::PTZTreeParameter(const PTZTreeParameter& other) {
@@ -24,7 +28,13 @@ PTZTreeParameter::PTZTreeParameter()
         return;
     }
     sampled_frame_num_ = other.sampled_frame_num_;
+    pp_x_ = other.pp_x_;
+    pp_y_ = other.pp_y_;
     base_tree_param_ = other.base_tree_param_;
+    out_of_bag_sampling_ = other.out_of_bag_sampling_;
+    out_of_bag_distance_threshold_ = other.out_of_bag_distance_threshold_;
+    out_of_bag_error_threshold_ = other.out_of_bag_error_threshold_;
+    out_of_bag_stop_ratio_ = other.out_of_bag_stop_ratio_;
 }
 
 bool  PTZTreeParameter::readFromFile(FILE *pf)
@@ -49,6 +59,32 @@ bool  PTZTreeParameter::readFromFile(FILE *pf)
     pp_x_ = imap[string("pp_x")];
     pp_y_ = imap[string("pp_y")];
     base_tree_param_.readFromFile(pf);
+    
+    // optional "name value" pairs after the tree parameter, old files have none
+    while (true) {
+        char s[1024] = {'\0'};
+        double val = 0;
+        int ret = fscanf(pf, "%1023s %lf", s, &val);
+        if (ret != 2) {
+            break;
+        }
+        string name(s);
+        if (name == "out_of_bag_sampling") {
+            out_of_bag_sampling_ = (val != 0.0);
+        }
+        else if (name == "out_of_bag_distance_threshold") {
+            out_of_bag_distance_threshold_ = val;
+        }
+        else if (name == "out_of_bag_error_threshold") {
+            out_of_bag_error_threshold_ = val;
+        }
+        else if (name == "out_of_bag_stop_ratio") {
+            out_of_bag_stop_ratio_ = val;
+        }
+        else {
+            printf("Warning: unknown tree parameter %s\n", s);
+        }
+    }
     return true;
 }
 
@@ -72,6 +108,10 @@ bool PTZTreeParameter::writeToFile(FILE *pf) const
     fprintf(pf, "pp_x %f\n", pp_x_);
     fprintf(pf, "pp_y %f\n\n", pp_y_);
     base_tree_param_.writeToFile(pf);
+    fprintf(pf, "out_of_bag_sampling %d\n", out_of_bag_sampling_ ? 1 : 0);
+    fprintf(pf, "out_of_bag_distance_threshold %f\n", out_of_bag_distance_threshold_);
+    fprintf(pf, "out_of_bag_error_threshold %f\n", out_of_bag_error_threshold_);
+    fprintf(pf, "out_of_bag_stop_ratio %f\n", out_of_bag_stop_ratio_);
     return true;
 }
 
@@ -109,70 +149,44 @@ static bool readSIFTLocationAndDescriptors(const char *mat_file,
     //printf("load %lu features from %s\n", features.size(), mat_file);
     return true;
 }
-    static bool readPTZFeatureLocationAndDescriptors(const char *mat_file,
+    // keypoint_data: n x 2, descriptor_data: n x dims, views of the .mat file in reader
+    static bool readPTZFeatureLocationAndDescriptors(matio::MatReader & reader,
                                                      Eigen::Vector3f & ptz,
-                                                     vector<Eigen::VectorXf> & locations,
-                                                     vector<Eigen::VectorXf> & descriptors)
+                                                     matio::ConstMapXf & keypoint_data,
+                                                     matio::ConstMapXf & descriptor_data)
     {
+        // one pass of the file
+        bool is_read = reader.read({"keypoint", "descriptor", "ptz"});
+        assert(is_read);
         
-        Eigen::MatrixXf keypoint_data;
-        Eigen::MatrixXf descriptor_data;
-        Eigen::MatrixXf ptz_data;
-        bool is_read = matio::readMatrix(mat_file, "keypoint", keypoint_data, false);
+        matio::ConstMapXf ptz_data(NULL, 0, 0);
+        is_read = reader.mapMatrix("keypoint", keypoint_data);
         assert(is_read);
-        is_read = matio::readMatrix(mat_file, "descriptor", descriptor_data, false);
+        is_read = reader.mapMatrix("descriptor", descriptor_data);
         assert(is_read);
         assert(keypoint_data.rows() == descriptor_data.rows());
         
-        is_read = matio::readMatrix(mat_file, "ptz", ptz_data, false);
+        is_read = reader.mapMatrix("ptz", ptz_data);
+        assert(is_read);
         assert(ptz_data.rows() == 3 && ptz_data.cols() == 1);
         ptz[0] = ptz_data(0, 0);
         ptz[1] = ptz_data(1, 0);
         ptz[2] = ptz_data(2, 0);
-        
-        const int dims = (int) descriptor_data.cols();
-        Eigen::VectorXf loc = VectorXf::Zero(2, 1);
-        Eigen::VectorXf feat = VectorXf::Zero(dims, 1);
-        for (int i = 0; i<keypoint_data.rows(); i++) {
-            loc[0] = keypoint_data(i, 0);
-            loc[1] = keypoint_data(i, 1);
-            feat = descriptor_data.row(i);
-            
-            locations.push_back(loc);
-            descriptors.push_back(feat);
-        }
-        assert(locations.size() == descriptors.size());
-        return true;
+        return is_read;
     }
     
-    static bool readeatureLocationAndDescriptors(const char *mat_file,
-                                                 vector<Eigen::VectorXf> & locations,
-                                                 vector<Eigen::VectorXf> & descriptors)
-                                                 
+    static bool readeatureLocationAndDescriptors(matio::MatReader & reader,
+                                                 matio::ConstMapXf & keypoint_data,
+                                                 matio::ConstMapXf & descriptor_data)
     {
-        
-        Eigen::MatrixXf keypoint_data;
-        Eigen::MatrixXf descriptor_data;
-        Eigen::MatrixXf ptz_data;
-        bool is_read = matio::readMatrix(mat_file, "keypoint", keypoint_data, false);
+        bool is_read = reader.read({"keypoint", "descriptor"});
+        assert(is_read);
+        is_read = reader.mapMatrix("keypoint", keypoint_data);
         assert(is_read);
-        is_read = matio::readMatrix(mat_file, "descriptor", descriptor_data, false);
+        is_read = reader.mapMatrix("descriptor", descriptor_data);
         assert(is_read);
         assert(keypoint_data.rows() == descriptor_data.rows());
-        
-        const int dims = (int) descriptor_data.cols();
-        Eigen::VectorXf loc = VectorXf::Zero(2, 1);
-        Eigen::VectorXf feat = VectorXf::Zero(dims, 1);
-        for (int i = 0; i<keypoint_data.rows(); i++) {
-            loc[0] = keypoint_data(i, 0);
-            loc[1] = keypoint_data(i, 1);
-            feat = descriptor_data.row(i);
-            
-            locations.push_back(loc);
-            descriptors.push_back(feat);
-        }
-        assert(locations.size() == descriptors.size());
-        return true;
+        return is_read;
     }
 
     /*
@@ -208,14 +222,16 @@ void generatePTZTraingSample(const char* feature_file_name,
     {
         assert(feature_ptz_file_name);
         
-        vector<Eigen::VectorXf> locations;
-        vector<Eigen::VectorXf> features;
-        readPTZFeatureLocationAndDescriptors(feature_ptz_file_name, ptz, locations, features);
-        for (int i = 0; i<locations.size(); i++) {
+        matio::MatReader reader(feature_ptz_file_name);
+        matio::ConstMapXf keypoint_data(NULL, 0, 0);
+        matio::ConstMapXf descriptor_data(NULL, 0, 0);
+        readPTZFeatureLocationAndDescriptors(reader, ptz, keypoint_data, descriptor_data);
+        samples.reserve(samples.size() + keypoint_data.rows());
+        for (int i = 0; i<keypoint_data.rows(); i++) {
             PTZTrainingSample s;
             
-            s.loc_[0] = locations[i][0];
-            s.loc_[1] = locations[i][1];
+            s.loc_[0] = keypoint_data(i, 0);
+            s.loc_[1] = keypoint_data(i, 1);
             //EigenX::pointPanTilt(pp, ptz, s.loc_, pan_tilt);
             /*
             Eigen::Vector2d point2PanTilt(const Eigen::Vector2d& pp,
@@ -228,7 +244,7 @@ void generatePTZTraingSample(const char* feature_file_name,
             
             s.pan_tilt_[0] = pan_tilt[0];
             s.pan_tilt_[1] = pan_tilt[1];
-            s.descriptor_ = features[i];
+            s.descriptor_ = descriptor_data.row(i).transpose();
             samples.push_back(s);
         }
     }
@@ -239,19 +255,65 @@ void generatePTZTraingSample(const char* feature_file_name,
     {
         assert(feature_location_file_name);
         
-        vector<Eigen::VectorXf> locations;
-        vector<Eigen::VectorXf> features;
-        readeatureLocationAndDescriptors(feature_location_file_name, locations, features);
-        for (int i = 0; i<locations.size(); i++) {
+        matio::MatReader reader(feature_location_file_name);
+        matio::ConstMapXf keypoint_data(NULL, 0, 0);
+        matio::ConstMapXf descriptor_data(NULL, 0, 0);
+        readeatureLocationAndDescriptors(reader, keypoint_data, descriptor_data);
+        samples.reserve(samples.size() + keypoint_data.rows());
+        for (int i = 0; i<keypoint_data.rows(); i++) {
             PTZSample s;
-            Eigen::Vector2f pan_tilt;
-            s.loc_[0] = locations[i][0];
-            s.loc_[1] = locations[i][1];
-            s.descriptor_ = features[i];
+            s.loc_[0] = keypoint_data(i, 0);
+            s.loc_[1] = keypoint_data(i, 1);
+            s.descriptor_ = descriptor_data.row(i).transpose();
             samples.push_back(s);
         }
     }
     
+    void generatePTZSample(const float* keypoints,
+                           const float* descriptors,
+                           const int n,
+                           const int descriptor_dim,
+                           vector<PTZSample> & samples)
+    {
+        assert(keypoints);
+        assert(descriptors);
+        assert(n >= 0 && descriptor_dim > 0);
+        
+        samples.resize(n);
+        for (int i = 0; i<n; i++) {
+            PTZSample& s = samples[i];
+            s.loc_[0] = keypoints[2*i + 0];
+            s.loc_[1] = keypoints[2*i + 1];
+            s.descriptor_ = Eigen::Map<const Eigen::VectorXf>(descriptors + i * descriptor_dim, descriptor_dim);
+        }
+    }
+    
+    void generatePTZSample(const float* keypoints,
+                           const float* descriptors,
+                           const int n,
+                           const int descriptor_dim,
+                           const Eigen::Vector2f& pp,
+                           const Eigen::Vector3f& ptz,
+                           vector<PTZTrainingSample> & samples)
+    {
+        assert(keypoints);
+        assert(descriptors);
+        assert(n >= 0 && descriptor_dim > 0);
+        
+        samples.resize(n);
+        for (int i = 0; i<n; i++) {
+            PTZTrainingSample& s = samples[i];
+            s.loc_[0] = keypoints[2*i + 0];
+            s.loc_[1] = keypoints[2*i + 1];
+            Eigen::Vector2d pan_tilt = cvx_pgl::point2PanTilt(pp.cast<double>(),
+                                                              ptz.cast<double>(),
+                                                              s.loc_.cast<double>());
+            s.pan_tilt_[0] = pan_tilt[0];
+            s.pan_tilt_[1] = pan_tilt[1];
+            s.descriptor_ = Eigen::Map<const Eigen::VectorXf>(descriptors + i * descriptor_dim, descriptor_dim);
+        }
+    }
+    
 void readSequenceData(const char * sequence_file_name,
                                         const char * sequence_base_directory,
                                         vector<string> & feature_files,
@@ -294,12 +356,15 @@ void readSequenceData(const char * sequence_file_name,
                          vector<Eigen::Vector2d> & image_points,
                          vector<Eigen::Vector2d> & rays)
     {
-        Eigen::MatrixXd keypoint_data;
-        Eigen::MatrixXd ray_data;
+        matio::MatReader reader(mat_file);
+        matio::ConstMapXd keypoint_data(NULL, 0, 0);
+        matio::ConstMapXd ray_data(NULL, 0, 0);
         
-        bool is_read = matio::readMatrix(mat_file, "keypoints", keypoint_data, false);
+        bool is_read = reader.read({"keypoints", "rays"});
+        assert(is_read);
+        is_read = reader.mapMatrix("keypoints", keypoint_data);
         assert(is_read);
-        is_read = matio::readMatrix(mat_file, "rays", ray_data, false);
+        is_read = reader.mapMatrix("rays", ray_data);
         assert(is_read);
         assert(keypoint_data.rows() == ray_data.rows());
         assert(keypoint_data.cols() == 2);
@@ -50,6 +50,13 @@ public:
     double pp_y_;
     
     BTDTRTreeParameter base_tree_param_;   // general tacktracking regression tree parameter
+    
+    // out-of-bag (boosting style) tree building, optional in the parameter file
+    // trees after the first one are trained on examples that the current forest predicts poorly
+    bool out_of_bag_sampling_;
+    double out_of_bag_distance_threshold_;  // well predicted: leaf node is closer than this (squared L2)
+    double out_of_bag_error_threshold_;     // and pan, tilt error is smaller than this (degree)
+    double out_of_bag_stop_ratio_;          // stop adding trees when fewer examples are poorly predicted
 
     PTZTreeParameter();
     PTZTreeParameter(const PTZTreeParameter& other);
@@ -81,6 +88,27 @@ void generatePTZSampleWithFeature(const char * feature_ptz_file_name,
     void generatePTZSampleWithFeature(const char * feature_location_file_name,
                                       const Eigen::Vector2f& pp,
                                       vector<PTZSample> & samples);
+    
+    // keypoints: n x 2, row major
+    // descriptors: n x descriptor_dim, row major
+    // samples: has NO pan, tilt label
+    void generatePTZSample(const float* keypoints,
+                           const float* descriptors,
+                           const int n,
+                           const int descriptor_dim,
+                           vector<PTZSample> & samples);
+    
+    // keypoints: n x 2, row major
+    // descriptors: n x descriptor_dim, row major
+    // pp: principal point
+    // ptz: pan, tilt and focal length of the image, used to compute the pan, tilt label
+    void generatePTZSample(const float* keypoints,
+                           const float* descriptors,
+                           const int n,
+                           const int descriptor_dim,
+                           const Eigen::Vector2f& pp,
+                           const Eigen::Vector3f& ptz,
+                           vector<PTZTrainingSample> & samples);
   //?
 void readSequenceData(const char * sequence_file_name,
                       const char * sequence_base_directory,
@@ -0,0 +1,164 @@
+//
+//  ptz_descriptor_index.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-29.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#include "ptz_descriptor_index.h"
+#include <assert.h>
+#include <float.h>
+#include <algorithm>
+
+PTZDescriptorIndex::PTZDescriptorIndex(int descriptor_dim,
+                                       const PTZDescriptorIndexParameter & param):
+descriptor_dim_(descriptor_dim), param_(param), is_build_done_(false), rebuild_num_(0)
+{
+    assert(descriptor_dim_ > 0);
+}
+
+PTZDescriptorIndex::~PTZDescriptorIndex()
+{
+    if (build_thread_.joinable()) {
+        build_thread_.join();
+    }
+}
+
+void PTZDescriptorIndex::add(const float * descriptors,
+                             const vector<Eigen::Vector2d> & rays)
+{
+    const size_t n = rays.size();
+    descriptors_.insert(descriptors_.end(), descriptors, descriptors + n * descriptor_dim_);
+    rays_.insert(rays_.end(), rays.begin(), rays.end());
+    maintain();
+}
+
+void PTZDescriptorIndex::maintain()
+{
+    if (build_thread_.joinable()) {
+        if (!is_build_done_) {
+            return;
+        }
+        build_thread_.join();
+        index_ = building_;
+        building_.reset();
+        rebuild_num_++;
+    }
+    
+    const int indexed_num = indexedSize();
+    const int linear_num = size() - indexed_num;
+    bool is_rebuild = false;
+    if (indexed_num == 0) {
+        is_rebuild = size() >= param_.min_index_size_;
+    }
+    else {
+        is_rebuild = linear_num > param_.rebuild_ratio_ * indexed_num;
+    }
+    if (!is_rebuild) {
+        return;
+    }
+    
+    // the index keeps pointers to its data, so it is built on a copy
+    std::shared_ptr<Snapshot> snapshot = std::make_shared<Snapshot>();
+    snapshot->data_ = descriptors_;
+    snapshot->size_ = size();
+    building_ = snapshot;
+    is_build_done_ = false;
+    
+    const int dim = descriptor_dim_;
+    const int tree_num = param_.tree_num_;
+    build_thread_ = std::thread([this, snapshot, dim, tree_num]() {
+        flann::Matrix<float> data(&snapshot->data_[0], snapshot->size_, dim);
+        snapshot->index_ = new Index(data, flann::KDTreeIndexParams(tree_num));
+        snapshot->index_->buildIndex();
+        is_build_done_ = true;
+    });
+}
+
+void PTZDescriptorIndex::waitForRebuild()
+{
+    if (build_thread_.joinable()) {
+        build_thread_.join();
+        index_ = building_;
+        building_.reset();
+        rebuild_num_++;
+    }
+}
+
+void PTZDescriptorIndex::knnSearch(const float * queries,
+                                   int n,
+                                   int k,
+                                   vector<int> & indices,
+                                   vector<float> & dists)
+{
+    assert(k > 0);
+    maintain();
+    
+    indices.assign((size_t)n * k, -1);
+    dists.assign((size_t)n * k, FLT_MAX);
+    if (n <= 0 || size() == 0) {
+        return;
+    }
+    
+    // step 1: kd-tree index
+    int start_index = 0;
+    if (index_ && index_->size_ > 0) {
+        start_index = index_->size_;
+        const int knn = std::min(k, index_->size_);
+        vector<int> index_indices((size_t)n * knn);
+        vector<float> index_dists((size_t)n * knn);
+        flann::Matrix<float> query_mat(const_cast<float *>(queries), n, descriptor_dim_);
+        flann::Matrix<int> indices_mat(&index_indices[0], n, knn);
+        flann::Matrix<float> dists_mat(&index_dists[0], n, knn);
+        index_->index_->knnSearch(query_mat, indices_mat, dists_mat, knn, flann::SearchParams(param_.checks_));
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < knn; j++) {
+                indices[(size_t)i * k + j] = index_indices[(size_t)i * knn + j];
+                dists[(size_t)i * k + j] = index_dists[(size_t)i * knn + j];
+            }
+        }
+    }
+    
+    // step 2: linear search of descriptors that are not indexed, keep k smallest in order
+    Distance distance;
+    for (int i = 0; i < n; i++) {
+        const float * q = queries + (size_t)i * descriptor_dim_;
+        int * cur_indices = &indices[(size_t)i * k];
+        float * cur_dists = &dists[(size_t)i * k];
+        for (int j = start_index; j < size(); j++) {
+            float d = distance(q, &descriptors_[(size_t)j * descriptor_dim_], descriptor_dim_);
+            if (d >= cur_dists[k-1]) {
+                continue;
+            }
+            int m = k - 1;
+            while (m > 0 && cur_dists[m-1] > d) {
+                cur_dists[m] = cur_dists[m-1];
+                cur_indices[m] = cur_indices[m-1];
+                m--;
+            }
+            cur_dists[m] = d;
+            cur_indices[m] = j;
+        }
+    }
+}
+
+void PTZDescriptorIndex::match(const float * queries,
+                               int n,
+                               float max_distance,
+                               vector<int> & query_indices,
+                               vector<int> & indices)
+{
+    query_indices.clear();
+    indices.clear();
+    
+    vector<int> nn_indices;
+    vector<float> nn_dists;
+    knnSearch(queries, n, 1, nn_indices, nn_dists);
+    for (int i = 0; i < n; i++) {
+        if (nn_indices[i] != -1 && nn_dists[i] < max_distance) {
+            query_indices.push_back(i);
+            indices.push_back(nn_indices[i]);
+        }
+    }
+}
@@ -0,0 +1,119 @@
+//
+//  ptz_descriptor_index.h
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-29.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef ptz_descriptor_index_h
+#define ptz_descriptor_index_h
+
+// incremental descriptor index of the nearest neighbor based ray map (nearest_neighbor.py)
+// descriptors are append only, each one has a ray (pan, tilt)
+// a FLANN kd-tree index covers a snapshot of the descriptors, newer descriptors are searched linearly
+// when the linear part grows, a new index is built in a background thread and swapped in by add or search
+#include <stdio.h>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <Eigen/Dense>
+#include <flann/flann.hpp>
+
+using std::vector;
+
+struct PTZDescriptorIndexParameter
+{
+    int tree_num_;            // number of kd-trees, the same as NNBasedMap
+    int checks_;              // leaf checks in a search, pyflann default
+    int min_index_size_;      // descriptors are searched linearly until the map has this many
+    double rebuild_ratio_;    // rebuild when linearly searched descriptors > ratio * indexed descriptors
+    
+    PTZDescriptorIndexParameter()
+    {
+        tree_num_ = 4;
+        checks_ = 32;
+        min_index_size_ = 1024;
+        rebuild_ratio_ = 0.25;
+    }
+};
+
+// add and search are called from one thread, rebuilding is in a background thread
+class PTZDescriptorIndex
+{
+    typedef flann::L2<float> Distance;
+    typedef flann::Index<Distance> Index;
+    
+    // kd-tree index of the first size_ descriptors, owns a copy of the descriptors
+    struct Snapshot
+    {
+        vector<float> data_;
+        Index * index_;
+        int size_;
+        
+        Snapshot():index_(NULL), size_(0) {}
+        ~Snapshot() { delete index_; }
+    };
+    
+    const int descriptor_dim_;
+    PTZDescriptorIndexParameter param_;
+    
+    vector<float> descriptors_;    // size x descriptor_dim
+    vector<Eigen::Vector2d> rays_;
+    
+    std::shared_ptr<Snapshot> index_;       // used in search, can be empty
+    std::shared_ptr<Snapshot> building_;    // being built in build_thread_
+    std::thread build_thread_;
+    std::atomic<bool> is_build_done_;
+    int rebuild_num_;
+
+public:
+    PTZDescriptorIndex(int descriptor_dim,
+                       const PTZDescriptorIndexParameter & param = PTZDescriptorIndexParameter());
+    ~PTZDescriptorIndex();
+    
+    // descriptors: n x descriptor_dim, e.g., keypoints of a keyframe
+    // rays: n, back projected keypoints
+    void add(const float * descriptors,
+             const vector<Eigen::Vector2d> & rays);
+    
+    // batched k nearest neighbor search, distance is squared L2 as FLANN
+    // indices, dists: n x k, row major, index -1 and distance FLT_MAX if the map has fewer than k descriptors
+    //                empty if n is 0
+    void knnSearch(const float * queries,
+                   int n,
+                   int k,
+                   vector<int> & indices,
+                   vector<float> & dists);
+    
+    // NNBasedMap.find_nearest: nearest descriptor of each query, only matches with distance < max_distance
+    // query_indices: index of the matched query
+    // indices: index of the nearest descriptor, use ray() to get its ray
+    void match(const float * queries,
+               int n,
+               float max_distance,
+               vector<int> & query_indices,
+               vector<int> & indices);
+    
+    const Eigen::Vector2d & ray(int index) const { return rays_[index]; }
+    
+    int size() const { return (int)rays_.size(); }
+    int descriptorDim() const { return descriptor_dim_; }
+    
+    // number of descriptors in the kd-tree index
+    int indexedSize() const { return index_ ? index_->size_ : 0; }
+    int rebuildNum() const { return rebuild_num_; }
+    
+    // wait for the background rebuild and swap it in
+    void waitForRebuild();
+
+private:
+    // swap in a finished index, start a rebuild if too many descriptors are searched linearly
+    void maintain();
+    
+    PTZDescriptorIndex(const PTZDescriptorIndex & other);
+    PTZDescriptorIndex & operator = (const PTZDescriptorIndex & other);
+};
+
+#endif /* ptz_descriptor_index_h */
@@ -0,0 +1,168 @@
+//
+//  ptz_ekf_tracker.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-28.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#include "ptz_ekf_tracker.h"
+#include "pgl_ptz_camera.h"
+#include <assert.h>
+#include <algorithm>
+
+PTZEKFTracker::PTZEKFTracker(const PTZEKFParameter & param):param_(param)
+{
+    init(Eigen::Vector3d::Zero());
+}
+
+void PTZEKFTracker::init(const Eigen::Vector3d & ptz)
+{
+    ptz_ = ptz;
+    velocity_.setZero();
+    camera_cov_.setZero();
+    camera_cov_(2, 2) = param_.focal_length_variance_;
+    
+    rays_.clear();
+    ray_covs_.clear();
+}
+
+int PTZEKFTracker::addRays(const vector<Eigen::Vector2d> & points)
+{
+    const int first_index = (int)rays_.size();
+    Eigen::Vector2d pp(param_.pp_x_, param_.pp_y_);
+    Eigen::Matrix2d cov = Eigen::Matrix2d::Identity() * param_.angle_variance_;
+    
+    rays_.reserve(rays_.size() + points.size());
+    ray_covs_.reserve(ray_covs_.size() + points.size());
+    for (int i = 0; i < points.size(); i++) {
+        rays_.push_back(cvx_pgl::point2PanTilt(pp, ptz_, points[i]));
+        ray_covs_.push_back(cov);
+    }
+    return first_index;
+}
+
+void PTZEKFTracker::removeRays(const vector<int> & indices)
+{
+    if (indices.empty()) {
+        return;
+    }
+    vector<bool> is_removed(rays_.size(), false);
+    for (int i = 0; i < indices.size(); i++) {
+        assert(indices[i] >= 0 && indices[i] < rays_.size());
+        is_removed[indices[i]] = true;
+    }
+    
+    int n = 0;
+    for (int i = 0; i < rays_.size(); i++) {
+        if (!is_removed[i]) {
+            rays_[n] = rays_[i];
+            ray_covs_[n] = ray_covs_[i];
+            n++;
+        }
+    }
+    rays_.resize(n);
+    ray_covs_.resize(n);
+}
+
+void PTZEKFTracker::predict()
+{
+    ptz_ += velocity_;
+    
+    const double scale = param_.process_noise_scale_;
+    camera_cov_(0, 0) += scale * param_.angle_variance_;
+    camera_cov_(1, 1) += scale * param_.angle_variance_;
+    camera_cov_(2, 2) += scale * param_.focal_length_variance_;
+}
+
+int PTZEKFTracker::update(const vector<Eigen::Vector2d> & points,
+                          const vector<int> & ray_indices)
+{
+    assert(points.size() == ray_indices.size());
+    const int m = (int)points.size();
+    if (m == 0) {
+        velocity_.setZero();
+        return 0;
+    }
+    
+    // P_camera = L L^T, P_camera can be singular (e.g., zero pan/tilt variance at the first frame)
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> es(camera_cov_);
+    Eigen::Vector3d sqrt_eigen_values = es.eigenvalues().cwiseMax(0.0).cwiseSqrt();
+    Eigen::Matrix3d L = es.eigenvectors() * sqrt_eigen_values.asDiagonal();
+    
+    // S = A P_camera A^T + D, A: 2m x 3 camera Jacobian, D: blockdiag(H_ray P_ray H_ray^T + R)
+    // Woodbury: S^-1 = D^-1 - D^-1 U C^-1 U^T D^-1, U = A L, C = I + U^T D^-1 U
+    Eigen::Vector2d pp(param_.pp_x_, param_.pp_y_);
+    const Eigen::Matrix2d R = Eigen::Matrix2d::Identity() * param_.observation_variance_;
+    Eigen::Matrix3d C = Eigen::Matrix3d::Identity();
+    Eigen::Vector3d w = Eigen::Vector3d::Zero();   // U^T D^-1 y
+    observed_rays_.resize(m);
+    for (int i = 0; i < m; i++) {
+        assert(ray_indices[i] >= 0 && ray_indices[i] < rays_.size());
+        observed_rays_[i] = rays_[ray_indices[i]];
+    }
+    cvx_pgl::panTilt2Point(pp, ptz_, observed_rays_, projections_, &h_cameras_, &h_rays_);
+    
+    observations_.resize(m);
+    for (int i = 0; i < m; i++) {
+        Observation & ob = observations_[i];
+        const int index = ray_indices[i];
+        ob.ray_index_ = index;
+        
+        ob.residual_ = points[i] - projections_[i];
+        ob.d_llt_.compute(h_rays_[i] * ray_covs_[index] * h_rays_[i].transpose() + R);
+        ob.u_ = h_cameras_[i] * L;
+        ob.d_inv_u_ = ob.d_llt_.solve(ob.u_);
+        ob.d_inv_y_ = ob.d_llt_.solve(ob.residual_);
+        
+        C.noalias() += ob.u_.transpose() * ob.d_inv_u_;
+        w.noalias() += ob.u_.transpose() * ob.d_inv_y_;
+    }
+    Eigen::LLT<Eigen::Matrix3d> c_llt(C);
+    assert(c_llt.info() == Eigen::Success);
+    Eigen::Vector3d c_inv_w = c_llt.solve(w);
+    Eigen::Matrix3d c_inv = c_llt.solve(Eigen::Matrix3d::Identity());
+    
+    // z = S^-1 y, camera update: P_camera A^T z = L U^T z
+    Eigen::Vector3d ut_z = Eigen::Vector3d::Zero();
+    for (int i = 0; i < m; i++) {
+        Observation & ob = observations_[i];
+        Eigen::Vector2d z = ob.d_inv_y_ - ob.d_inv_u_ * c_inv_w;
+        ut_z.noalias() += ob.u_.transpose() * z;
+        
+        // ray update with the diagonal block of S^-1
+        const int index = ob.ray_index_;
+        Eigen::Matrix2d s_inv = ob.d_llt_.solve(Eigen::Matrix2d::Identity()) - ob.d_inv_u_ * c_inv * ob.d_inv_u_.transpose();
+        Eigen::Matrix2d ph = ray_covs_[index] * h_rays_[i].transpose();
+        rays_[index] += ph * z;
+        Eigen::Matrix2d cov = ray_covs_[index] - ph * s_inv * ph.transpose();
+        ray_covs_[index] = 0.5 * (cov + cov.transpose());
+    }
+    
+    // P_camera - P_camera A^T S^-1 A P_camera = L C^-1 L^T
+    Eigen::Vector3d delta = L * ut_z;
+    Eigen::Matrix3d cov = L * c_inv * L.transpose();
+    camera_cov_ = 0.5 * (cov + cov.transpose());
+    
+    ptz_ += delta;
+    velocity_ = delta;
+    return m;
+}
+
+void PTZEKFTracker::projectRays(const int width, const int height,
+                                vector<Eigen::Vector2d> & points,
+                                vector<int> & ray_indices) const
+{
+    points.clear();
+    ray_indices.clear();
+    Eigen::Vector2d pp(param_.pp_x_, param_.pp_y_);
+    vector<Eigen::Vector2d> projections;
+    cvx_pgl::panTilt2Point(pp, ptz_, rays_, projections, NULL, NULL);
+    for (int i = 0; i < projections.size(); i++) {
+        const Eigen::Vector2d & p = projections[i];
+        if (p.x() >= 0 && p.x() < width && p.y() >= 0 && p.y() < height) {
+            points.push_back(p);
+            ray_indices.push_back(i);
+        }
+    }
+}
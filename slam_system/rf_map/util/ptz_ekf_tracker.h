@@ -0,0 +1,113 @@
+//
+//  ptz_ekf_tracker.h
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-28.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef ptz_ekf_tracker_h
+#define ptz_ekf_tracker_h
+
+// extended Kalman filter of a PTZ camera and ray landmarks, the tracking filter of ptz_slam.py
+// state: pan, tilt, focal length and (pan, tilt) of each ray landmark
+// covariance is kept block diagonal: a 3 x 3 camera block and a 2 x 2 block for each ray,
+// as ptz_slam.py which never keeps camera-ray cross terms
+// observation Jacobian H = [H_camera | blockdiag(H_ray)] is analytic,
+// S = H P H^T + R is a block diagonal matrix plus a rank 3 camera term,
+// it is solved with Cholesky factors of the 2 x 2 blocks and of a 3 x 3 capacitance matrix
+// so an update is linear in the number of observed rays
+#include <stdio.h>
+#include <vector>
+#include <Eigen/Dense>
+
+using std::vector;
+
+struct PTZEKFParameter
+{
+    double pp_x_;                    // principal point, image center
+    double pp_y_;
+    double observation_variance_;    // pixel^2
+    double angle_variance_;          // degree^2, initial ray variance and camera process noise
+    double focal_length_variance_;   // pixel^2
+    double process_noise_scale_;     // camera process noise is scale * diag(angle, angle, focal length variance)
+    
+    // default: the values in ptz_slam.py, 1280 x 720 image
+    PTZEKFParameter()
+    {
+        pp_x_ = 1280.0/2.0;
+        pp_y_ = 720.0/2.0;
+        observation_variance_ = 0.1;
+        angle_variance_ = 0.001;
+        focal_length_variance_ = 1.0;
+        process_noise_scale_ = 5.0;
+    }
+};
+
+// not thread safe, one tracker for each video stream
+class PTZEKFTracker
+{
+    // per observation memory, reused between updates
+    struct Observation
+    {
+        int ray_index_;
+        Eigen::Vector2d residual_;
+        Eigen::LLT<Eigen::Matrix2d> d_llt_;       // D = H_ray P_ray H_ray^T + R
+        Eigen::Matrix<double, 2, 3> u_;           // H_camera L, P_camera = L L^T
+        Eigen::Matrix<double, 2, 3> d_inv_u_;     // D^-1 U
+        Eigen::Vector2d d_inv_y_;                 // D^-1 residual
+    };
+    
+    PTZEKFParameter param_;
+    
+    Eigen::Vector3d ptz_;
+    Eigen::Vector3d velocity_;                // camera update of the last frame, constant speed model
+    Eigen::Matrix3d camera_cov_;
+    
+    vector<Eigen::Vector2d> rays_;
+    vector<Eigen::Matrix2d> ray_covs_;
+    
+    vector<Observation> observations_;
+    vector<Eigen::Vector2d> observed_rays_;
+    vector<Eigen::Vector2d> projections_;
+    vector<Eigen::Matrix<double, 2, 3> > h_cameras_;   // observation Jacobian of the camera
+    vector<Eigen::Matrix2d> h_rays_;                   // observation Jacobian of the ray
+
+public:
+    explicit PTZEKFTracker(const PTZEKFParameter & param = PTZEKFParameter());
+    
+    // start tracking from a camera pose, e.g., the first frame or after relocalization
+    // rays are removed, velocity is zero
+    void init(const Eigen::Vector3d & ptz);
+    
+    // back project image points to rays with the current camera
+    // return: index of the first new ray
+    int addRays(const vector<Eigen::Vector2d> & points);
+    
+    // remove rays, the other rays keep their order, e.g., outliers of frame-to-frame matching
+    void removeRays(const vector<int> & indices);
+    
+    // constant speed model, camera covariance grows by the process noise
+    void predict();
+    
+    // EKF update from image points of rays
+    // points: observed keypoints
+    // ray_indices: ray index of each point, a ray is observed at most once
+    // return: number of used observations
+    int update(const vector<Eigen::Vector2d> & points,
+               const vector<int> & ray_indices);
+    
+    // project rays to the image, width x height, with the current camera
+    void projectRays(const int width, const int height,
+                     vector<Eigen::Vector2d> & points,
+                     vector<int> & ray_indices) const;
+    
+    const Eigen::Vector3d & ptz() const { return ptz_; }
+    const Eigen::Vector3d & velocity() const { return velocity_; }
+    const Eigen::Matrix3d & cameraCovariance() const { return camera_cov_; }
+    const vector<Eigen::Vector2d> & rays() const { return rays_; }
+    const vector<Eigen::Matrix2d> & rayCovariances() const { return ray_covs_; }
+    int rayNum() const { return (int)rays_.size(); }
+};
+
+#endif /* ptz_ekf_tracker_h */
@@ -0,0 +1,172 @@
+//
+//  ptz_keyframe_database.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-30.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#include "ptz_keyframe_database.h"
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+
+PTZKeyframeDatabase::PTZKeyframeDatabase(int descriptor_dim, double image_width, double zoom_weight):
+descriptor_dim_(descriptor_dim), image_width_(image_width), zoom_weight_(zoom_weight)
+{
+    assert(descriptor_dim_ > 0);
+    assert(image_width_ > 0);
+}
+
+double PTZKeyframeDatabase::halfFov(double focal_length) const
+{
+    assert(focal_length > 0);
+    return atan(image_width_ / 2.0 / focal_length) * 180.0 / M_PI;
+}
+
+int PTZKeyframeDatabase::zoomBucket(double half_fov)
+{
+    // the half field of view is less than 90 degrees, at most 8 buckets
+    return (int)ceil(log2(std::max(half_fov, 1.0)));
+}
+
+double PTZKeyframeDatabase::distance(const Eigen::Vector3d & ptz1, const Eigen::Vector3d & ptz2) const
+{
+    double d_pan = ptz1[0] - ptz2[0];
+    double d_tilt = ptz1[1] - ptz2[1];
+    double d_zoom = zoom_weight_ * log(ptz1[2] / ptz2[2]);
+    return sqrt(d_pan * d_pan + d_tilt * d_tilt + d_zoom * d_zoom);
+}
+
+int PTZKeyframeDatabase::addKeyframe(const Eigen::Vector3d & ptz,
+                                     const float * keypoints,
+                                     const float * descriptors,
+                                     int n)
+{
+    assert(n >= 0);
+    Keyframe keyframe;
+    keyframe.ptz_ = ptz;
+    keyframe.half_fov_ = halfFov(ptz[2]);
+    keyframe.feature_start_ = keypoints_.size() / 2;
+    keyframe.feature_num_ = n;
+    
+    keypoints_.insert(keypoints_.end(), keypoints, keypoints + (size_t)n * 2);
+    descriptors_.insert(descriptors_.end(), descriptors, descriptors + (size_t)n * descriptor_dim_);
+    
+    const int id = (int)keyframes_.size();
+    keyframes_.push_back(keyframe);
+    pan_index_.insert(std::make_pair(ptz[0], id));
+    
+    const int b = zoomBucket(keyframe.half_fov_);
+    if (b >= zoom_buckets_.size()) {
+        zoom_buckets_.resize(b + 1);
+    }
+    zoom_buckets_[b].pan_index_.insert(std::make_pair(ptz[0], id));
+    zoom_buckets_[b].max_half_fov_ = std::max(zoom_buckets_[b].max_half_fov_, keyframe.half_fov_);
+    return id;
+}
+
+void PTZKeyframeDatabase::overlapKeyframes(const Eigen::Vector3d & ptz,
+                                           vector<int> & keyframe_ids,
+                                           vector<double> & overlaps) const
+{
+    keyframe_ids.clear();
+    overlaps.clear();
+    
+    const double half_fov = halfFov(ptz[2]);
+    const double pan_min = ptz[0] - half_fov;
+    const double pan_max = ptz[0] + half_fov;
+    
+    // a keyframe of a bucket overlaps only if its pan is within half_fov + max_half_fov_ of the bucket
+    for (int b = 0; b < zoom_buckets_.size(); b++) {
+        const ZoomBucket & bucket = zoom_buckets_[b];
+        auto begin = bucket.pan_index_.lower_bound(pan_min - bucket.max_half_fov_);
+        auto end = bucket.pan_index_.upper_bound(pan_max + bucket.max_half_fov_);
+        for (auto it = begin; it != end; it++) {
+            const Keyframe & keyframe = keyframes_[it->second];
+            double angle1 = std::max(pan_min, keyframe.ptz_[0] - keyframe.half_fov_);
+            double angle2 = std::min(pan_max, keyframe.ptz_[0] + keyframe.half_fov_);
+            if (angle2 - angle1 > 0) {
+                keyframe_ids.push_back(it->second);
+                overlaps.push_back(angle2 - angle1);
+            }
+        }
+    }
+}
+
+double PTZKeyframeDatabase::maxOverlap(const Eigen::Vector3d & ptz) const
+{
+    vector<int> keyframe_ids;
+    vector<double> overlaps;
+    overlapKeyframes(ptz, keyframe_ids, overlaps);
+    double max_overlap = 0.0;
+    for (int i = 0; i < overlaps.size(); i++) {
+        max_overlap = std::max(max_overlap, overlaps[i]);
+    }
+    return max_overlap;
+}
+
+bool PTZKeyframeDatabase::isGoodNewKeyframe(const Eigen::Vector3d & ptz,
+                                            double threshold1,
+                                            double threshold2) const
+{
+    if (keyframes_.empty()) {
+        printf("Warning: not existing key frames\n");
+        return false;
+    }
+    double max_overlap = maxOverlap(ptz);
+    return max_overlap > threshold1 && max_overlap < threshold2;
+}
+
+int PTZKeyframeDatabase::nearestKeyframe(const Eigen::Vector3d & ptz,
+                                         double * min_distance) const
+{
+    if (keyframes_.empty()) {
+        return -1;
+    }
+    
+    // walk away from the pan of the query in both directions
+    // the distance is at least the pan difference, so a side stops once its pan difference is too large
+    int best_id = -1;
+    double best_distance = INFINITY;
+    auto right = pan_index_.lower_bound(ptz[0]);
+    auto left = right;
+    bool is_left_done = left == pan_index_.begin();
+    bool is_right_done = right == pan_index_.end();
+    while (!is_left_done || !is_right_done) {
+        if (!is_right_done) {
+            if (right->first - ptz[0] >= best_distance) {
+                is_right_done = true;
+            }
+            else {
+                double d = distance(ptz, keyframes_[right->second].ptz_);
+                if (d < best_distance) {
+                    best_distance = d;
+                    best_id = right->second;
+                }
+                right++;
+                is_right_done = right == pan_index_.end();
+            }
+        }
+        if (!is_left_done) {
+            auto prev = left;
+            prev--;
+            if (ptz[0] - prev->first >= best_distance) {
+                is_left_done = true;
+            }
+            else {
+                double d = distance(ptz, keyframes_[prev->second].ptz_);
+                if (d < best_distance) {
+                    best_distance = d;
+                    best_id = prev->second;
+                }
+                left = prev;
+                is_left_done = left == pan_index_.begin();
+            }
+        }
+    }
+    if (min_distance != NULL) {
+        *min_distance = best_distance;
+    }
+    return best_id;
+}
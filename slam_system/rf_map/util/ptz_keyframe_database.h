@@ -0,0 +1,104 @@
+//
+//  ptz_keyframe_database.h
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-30.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef ptz_keyframe_database_h
+#define ptz_keyframe_database_h
+
+// keyframes of the map keyed by camera pose (scene_map.py, relocalization.py)
+// keyframes are ordered by pan, each covers the pan interval [pan - half fov, pan + half fov]
+// overlap queries search keyframes of similar field of view together (zoom buckets), so a zoomed-out
+// keyframe does not widen the search of the others, a visited keyframe that does not overlap is
+// less than its own half field of view away from the view
+// nearest keyframe queries walk from the pan of the query and stop at the best distance
+// keypoints and descriptors of all keyframes are stored contiguously
+// pan overlap is the same as overlap_pan_angle in util.py, pan is not wrapped
+#include <stdio.h>
+#include <vector>
+#include <map>
+#include <Eigen/Dense>
+
+using std::vector;
+
+class PTZKeyframeDatabase
+{
+    struct Keyframe
+    {
+        Eigen::Vector3d ptz_;      // pan, tilt, focal length
+        double half_fov_;          // half horizontal field of view, degree
+        size_t feature_start_;     // first keypoint in keypoints_ and descriptors_
+        int feature_num_;
+    };
+    
+    // keyframes whose half field of view is in (2^(b-1), 2^b] degree, bucket 0 is (0, 1]
+    struct ZoomBucket
+    {
+        std::multimap<double, int> pan_index_;    // pan --> keyframe id
+        double max_half_fov_;
+        
+        ZoomBucket() {max_half_fov_ = 0.0;}
+    };
+    
+    const int descriptor_dim_;
+    const double image_width_;
+    double zoom_weight_;             // degree for a factor of e in focal length, nearest keyframe distance
+    
+    vector<Keyframe> keyframes_;
+    vector<float> keypoints_;        // all keyframes, n x 2
+    vector<float> descriptors_;      // all keyframes, n x descriptor_dim
+    
+    std::multimap<double, int> pan_index_;    // pan --> keyframe id, all keyframes
+    vector<ZoomBucket> zoom_buckets_;         // overlap queries
+
+public:
+    PTZKeyframeDatabase(int descriptor_dim, double image_width = 1280, double zoom_weight = 10.0);
+    
+    // keypoints: n x 2, descriptors: n x descriptor_dim, row major
+    // return: keyframe id, ids are 0, 1, 2, ... in the order of adding
+    int addKeyframe(const Eigen::Vector3d & ptz,
+                    const float * keypoints,
+                    const float * descriptors,
+                    int n);
+    
+    int size() const { return (int)keyframes_.size(); }
+    
+    // keyframes whose pan interval overlaps the view of ptz, not sorted
+    // overlaps: overlapped pan angle in degree, > 0
+    void overlapKeyframes(const Eigen::Vector3d & ptz,
+                          vector<int> & keyframe_ids,
+                          vector<double> & overlaps) const;
+    
+    // maximum overlapped pan angle with all keyframes, 0 if no keyframe overlaps
+    double maxOverlap(const Eigen::Vector3d & ptz) const;
+    
+    // Map.good_new_keyframe: maximum overlap in (threshold1, threshold2)
+    bool isGoodNewKeyframe(const Eigen::Vector3d & ptz,
+                           double threshold1 = 5.0,
+                           double threshold2 = 20.0) const;
+    
+    // nearest keyframe, distance: sqrt(d_pan^2 + d_tilt^2 + (zoom_weight * log(f1/f2))^2)
+    // return: keyframe id, -1 if the database is empty
+    int nearestKeyframe(const Eigen::Vector3d & ptz,
+                        double * distance = NULL) const;
+    
+    const Eigen::Vector3d & ptz(int id) const { return keyframes_[id].ptz_; }
+    int featureNum(int id) const { return keyframes_[id].feature_num_; }
+    const float * keypoints(int id) const { return &keypoints_[keyframes_[id].feature_start_ * 2]; }
+    const float * descriptors(int id) const { return &descriptors_[keyframes_[id].feature_start_ * descriptor_dim_]; }
+    
+    // all descriptors, featureStart(id) is the first row of a keyframe
+    const float * allDescriptors() const { return descriptors_.empty() ? NULL : &descriptors_[0]; }
+    size_t featureStart(int id) const { return keyframes_[id].feature_start_; }
+    int descriptorDim() const { return descriptor_dim_; }
+
+private:
+    double halfFov(double focal_length) const;
+    static int zoomBucket(double half_fov);
+    double distance(const Eigen::Vector3d & ptz1, const Eigen::Vector3d & ptz2) const;
+};
+
+#endif /* ptz_keyframe_database_h */
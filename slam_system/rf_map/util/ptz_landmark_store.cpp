@@ -0,0 +1,145 @@
+//
+//  ptz_landmark_store.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-29.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#include "ptz_landmark_store.h"
+#include <assert.h>
+#include <string.h>
+
+PTZLandmarkStore::PTZLandmarkStore(int descriptor_dim, double grid_cell_size):
+descriptor_dim_(descriptor_dim), grid_(grid_cell_size)
+{
+    assert(descriptor_dim_ > 0);
+}
+
+void PTZLandmarkStore::reserve(int n)
+{
+    rays_.reserve(n);
+    descriptors_.reserve((size_t)n * descriptor_dim_);
+    covariances_.reserve(n);
+    cross_covariances_.reserve(n);
+    generations_.reserve(n);
+    positions_.reserve(n);
+    alive_slots_.reserve(n);
+}
+
+void PTZLandmarkStore::clear()
+{
+    // keep generations so that old handles stay invalid
+    free_slots_.clear();
+    for (int i = (int)rays_.size() - 1; i >= 0; i--) {
+        if (positions_[i] != -1) {
+            generations_[i] = (generations_[i] + 1) & 0x7fffffff;
+            positions_[i] = -1;
+        }
+        free_slots_.push_back(i);
+    }
+    alive_slots_.clear();
+    grid_.clear();
+}
+
+PTZLandmarkStore::Handle PTZLandmarkStore::add(const Eigen::Vector2d & ray,
+                                               const float * descriptor,
+                                               const Eigen::Matrix2d & covariance,
+                                               const Eigen::Matrix<double, 3, 2> * cross_covariance)
+{
+    int s = 0;
+    if (!free_slots_.empty()) {
+        s = free_slots_.back();
+        free_slots_.pop_back();
+    }
+    else {
+        s = (int)rays_.size();
+        rays_.push_back(Eigen::Vector2d::Zero());
+        descriptors_.resize(descriptors_.size() + descriptor_dim_);
+        covariances_.push_back(Eigen::Matrix2d::Zero());
+        cross_covariances_.push_back(Eigen::Matrix<double, 3, 2>::Zero());
+        generations_.push_back(0);
+        positions_.push_back(-1);
+    }
+    
+    rays_[s] = ray;
+    float * p_descriptor = &descriptors_[(size_t)s * descriptor_dim_];
+    if (descriptor != NULL) {
+        memcpy(p_descriptor, descriptor, sizeof(float) * descriptor_dim_);
+    }
+    else {
+        memset(p_descriptor, 0, sizeof(float) * descriptor_dim_);
+    }
+    covariances_[s] = covariance;
+    if (cross_covariance != NULL) {
+        cross_covariances_[s] = *cross_covariance;
+    }
+    else {
+        cross_covariances_[s].setZero();
+    }
+    positions_[s] = (int)alive_slots_.size();
+    alive_slots_.push_back(s);
+    grid_.insert(s, ray);
+    return ((Handle)generations_[s] << 32) | (Handle)s;
+}
+
+bool PTZLandmarkStore::remove(Handle handle)
+{
+    if (!isValid(handle)) {
+        return false;
+    }
+    const int s = slot(handle);
+    
+    // swap the last alive landmark into the position
+    const int pos = positions_[s];
+    const int last = alive_slots_.back();
+    alive_slots_[pos] = last;
+    positions_[last] = pos;
+    alive_slots_.pop_back();
+    
+    positions_[s] = -1;
+    generations_[s] = (generations_[s] + 1) & 0x7fffffff;   // handles stay positive
+    free_slots_.push_back(s);
+    grid_.remove(s);
+    return true;
+}
+
+bool PTZLandmarkStore::isValid(Handle handle) const
+{
+    if (handle < 0) {
+        return false;
+    }
+    const int s = slot(handle);
+    const uint32_t generation = (uint32_t)(handle >> 32);
+    return s < rays_.size() && positions_[s] != -1 && generations_[s] == generation;
+}
+
+PTZLandmarkStore::Handle PTZLandmarkStore::handle(int i) const
+{
+    assert(i >= 0 && i < alive_slots_.size());
+    const int s = alive_slots_[i];
+    return ((Handle)generations_[s] << 32) | (Handle)s;
+}
+
+void PTZLandmarkStore::setRay(int slot, const Eigen::Vector2d & ray)
+{
+    assert(positions_[slot] != -1);
+    rays_[slot] = ray;
+    grid_.update(slot, ray);
+}
+
+void PTZLandmarkStore::visibleLandmarks(const Eigen::Vector2d & pp,
+                                        const Eigen::Vector3d & ptz,
+                                        int width,
+                                        int height,
+                                        vector<Handle> & handles,
+                                        vector<Eigen::Vector2d> & points) const
+{
+    vector<int> slots;
+    grid_.visible(pp, ptz, width, height, slots, points);
+    handles.resize(slots.size());
+    for (int i = 0; i < slots.size(); i++) {
+        const int s = slots[i];
+        handles[i] = ((Handle)generations_[s] << 32) | (Handle)s;
+    }
+}
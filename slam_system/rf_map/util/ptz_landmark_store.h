@@ -0,0 +1,99 @@
+//
+//  ptz_landmark_store.h
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-29.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef ptz_landmark_store_h
+#define ptz_landmark_store_h
+
+// ray landmarks of the tracker: (pan, tilt), descriptor, 2 x 2 covariance and 3 x 2 camera-ray covariance
+// structure of arrays indexed by slot, removed slots are reused from a free list
+// a handle is the slot and a generation, so a handle of a removed landmark is never valid again
+// add and remove are O(1), nothing is moved when a landmark is removed
+// rays are indexed by a pan-tilt grid, so visible landmarks are found without projecting all rays
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <Eigen/Dense>
+#include "pgl_pan_tilt_grid.h"
+
+using std::vector;
+
+class PTZLandmarkStore
+{
+public:
+    typedef int64_t Handle;    // invalid handle: -1
+
+private:
+    const int descriptor_dim_;
+    
+    // per slot
+    vector<Eigen::Vector2d> rays_;                            // pan, tilt in degree
+    vector<float> descriptors_;                               // slot number x descriptor_dim
+    vector<Eigen::Matrix2d> covariances_;
+    vector<Eigen::Matrix<double, 3, 2> > cross_covariances_;  // camera (pan, tilt, focal length) x ray
+    vector<uint32_t> generations_;
+    vector<int> positions_;      // position in alive_slots_, -1 if the slot is free
+    
+    vector<int> alive_slots_;    // landmarks in no particular order, removal swaps the last one in
+    vector<int> free_slots_;
+    
+    cvx_pgl::pan_tilt_grid grid_;   // slots of landmarks
+
+public:
+    // grid_cell_size: degree, cell size of the pan-tilt grid
+    explicit PTZLandmarkStore(int descriptor_dim, double grid_cell_size = 2.0);
+    
+    // reserve memory for n landmarks
+    void reserve(int n);
+    
+    void clear();
+    
+    // descriptor: descriptor_dim floats, can be NULL (zeros)
+    // cross_covariance: can be NULL (zeros)
+    Handle add(const Eigen::Vector2d & ray,
+               const float * descriptor,
+               const Eigen::Matrix2d & covariance,
+               const Eigen::Matrix<double, 3, 2> * cross_covariance = NULL);
+    
+    // return: false if the handle is not valid
+    bool remove(Handle handle);
+    
+    bool isValid(Handle handle) const;
+    
+    // number of landmarks
+    int size() const { return (int)alive_slots_.size(); }
+    
+    // number of slots, including free slots
+    int slotNum() const { return (int)rays_.size(); }
+    int descriptorDim() const { return descriptor_dim_; }
+    
+    // handle of the i-th landmark, 0 <= i < size(), the order changes after remove
+    Handle handle(int i) const;
+    
+    // slot of a valid handle, for direct access to the arrays below
+    int slot(Handle handle) const { return (int)(handle & 0xffffffff); }
+    
+    const Eigen::Vector2d & ray(int slot) const { return rays_[slot]; }
+    void setRay(int slot, const Eigen::Vector2d & ray);
+    float * descriptor(int slot) { return &descriptors_[(size_t)slot * descriptor_dim_]; }
+    const float * descriptor(int slot) const { return &descriptors_[(size_t)slot * descriptor_dim_]; }
+    Eigen::Matrix2d & covariance(int slot) { return covariances_[slot]; }
+    const Eigen::Matrix2d & covariance(int slot) const { return covariances_[slot]; }
+    Eigen::Matrix<double, 3, 2> & crossCovariance(int slot) { return cross_covariances_[slot]; }
+    const Eigen::Matrix<double, 3, 2> & crossCovariance(int slot) const { return cross_covariances_[slot]; }
+    
+    // landmarks whose projection are in the image, width x height
+    // cost is proportional to the landmarks around the field of view, not to size()
+    void visibleLandmarks(const Eigen::Vector2d & pp,
+                          const Eigen::Vector3d & ptz,
+                          int width,
+                          int height,
+                          vector<Handle> & handles,
+                          vector<Eigen::Vector2d> & points) const;
+};
+
+#endif /* ptz_landmark_store_h */
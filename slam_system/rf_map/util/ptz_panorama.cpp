@@ -0,0 +1,433 @@
+//
+//  ptz_panorama.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-30.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#include "ptz_panorama.h"
+#include "dt_thread_pool.hpp"
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+using Eigen::Vector2d;
+using Eigen::Vector3d;
+using Eigen::Matrix3d;
+
+namespace {
+    double wrapAngle(double angle)
+    {
+        while (angle >= 180.0) {
+            angle -= 360.0;
+        }
+        while (angle < -180.0) {
+            angle += 360.0;
+        }
+        return angle;
+    }
+}
+
+PTZPanorama::PTZPanorama(const PTZPanoramaParameter & param, int channels):
+param_(param), channels_(channels), pool_(NULL), image_num_(0)
+{
+    assert(param_.pan_max_ > param_.pan_min_);
+    assert(param_.tilt_max_ > param_.tilt_min_);
+    assert(param_.pixels_per_degree_ > 0);
+    assert(param_.tile_size_ > 0);
+    assert(channels_ > 0);
+    assert(param_.median_window_size_ > 0);
+    
+    width_ = (int)ceil((param_.pan_max_ - param_.pan_min_) * param_.pixels_per_degree_);
+    height_ = (int)ceil((param_.tilt_max_ - param_.tilt_min_) * param_.pixels_per_degree_);
+    tile_cols_ = (width_ + param_.tile_size_ - 1) / param_.tile_size_;
+    tile_rows_ = (height_ + param_.tile_size_ - 1) / param_.tile_size_;
+    tiles_.resize(tile_cols_ * tile_rows_, NULL);
+    
+    const double deg2rad = M_PI / 180.0;
+    sin_pan_.resize(width_);
+    cos_pan_.resize(width_);
+    for (int x = 0; x < width_; x++) {
+        double pan = pixel2PanTilt(x, 0)[0] * deg2rad;
+        sin_pan_[x] = sin(pan);
+        cos_pan_[x] = cos(pan);
+    }
+    sin_tilt_.resize(height_);
+    cos_tilt_.resize(height_);
+    for (int y = 0; y < height_; y++) {
+        double tilt = pixel2PanTilt(0, y)[1] * deg2rad;
+        sin_tilt_[y] = sin(tilt);
+        cos_tilt_[y] = cos(tilt);
+    }
+    
+    if (param_.thread_num_ < 1) {
+        param_.thread_num_ = 1;
+    }
+    pool_ = new DTThreadPool(param_.thread_num_);
+}
+
+PTZPanorama::~PTZPanorama()
+{
+    for (int i = 0; i < tiles_.size(); i++) {
+        delete tiles_[i];
+    }
+    delete pool_;
+}
+
+Vector2d PTZPanorama::pixel2PanTilt(double x, double y) const
+{
+    double pan = param_.pan_min_ + (x + 0.5) / param_.pixels_per_degree_;
+    double tilt = param_.tilt_max_ - (y + 0.5) / param_.pixels_per_degree_;
+    return Vector2d(pan, tilt);
+}
+
+Vector2d PTZPanorama::panTilt2Pixel(double pan, double tilt) const
+{
+    double x = (pan - param_.pan_min_) * param_.pixels_per_degree_ - 0.5;
+    double y = (param_.tilt_max_ - tilt) * param_.pixels_per_degree_ - 0.5;
+    return Vector2d(x, y);
+}
+
+int PTZPanorama::tileNum() const
+{
+    int num = 0;
+    for (int i = 0; i < tiles_.size(); i++) {
+        if (tiles_[i] != NULL) {
+            num++;
+        }
+    }
+    return num;
+}
+
+void PTZPanorama::computeRemapTable(const cvx_pgl::ptz_camera & camera,
+                                    int image_width,
+                                    int image_height,
+                                    vector<PTZRemapTable> & tables) const
+{
+    const Vector3d ptz = camera.ptz();
+    const Vector2d pp = camera.principal_point();
+    const double fl = ptz[2];
+    const Matrix3d r = cvx_pgl::matrixFromTiltX(ptz[1]) * cvx_pgl::matrixFromPanY(ptz[0]);
+    const Matrix3d rt = r.transpose();
+    
+    // step 1: bounding box of the image on the canvas, the same as pan_tilt_grid::query
+    // pan is continuous around the camera pan, e.g., [170, 200] for a camera at 185
+    const int sample_num = 64;
+    double min_pan = 180.0, max_pan = -180.0, min_tilt = 90.0, max_tilt = -90.0;
+    for (int i = 0; i < 4 * sample_num; i++) {
+        const int side = i / sample_num;
+        const double t = (double)(i % sample_num) / sample_num;
+        double x = 0, y = 0;
+        switch (side) {
+            case 0: x = t * image_width;       y = 0;                        break;
+            case 1: x = image_width;           y = t * image_height;         break;
+            case 2: x = (1 - t) * image_width; y = image_height;             break;
+            default: x = 0;                    y = (1 - t) * image_height;   break;
+        }
+        Vector3d d = rt * Vector3d((x - pp[0]) / fl, (y - pp[1]) / fl, 1.0);
+        double pan = atan2(d[0], d[2]) * 180.0 / M_PI;
+        double tilt = atan2(-d[1], sqrt(d[0] * d[0] + d[2] * d[2])) * 180.0 / M_PI;
+        double delta_pan = wrapAngle(pan - ptz[0]);
+        min_pan = std::min(min_pan, delta_pan);
+        max_pan = std::max(max_pan, delta_pan);
+        min_tilt = std::min(min_tilt, tilt);
+        max_tilt = std::max(max_tilt, tilt);
+    }
+    min_pan += ptz[0];
+    max_pan += ptz[0];
+    
+    // a pole in the image covers all pans
+    bool is_pole = false;
+    for (int k = 0; k < 2; k++) {
+        Vector3d q = r * Vector3d(0, k == 0 ? -1.0 : 1.0, 0);   // tilt 90, tilt -90
+        if (q[2] <= 0) {
+            continue;
+        }
+        double x = fl * q[0] / q[2] + pp[0];
+        double y = fl * q[1] / q[2] + pp[1];
+        if (x >= 0 && x <= image_width && y >= 0 && y <= image_height) {
+            is_pole = true;
+            if (k == 0) {
+                max_tilt = 90.0;
+            }
+            else {
+                min_tilt = -90.0;
+            }
+        }
+    }
+    
+    // two pixel margin for the sampling of the border
+    const int y1 = std::max(0, (int)floor(panTilt2Pixel(0, max_tilt).y()) - 2);
+    const int y2 = std::min(height_, (int)ceil(panTilt2Pixel(0, min_tilt).y()) + 3);
+    
+    // column ranges, the pan range is split at the canvas seam, e.g., [170, 200] is
+    // [170, 180] and [-180, -160] on a [-180, 180] canvas
+    vector<std::pair<int, int> > ranges;
+    if (is_pole) {
+        ranges.push_back(std::make_pair(0, width_));
+    }
+    else {
+        const int k_min = (int)ceil((param_.pan_min_ - max_pan) / 360.0);
+        const int k_max = (int)floor((param_.pan_max_ - min_pan) / 360.0);
+        for (int k = k_min; k <= k_max; k++) {
+            int x1 = std::max(0, (int)floor(panTilt2Pixel(min_pan + 360.0 * k, 0).x()) - 2);
+            int x2 = std::min(width_, (int)ceil(panTilt2Pixel(max_pan + 360.0 * k, 0).x()) + 3);
+            if (x1 >= x2) {
+                continue;
+            }
+            // margins of two pieces overlap, a pixel is blended once
+            if (!ranges.empty() && x1 <= ranges.back().second) {
+                ranges.back().second = std::max(ranges.back().second, x2);
+            }
+            else {
+                ranges.push_back(std::make_pair(x1, x2));
+            }
+        }
+    }
+    
+    tables.clear();
+    for (const auto& range: ranges) {
+        PTZRemapTable table;
+        table.x_ = range.first;
+        table.y_ = y1;
+        table.width_ = range.second - range.first;
+        table.height_ = std::max(0, y2 - y1);
+        if (table.height_ == 0) {
+            continue;
+        }
+        table.map_x_.resize(table.width_ * table.height_);
+        table.map_y_.resize(table.width_ * table.height_);
+        tables.push_back(table);
+    }
+    
+    // step 2: project canvas rays to the image, rows in parallel
+    const double max_x = image_width - 1;
+    const double max_y = image_height - 1;
+    for (auto& table: tables) {
+        pool_->parallelFor(table.height_, [&](int thread_id, int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                const int y = table.y_ + i;
+                const double cos_b = cos_tilt_[y], sin_b = sin_tilt_[y];
+                // ray d = (cos(b)sin(a), -sin(b), cos(b)cos(a)), q = R * d is linear in sin(a), cos(a)
+                const Vector3d q_sin = r.col(0) * cos_b;
+                const Vector3d q_cos = r.col(2) * cos_b;
+                const Vector3d q_const = -r.col(1) * sin_b;
+                float * map_x = &table.map_x_[i * table.width_];
+                float * map_y = &table.map_y_[i * table.width_];
+                for (int j = 0; j < table.width_; j++) {
+                    const int x = table.x_ + j;
+                    Vector3d q = q_sin * sin_pan_[x] + q_cos * cos_pan_[x] + q_const;
+                    map_x[j] = -1.0f;
+                    map_y[j] = -1.0f;
+                    if (q[2] <= 0) {
+                        continue;
+                    }
+                    double u = fl * q[0] / q[2] + pp[0];
+                    double v = fl * q[1] / q[2] + pp[1];
+                    if (u >= 0 && u <= max_x && v >= 0 && v <= max_y) {
+                        map_x[j] = (float)u;
+                        map_y[j] = (float)v;
+                    }
+                }
+            }
+        });
+    }
+}
+
+void PTZPanorama::blend(const unsigned char * image,
+                        int image_width,
+                        int image_height,
+                        const vector<PTZRemapTable> & tables)
+{
+    assert(image != NULL);
+    for (const auto& table: tables) {
+        blendTable(image, image_width, image_height, table);
+    }
+    image_num_++;
+}
+
+void PTZPanorama::blendTable(const unsigned char * image,
+                             int image_width,
+                             int image_height,
+                             const PTZRemapTable & table)
+{
+    if (table.width_ == 0 || table.height_ == 0) {
+        return;
+    }
+    assert(table.x_ >= 0 && table.x_ + table.width_ <= width_);
+    assert(table.y_ >= 0 && table.y_ + table.height_ <= height_);
+    
+    // tiles covered by the bounding box, each tile is updated by one thread
+    const int tile_size = param_.tile_size_;
+    const int tile_x1 = table.x_ / tile_size;
+    const int tile_y1 = table.y_ / tile_size;
+    const int tile_x2 = (table.x_ + table.width_ - 1) / tile_size;
+    const int tile_y2 = (table.y_ + table.height_ - 1) / tile_size;
+    const int cols = tile_x2 - tile_x1 + 1;
+    const int rows = tile_y2 - tile_y1 + 1;
+    const int c = channels_;
+    const int stride = image_width * c;
+    const bool is_median = param_.blend_method_ == 1;
+    const int window_size = param_.median_window_size_;
+    
+    pool_->parallelFor(cols * rows, [&](int thread_id, int begin, int end) {
+        vector<float> color(c);
+        for (int k = begin; k < end; k++) {
+            const int tile_x = tile_x1 + k % cols;
+            const int tile_y = tile_y1 + k / cols;
+            const int x1 = std::max(tile_x * tile_size, table.x_);
+            const int y1 = std::max(tile_y * tile_size, table.y_);
+            const int x2 = std::min((tile_x + 1) * tile_size, table.x_ + table.width_);
+            const int y2 = std::min((tile_y + 1) * tile_size, table.y_ + table.height_);
+            
+            Tile * tile = tiles_[tile_y * tile_cols_ + tile_x];
+            for (int y = y1; y < y2; y++) {
+                const float * map_x = &table.map_x_[(y - table.y_) * table.width_];
+                const float * map_y = &table.map_y_[(y - table.y_) * table.width_];
+                for (int x = x1; x < x2; x++) {
+                    const float u = map_x[x - table.x_];
+                    const float v = map_y[x - table.x_];
+                    if (u < 0) {
+                        continue;
+                    }
+                    
+                    // bilinear interpolation, u in [0, image_width - 1], v in [0, image_height - 1]
+                    const int u0 = (int)u;
+                    const int v0 = (int)v;
+                    const int u1 = std::min(u0 + 1, image_width - 1);
+                    const int v1 = std::min(v0 + 1, image_height - 1);
+                    const float du = u - u0, dv = v - v0;
+                    const unsigned char * p00 = image + v0 * stride + u0 * c;
+                    const unsigned char * p01 = image + v0 * stride + u1 * c;
+                    const unsigned char * p10 = image + v1 * stride + u0 * c;
+                    const unsigned char * p11 = image + v1 * stride + u1 * c;
+                    for (int i = 0; i < c; i++) {
+                        color[i] = (1 - dv) * ((1 - du) * p00[i] + du * p01[i]) +
+                                   dv * ((1 - du) * p10[i] + du * p11[i]);
+                    }
+                    
+                    if (tile == NULL) {
+                        tile = new Tile();
+                        if (is_median) {
+                            tile->window_.resize(tile_size * tile_size * c * window_size, 0);
+                            tile->lower_num_.resize(tile_size * tile_size * c, 0);
+                        }
+                        else {
+                            tile->color_.resize(tile_size * tile_size * c, 0.0f);
+                        }
+                        tile->count_.resize(tile_size * tile_size, 0);
+                        tiles_[tile_y * tile_cols_ + tile_x] = tile;
+                    }
+                    const int index = (y - tile_y * tile_size) * tile_size + (x - tile_x * tile_size);
+                    uint16_t & n = tile->count_[index];
+                    if (n == UINT16_MAX) {
+                        continue;
+                    }
+                    n++;
+                    if (is_median) {
+                        const int size = std::min(n - 1, window_size);   // window size before the new color
+                        for (int i = 0; i < c; i++) {
+                            unsigned char * w = &tile->window_[(index * c + i) * window_size];
+                            uint16_t & lower_num = tile->lower_num_[index * c + i];
+                            const unsigned char value = (unsigned char)(color[i] + 0.5f);
+                            
+                            // rank of the median in the window after inserting the new color
+                            const int rank = (n - 1) / 2 - lower_num;
+                            int j = size;
+                            if (size == window_size) {
+                                // the window is full, drop the lowest or the highest color
+                                // the one farther from the median
+                                if (rank > window_size - rank) {
+                                    if (value <= w[0]) {
+                                        lower_num++;
+                                        continue;
+                                    }
+                                    memmove(w, w + 1, window_size - 1);
+                                    lower_num++;
+                                    j = window_size - 1;
+                                }
+                                else {
+                                    if (value >= w[window_size - 1]) {
+                                        continue;
+                                    }
+                                    j = window_size - 1;
+                                }
+                            }
+                            // insertion sort
+                            while (j > 0 && w[j - 1] > value) {
+                                w[j] = w[j - 1];
+                                j--;
+                            }
+                            w[j] = value;
+                        }
+                    }
+                    else {
+                        float * m = &tile->color_[index * c];
+                        for (int i = 0; i < c; i++) {
+                            m[i] += (color[i] - m[i]) / n;
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+void PTZPanorama::addImage(const unsigned char * image,
+                           int image_width,
+                           int image_height,
+                           const cvx_pgl::ptz_camera & camera)
+{
+    vector<PTZRemapTable> tables;
+    computeRemapTable(camera, image_width, image_height, tables);
+    blend(image, image_width, image_height, tables);
+}
+
+void PTZPanorama::getPanorama(unsigned char * panorama) const
+{
+    assert(panorama != NULL);
+    const int c = channels_;
+    const int tile_size = param_.tile_size_;
+    const bool is_median = param_.blend_method_ == 1;
+    const int window_size = param_.median_window_size_;
+    memset(panorama, 0, sizeof(unsigned char) * width_ * height_ * c);
+    for (int tile_y = 0; tile_y < tile_rows_; tile_y++) {
+        for (int tile_x = 0; tile_x < tile_cols_; tile_x++) {
+            const Tile * tile = tiles_[tile_y * tile_cols_ + tile_x];
+            if (tile == NULL) {
+                continue;
+            }
+            const int x2 = std::min((tile_x + 1) * tile_size, width_);
+            const int y2 = std::min((tile_y + 1) * tile_size, height_);
+            for (int y = tile_y * tile_size; y < y2; y++) {
+                for (int x = tile_x * tile_size; x < x2; x++) {
+                    const int index = (y - tile_y * tile_size) * tile_size + (x - tile_x * tile_size);
+                    const int n = tile->count_[index];
+                    if (n == 0) {
+                        continue;
+                    }
+                    unsigned char * p = &panorama[(y * width_ + x) * c];
+                    if (is_median) {
+                        // the same as np.median, average of the two middle colors for an even number
+                        const int size = std::min(n, window_size);
+                        for (int i = 0; i < c; i++) {
+                            const unsigned char * w = &tile->window_[(index * c + i) * window_size];
+                            const int lower_num = tile->lower_num_[index * c + i];
+                            const int rank1 = std::max(0, std::min(size - 1, (n - 1) / 2 - lower_num));
+                            const int rank2 = std::max(0, std::min(size - 1, n / 2 - lower_num));
+                            p[i] = (unsigned char)((w[rank1] + w[rank2] + 1) / 2);
+                        }
+                    }
+                    else {
+                        for (int i = 0; i < c; i++) {
+                            float v = tile->color_[index * c + i] + 0.5f;
+                            p[i] = (unsigned char)std::max(0.0f, std::min(255.0f, v));
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,152 @@
+//
+//  ptz_panorama.h
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-30.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef ptz_panorama_h
+#define ptz_panorama_h
+
+// panorama of a ptz camera on a spherical (equirectangular) canvas, replaces map_image.py
+// canvas pixel (x, y) is the ray pan = pan_min + (x + 0.5)/pixels_per_degree, tilt = tilt_max - (y + 0.5)/pixels_per_degree
+// an image is warped by a remap table computed from its pan, tilt and focal length
+// images are blended one by one into canvas tiles, tiles are updated in parallel
+// the canvas keeps a running average or an approximate running median, memory does not grow with the number of images
+// running median: each pixel keeps a sorted window of the middle colors, the lowest or the highest color is dropped
+// to keep the median inside the window, it is exact unless a new color falls below/above the dropped colors
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <Eigen/Dense>
+#include "pgl_ptz_camera.h"
+
+using std::vector;
+
+class DTThreadPool;
+
+struct PTZPanoramaParameter
+{
+    double pan_min_;              // canvas range, degree
+    double pan_max_;
+    double tilt_min_;
+    double tilt_max_;
+    double pixels_per_degree_;    // canvas resolution
+    
+    int tile_size_;               // canvas tile size in pixel
+    int thread_num_;
+    
+    int blend_method_;            // 0: average, 1: approximate median (blending_with_median)
+    int median_window_size_;      // colors kept per pixel for the median, exact median up to this many images
+    
+    PTZPanoramaParameter()
+    {
+        pan_min_ = -90.0;
+        pan_max_ = 90.0;
+        tilt_min_ = -45.0;
+        tilt_max_ = 15.0;
+        pixels_per_degree_ = 20.0;
+        
+        tile_size_ = 128;
+        thread_num_ = 4;
+        
+        blend_method_ = 0;
+        median_window_size_ = 9;
+    }
+};
+
+// source image location of canvas pixels, the same as map_x and map_y in cv::remap
+// only the bounding box of the image on the canvas, or a part of it split at the canvas seam
+struct PTZRemapTable
+{
+    int x_;                       // bounding box on the canvas
+    int y_;
+    int width_;
+    int height_;
+    vector<float> map_x_;         // height x width, -1 if the ray is not in the image
+    vector<float> map_y_;
+    
+    PTZRemapTable():x_(0), y_(0), width_(0), height_(0) {}
+};
+
+// not thread safe, images are added from one thread
+class PTZPanorama
+{
+    // blending state of a canvas tile, allocated when an image covers it
+    struct Tile
+    {
+        vector<float> color_;             // tile_size x tile_size x channels, running average
+        vector<unsigned char> window_;    // tile_size x tile_size x channels x median_window_size, sorted
+        vector<uint16_t> lower_num_;      // tile_size x tile_size x channels, colors dropped below the window
+        vector<uint16_t> count_;          // tile_size x tile_size, number of blended images
+    };
+    
+    PTZPanoramaParameter param_;
+    int channels_;
+    int width_;                     // canvas size
+    int height_;
+    int tile_cols_;
+    int tile_rows_;
+    vector<Tile *> tiles_;
+    
+    // canvas rays (cos(b)sin(a), -sin(b), cos(b)cos(a)), separable in pan and tilt
+    vector<double> sin_pan_;        // per canvas column
+    vector<double> cos_pan_;
+    vector<double> sin_tilt_;       // per canvas row
+    vector<double> cos_tilt_;
+    
+    DTThreadPool * pool_;
+    int image_num_;
+
+public:
+    PTZPanorama(const PTZPanoramaParameter & param = PTZPanoramaParameter(), int channels = 3);
+    ~PTZPanorama();
+    
+    // remap tables of an image_width x image_height image from the camera
+    // tables: one per piece of the image on the canvas, an image across the pan seam
+    //         (e.g., +-180 of a 360 degree canvas) has two pieces
+    void computeRemapTable(const cvx_pgl::ptz_camera & camera,
+                           int image_width,
+                           int image_height,
+                           vector<PTZRemapTable> & tables) const;
+    
+    // image: image_height x image_width x channels, row major, e.g., cv::Mat of uint8
+    // tables: from computeRemapTable with the same image size
+    void blend(const unsigned char * image,
+               int image_width,
+               int image_height,
+               const vector<PTZRemapTable> & tables);
+    
+    // computeRemapTable and blend
+    void addImage(const unsigned char * image,
+                  int image_width,
+                  int image_height,
+                  const cvx_pgl::ptz_camera & camera);
+    
+    // panorama: height x width x channels, 0 if no image covers a pixel
+    void getPanorama(unsigned char * panorama) const;
+    
+    int width() const { return width_; }
+    int height() const { return height_; }
+    int channels() const { return channels_; }
+    int imageNum() const { return image_num_; }
+    
+    // number of allocated tiles
+    int tileNum() const;
+    
+    // pan, tilt of a canvas pixel
+    Eigen::Vector2d pixel2PanTilt(double x, double y) const;
+    Eigen::Vector2d panTilt2Pixel(double pan, double tilt) const;
+
+private:
+    void blendTable(const unsigned char * image,
+                    int image_width,
+                    int image_height,
+                    const PTZRemapTable & table);
+    
+    PTZPanorama(const PTZPanorama & other);
+    PTZPanorama & operator = (const PTZPanorama & other);
+};
+
+#endif /* ptz_panorama_h */
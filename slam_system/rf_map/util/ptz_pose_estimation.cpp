@@ -9,87 +9,93 @@
 #include "ptz_pose_estimation.h"
 #include "eigen_geometry_util.h"
 #include "pgl_ptz_camera.h"
+#include "dt_rng.hpp"
+#include "dt_profiler.hpp"
 #include <iostream>
+#include <climits>
+#include <algorithm>
+#include <cmath>
 
 using std::cout;
 using std::endl;
 
 namespace ptz_pose_opt {
-    namespace {
-        struct Hypothesis
-        {
-            double loss_;
-            Eigen::Vector3d ptz_;
-            vector<int> inlier_indices_;         // image coordinate index
-            vector<int> inlier_candidate_pan_tilt_indices_; // camera coordinate pan tilt index
-            
-            // store all inliers from preemptive ransac
-            vector<Eigen::Vector2d> image_pts_;
-            vector<Eigen::Vector2d> camera_pan_tilt_;
-            
-            Hypothesis()
-            {
-                loss_ = INT_MAX;
-            }
-            
-            Hypothesis(double loss)
-            {
-                loss_  = loss;
-            }
+    typedef PTZPreemptiveRANSACBuffer::Hypothesis Hypothesis;
+    
+    // add outliers of the sampled points to the loss, record inliers
+    // one camera point may have multiple pan, tilt correspondences
+    static void scoreHypothesis(const vector<Eigen::Vector2d> & image_points,
+                                const vector<vector<Eigen::Vector2d> > & candidate_pan_tilt,
+                                const Eigen::Vector2d& pp,
+                                const vector<int> & sampled_indices,
+                                const double threshold,
+                                Hypothesis & hp)
+    {
+        // check accuracy by project pan, tilt to image space
+        for (int j = 0; j<sampled_indices.size(); j++) {
+            const int index = sampled_indices[j];
+            const vector<Eigen::Vector2d> & cur_pan_tilt = candidate_pan_tilt[index];
             
-            Hypothesis(const Hypothesis& other)
-            {
-                if (&other == this) {
-                    return;
+            // check minimum distance from projected points to image coordinate
+            double min_dis = threshold * 2;
+            int min_index = -1;
+            for (int k = 0; k<cur_pan_tilt.size(); k++) {
+                Eigen::Vector2d point = cvx_pgl::panTilt2Point(pp, hp.ptz_, cur_pan_tilt[k]);
+                double dis = (image_points[index] - point).norm();
+                if (dis < min_dis) {
+                    min_dis = dis;
+                    min_index = k;
                 }
-                loss_ = other.loss_;
-                ptz_ = other.ptz_;
-                inlier_indices_ = other.inlier_indices_;
-                inlier_candidate_pan_tilt_indices_ = other.inlier_candidate_pan_tilt_indices_;
-                image_pts_ = other.image_pts_;
-                camera_pan_tilt_ = other.camera_pan_tilt_;
-            }
+            } // end of k
             
-            Hypothesis & operator = (const Hypothesis & other)
-            {
-                if (&other == this) {
-                    return *this;
-                }
-                loss_ = other.loss_;
-                ptz_ = other.ptz_;
-                inlier_indices_ = other.inlier_indices_;
-                inlier_candidate_pan_tilt_indices_ = other.inlier_candidate_pan_tilt_indices_;
-                image_pts_ = other.image_pts_;
-                camera_pan_tilt_ = other.camera_pan_tilt_;
-                
-                return *this;
+            if (min_dis > threshold) {
+                hp.loss_ += 1.0;
             }
-            
-            bool operator < (const Hypothesis & other) const
-            {
-                return loss_ < other.loss_;
+            else {
+                hp.inlier_indices_.push_back(index);
+                hp.inlier_candidate_pan_tilt_indices_.push_back(min_index);
             }
-        };
+        } // end of j
+        assert(hp.inlier_indices_.size() == hp.inlier_candidate_pan_tilt_indices_.size());
     }
     
-    // @brief project pan, tilt ray to image space
-    static vector<vector<Eigen::Vector2d> > projectPanTilt(const Eigen::Vector3d& ptz,
-                                                           const Eigen::Vector2d& pp,
-                                                           const vector<vector<Eigen::Vector2d> > & input_pan_tilt)
+    // the closest candidate of each sampled point that is projected within threshold
+    static void collectInliers(const vector<Eigen::Vector2d> & image_points,
+                               const vector<vector<Eigen::Vector2d> > & candidate_pan_tilt,
+                               const Eigen::Vector2d& pp,
+                               const vector<int> & sampled_indices,
+                               const double threshold,
+                               const Eigen::Vector3d & ptz,
+                               vector<Eigen::Vector2d> & inlier_image_pts,
+                               vector<Eigen::Vector2d> & inlier_pan_tilt)
     {
-        vector<vector<Eigen::Vector2d> > image_pts(input_pan_tilt.size());
-        for (int i = 0; i<input_pan_tilt.size(); i++) {
-            
-            for (int j = 0; j<input_pan_tilt[i].size(); j++) {
-                Eigen::Vector2d point = cvx_pgl::panTilt2Point(pp, ptz, input_pan_tilt[i][j]);
-                if (j == 0) {
-                    //cout<<"pan tilt    is "<<input_pan_tilt[i][0].transpose()<<endl;
-                    //cout<<"projection is "<<point.transpose()<<endl;
+        inlier_image_pts.clear();
+        inlier_pan_tilt.clear();
+        for (int j = 0; j<sampled_indices.size(); j++) {
+            const int index = sampled_indices[j];
+            const vector<Eigen::Vector2d> & cur_pan_tilt = candidate_pan_tilt[index];
+            double min_dis = threshold;
+            int min_index = -1;
+            for (int k = 0; k<cur_pan_tilt.size(); k++) {
+                double dis = (image_points[index] - cvx_pgl::panTilt2Point(pp, ptz, cur_pan_tilt[k])).norm();
+                if (dis < min_dis) {
+                    min_dis = dis;
+                    min_index = k;
                 }
-                image_pts[i].push_back(point);
+            }
+            if (min_index != -1) {
+                inlier_image_pts.push_back(image_points[index]);
+                inlier_pan_tilt.push_back(cur_pan_tilt[min_index]);
             }
         }
-        return image_pts;
+    }
+    
+    void PTZPreemptiveRANSACBuffer::Hypothesis::reset(const Eigen::Vector3d & ptz)
+    {
+        loss_ = INT_MAX;
+        ptz_ = ptz;
+        inlier_indices_.clear();
+        inlier_candidate_pan_tilt_indices_.clear();
     }
     
     bool preemptiveRANSACOneToMany(const vector<Eigen::Vector2d> & image_points,
@@ -98,6 +104,46 @@ namespace ptz_pose_opt {
                                    const PTZPreemptiveRANSACParameter & param,
                                    Eigen::Vector3d & ptz,
                                    bool verbose)
+    {
+        DTRng rng(param.random_seed_);
+        return preemptiveRANSACOneToMany(image_points, candidate_pan_tilt, pp, param, rng, ptz, verbose);
+    }
+    
+    bool preemptiveRANSACOneToMany(const vector<Eigen::Vector2d> & image_points,
+                                   const vector<vector<Eigen::Vector2d> > & candidate_pan_tilt,
+                                   const Eigen::Vector2d& pp,
+                                   const PTZPreemptiveRANSACParameter & param,
+                                   DTRng & rng,
+                                   Eigen::Vector3d & ptz,
+                                   bool verbose)
+    {
+        PTZPreemptiveRANSACBuffer buffer;
+        return preemptiveRANSACOneToMany(image_points, candidate_pan_tilt, pp, param, rng, buffer, ptz, verbose);
+    }
+    
+    bool preemptiveRANSACOneToMany(const vector<Eigen::Vector2d> & image_points,
+                                   const vector<vector<Eigen::Vector2d> > & candidate_pan_tilt,
+                                   const Eigen::Vector2d& pp,
+                                   const PTZPreemptiveRANSACParameter & param,
+                                   DTRng & rng,
+                                   PTZPreemptiveRANSACBuffer & buffer,
+                                   Eigen::Vector3d & ptz,
+                                   bool verbose)
+    {
+        vector<float> match_distances;
+        return preemptiveRANSACOneToMany(image_points, candidate_pan_tilt, match_distances, pp, param,
+                                         rng, buffer, ptz, verbose);
+    }
+    
+    bool preemptiveRANSACOneToMany(const vector<Eigen::Vector2d> & image_points,
+                                   const vector<vector<Eigen::Vector2d> > & candidate_pan_tilt,
+                                   const vector<float> & match_distances,
+                                   const Eigen::Vector2d& pp,
+                                   const PTZPreemptiveRANSACParameter & param,
+                                   DTRng & rng,
+                                   PTZPreemptiveRANSACBuffer & buffer,
+                                   Eigen::Vector3d & ptz,
+                                   bool verbose)
     {
         assert(image_points.size() == candidate_pan_tilt.size());
         if (image_points.size() <= 12) {
@@ -110,131 +156,208 @@ namespace ptz_pose_opt {
         const int B = param.sample_number_;
         double threshold = param.reprojection_error_threshold_;
         
+        // hypotheses in [0, hypothesis_num) are active, the rest keep their memory
+        vector<Hypothesis> & hypotheses = buffer.hypotheses_;
+        if (hypotheses.size() < K + 1) {
+            hypotheses.resize(K + 1);
+        }
+        int hypothesis_num = 0;
+        
+        // progressive sampling, PROSAC (Chum and Matas, CVPR 2005)
+        // image points are sorted by match distance, the t-th sample takes the newest point of
+        // the growing set [0, n) and a random one from [0, n-1), n reaches N at the last iteration
+        const bool is_progressive = param.progressive_sampling_ && match_distances.size() == N;
+        vector<int> & sorted_indices = buffer.sorted_indices_;
+        int n = 2;
+        double T_n = num_iteration * 2.0 / ((double)N * (N - 1));  // expected samples from [0, n) in uniform sampling
+        double T_n_prime = 1.0;
+        if (is_progressive) {
+            sorted_indices.resize(N);
+            for (int i = 0; i<N; i++) {
+                sorted_indices[i] = i;
+            }
+            std::stable_sort(sorted_indices.begin(), sorted_indices.end(), [&](int a, int b) {
+                return match_distances[a] < match_distances[b];
+            });
+        }
+        
+        // early termination, each hypothesis is scored on one random set while sampling,
+        // the score is the first round of preemption
+        // the two point solver is approximate (tens of pixels), a hypothesis that has enough
+        // inliers under the coarse threshold is refined before it is checked against the target
+        vector<int> & sampled_indices = buffer.sampled_indices_;
+        vector<Eigen::Vector2d> & inlier_image_pts = buffer.inlier_image_pts_;
+        vector<Eigen::Vector2d> & inlier_pan_tilt = buffer.inlier_pan_tilt_;
+        const bool is_scored = param.target_inlier_ratio_ > 0.0;
+        const int target_inlier_num = std::max(5, (int)std::ceil(param.target_inlier_ratio_ * B));
+        const double coarse_threshold = threshold * 10.0;
+        if (is_scored) {
+            sampled_indices.resize(B);
+            for (int i = 0; i<B; i++) {
+                sampled_indices[i] = rng.uniformInt(N);
+            }
+        }
+        
         // step 1: sample hyperthesis
-        vector<Hypothesis> hypotheses;
-        Hypothesis hp;
-        hp.ptz_ = ptz;
-        hypotheses.push_back(hp);
-        for (int i = 0; i<num_iteration; i++) {
-            int k1 = 0;
-            int k2 = 0;
-            do{
-                k1 = rand()%N;
-                k2 = rand()%N;
-            }while (k1 == k2);
+        bool is_terminated = false;
+        {
+            DTScopedTimer timer(DTProfiler::HYPOTHESIS);
+            hypotheses[hypothesis_num++].reset(ptz);
+            if (is_scored) {
+                scoreHypothesis(image_points, candidate_pan_tilt, pp, sampled_indices, threshold, hypotheses[0]);
+            }
+            for (int i = 0; i<num_iteration; i++) {
+                int k1 = 0;
+                int k2 = 0;
+                if (is_progressive) {
+                    while (i + 1 > T_n_prime && n < N) {
+                        const double T_next = T_n * (n + 1) / (n - 1);
+                        T_n_prime += std::ceil(T_next - T_n);
+                        T_n = T_next;
+                        n++;
+                    }
+                    k1 = sorted_indices[n - 1];
+                    k2 = sorted_indices[rng.uniformInt(n - 1)];
+                }
+                else {
+                    do{
+                        k1 = rng.uniformInt(N);
+                        k2 = rng.uniformInt(N);
+                    }while (k1 == k2);
+                }
             
-            const Eigen::Vector2d pan_tilt1 = candidate_pan_tilt[k1][0];
-            const Eigen::Vector2d pan_tilt2 = candidate_pan_tilt[k2][0];
-            const Eigen::Vector2d point1 = image_points[k1];
-            const Eigen::Vector2d point2 = image_points[k2];
-            Eigen::Vector3d cur_ptz;
+                const Eigen::Vector2d pan_tilt1 = candidate_pan_tilt[k1][0];
+                const Eigen::Vector2d pan_tilt2 = candidate_pan_tilt[k2][0];
+                const Eigen::Vector2d point1 = image_points[k1];
+                const Eigen::Vector2d point2 = image_points[k2];
+                Eigen::Vector3d cur_ptz;
             
-            bool is_valid = EigenX::ptzFromTwoPoints(pan_tilt1, pan_tilt2, point1, point2, pp, cur_ptz);
-            if (is_valid) {
-                Hypothesis hp;
-                hp.ptz_ = cur_ptz;
-                hypotheses.push_back(hp);
-            }
-            else {
-                if (verbose) {
-                    printf("warning: estimate ptz from two points failed.\n");
+                bool is_valid = EigenX::ptzFromTwoPoints(pan_tilt1, pan_tilt2, point1, point2, pp, cur_ptz);
+                if (is_valid) {
+                    Hypothesis & hp = hypotheses[hypothesis_num++];
+                    hp.reset(cur_ptz);
+                    if (is_scored) {
+                        collectInliers(image_points, candidate_pan_tilt, pp, sampled_indices, coarse_threshold,
+                                       hp.ptz_, inlier_image_pts, inlier_pan_tilt);
+                        if ((int)inlier_image_pts.size() >= target_inlier_num) {
+                            DTScopedTimer lm_timer(DTProfiler::LM_REFINE);
+                            Eigen::Vector3d opt_ptz;
+                            cvx_pgl::optimizePTZ(pp, inlier_pan_tilt, inlier_image_pts, hp.ptz_, opt_ptz);
+                            hp.ptz_ = opt_ptz;
+                        }
+                        scoreHypothesis(image_points, candidate_pan_tilt, pp, sampled_indices, threshold, hp);
+                        if ((int)hp.inlier_indices_.size() >= target_inlier_num) {
+                            is_terminated = true;
+                            if (verbose) {
+                                printf("early termination after %d samples\n", i + 1);
+                            }
+                            break;
+                        }
+                    }
                 }
+                else {
+                    if (verbose) {
+                        printf("warning: estimate ptz from two points failed.\n");
+                    }
                 
-            }
-            if (hypotheses.size() > K) {
-                if (verbose) {
-                    printf("initialization repeat %d times\n", i);
                 }
-                break;
+                if (hypothesis_num > K) {
+                    if (verbose) {
+                        printf("initialization repeat %d times\n", i);
+                    }
+                    break;
+                }
             }
         }
+        DTProfiler::addCount(DTProfiler::HYPOTHESIS_NUM, hypothesis_num);
         if (verbose) {
-            printf("init ptz camera parameter number is %lu\n", hypotheses.size());
+            printf("init ptz camera parameter number is %d\n", hypothesis_num);
         }
         
-        if (hypotheses.size() < K/4) {
-            printf("Warning: not enough hypotheses %lu vs %d.\n", hypotheses.size(), K/4);
+        if (verbose && !is_terminated && hypothesis_num < K/4) {
+            printf("Warning: not enough hypotheses %d vs %d.\n", hypothesis_num, K/4);
             //return false;
         }
         
         // step 2: optimize pan, tilt, focal length
-        while (hypotheses.size() > 1) {
-            // sample random set
-            vector<Eigen::Vector2d> sampled_image_pts;
-            vector<vector<Eigen::Vector2d> > sampled_pan_tilt;  // one camera point may have multiple pan, tilt correspondences
-            vector<int> sampled_indices;
-            for (int i =0; i<B; i++) {
-                int index = rand()%N;
-                sampled_image_pts.push_back(image_points[index]);
-                sampled_pan_tilt.push_back(candidate_pan_tilt[index]);
-                sampled_indices.push_back(index);
-            }
-            
-            // count outliers as energy measurement
-            for (int i = 0; i<hypotheses.size(); i++) {
-                // check accuracy by project pan, tilt to image space
-                vector<vector<Eigen::Vector2d> > projected_pan_tilt = projectPanTilt(hypotheses[i].ptz_, pp, sampled_pan_tilt);
-                
-                // check minimum distance from projected points to image coordinate
-                for (int j = 0; j<projected_pan_tilt.size(); j++) {
-                    //cout<<"projected location "<<projected_pan_tilt[j][0].transpose()<<endl;
-                    double min_dis = threshold * 2;
-                    int min_index = -1;
-                    for (int k = 0; k<projected_pan_tilt[j].size(); k++) {
-                        Eigen::Vector2d dif = sampled_image_pts[j] - projected_pan_tilt[j][k];
-                        double dis = dif.norm();
-                        //printf("distance is %lf\n", dis);
-                        if (dis < min_dis) {
-                            min_dis = dis;
-                            min_index = k;
-                        }
-                    } // end of k
-                    
-                    if (min_dis > threshold) {
-                        hypotheses[i].loss_ += 1.0;
+        bool is_round_scored = is_scored;
+        while (hypothesis_num > 1) {
+            {
+                DTScopedTimer timer(DTProfiler::PREEMPTIVE_ROUND);
+                if (!is_round_scored) {
+                    // sample random set
+                    sampled_indices.resize(B);
+                    for (int i =0; i<B; i++) {
+                        sampled_indices[i] = rng.uniformInt(N);
                     }
-                    else {
-                        hypotheses[i].inlier_indices_.push_back(sampled_indices[j]);
-                        hypotheses[i].inlier_candidate_pan_tilt_indices_.push_back(min_index);
+                    
+                    // count outliers as energy measurement
+                    for (int i = 0; i<hypothesis_num; i++) {
+                        scoreHypothesis(image_points, candidate_pan_tilt, pp, sampled_indices, threshold, hypotheses[i]);
                     }
-                } // end of j
-                assert(hypotheses[i].inlier_indices_.size() == hypotheses[i].inlier_candidate_pan_tilt_indices_.size());
-            } // end of i
+                }
+                is_round_scored = false;
             
-            // remove half of the hypotheses
-            std::sort(hypotheses.begin(), hypotheses.end());
-            hypotheses.resize(hypotheses.size()/2);
+                // remove half of the hypotheses
+                std::sort(hypotheses.begin(), hypotheses.begin() + hypothesis_num);
+                hypothesis_num /= 2;
+            }
             
             // refine by inliers
-            for (int i = 0; i<hypotheses.size(); i++) {
+            for (int i = 0; i<hypothesis_num; i++) {
+                Hypothesis & hp = hypotheses[i];
                 // number of inliers is larger than minimum configure
-                if (hypotheses[i].inlier_indices_.size() > 4) {
-                    vector<Eigen::Vector2d> inlier_image_pts;
-                    vector<Eigen::Vector2d> inlier_pan_tilt;
-                    for (int j = 0; j < hypotheses[i].inlier_indices_.size(); j++) {
-                        int index = hypotheses[i].inlier_indices_[j];
-                        int pan_tilt_index = hypotheses[i].inlier_candidate_pan_tilt_indices_[j];
+                if (hp.inlier_indices_.size() > 4) {
+                    inlier_image_pts.clear();
+                    inlier_pan_tilt.clear();
+                    for (int j = 0; j < hp.inlier_indices_.size(); j++) {
+                        int index = hp.inlier_indices_[j];
+                        int pan_tilt_index = hp.inlier_candidate_pan_tilt_indices_[j];
                         inlier_image_pts.push_back(image_points[index]);
                         inlier_pan_tilt.push_back(candidate_pan_tilt[index][pan_tilt_index]);
                     }
                     
                     Eigen::Vector3d opt_ptz;
-                    double reprojection_error = cvx_pgl::optimizePTZ(pp, inlier_pan_tilt, inlier_image_pts, hypotheses[i].ptz_, opt_ptz);
-                    hypotheses[i].ptz_ = opt_ptz;
-                    hypotheses[i].inlier_indices_.clear();
-                    hypotheses[i].inlier_candidate_pan_tilt_indices_.clear();
-                    if (hypotheses.size() == 1 && verbose) {
-                        printf("hypotheses rank %lu, reprojection error %f pixels\n", hypotheses.size(), reprojection_error);
+                    double reprojection_error = 0.0;
+                    {
+                        DTScopedTimer timer(DTProfiler::LM_REFINE);
+                        reprojection_error = cvx_pgl::optimizePTZ(pp, inlier_pan_tilt, inlier_image_pts, hp.ptz_, opt_ptz);
+                    }
+                    hp.ptz_ = opt_ptz;
+                    hp.inlier_indices_.clear();
+                    hp.inlier_candidate_pan_tilt_indices_.clear();
+                    if (hypothesis_num == 1 && verbose) {
+                        printf("hypotheses rank %d, reprojection error %f pixels\n", hypothesis_num, reprojection_error);
                     }
                 }
                 else {
-                    //printf("Warning: inlier number is too small %lu \n", hypotheses[i].inlier_indices_.size());
+                    //printf("Warning: inlier number is too small %lu \n", hp.inlier_indices_.size());
                 }
             }
         }
-        assert(hypotheses.size() == 1);
+        assert(hypothesis_num == 1);
         
         ptz = hypotheses[0].ptz_;
         return true;
     }
+    
+    int inlierNumber(const vector<Eigen::Vector2d> & image_points,
+                     const vector<vector<Eigen::Vector2d> > & candidate_pan_tilt,
+                     const Eigen::Vector2d& pp,
+                     const Eigen::Vector3d& ptz,
+                     const double threshold)
+    {
+        assert(image_points.size() == candidate_pan_tilt.size());
+        int num = 0;
+        for (int i = 0; i<image_points.size(); i++) {
+            for (int j = 0; j<candidate_pan_tilt[i].size(); j++) {
+                Eigen::Vector2d p = cvx_pgl::panTilt2Point(pp, ptz, candidate_pan_tilt[i][j]);
+                if ((p - image_points[i]).norm() < threshold) {
+                    num++;
+                    break;
+                }
+            }
+        }
+        return num;
+    }
 }
@@ -10,6 +10,7 @@
 #define __PTZBTRF__ptz_pose_estimation__
 
 #include <stdio.h>
+#include <stdint.h>
 #include <vector>
 #include <Eigen/Dense>
 
@@ -17,6 +18,8 @@ using std::vector;
 using Eigen::Vector2d;
 using Eigen::Vector2d;
 
+class DTRng;
+
 // optimize pan, tilt and zoom camera pose given
 // noise observation
 namespace ptz_pose_opt {
@@ -24,14 +27,46 @@ namespace ptz_pose_opt {
     {
         double reprojection_error_threshold_;    // distance threshod, unit pixel
         int sample_number_;
+        uint64_t random_seed_;                   // seed of sampling when no generator is provided
+        bool progressive_sampling_;              // PROSAC, sample the closest matches first, needs match distances
+        double target_inlier_ratio_;             // > 0: stop sampling once a hypothesis has this inlier ratio
    
         PTZPreemptiveRANSACParameter()
         {
             reprojection_error_threshold_ = 2.0; //
             sample_number_ = 32;
+            random_seed_ = 0;
+            progressive_sampling_ = false;
+            target_inlier_ratio_ = 0.0;
         }
     };
     
+    // reusable memory of preemptiveRANSACOneToMany, one per thread
+    // keeps its capacity between calls
+    struct PTZPreemptiveRANSACBuffer
+    {
+        struct Hypothesis
+        {
+            double loss_;
+            Eigen::Vector3d ptz_;
+            vector<int> inlier_indices_;                    // image coordinate index
+            vector<int> inlier_candidate_pan_tilt_indices_; // camera coordinate pan tilt index
+            
+            void reset(const Eigen::Vector3d & ptz);
+            
+            bool operator < (const Hypothesis & other) const
+            {
+                return loss_ < other.loss_;
+            }
+        };
+        
+        vector<Hypothesis> hypotheses_;
+        vector<int> sampled_indices_;
+        vector<int> sorted_indices_;    // image point indices in ascending match distance
+        vector<Eigen::Vector2d> inlier_image_pts_;
+        vector<Eigen::Vector2d> inlier_pan_tilt_;
+    };
+    
     ///image_points: image coordinate locations
     // candidate_pan_tilt: corresonding pan, tilt in camera coordinate, have outliers, multiple choices
     // param: RANSAC parameter
@@ -44,6 +79,45 @@ namespace ptz_pose_opt {
                                    Eigen::Vector3d & ptz,
                                    bool verbose = true);
     
+    // rng: random number generator for sampling, caller keeps one per thread
+    bool preemptiveRANSACOneToMany(const vector<Eigen::Vector2d> & image_points,
+                                   const vector<vector<Eigen::Vector2d> > & candidate_pan_tilt,
+                                   const Eigen::Vector2d& principal_point,
+                                   const PTZPreemptiveRANSACParameter & param,
+                                   DTRng & rng,
+                                   Eigen::Vector3d & ptz,
+                                   bool verbose = true);
+    
+    // buffer: memory reused between calls
+    bool preemptiveRANSACOneToMany(const vector<Eigen::Vector2d> & image_points,
+                                   const vector<vector<Eigen::Vector2d> > & candidate_pan_tilt,
+                                   const Eigen::Vector2d& principal_point,
+                                   const PTZPreemptiveRANSACParameter & param,
+                                   DTRng & rng,
+                                   PTZPreemptiveRANSACBuffer & buffer,
+                                   Eigen::Vector3d & ptz,
+                                   bool verbose = true);
+    
+    // match_distances: feature distance of the first candidate of each image point,
+    // used by progressive sampling, can be empty
+    bool preemptiveRANSACOneToMany(const vector<Eigen::Vector2d> & image_points,
+                                   const vector<vector<Eigen::Vector2d> > & candidate_pan_tilt,
+                                   const vector<float> & match_distances,
+                                   const Eigen::Vector2d& principal_point,
+                                   const PTZPreemptiveRANSACParameter & param,
+                                   DTRng & rng,
+                                   PTZPreemptiveRANSACBuffer & buffer,
+                                   Eigen::Vector3d & ptz,
+                                   bool verbose = true);
+    
+    // number of image points that have at least one candidate pan, tilt
+    // projected within threshold (pixel) under the camera ptz
+    int inlierNumber(const vector<Eigen::Vector2d> & image_points,
+                     const vector<vector<Eigen::Vector2d> > & candidate_pan_tilt,
+                     const Eigen::Vector2d& principal_point,
+                     const Eigen::Vector3d& ptz,
+                     const double threshold);
+    
     //bool bundleAdjustment(
 }
 
@@ -0,0 +1,579 @@
+//
+//  ptz_relocalizer.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-20.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#include "ptz_relocalizer.h"
+#include "dt_thread_pool.hpp"
+#include "dt_profiler.hpp"
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+
+using std::string;
+
+PTZRelocalizerParameter::PTZRelocalizerParameter()
+{
+    pp_x_ = 1280/2.0;
+    pp_y_ = 720/2.0;
+    max_check_ = 4;
+    forest_max_check_ = 0;
+    distance_threshold_ = 0.2;
+    binary_distance_threshold_ = 0.25;
+    early_exit_agree_num_ = 0;
+    early_exit_agree_tolerance_ = 1.0;
+    early_exit_confident_distance_ = 0.0;
+    early_exit_reject_ratio_ = 0.0;
+    thread_num_ = 1;
+    prior_min_inlier_num_ = 10;
+}
+
+bool PTZRelocalizerParameter::readFromFile(FILE *pf)
+{
+    assert(pf);
+    
+    std::unordered_map<string, double> imap;
+    while (true) {
+        char s[1024] = {'\0'};
+        double val = 0;
+        int ret = fscanf(pf, "%1023s %lf", s, &val);
+        if (ret != 2) {
+            break;
+        }
+        imap[string(s)] = val;
+    }
+    
+    for (auto it = imap.begin(); it != imap.end(); it++) {
+        const string & name = it->first;
+        const double val = it->second;
+        if (name == "pp_x") {
+            pp_x_ = val;
+        }
+        else if (name == "pp_y") {
+            pp_y_ = val;
+        }
+        else if (name == "max_check") {
+            max_check_ = (int)val;
+        }
+        else if (name == "forest_max_check") {
+            forest_max_check_ = (int)val;
+        }
+        else if (name == "distance_threshold") {
+            distance_threshold_ = val;
+        }
+        else if (name == "binary_distance_threshold") {
+            binary_distance_threshold_ = val;
+        }
+        else if (name == "early_exit_agree_num") {
+            early_exit_agree_num_ = (int)val;
+        }
+        else if (name == "early_exit_agree_tolerance") {
+            early_exit_agree_tolerance_ = val;
+        }
+        else if (name == "early_exit_confident_distance") {
+            early_exit_confident_distance_ = val;
+        }
+        else if (name == "early_exit_reject_ratio") {
+            early_exit_reject_ratio_ = val;
+        }
+        else if (name == "prior_min_inlier_num") {
+            prior_min_inlier_num_ = (int)val;
+        }
+        else if (name == "thread_num") {
+            thread_num_ = (int)val;
+        }
+        else if (name == "reprojection_error_threshold") {
+            ransac_param_.reprojection_error_threshold_ = val;
+        }
+        else if (name == "ransac_sample_number") {
+            ransac_param_.sample_number_ = (int)val;
+        }
+        else if (name == "random_seed") {
+            ransac_param_.random_seed_ = (uint64_t)val;
+        }
+        else if (name == "progressive_sampling") {
+            ransac_param_.progressive_sampling_ = (val != 0.0);
+        }
+        else if (name == "target_inlier_ratio") {
+            ransac_param_.target_inlier_ratio_ = val;
+        }
+        else {
+            printf("Warning: unknown relocalization parameter %s\n", name.c_str());
+        }
+    }
+    return true;
+}
+
+bool PTZRelocalizerParameter::readFromFile(const char *file_name)
+{
+    assert(file_name);
+    FILE *pf = fopen(file_name, "r");
+    if (!pf) {
+        printf("can not open %s\n", file_name);
+        return false;
+    }
+    this->readFromFile(pf);
+    fclose(pf);
+    return true;
+}
+
+bool PTZRelocalizerParameter::writeToFile(FILE *pf) const
+{
+    assert(pf);
+    fprintf(pf, "pp_x %f\n", pp_x_);
+    fprintf(pf, "pp_y %f\n", pp_y_);
+    fprintf(pf, "max_check %d\n", max_check_);
+    fprintf(pf, "forest_max_check %d\n", forest_max_check_);
+    fprintf(pf, "distance_threshold %f\n", distance_threshold_);
+    fprintf(pf, "binary_distance_threshold %f\n", binary_distance_threshold_);
+    fprintf(pf, "early_exit_agree_num %d\n", early_exit_agree_num_);
+    fprintf(pf, "early_exit_agree_tolerance %f\n", early_exit_agree_tolerance_);
+    fprintf(pf, "early_exit_confident_distance %f\n", early_exit_confident_distance_);
+    fprintf(pf, "early_exit_reject_ratio %f\n", early_exit_reject_ratio_);
+    fprintf(pf, "thread_num %d\n", thread_num_);
+    fprintf(pf, "prior_min_inlier_num %d\n", prior_min_inlier_num_);
+    fprintf(pf, "reprojection_error_threshold %f\n", ransac_param_.reprojection_error_threshold_);
+    fprintf(pf, "ransac_sample_number %d\n", ransac_param_.sample_number_);
+    fprintf(pf, "random_seed %llu\n", (unsigned long long)ransac_param_.random_seed_);
+    fprintf(pf, "progressive_sampling %d\n", ransac_param_.progressive_sampling_ ? 1 : 0);
+    fprintf(pf, "target_inlier_ratio %f\n", ransac_param_.target_inlier_ratio_);
+    return true;
+}
+
+void PTZRelocalizerParameter::printSelf() const
+{
+    writeToFile(stdout);
+}
+
+PTZRelocalizer::PTZRelocalizer(const PTZRelocalizerParameter & param)
+{
+    pool_ = NULL;
+    this->setParameter(param);
+}
+
+PTZRelocalizer::~PTZRelocalizer()
+{
+    if (pool_) {
+        delete pool_;
+        pool_ = NULL;
+    }
+    for (int i = 0; i<thread_buffers_.size(); i++) {
+        delete thread_buffers_[i];
+    }
+    thread_buffers_.clear();
+    for (int i = 0; i<estimate_buffers_.size(); i++) {
+        delete estimate_buffers_[i];
+    }
+    estimate_buffers_.clear();
+}
+
+void PTZRelocalizer::setParameter(const PTZRelocalizerParameter & param)
+{
+    param_ = param;
+    if (param_.thread_num_ < 1) {
+        param_.thread_num_ = 1;
+    }
+    if (pool_ == NULL || pool_->threadNum() != param_.thread_num_) {
+        if (pool_) {
+            delete pool_;
+        }
+        pool_ = new DTThreadPool(param_.thread_num_);
+    }
+    while (thread_buffers_.size() < param_.thread_num_) {
+        thread_buffers_.push_back(new ThreadBuffer());
+    }
+    while (estimate_buffers_.size() < param_.thread_num_) {
+        estimate_buffers_.push_back(new EstimateBuffer());
+    }
+}
+
+const PTZRelocalizerParameter & PTZRelocalizer::getParameter() const
+{
+    return param_;
+}
+
+int PTZRelocalizer::relocalize(const BTDTRegressor & model,
+                               const float* keypoints,
+                               const float* descriptors,
+                               const int n,
+                               const int descriptor_dim,
+                               double* pan_tilt_zoom)
+{
+    assert(keypoints && descriptors && pan_tilt_zoom);
+    if (descriptor_dim != model.featureDim()) {
+        printf("Error: descriptor dimension %d, model %d\n", descriptor_dim, model.featureDim());
+        return 0;
+    }
+    DTScopedTimer timer(DTProfiler::RELOCALIZE);
+    this->reserve(n);
+    
+    {
+        DTScopedTimer predict_timer(DTProfiler::PREDICT);
+        pool_->parallelFor(n, [&](int thread_id, int begin, int end) {
+            ThreadBuffer & buffer = *thread_buffers_[thread_id];
+            for (int i = begin; i<end; i++) {
+                locations_[i] = Eigen::Vector2d(keypoints[2*i], keypoints[2*i+1]);
+                buffer.feature_ = Eigen::Map<const Eigen::VectorXf>(descriptors + (size_t)descriptor_dim * i, descriptor_dim);
+                this->predictCandidate(model, i, buffer);
+            }
+        });
+    }
+    return this->estimateCamera(n, pan_tilt_zoom);
+}
+
+int PTZRelocalizer::relocalize(const BTDTRegressor & model,
+                               const vector<btdtr_ptz_util::PTZSample> & samples,
+                               double* pan_tilt_zoom)
+{
+    assert(pan_tilt_zoom);
+    for (const auto& s: samples) {
+        if (s.descriptor_.size() != model.featureDim()) {
+            printf("Error: descriptor dimension %d, model %d\n", (int)s.descriptor_.size(), model.featureDim());
+            return 0;
+        }
+    }
+    DTScopedTimer timer(DTProfiler::RELOCALIZE);
+    const int n = (int)samples.size();
+    this->reserve(n);
+    
+    {
+        DTScopedTimer predict_timer(DTProfiler::PREDICT);
+        pool_->parallelFor(n, [&](int thread_id, int begin, int end) {
+            ThreadBuffer & buffer = *thread_buffers_[thread_id];
+            for (int i = begin; i<end; i++) {
+                locations_[i] = Eigen::Vector2d(samples[i].loc_.x(), samples[i].loc_.y());
+                buffer.feature_ = samples[i].descriptor_;
+                this->predictCandidate(model, i, buffer);
+            }
+        });
+    }
+    return this->estimateCamera(n, pan_tilt_zoom);
+}
+
+int PTZRelocalizer::relocalize(const vector<const BTDTRegressor *> & models,
+                               const float* keypoints,
+                               const float* descriptors,
+                               const int n,
+                               const int descriptor_dim,
+                               double* pan_tilt_zoom,
+                               const int tree_num)
+{
+    assert(models.size() > 0);
+    assert(keypoints && descriptors && pan_tilt_zoom);
+    for (const BTDTRegressor * model: models) {
+        if (descriptor_dim != model->featureDim()) {
+            printf("Error: descriptor dimension %d, model %d\n", descriptor_dim, model->featureDim());
+            return 0;
+        }
+    }
+    DTScopedTimer timer(DTProfiler::RELOCALIZE);
+    this->reserve(n);
+    
+    {
+        DTScopedTimer predict_timer(DTProfiler::PREDICT);
+        pool_->parallelFor(n, [&](int thread_id, int begin, int end) {
+            ThreadBuffer & buffer = *thread_buffers_[thread_id];
+            for (int i = begin; i<end; i++) {
+                locations_[i] = Eigen::Vector2d(keypoints[2*i], keypoints[2*i+1]);
+                buffer.feature_ = Eigen::Map<const Eigen::VectorXf>(descriptors + (size_t)descriptor_dim * i, descriptor_dim);
+                this->predictCandidate(models, tree_num, i, buffer);
+            }
+        });
+    }
+    return this->estimateCamera(n, pan_tilt_zoom);
+}
+
+template <int WordNum>
+int PTZRelocalizer::relocalize(const BTHammingRegressor<WordNum> & model,
+                               const float* keypoints,
+                               const unsigned char* descriptors,
+                               const int n,
+                               double* pan_tilt_zoom)
+{
+    typedef BTHammingTree<WordNum> TreeType;
+    assert(keypoints && descriptors && pan_tilt_zoom);
+    DTScopedTimer timer(DTProfiler::RELOCALIZE);
+    this->reserve(n);
+    
+    const double distance_threshold = param_.binary_distance_threshold_ * TreeType::BIT_NUM;
+    {
+        DTScopedTimer predict_timer(DTProfiler::PREDICT);
+        pool_->parallelFor(n, [&](int thread_id, int begin, int end) {
+            ThreadBuffer & buffer = *thread_buffers_[thread_id];
+            typename TreeType::Descriptor feature;
+            for (int i = begin; i<end; i++) {
+                locations_[i] = Eigen::Vector2d(keypoints[2*i], keypoints[2*i+1]);
+                TreeType::pack(descriptors + (size_t)TreeType::BYTE_NUM * i, feature);
+                model.predict(feature, param_.max_check_, buffer.hamming_search_, buffer.predictions_, buffer.dists_);
+                buffer.tree_query_num_ += (int64_t)buffer.predictions_.size();
+                this->collectCandidate(i, buffer, distance_threshold);
+            }
+        });
+    }
+    return this->estimateCamera(n, pan_tilt_zoom);
+}
+
+template int PTZRelocalizer::relocalize<4>(const BTHammingRegressor<4> & model,
+                                           const float* keypoints,
+                                           const unsigned char* descriptors,
+                                           const int n,
+                                           double* pan_tilt_zoom);
+template int PTZRelocalizer::relocalize<8>(const BTHammingRegressor<8> & model,
+                                           const float* keypoints,
+                                           const unsigned char* descriptors,
+                                           const int n,
+                                           double* pan_tilt_zoom);
+
+void PTZRelocalizer::relocalizeBatch(const BTDTRegressor & model,
+                                     const int descriptor_dim,
+                                     vector<PTZRelocalizationFrame> & frames)
+{
+    if (descriptor_dim != model.featureDim()) {
+        printf("Error: descriptor dimension %d, model %d\n", descriptor_dim, model.featureDim());
+        for (auto& frame: frames) {
+            frame.inlier_num_ = 0;
+        }
+        return;
+    }
+    DTScopedTimer timer(DTProfiler::RELOCALIZE);
+    const int frame_num = (int)frames.size();
+    
+    // first keypoint of each frame in the batch
+    vector<int> offsets(frame_num + 1, 0);
+    for (int i = 0; i<frame_num; i++) {
+        assert(frames[i].keypoints_ && frames[i].descriptors_);
+        offsets[i+1] = offsets[i] + frames[i].n_;
+    }
+    const int n = offsets[frame_num];
+    this->reserve(n);
+    
+    // 1. predict keypoints of all frames
+    {
+        DTScopedTimer predict_timer(DTProfiler::PREDICT);
+        pool_->parallelFor(n, [&](int thread_id, int begin, int end) {
+            ThreadBuffer & buffer = *thread_buffers_[thread_id];
+            int f = (int)(std::upper_bound(offsets.begin(), offsets.end(), begin) - offsets.begin()) - 1;
+            for (int i = begin; i<end; i++) {
+                while (i >= offsets[f+1]) {
+                    f++;
+                }
+                const int k = i - offsets[f];
+                const float* keypoints = frames[f].keypoints_;
+                locations_[i] = Eigen::Vector2d(keypoints[2*k], keypoints[2*k+1]);
+                buffer.feature_ = Eigen::Map<const Eigen::VectorXf>(frames[f].descriptors_ + (size_t)descriptor_dim * k, descriptor_dim);
+                this->predictCandidate(model, i, buffer);
+            }
+        });
+    }
+    this->countPrediction(n);
+    
+    // 2. estimate frames in parallel
+    pool_->parallelFor(frame_num, [&](int thread_id, int begin, int end) {
+        EstimateBuffer & buffer = *estimate_buffers_[thread_id];
+        for (int f = begin; f<end; f++) {
+            frames[f].inlier_num_ = this->estimateCamera(offsets[f], frames[f].n_, buffer, frames[f].pan_tilt_zoom_);
+        }
+    });
+}
+
+int PTZRelocalizer::candidateNum() const
+{
+    return (int)estimate_buffers_[0]->image_points_.size();
+}
+
+void PTZRelocalizer::reserve(const int n)
+{
+    // never shrink, keep the memory of candidates
+    if (candidates_.size() < n) {
+        locations_.resize(n);
+        candidates_.resize(n);
+        min_dists_.resize(n);
+        is_valid_.resize(n);
+    }
+}
+
+void PTZRelocalizer::predictCandidate(const BTDTRegressor & model, const int index, ThreadBuffer & buffer)
+{
+    // predict from observation (descriptors)
+    this->predictForest(model, 0, buffer);
+    this->collectCandidate(index, buffer, param_.distance_threshold_);
+}
+
+void PTZRelocalizer::predictCandidate(const vector<const BTDTRegressor *> & models, const int tree_num,
+                                      const int index, ThreadBuffer & buffer)
+{
+    if (models.size() == 1 && tree_num <= 0) {
+        this->predictCandidate(*models[0], index, buffer);
+        return;
+    }
+    
+    // merge predictions of all forests, insertion sort by feature distance
+    vector<Eigen::VectorXf> & merged_predictions = buffer.merged_predictions_;
+    vector<float> & merged_dists = buffer.merged_dists_;
+    int merged_num = 0;
+    int max_tree_num = 0;
+    for (int i = 0; i<models.size(); i++) {
+        max_tree_num = std::max(max_tree_num, models[i]->treeNum());
+    }
+    
+    // split tree_num among forests, the first trees of each forest and at least one tree
+    const int model_num = (int)models.size();
+    for (int i = 0; i<models.size(); i++) {
+        int model_tree_num = 0;
+        if (tree_num > 0) {
+            model_tree_num = std::max(1, tree_num / model_num + (i < tree_num % model_num ? 1 : 0));
+        }
+        this->predictForest(*models[i], model_tree_num, buffer);
+        const int pred_num = (int)buffer.predictions_.size();
+        if (merged_predictions.size() < merged_num + pred_num) {
+            merged_predictions.resize(merged_num + pred_num);
+            merged_dists.resize(merged_num + pred_num);
+        }
+        for (int j = 0; j<pred_num; j++) {
+            int k = merged_num;
+            merged_predictions[k].swap(buffer.predictions_[j]);
+            merged_dists[k] = buffer.dists_[j];
+            for (; k > 0 && merged_dists[k] < merged_dists[k-1]; k--) {
+                std::swap(merged_dists[k], merged_dists[k-1]);
+                merged_predictions[k].swap(merged_predictions[k-1]);
+            }
+            merged_num++;
+        }
+    }
+    
+    // keep the closest ones, as many as one forest, RANSAC cost does not grow with the number of forests
+    merged_num = std::min(merged_num, max_tree_num);
+    
+    // swap back, merged buffers keep the memory
+    buffer.predictions_.resize(merged_num);
+    buffer.dists_.resize(merged_num);
+    for (int i = 0; i<merged_num; i++) {
+        buffer.predictions_[i].swap(merged_predictions[i]);
+        buffer.dists_[i] = merged_dists[i];
+    }
+    this->collectCandidate(index, buffer, param_.distance_threshold_);
+}
+
+void PTZRelocalizer::predictForest(const BTDTRegressor & model, const int max_tree_num, ThreadBuffer & buffer)
+{
+    const bool is_early_exit = param_.early_exit_agree_num_ > 0 ||
+                               param_.early_exit_confident_distance_ > 0 ||
+                               param_.early_exit_reject_ratio_ > 0 ||
+                               (max_tree_num > 0 && max_tree_num < model.treeNum());
+    BTDTREarlyExitParameter early_exit;
+    early_exit.max_tree_num_ = max_tree_num;
+    early_exit.agree_tree_num_ = param_.early_exit_agree_num_;
+    early_exit.agree_tolerance_ = param_.early_exit_agree_tolerance_;
+    early_exit.confident_distance_ = param_.early_exit_confident_distance_;
+    early_exit.reject_distance_ = param_.early_exit_reject_ratio_ * param_.distance_threshold_;
+    
+    // joint search and early exit work together, a rejected descriptor has no prediction
+    int tree_query_num = 0;
+    if (param_.forest_max_check_ > 0) {
+        tree_query_num = model.predictJoint(buffer.feature_, param_.forest_max_check_, early_exit, buffer.joint_search_,
+                                            buffer.predictions_, buffer.dists_);
+    }
+    else if (is_early_exit) {
+        tree_query_num = model.predictAdaptive(buffer.feature_, param_.max_check_, early_exit, buffer.search_,
+                                               buffer.predictions_, buffer.dists_);
+    }
+    else {
+        model.predict(buffer.feature_, param_.max_check_, buffer.search_, buffer.predictions_, buffer.dists_);
+        tree_query_num = model.treeNum();
+    }
+    buffer.tree_query_num_ += tree_query_num;
+}
+
+void PTZRelocalizer::collectCandidate(const int index, ThreadBuffer & buffer, const double distance_threshold)
+{
+    vector<Eigen::Vector2d> & cur_candidate = candidates_[index];
+    cur_candidate.clear();
+    
+    const vector<Eigen::VectorXf> & cur_predictions = buffer.predictions_;
+    const vector<float> & cur_dists = buffer.dists_;
+    assert(cur_predictions.size() == cur_dists.size());
+    
+    // distance is in non-decrease order
+    for (int k = 0; k<cur_predictions.size() && cur_dists[k] < distance_threshold; k++) {
+        assert(cur_predictions[k].size() == 2);
+        cur_candidate.push_back(Eigen::Vector2d(cur_predictions[k][0], cur_predictions[k][1]));
+    }
+    is_valid_[index] = cur_candidate.empty() ? 0 : 1;
+    min_dists_[index] = cur_candidate.empty() ? 0.0f : cur_dists[0];
+}
+
+int PTZRelocalizer::estimateCamera(const int n, double* pan_tilt_zoom)
+{
+    this->countPrediction(n);
+    return this->estimateCamera(0, n, *estimate_buffers_[0], pan_tilt_zoom);
+}
+
+void PTZRelocalizer::countPrediction(const int n)
+{
+    DTProfiler::addCount(DTProfiler::KEYPOINT, n);
+    for (int i = 0; i<thread_buffers_.size(); i++) {
+        DTProfiler::addCount(DTProfiler::TREE_QUERY, thread_buffers_[i]->tree_query_num_);
+        thread_buffers_[i]->tree_query_num_ = 0;
+    }
+}
+
+int PTZRelocalizer::estimateCamera(const int begin, const int n, EstimateBuffer & buffer, double* pan_tilt_zoom)
+{
+    vector<Eigen::Vector2d> & image_points = buffer.image_points_;
+    vector<float> & candidate_dists = buffer.candidate_dists_;
+    vector<vector<Eigen::Vector2d> > & candidate_pan_tilt = buffer.candidate_pan_tilt_;
+    const int end = begin + n;
+    
+    // move candidates to RANSAC input by swapping, no copy
+    {
+        DTScopedTimer timer(DTProfiler::CANDIDATE_FILTER);
+        image_points.clear();
+        candidate_dists.clear();
+        candidate_pan_tilt.clear();
+        for (int i = begin; i<end; i++) {
+            if (is_valid_[i]) {
+                image_points.push_back(locations_[i]);
+                candidate_dists.push_back(min_dists_[i]);
+                candidate_pan_tilt.push_back(vector<Eigen::Vector2d>());
+                candidate_pan_tilt.back().swap(candidates_[i]);
+            }
+        }
+    }
+    DTProfiler::addCount(DTProfiler::CANDIDATE, (int64_t)image_points.size());
+    
+    // the same input gives the same camera pose in every call
+    DTRng & rng = buffer.rng_;
+    rng.seed(param_.ransac_param_.random_seed_);
+    const Eigen::Vector2d pp(param_.pp_x_, param_.pp_y_);
+    Eigen::Vector3d estimated_ptz(pan_tilt_zoom[0], pan_tilt_zoom[1], pan_tilt_zoom[2]);
+    bool is_opt = ptz_pose_opt::preemptiveRANSACOneToMany(image_points, candidate_pan_tilt,
+                                                          candidate_dists, pp,
+                                                          param_.ransac_param_, rng, buffer.ransac_buffer_,
+                                                          estimated_ptz, false);
+    int inlier_num = 0;
+    if (is_opt) {
+        pan_tilt_zoom[0] = estimated_ptz[0];
+        pan_tilt_zoom[1] = estimated_ptz[1];
+        pan_tilt_zoom[2] = estimated_ptz[2];
+        inlier_num = ptz_pose_opt::inlierNumber(image_points, candidate_pan_tilt, pp, estimated_ptz,
+                                                param_.ransac_param_.reprojection_error_threshold_);
+        DTProfiler::addCount(DTProfiler::INLIER, inlier_num);
+    }
+    else {
+        DTProfiler::addCount(DTProfiler::RELOCALIZE_FAIL);
+    }
+    
+    // give the memory back to keypoint slots
+    int index = 0;
+    for (int i = begin; i<end; i++) {
+        if (is_valid_[i]) {
+            candidates_[i].swap(candidate_pan_tilt[index]);
+            index++;
+        }
+    }
+    return inlier_num;
+}
@@ -0,0 +1,207 @@
+//
+//  ptz_relocalizer.h
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-20.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef ptz_relocalizer_h
+#define ptz_relocalizer_h
+
+// relocalize a PTZ camera from keypoints and descriptors using a random forest
+// configured once, memory is reused between calls
+#include <stdio.h>
+#include <vector>
+#include <Eigen/Dense>
+#include "bt_dt_regressor.h"
+#include "bt_hamming_regressor.h"
+#include "btdtr_ptz_util.h"
+#include "ptz_pose_estimation.h"
+#include "dt_rng.hpp"
+
+using std::vector;
+
+class DTThreadPool;
+
+struct PTZRelocalizerParameter
+{
+    double pp_x_;                 // principal point, image center
+    double pp_y_;
+    int max_check_;               // number of checked leaf nodes in back tracking
+    int forest_max_check_;        // > 0: joint search of all trees, number of checked leaf nodes in the forest
+    double distance_threshold_;   // feature distance threshold of a valid prediction
+    double binary_distance_threshold_;  // Hamming distance threshold, fraction of descriptor bits
+    
+    // adaptive number of trees for each keypoint, 0 disables a rule, also applies to the joint search
+    // a rejected keypoint has no candidate and is not used in RANSAC
+    int early_exit_agree_num_;               // stop once this number of trees agree on pan, tilt
+    double early_exit_agree_tolerance_;      // pan, tilt agreement in degrees
+    double early_exit_confident_distance_;   // stop once a leaf node is closer than this
+    double early_exit_reject_ratio_;         // reject if distance > ratio * distance_threshold, first tree or closest leaf in joint search
+    
+    int thread_num_;              // number of threads in prediction
+    int prior_min_inlier_num_;    // relocalization with a prior falls back to global search below this
+    ptz_pose_opt::PTZPreemptiveRANSACParameter ransac_param_;
+    
+    // default: 1280 x 720 image
+    PTZRelocalizerParameter();
+    
+    // text file, one "name value" pair per line, missing names keep default values
+    // pp_x, pp_y, max_check, forest_max_check, distance_threshold, binary_distance_threshold, thread_num,
+    // early_exit_agree_num, early_exit_agree_tolerance, early_exit_confident_distance, early_exit_reject_ratio,
+    // prior_min_inlier_num,
+    // reprojection_error_threshold, ransac_sample_number, random_seed, progressive_sampling, target_inlier_ratio
+    bool readFromFile(FILE *pf);
+    bool readFromFile(const char *file_name);
+    bool writeToFile(FILE *pf) const;
+    void printSelf() const;
+};
+
+// one frame in batch relocalization
+struct PTZRelocalizationFrame
+{
+    const float* keypoints_;      // n x 2, row major
+    const float* descriptors_;    // n x descriptor_dim, row major
+    int n_;
+    double pan_tilt_zoom_[3];     // input initial camera pose, output estimated camera pose
+    int inlier_num_;              // output, 0 if failed
+    
+    PTZRelocalizationFrame()
+    {
+        keypoints_ = NULL;
+        descriptors_ = NULL;
+        n_ = 0;
+        pan_tilt_zoom_[0] = pan_tilt_zoom_[1] = pan_tilt_zoom_[2] = 0.0;
+        inlier_num_ = 0;
+    }
+};
+
+// not thread safe, one relocalizer for each video stream
+class PTZRelocalizer
+{
+    // memory of a prediction thread
+    struct ThreadBuffer
+    {
+        BTDTRTree::SearchBuffer search_;
+        BTDTRegressor::JointSearchBuffer joint_search_;
+        BTHammingSearchBuffer hamming_search_;
+        Eigen::VectorXf feature_;
+        vector<Eigen::VectorXf> predictions_;
+        vector<float> dists_;
+        vector<Eigen::VectorXf> merged_predictions_;   // predictions of several forests
+        vector<float> merged_dists_;
+        int64_t tree_query_num_;    // number of queried trees, for profiling
+        
+        ThreadBuffer() {tree_query_num_ = 0;}
+    };
+    
+    PTZRelocalizerParameter param_;
+    DTThreadPool * pool_;
+    vector<ThreadBuffer *> thread_buffers_;
+    
+    // per keypoint, indexed by input order
+    vector<Eigen::Vector2d> locations_;
+    vector<vector<Eigen::Vector2d> > candidates_;
+    vector<float> min_dists_;     // feature distance of the first candidate
+    vector<char> is_valid_;
+    
+    // memory of camera estimation of a frame
+    struct EstimateBuffer
+    {
+        // keypoints that have candidates, input of RANSAC
+        vector<Eigen::Vector2d> image_points_;
+        vector<float> candidate_dists_;
+        vector<vector<Eigen::Vector2d> > candidate_pan_tilt_;
+        ptz_pose_opt::PTZPreemptiveRANSACBuffer ransac_buffer_;
+        DTRng rng_;
+    };
+    
+    // one per thread, the first one is used by single frame relocalization
+    vector<EstimateBuffer *> estimate_buffers_;
+    
+public:
+    explicit PTZRelocalizer(const PTZRelocalizerParameter & param = PTZRelocalizerParameter());
+    ~PTZRelocalizer();
+    
+    // thread pool is re-created only if the thread number changes
+    void setParameter(const PTZRelocalizerParameter & param);
+    const PTZRelocalizerParameter & getParameter() const;
+    
+    // keypoints: n x 2, row major
+    // descriptors: n x descriptor_dim, row major
+    // pan_tilt_zoom: input initial camera pose, output estimated camera pose
+    // return: inlier number, 0 if failed
+    int relocalize(const BTDTRegressor & model,
+                   const float* keypoints,
+                   const float* descriptors,
+                   const int n,
+                   const int descriptor_dim,
+                   double* pan_tilt_zoom);
+    
+    int relocalize(const BTDTRegressor & model,
+                   const vector<btdtr_ptz_util::PTZSample> & samples,
+                   double* pan_tilt_zoom);
+    
+    // query several forests, e.g., shards of a map, candidates of all forests are merged
+    // tree_num: > 0, tree_num trees in total are split among forests, at least one tree of each forest
+    //           0, all trees of every forest are queried
+    int relocalize(const vector<const BTDTRegressor *> & models,
+                   const float* keypoints,
+                   const float* descriptors,
+                   const int n,
+                   const int descriptor_dim,
+                   double* pan_tilt_zoom,
+                   const int tree_num = 0);
+    
+    // binary descriptors (ORB, LATCH), model is a Hamming forest
+    // descriptors: n x (WordNum * 8) bytes, row major
+    template <int WordNum>
+    int relocalize(const BTHammingRegressor<WordNum> & model,
+                   const float* keypoints,
+                   const unsigned char* descriptors,
+                   const int n,
+                   double* pan_tilt_zoom);
+    
+    // frames of several cameras with the same model, e.g., requests of a relocalization service
+    // keypoints of all frames are predicted in one parallel loop, then frames are estimated in parallel
+    // each frame gets the same result as relocalize()
+    // every frame fails if descriptor_dim is not the dimension of the model
+    void relocalizeBatch(const BTDTRegressor & model,
+                         const int descriptor_dim,
+                         vector<PTZRelocalizationFrame> & frames);
+    
+    // number of keypoints that have candidate pan, tilt in the last single frame call
+    int candidateNum() const;
+    
+private:
+    PTZRelocalizer(const PTZRelocalizer & other);
+    PTZRelocalizer & operator = (const PTZRelocalizer & other);
+    
+    // grow per keypoint memory
+    void reserve(const int n);
+    
+    // predict candidate pan, tilt of keypoint index, feature is in buffer
+    void predictCandidate(const BTDTRegressor & model, const int index, ThreadBuffer & buffer);
+    void predictCandidate(const vector<const BTDTRegressor *> & models, const int tree_num,
+                          const int index, ThreadBuffer & buffer);
+    
+    // predictions and distances of one forest, search mode and early exit are from the parameter
+    // max_tree_num: > 0, query at most the first max_tree_num trees
+    // queried trees are counted in buffer
+    void predictForest(const BTDTRegressor & model, const int max_tree_num, ThreadBuffer & buffer);
+    
+    // keep predictions in buffer that are closer than distance_threshold
+    void collectCandidate(const int index, ThreadBuffer & buffer, const double distance_threshold);
+    
+    // estimate camera pose from the candidates of n keypoints
+    int estimateCamera(const int n, double* pan_tilt_zoom);
+    
+    // keypoints [begin, begin + n), buffer is owned by the calling thread
+    int estimateCamera(const int begin, const int n, EstimateBuffer & buffer, double* pan_tilt_zoom);
+    
+    // add keypoint and tree query numbers of the last prediction to the profiler
+    void countPrediction(const int n);
+};
+
+#endif /* ptz_relocalizer_h */
@@ -0,0 +1,452 @@
+//
+//  ptz_synthetic_generator.cpp
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-31.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#include "ptz_synthetic_generator.h"
+#include <assert.h>
+#include <math.h>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <algorithm>
+#include "dt_rng.hpp"
+#include "dt_thread_pool.hpp"
+#include "mat_io.hpp"
+
+using std::string;
+
+PTZSyntheticGeneratorParameter::PTZSyntheticGeneratorParameter()
+{
+    pp_x_ = 1280/2.0;
+    pp_y_ = 720/2.0;
+    image_width_ = 1280;
+    image_height_ = 720;
+    
+    landmark_num_ = 20000;
+    landmark_pan_min_ = -90.0;
+    landmark_pan_max_ = 90.0;
+    landmark_tilt_min_ = -40.0;
+    landmark_tilt_max_ = 10.0;
+    
+    descriptor_dim_ = 128;
+    descriptor_noise_ = 0.02;
+    keypoint_noise_ = 1.0;
+    outlier_ratio_ = 0.2;
+    max_keypoint_num_ = 300;
+    
+    frame_num_ = 10000;
+    trajectory_length_ = 1000;
+    pan_min_ = -60.0;
+    pan_max_ = 60.0;
+    tilt_min_ = -20.0;
+    tilt_max_ = -5.0;
+    focal_length_min_ = 1000.0;
+    focal_length_max_ = 4000.0;
+    pan_acceleration_ = 0.05;
+    tilt_acceleration_ = 0.01;
+    zoom_acceleration_ = 0.002;
+    damping_ = 0.95;
+    
+    random_seed_ = 0;
+    thread_num_ = 4;
+}
+
+bool PTZSyntheticGeneratorParameter::readFromFile(FILE *pf)
+{
+    assert(pf);
+    
+    std::unordered_map<string, double> imap;
+    while (true) {
+        char s[1024] = {'\0'};
+        double val = 0;
+        int ret = fscanf(pf, "%1023s %lf", s, &val);
+        if (ret != 2) {
+            break;
+        }
+        imap[string(s)] = val;
+    }
+    
+    for (auto it = imap.begin(); it != imap.end(); it++) {
+        const string & name = it->first;
+        const double val = it->second;
+        if (name == "pp_x") {
+            pp_x_ = val;
+        }
+        else if (name == "pp_y") {
+            pp_y_ = val;
+        }
+        else if (name == "image_width") {
+            image_width_ = (int)val;
+        }
+        else if (name == "image_height") {
+            image_height_ = (int)val;
+        }
+        else if (name == "landmark_num") {
+            landmark_num_ = (int)val;
+        }
+        else if (name == "landmark_pan_min") {
+            landmark_pan_min_ = val;
+        }
+        else if (name == "landmark_pan_max") {
+            landmark_pan_max_ = val;
+        }
+        else if (name == "landmark_tilt_min") {
+            landmark_tilt_min_ = val;
+        }
+        else if (name == "landmark_tilt_max") {
+            landmark_tilt_max_ = val;
+        }
+        else if (name == "descriptor_dim") {
+            descriptor_dim_ = (int)val;
+        }
+        else if (name == "descriptor_noise") {
+            descriptor_noise_ = val;
+        }
+        else if (name == "keypoint_noise") {
+            keypoint_noise_ = val;
+        }
+        else if (name == "outlier_ratio") {
+            outlier_ratio_ = val;
+        }
+        else if (name == "max_keypoint_num") {
+            max_keypoint_num_ = (int)val;
+        }
+        else if (name == "frame_num") {
+            frame_num_ = (int)val;
+        }
+        else if (name == "trajectory_length") {
+            trajectory_length_ = (int)val;
+        }
+        else if (name == "pan_min") {
+            pan_min_ = val;
+        }
+        else if (name == "pan_max") {
+            pan_max_ = val;
+        }
+        else if (name == "tilt_min") {
+            tilt_min_ = val;
+        }
+        else if (name == "tilt_max") {
+            tilt_max_ = val;
+        }
+        else if (name == "focal_length_min") {
+            focal_length_min_ = val;
+        }
+        else if (name == "focal_length_max") {
+            focal_length_max_ = val;
+        }
+        else if (name == "pan_acceleration") {
+            pan_acceleration_ = val;
+        }
+        else if (name == "tilt_acceleration") {
+            tilt_acceleration_ = val;
+        }
+        else if (name == "zoom_acceleration") {
+            zoom_acceleration_ = val;
+        }
+        else if (name == "damping") {
+            damping_ = val;
+        }
+        else if (name == "random_seed") {
+            random_seed_ = (unsigned long long)val;
+        }
+        else if (name == "thread_num") {
+            thread_num_ = (int)val;
+        }
+        else {
+            printf("Warning: unknown parameter %s\n", name.c_str());
+        }
+    }
+    assert(outlier_ratio_ >= 0.0 && outlier_ratio_ < 1.0);
+    return true;
+}
+
+bool PTZSyntheticGeneratorParameter::readFromFile(const char *file_name)
+{
+    assert(file_name);
+    FILE *pf = fopen(file_name, "r");
+    if (!pf) {
+        printf("can not open %s\n", file_name);
+        return false;
+    }
+    this->readFromFile(pf);
+    fclose(pf);
+    return true;
+}
+
+bool PTZSyntheticGeneratorParameter::writeToFile(FILE *pf) const
+{
+    assert(pf);
+    fprintf(pf, "pp_x %f\n", pp_x_);
+    fprintf(pf, "pp_y %f\n", pp_y_);
+    fprintf(pf, "image_width %d\n", image_width_);
+    fprintf(pf, "image_height %d\n", image_height_);
+    fprintf(pf, "landmark_num %d\n", landmark_num_);
+    fprintf(pf, "landmark_pan_min %f\n", landmark_pan_min_);
+    fprintf(pf, "landmark_pan_max %f\n", landmark_pan_max_);
+    fprintf(pf, "landmark_tilt_min %f\n", landmark_tilt_min_);
+    fprintf(pf, "landmark_tilt_max %f\n", landmark_tilt_max_);
+    fprintf(pf, "descriptor_dim %d\n", descriptor_dim_);
+    fprintf(pf, "descriptor_noise %f\n", descriptor_noise_);
+    fprintf(pf, "keypoint_noise %f\n", keypoint_noise_);
+    fprintf(pf, "outlier_ratio %f\n", outlier_ratio_);
+    fprintf(pf, "max_keypoint_num %d\n", max_keypoint_num_);
+    fprintf(pf, "frame_num %d\n", frame_num_);
+    fprintf(pf, "trajectory_length %d\n", trajectory_length_);
+    fprintf(pf, "pan_min %f\n", pan_min_);
+    fprintf(pf, "pan_max %f\n", pan_max_);
+    fprintf(pf, "tilt_min %f\n", tilt_min_);
+    fprintf(pf, "tilt_max %f\n", tilt_max_);
+    fprintf(pf, "focal_length_min %f\n", focal_length_min_);
+    fprintf(pf, "focal_length_max %f\n", focal_length_max_);
+    fprintf(pf, "pan_acceleration %f\n", pan_acceleration_);
+    fprintf(pf, "tilt_acceleration %f\n", tilt_acceleration_);
+    fprintf(pf, "zoom_acceleration %f\n", zoom_acceleration_);
+    fprintf(pf, "damping %f\n", damping_);
+    fprintf(pf, "random_seed %llu\n", random_seed_);
+    fprintf(pf, "thread_num %d\n", thread_num_);
+    return true;
+}
+
+void PTZSyntheticGeneratorParameter::printSelf() const
+{
+    writeToFile(stdout);
+}
+
+namespace {
+    // SIFT like descriptor, non-negative and unit length
+    void randomDescriptor(DTRng & rng, int dim, float * descriptor)
+    {
+        std::normal_distribution<double> normal(0.0, 1.0);
+        double norm = 0.0;
+        for (int i = 0; i < dim; i++) {
+            descriptor[i] = (float)fabs(normal(rng));
+            norm += descriptor[i] * descriptor[i];
+        }
+        norm = std::max(sqrt(norm), 1e-10);
+        for (int i = 0; i < dim; i++) {
+            descriptor[i] /= norm;
+        }
+    }
+    
+    // reflect x into [min_v, max_v], change the sign of the velocity
+    void reflect(double min_v, double max_v, double & x, double & v)
+    {
+        if (x < min_v) {
+            x = std::min(2 * min_v - x, max_v);
+            v = -v;
+        }
+        else if (x > max_v) {
+            x = std::max(2 * max_v - x, min_v);
+            v = -v;
+        }
+    }
+}
+
+PTZSyntheticGenerator::PTZSyntheticGenerator(const PTZSyntheticGeneratorParameter & param):
+param_(param)
+{
+    assert(param_.landmark_num_ > 0);
+    assert(param_.descriptor_dim_ > 0);
+    if (param_.thread_num_ < 1) {
+        param_.thread_num_ = 1;
+    }
+    pool_ = new DTThreadPool(param_.thread_num_);
+    
+    // random landmarks, uniform in pan and tilt
+    DTRng rng(param_.random_seed_, 0);
+    const int dim = param_.descriptor_dim_;
+    landmarks_.resize(param_.landmark_num_);
+    descriptors_.resize((size_t)param_.landmark_num_ * dim);
+    for (int i = 0; i < param_.landmark_num_; i++) {
+        landmarks_[i][0] = rng.uniform(param_.landmark_pan_min_, param_.landmark_pan_max_);
+        landmarks_[i][1] = rng.uniform(param_.landmark_tilt_min_, param_.landmark_tilt_max_);
+        randomDescriptor(rng, dim, &descriptors_[(size_t)i * dim]);
+        grid_.insert(i, landmarks_[i]);
+    }
+}
+
+PTZSyntheticGenerator::~PTZSyntheticGenerator()
+{
+    delete pool_;
+}
+
+void PTZSyntheticGenerator::generateTrajectory(vector<Eigen::Vector3d> & ptzs) const
+{
+    ptzs.resize(param_.frame_num_);
+    const int length = std::max(1, param_.trajectory_length_);
+    const double log_fl_min = log(param_.focal_length_min_);
+    const double log_fl_max = log(param_.focal_length_max_);
+    
+    for (int start = 0; start < param_.frame_num_; start += length) {
+        // each trajectory has its own random stream, the distribution caches a value so it is not shared
+        DTRng rng(param_.random_seed_ + 1, (uint64_t)(start / length));
+        std::normal_distribution<double> normal(0.0, 1.0);
+        double pan = rng.uniform(param_.pan_min_, param_.pan_max_);
+        double tilt = rng.uniform(param_.tilt_min_, param_.tilt_max_);
+        double log_fl = rng.uniform(log_fl_min, log_fl_max);
+        double v_pan = 0, v_tilt = 0, v_zoom = 0;
+        
+        const int end = std::min(start + length, param_.frame_num_);
+        for (int i = start; i < end; i++) {
+            ptzs[i] = Eigen::Vector3d(pan, tilt, exp(log_fl));
+            
+            v_pan = param_.damping_ * v_pan + param_.pan_acceleration_ * normal(rng);
+            v_tilt = param_.damping_ * v_tilt + param_.tilt_acceleration_ * normal(rng);
+            v_zoom = param_.damping_ * v_zoom + param_.zoom_acceleration_ * normal(rng);
+            pan += v_pan;
+            tilt += v_tilt;
+            log_fl += v_zoom;
+            reflect(param_.pan_min_, param_.pan_max_, pan, v_pan);
+            reflect(param_.tilt_min_, param_.tilt_max_, tilt, v_tilt);
+            reflect(log_fl_min, log_fl_max, log_fl, v_zoom);
+        }
+    }
+}
+
+void PTZSyntheticGenerator::generateFrame(int frame_index,
+                                          const Eigen::Vector3d & ptz,
+                                          vector<float> & keypoints,
+                                          vector<float> & descriptors,
+                                          vector<int> & landmark_ids) const
+{
+    keypoints.clear();
+    descriptors.clear();
+    landmark_ids.clear();
+    
+    DTRng rng(param_.random_seed_ + 2, (uint64_t)frame_index);
+    std::normal_distribution<double> normal(0.0, 1.0);
+    const int dim = param_.descriptor_dim_;
+    const int width = param_.image_width_;
+    const int height = param_.image_height_;
+    const Eigen::Vector2d pp(param_.pp_x_, param_.pp_y_);
+    
+    // step 1: visible landmarks, randomly selected if there are too many
+    vector<int> ids;
+    vector<Eigen::Vector2d> points;
+    grid_.visible(pp, ptz, width, height, ids, points);
+    vector<int> order(ids.size());
+    for (int i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    const int max_inlier_num = (int)round(param_.max_keypoint_num_ * (1.0 - param_.outlier_ratio_));
+    const int inlier_num = std::min((int)ids.size(), max_inlier_num);
+    rng.partialShuffle(order.begin(), order.begin() + inlier_num, order.end());
+    const int outlier_num = (int)round(inlier_num * param_.outlier_ratio_ / (1.0 - param_.outlier_ratio_));
+    
+    const int n = inlier_num + outlier_num;
+    keypoints.resize((size_t)n * 2);
+    descriptors.resize((size_t)n * dim);
+    landmark_ids.resize(n);
+    
+    // step 2: inliers, noisy projection and noisy descriptor
+    for (int i = 0; i < inlier_num; i++) {
+        const int id = ids[order[i]];
+        const Eigen::Vector2d & p = points[order[i]];
+        double x = p.x() + param_.keypoint_noise_ * normal(rng);
+        double y = p.y() + param_.keypoint_noise_ * normal(rng);
+        keypoints[2*i] = (float)std::max(0.0, std::min(width - 1.0, x));
+        keypoints[2*i+1] = (float)std::max(0.0, std::min(height - 1.0, y));
+        
+        const float * landmark_descriptor = landmarkDescriptor(id);
+        float * descriptor = &descriptors[(size_t)i * dim];
+        double norm = 0.0;
+        for (int j = 0; j < dim; j++) {
+            double v = landmark_descriptor[j] + param_.descriptor_noise_ * normal(rng);
+            descriptor[j] = (float)std::max(0.0, v);
+            norm += descriptor[j] * descriptor[j];
+        }
+        norm = std::max(sqrt(norm), 1e-10);
+        for (int j = 0; j < dim; j++) {
+            descriptor[j] /= norm;
+        }
+        landmark_ids[i] = id;
+    }
+    
+    // step 3: outliers, random location and random descriptor
+    for (int i = inlier_num; i < n; i++) {
+        keypoints[2*i] = (float)rng.uniform(0, width - 1);
+        keypoints[2*i+1] = (float)rng.uniform(0, height - 1);
+        randomDescriptor(rng, dim, &descriptors[(size_t)i * dim]);
+        landmark_ids[i] = -1;
+    }
+}
+
+void PTZSyntheticGenerator::generateSamples(const vector<Eigen::Vector3d> & ptzs,
+                                            vector<vector<btdtr_ptz_util::PTZTrainingSample> > & frame_samples) const
+{
+    frame_samples.resize(ptzs.size());
+    const Eigen::Vector2f pp(param_.pp_x_, param_.pp_y_);
+    const int dim = param_.descriptor_dim_;
+    pool_->parallelFor((int)ptzs.size(), [&](int thread_id, int begin, int end) {
+        vector<float> keypoints;
+        vector<float> descriptors;
+        vector<int> landmark_ids;
+        for (int i = begin; i < end; i++) {
+            generateFrame(i, ptzs[i], keypoints, descriptors, landmark_ids);
+            frame_samples[i].clear();
+            const int n = (int)landmark_ids.size();
+            if (n == 0) {
+                continue;
+            }
+            btdtr_ptz_util::generatePTZSample(&keypoints[0], &descriptors[0], n, dim,
+                                              pp, ptzs[i].cast<float>(), frame_samples[i]);
+        }
+    });
+}
+
+long long PTZSyntheticGenerator::writeSequence(const vector<Eigen::Vector3d> & ptzs,
+                                               const char * output_folder,
+                                               const char * feature_label_file) const
+{
+    assert(output_folder);
+    assert(feature_label_file);
+    
+    FILE *pf = fopen(feature_label_file, "w");
+    if (!pf) {
+        printf("can not open %s\n", feature_label_file);
+        return 0;
+    }
+    
+    // generate a batch of frames in parallel, write them in order
+    const int dim = param_.descriptor_dim_;
+    const int batch_size = 16 * pool_->threadNum();
+    const int frame_num = (int)ptzs.size();
+    vector<vector<float> > keypoints(batch_size);
+    vector<vector<float> > descriptors(batch_size);
+    vector<vector<int> > landmark_ids(batch_size);
+    vector<string> names = {"keypoint", "descriptor", "ptz"};
+    long long sample_num = 0;
+    for (int start = 0; start < frame_num; start += batch_size) {
+        const int cur_batch_size = std::min(batch_size, frame_num - start);
+        pool_->parallelFor(cur_batch_size, [&](int thread_id, int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                generateFrame(start + i, ptzs[start + i], keypoints[i], descriptors[i], landmark_ids[i]);
+            }
+        });
+        
+        for (int i = 0; i < cur_batch_size; i++) {
+            const int n = (int)landmark_ids[i].size();
+            vector<Eigen::MatrixXf> data(3);
+            data[0] = Eigen::Map<const Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> >(keypoints[i].data(), n, 2);
+            data[1] = Eigen::Map<const Eigen::Matrix<float, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> >(descriptors[i].data(), n, dim);
+            data[2] = ptzs[start + i].cast<float>();
+            
+            char file_name[1024] = {'\0'};
+            snprintf(file_name, sizeof(file_name), "%s/%08d.mat", output_folder, start + i);
+            if (!matio::writeMultipleMatrix(file_name, names, data)) {
+                fclose(pf);
+                return sample_num;
+            }
+            fprintf(pf, "%s\n", file_name);
+            sample_num += n;
+        }
+    }
+    fclose(pf);
+    printf("write %d frames, %lld samples to %s\n", frame_num, sample_num, output_folder);
+    return sample_num;
+}
@@ -0,0 +1,119 @@
+//
+//  ptz_synthetic_generator.h
+//  ptz_slam_dev
+//
+//  Created by jimmy on 2019-07-31.
+//  Copyright © 2019 Nowhere Planet. All rights reserved.
+//
+
+#ifndef ptz_synthetic_generator_h
+#define ptz_synthetic_generator_h
+
+// synthetic training data of the random forest map, large scale version of generator/ and synthesized_court_sequence/
+// landmarks are random rays (pan, tilt) with a SIFT like descriptor
+// a frame observes landmarks visible from a ptz camera: keypoint = projection + noise, descriptor = landmark descriptor + noise
+// outliers are keypoints at random locations with random descriptors, e.g., players
+// output: .mat files of keypoint, descriptor and ptz, the same as generatePTZSampleWithFeature
+#include <stdio.h>
+#include <vector>
+#include <Eigen/Dense>
+#include "pgl_pan_tilt_grid.h"
+#include "btdtr_ptz_util.h"
+
+using std::vector;
+
+class DTThreadPool;
+
+struct PTZSyntheticGeneratorParameter
+{
+    double pp_x_;                 // principal point
+    double pp_y_;
+    int image_width_;
+    int image_height_;
+    
+    int landmark_num_;
+    double landmark_pan_min_;     // landmark range, degree
+    double landmark_pan_max_;
+    double landmark_tilt_min_;
+    double landmark_tilt_max_;
+    
+    int descriptor_dim_;
+    double descriptor_noise_;     // standard deviation of each dimension, descriptors have unit length
+    double keypoint_noise_;       // standard deviation in pixel
+    double outlier_ratio_;        // fraction of outlier keypoints in a frame
+    int max_keypoint_num_;        // keypoints in a frame, inliers and outliers
+    
+    // random camera trajectory, velocity is damped and changed by random acceleration
+    int frame_num_;
+    int trajectory_length_;       // frames of a trajectory, the camera jumps to a random pose between trajectories
+    double pan_min_;              // camera range
+    double pan_max_;
+    double tilt_min_;
+    double tilt_max_;
+    double focal_length_min_;
+    double focal_length_max_;
+    double pan_acceleration_;     // standard deviation, degree per frame^2
+    double tilt_acceleration_;
+    double zoom_acceleration_;    // standard deviation of log focal length per frame^2
+    double damping_;
+    
+    unsigned long long random_seed_;
+    int thread_num_;
+    
+    // default: 1280 x 720 image, basketball court like camera
+    PTZSyntheticGeneratorParameter();
+    
+    // text file, one "name value" pair per line, missing names keep default values
+    bool readFromFile(FILE *pf);
+    bool readFromFile(const char *file_name);
+    bool writeToFile(FILE *pf) const;
+    void printSelf() const;
+};
+
+// frames are generated independently, the same frame index and ptz always give the same frame
+class PTZSyntheticGenerator
+{
+    PTZSyntheticGeneratorParameter param_;
+    vector<Eigen::Vector2d> landmarks_;     // pan, tilt
+    vector<float> descriptors_;             // landmark_num x descriptor_dim
+    cvx_pgl::pan_tilt_grid grid_;
+    DTThreadPool * pool_;
+
+public:
+    explicit PTZSyntheticGenerator(const PTZSyntheticGeneratorParameter & param);
+    ~PTZSyntheticGenerator();
+    
+    // random trajectories of param.frame_num_ frames
+    void generateTrajectory(vector<Eigen::Vector3d> & ptzs) const;
+    
+    // one frame, thread safe
+    // keypoints: n x 2, descriptors: n x descriptor_dim, row major
+    // landmark_ids: landmark of each keypoint, -1 for outliers
+    void generateFrame(int frame_index,
+                       const Eigen::Vector3d & ptz,
+                       vector<float> & keypoints,
+                       vector<float> & descriptors,
+                       vector<int> & landmark_ids) const;
+    
+    // training examples of each frame in memory, input of RFMapBuilder::buildModel
+    // frames are generated in parallel
+    void generateSamples(const vector<Eigen::Vector3d> & ptzs,
+                         vector<vector<btdtr_ptz_util::PTZTrainingSample> > & frame_samples) const;
+    
+    // write one .mat file per frame to output_folder, and the list of files to feature_label_file
+    // feature_label_file: input of RFMap::createMap
+    // return: number of samples
+    long long writeSequence(const vector<Eigen::Vector3d> & ptzs,
+                            const char * output_folder,
+                            const char * feature_label_file) const;
+    
+    int landmarkNum() const { return (int)landmarks_.size(); }
+    const Eigen::Vector2d & landmark(int id) const { return landmarks_[id]; }
+    const float * landmarkDescriptor(int id) const { return &descriptors_[(size_t)id * param_.descriptor_dim_]; }
+
+private:
+    PTZSyntheticGenerator(const PTZSyntheticGenerator & other);
+    PTZSyntheticGenerator & operator = (const PTZSyntheticGenerator & other);
+};
+
+#endif /* ptz_synthetic_generator_h */